@@ -32,6 +32,8 @@ template <typename ElemType>
 void DoCrossValidate(const ConfigParameters& config);
 template <typename ElemType>
 void DoWriteOutput(const ConfigParameters& config);
+template <typename ElemType>
+void DoQuantize(const ConfigParameters& config);
 
 // misc (OtherActions.cp)
 template <typename ElemType>
@@ -39,6 +41,8 @@ void DoCreateLabelMap(const ConfigParameters& config);
 template <typename ElemType>
 void DoParameterSVD(const ConfigParameters& config);
 template <typename ElemType>
+void DoSaveMappedModel(const ConfigParameters& config);
+template <typename ElemType>
 void DoWriteWordAndClassInfo(const ConfigParameters& config);
 template <typename ElemType>
 void DoTopologyPlot(const ConfigParameters& config);
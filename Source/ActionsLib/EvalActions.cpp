@@ -38,6 +38,22 @@ using namespace std;
 using namespace Microsoft::MSR;
 using namespace Microsoft::MSR::CNTK;
 
+// ===========================================================================
+// OptimizeNetworkIfRequested() - optional graph optimization for evaluation
+// ===========================================================================
+
+// Parameters are not updated by the commands below, so all of them can be treated as constants.
+// 'requestedNodeNames' are the nodes the command will evaluate in addition to the network's node groups; they must survive.
+static void OptimizeNetworkIfRequested(const ConfigParameters& config, ComputationNetworkPtr net, const vector<wstring>& requestedNodeNames)
+{
+    bool optimizeNetwork = config(L"optimizeNetwork", "false");
+    if (!optimizeNetwork)
+        return;
+    wstring dumpPath = config(L"optimizedNetworkDumpPath", L"");
+    net->EnableGraphOptimization(true /*freezeParameters*/, requestedNodeNames, dumpPath);
+    net->CompileNetwork();
+}
+
 // ===========================================================================
 // DoEvalBase() - implements CNTK "eval" command
 // ===========================================================================
@@ -66,6 +82,7 @@ static void DoEvalBase(const ConfigParameters& config, IDataReader<ElemType>& re
     }
 
     auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath);
+    OptimizeNetworkIfRequested(config, net, evalNodeNamesVector);
 
     SimpleEvaluator<ElemType> eval(net, numMBsToShowResult, traceLevel);
     eval.Evaluate(&reader, evalNodeNamesVector, mbSize[0], epochSize);
@@ -86,6 +103,76 @@ void DoEval(const ConfigParameters& config)
 template void DoEval<double>(const ConfigParameters& config);
 template void DoEval<float>(const ConfigParameters& config);
 
+// ===========================================================================
+// DoQuantize() - implements CNTK "quantize" command
+// ===========================================================================
+
+// Post-training int8 quantization of the Times and Convolution weight products for CPU inference.
+// The float network is evaluated over the sample set given by 'reader' while recording the input ranges of these nodes.
+// The quantized network is then evaluated on the same data, and both results are reported for comparison.
+// The ranges are written to 'quantizationRangesPath'; pass that file as 'quantizationRanges' to the evaluation library to serve the quantized model.
+template <typename ElemType>
+void DoQuantize(const ConfigParameters& config)
+{
+    ConfigParameters readerConfig(config(L"reader"));
+    readerConfig.Insert("traceLevel", config(L"traceLevel", "0"));
+    DataReader<ElemType> reader(readerConfig);
+
+    DEVICEID_TYPE deviceId = DeviceFromConfig(config);
+    if (deviceId != CPUDEVICE)
+        InvalidArgument("quantize: The int8 kernels are only available on the CPU, please use deviceId=-1.");
+    ConfigArray minibatchSize = config(L"minibatchSize", "40960");
+    intargvector mbSize = minibatchSize;
+    size_t epochSize = config(L"epochSize", "0");
+    if (epochSize == 0)
+        epochSize = requestDataSize;
+    wstring modelPath = config(L"modelPath");
+    wstring rangesPath = config(L"quantizationRangesPath", L"");
+    if (rangesPath.empty())
+        rangesPath = modelPath + L".ranges";
+
+    int traceLevel = config(L"traceLevel", "0");
+    size_t numMBsToShowResult = config(L"numMBsToShowResult", "100");
+
+    ConfigArray evalNodeNames = config(L"evalNodeNames", "");
+    vector<wstring> evalNodeNamesVector;
+    for (int i = 0; i < evalNodeNames.size(); ++i)
+        evalNodeNamesVector.push_back(evalNodeNames[i]);
+
+    auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath);
+    SimpleEvaluator<ElemType> eval(net, numMBsToShowResult, traceLevel);
+
+    fprintf(stderr, "\nquantize: Evaluating the float network and calibrating input ranges.\n");
+    net->SetQuantizationCalibration(true);
+    auto startTime = chrono::steady_clock::now();
+    vector<double> floatResults = eval.Evaluate(&reader, evalNodeNamesVector, mbSize[0], epochSize);
+    double floatSeconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    net->SetQuantizationCalibration(false);
+
+    if (net->QuantizeForInference() == 0)
+        RuntimeError("quantize: The network has no weight products that can be quantized.");
+    net->SaveQuantizationRanges(rangesPath);
+    fprintf(stderr, "quantize: Input ranges written to %ls.\n", rangesPath.c_str());
+
+    fprintf(stderr, "\nquantize: Evaluating the quantized network.\n");
+    startTime = chrono::steady_clock::now();
+    vector<double> quantizedResults = eval.Evaluate(&reader, evalNodeNamesVector, mbSize[0], epochSize);
+    double quantizedSeconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+
+    // the calibration data doubles as the accuracy check; use a held-out 'reader' for an unbiased comparison
+    fprintf(stderr, "\nquantize: Accuracy report (float vs. int8):\n");
+    for (size_t i = 0; i < floatResults.size(); i++)
+    {
+        wstring name = i < evalNodeNamesVector.size() ? evalNodeNamesVector[i] : msra::strfun::wstrprintf(L"criterion %d", (int) i);
+        fprintf(stderr, "quantize: %ls: float = %.8g, int8 = %.8g, difference = %+.8g\n",
+                name.c_str(), floatResults[i], quantizedResults[i], quantizedResults[i] - floatResults[i]);
+    }
+    fprintf(stderr, "quantize: Evaluation time: float = %.3f s, int8 = %.3f s (includes reading the data)\n", floatSeconds, quantizedSeconds);
+}
+
+template void DoQuantize<double>(const ConfigParameters& config);
+template void DoQuantize<float>(const ConfigParameters& config);
+
 // ===========================================================================
 // DoCrossValidate() - implements CNTK "cv" command
 // ===========================================================================
@@ -227,6 +314,7 @@ void DoWriteOutput(const ConfigParameters& config)
     }
 
     auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath);
+    OptimizeNetworkIfRequested(config, net, outputNodeNamesVector);
 
     SimpleOutputWriter<ElemType> writer(net, 1);
 
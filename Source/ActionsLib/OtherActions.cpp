@@ -208,6 +208,28 @@ void DoParameterSVD(const ConfigParameters& config)
 template void DoParameterSVD<float>(const ConfigParameters& config);
 template void DoParameterSVD<double>(const ConfigParameters& config);
 
+// ===========================================================================
+// DoSaveMappedModel() - implements CNTK "saveMapped" command
+// ===========================================================================
+
+// convert a model to the mapped model format (see ComputationNetwork::SaveMapped()), which loads without parsing or copying the parameters
+template <typename ElemType>
+void DoSaveMappedModel(const ConfigParameters& config)
+{
+    wstring modelPath = config(L"modelPath");
+    wstring outputModelPath = config(L"outputModelPath", L"");
+    if (outputModelPath.empty())
+        outputModelPath = modelPath + L".mapped";
+
+    ComputationNetwork net(CPUDEVICE);
+    net.Load<ElemType>(modelPath);
+    net.SaveMapped<ElemType>(outputModelPath);
+    fprintf(stderr, "Mapped model written to %ls.\n", outputModelPath.c_str());
+}
+
+template void DoSaveMappedModel<float>(const ConfigParameters& config);
+template void DoSaveMappedModel<double>(const ConfigParameters& config);
+
 // ===========================================================================
 // DoWriteWordAndClassInfo() - implements CNTK "writeWordAndClass" command
 // ===========================================================================
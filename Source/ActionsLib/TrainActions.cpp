@@ -93,6 +93,16 @@ shared_ptr<C> CreateObject(const ConfigParameters& config, const wchar_t* id)
     return make_shared<C>(readerConfig);                           // old CNTK config specifies a dictionary which then must be explicitly instantiated
 }
 
+// the configuration of an object as text, to identify e.g. the data a reader reads (the key of SGD's precompute cache)
+static wstring GetConfigText(const ScriptableObjects::IConfigRecord&, const wchar_t*)
+{
+    return wstring(); // BrainScript records have no textual form
+}
+static wstring GetConfigText(const ConfigParameters& config, const wchar_t* id)
+{
+    return msra::strfun::utf16(config(id));
+}
+
 template <class ConfigRecordType, typename ElemType>
 void DoTrain(const ConfigRecordType& config)
 {
@@ -155,6 +165,23 @@ void DoTrain(const ConfigRecordType& config)
         RuntimeError("No network builder found in the config file. NDLNetworkBuilder or SimpleNetworkBuilde must be specified");
     }
 
+    // optionally move loop-invariant computation out of recurrent loops when the network is compiled
+    // This changes the graph that is saved, so it must be asked for.
+    bool hoistLoopInvariants = config(L"hoistLoopInvariants", false);
+    if (hoistLoopInvariants)
+    {
+        int traceLevel = config(L"traceLevel", (int) 0);
+        auto createOriginalNetworkFn = createNetworkFn;
+        createNetworkFn = [createOriginalNetworkFn, traceLevel](DEVICEID_TYPE deviceId)
+        {
+            auto net = createOriginalNetworkFn(deviceId);
+            net->SetTraceLevel(traceLevel);
+            net->EnableLoopInvariantHoisting(true);
+            net->CompileNetwork();
+            return net;
+        };
+    }
+
     auto dataReader = CreateObject<DataReader<ElemType>>(config, L"reader");
 
     shared_ptr<DataReader<ElemType>> cvDataReader;
@@ -172,6 +199,7 @@ void DoTrain(const ConfigRecordType& config)
         optimizer = make_shared<SGD<ElemType>>(configSGD);
     }
 
+    optimizer->SetPreComputeCacheKey(GetConfigText(config, L"reader"));
     optimizer->Train(createNetworkFn, deviceId, dataReader.get(), cvDataReader.get(), makeMode);
 }
 
@@ -242,6 +270,7 @@ void DoAdapt(const ConfigParameters& config)
     wstring refNodeName = config(L"refNodeName", L"");
 
     SGD<ElemType> sgd(configSGD);
+    sgd.SetPreComputeCacheKey(GetConfigText(config, L"reader"));
 
     sgd.Adapt(origModelFileName, refNodeName, dataReader, cvDataReader, deviceId, makeMode);
 
@@ -72,9 +72,7 @@ wstring computationNodes = // TODO: use actual TypeName() here? would first need
 #define BinaryStandardNode(Op, a, b) L## #Op L"(" L## #a L", " L## #b L", tag='') = new ComputationNode [ operation = '" L## #Op L"' ; inputs = (" L## #a L" : " L## #b L") /*plus the function args*/ ]\n"
 #define TernaryStandardNode(Op, a, b, c) L## #Op L"(" L## #a L", " L## #b L", " L## #c L", tag='') = new ComputationNode [ operation = '" L## #Op L"' ; inputs = (" L## #a L" : " L## #b L" : " L## #c L") /*plus the function args*/ ]\n"
 #define QuaternaryStandardNode(Op, a, b, c, d) L## #Op L"(" L## #a L", " L## #b L", " L## #c L", " L## #d L", tag='') = new ComputationNode [ operation = '" L## #Op L"' ; inputs = (" L## #a L" : " L## #b L" : " L## #c L" : " L## #d L") /*plus the function args*/ ]\n"
-#ifdef COMING_SOON
     TernaryStandardNode(CRF, labelVectorSequence, positionDependenScoreVectorSequence, transitionScores) // TODO: better names
-#endif
     QuaternaryStandardNode(ClassBasedCrossEntropyWithSoftmax, labelClassDescriptorVectorSequence, mainInputInfo, mainWeight, classLogProbsBeforeSoftmax)
     // BUGBUG: the commented-out ones are not mentioned in the CNTK book, nor are their parameters documented in the source code
     BinaryStandardNode(ColumnElementTimes, aVectorSequence, anotherVectorSequence)
@@ -93,7 +91,7 @@ wstring computationNodes = // TODO: use actual TypeName() here? would first need
     QuaternaryStandardNode(GMMLogLikelihood, unnormalizedPriorVector, meansAsRows, logStdDevAsRows, dataVectorSequence)
     UnaryStandardNode(InvStdDev, dataVectorSequence)
     BinaryStandardNode(KhatriRaoProduct, leftMatrix, rightMatrix)
-    //BinaryStandardNode(LSTMNode)
+    QuaternaryStandardNode(LSTMCell, weights, bias, inputVectorSequence, prevStateVectorSequence)
     UnaryStandardNode(Log, x)
     UnaryStandardNode(LogSoftmax, z)
     //BinaryStandardNode(LookupTableNode)
@@ -159,6 +159,9 @@ void DoCommands(const ConfigParameters& config)
         std::cerr << "Using " << numCPUThreads << " CPU threads" << endl;
     }
 
+    // run independent nodes of CPU networks concurrently (0: off)
+    ComputationNetwork::SetConcurrentNodeExecution(config(L"concurrentNodeWorkers", (size_t) 0), config(L"numCPUThreadsPerNodeWorker", (int) 0));
+
     bool progressTracing = config(L"progressTracing", false);
 
     // temporary hack to prevent users from failling for a small breaking change related to the "truncated" flag (will be redone bigger and better some day)
@@ -237,6 +240,10 @@ void DoCommands(const ConfigParameters& config)
             {
                 DoWriteOutput<ElemType>(commandParams);
             }
+            else if (action[j] == "quantize")
+            {
+                DoQuantize<ElemType>(commandParams);
+            }
             else if (action[j] == "devtest")
             {
                 TestCn<ElemType>(config); // for "devtest" action pass the root config instead
@@ -261,6 +268,10 @@ void DoCommands(const ConfigParameters& config)
             {
                 DoTopologyPlot<ElemType>(commandParams);
             }
+            else if (action[j] == "saveMapped")
+            {
+                DoSaveMappedModel<ElemType>(commandParams);
+            }
             else if (action[j] == "SVD")
             {
                 DoParameterSVD<ElemType>(commandParams);
@@ -456,6 +467,7 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
     numCPUThreads = CPUMatrix<float /*any will do*/>::SetNumThreads(numCPUThreads);
     if (numCPUThreads > 0)
         fprintf(stderr, "Using %d CPU threads.\n", numCPUThreads);
+    ComputationNetwork::SetConcurrentNodeExecution(config(L"concurrentNodeWorkers", (size_t) 0), config(L"numCPUThreadsPerNodeWorker", (int) 0));
 
     bool progressTracing = config(L"progressTracing", false);
     size_t fullTotalMaxEpochs = 1; // BUGBUG: BS does not allow me to read out the max epochs parameters, as that would instantiate and thus execute the objects
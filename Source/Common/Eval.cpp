@@ -136,6 +136,27 @@ void Eval<ElemType>::ResetState()
     m_eval->ResetState();
 }
 
+// OpenSession - open a streaming session, an independent stream of frames with its own recurrent state
+template <class ElemType>
+size_t Eval<ElemType>::OpenSession()
+{
+    return m_eval->OpenSession();
+}
+
+// CloseSession - close a session and free its state
+template <class ElemType>
+void Eval<ElemType>::CloseSession(size_t sessionId)
+{
+    m_eval->CloseSession(sessionId);
+}
+
+// EvaluateSessions - Evaluate the next chunk of frames of each of the given sessions, as parallel sequences of one minibatch
+template <class ElemType>
+void Eval<ElemType>::EvaluateSessions(const std::vector<size_t>& sessionIds, std::vector<std::map<std::wstring, std::vector<ElemType>*>>& inputs, std::vector<std::map<std::wstring, std::vector<ElemType>*>>& outputs)
+{
+    m_eval->EvaluateSessions(sessionIds, inputs, outputs);
+}
+
 //The explicit instantiation
 template class Eval<double>;
 template class Eval<float>;
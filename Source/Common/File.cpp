@@ -17,6 +17,7 @@
 #ifdef _WIN32
 #define NOMINMAX
 #include "Windows.h"
+#include <io.h>
 #endif
 #ifdef __unix__
 #include <unistd.h>
@@ -146,6 +147,8 @@ bool File::IsTextBased()
 // Note: this does not check for errors. Use Flush() before closing a file you are writing.
 File::~File(void)
 {
+    if (m_file == nullptr) // (already closed)
+        return;
     if (m_pcloseNeeded)
         _pclose(m_file);
     else if (m_file != stdin && m_file != stdout && m_file != stderr)
@@ -157,6 +160,34 @@ void File::Flush()
     fflushOrDie(m_file);
 }
 
+// Sync - flush, and have the OS write the file contents to the disk
+// Used where a file must be complete on disk before it is renamed into place, e.g. for checkpoints.
+void File::Sync()
+{
+    fflushOrDie(m_file);
+#ifdef _WIN32
+    int rc = _commit(_fileno(m_file));
+#else
+    int rc = fsync(fileno(m_file));
+#endif
+    if (rc != 0)
+        RuntimeError("error syncing file to disk: %s", strerror(errno));
+}
+
+// Close - close the file before the File object goes away, e.g. to rename it
+// Unlike the destructor, this reports errors. The File object cannot be used afterwards.
+void File::Close()
+{
+    FILE* file = m_file;
+    m_file = nullptr;
+    if (file == nullptr)
+        return;
+    if (m_pcloseNeeded)
+        _pclose(file);
+    else if (file != stdin && file != stdout && file != stderr && fclose(file) != 0)
+        RuntimeError("error closing file: %s", strerror(errno));
+}
+
 // GetLine - get a line from the file
 // str - string to store the line
 void File::GetLine(wstring& str)
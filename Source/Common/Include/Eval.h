@@ -49,6 +49,10 @@ public:
     virtual void StartEvaluateMinibatchLoop(const std::wstring& outputNodeName) = 0;
     virtual void Evaluate(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs) = 0;
     virtual void ResetState() = 0;
+
+    virtual size_t OpenSession() = 0;
+    virtual void CloseSession(size_t sessionId) = 0;
+    virtual void EvaluateSessions(const std::vector<size_t>& sessionIds, std::vector<std::map<std::wstring, std::vector<ElemType>*>>& inputs, std::vector<std::map<std::wstring, std::vector<ElemType>*>>& outputs) = 0;
 };
 
 // GetEval - get a evaluator type from the DLL
@@ -80,6 +84,7 @@ public:
     // deviceId=auto ( can be [0,all,cpu,0:2:3,auto] define accellerators (GPUs) to use, or the CPU
     // modelPath=c:\models\model.dnn (model path, if not specified, must call LoadModel() method before Evaluate()
     // minibatchSize=1024 (minibatch size used during evaluation if < passed data size)
+    // concurrentEvaluation=false (if true, Evaluate() may be called from several threads at once; each call is then a sequence of its own, and ResetState() has no effect)
     Eval(const std::string& config);
     virtual ~Eval();
 
@@ -102,5 +107,18 @@ public:
     virtual void Evaluate(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs);
     virtual void Init(const std::string& config);
     virtual void ResetState();
+
+    // OpenSession - open a streaming session, an independent stream of frames with its own recurrent state
+    // returns - id of the session, to be passed to EvaluateSessions() and CloseSession()
+    virtual size_t OpenSession();
+
+    // CloseSession - close a session and free its state
+    virtual void CloseSession(size_t sessionId);
+
+    // EvaluateSessions - Evaluate the next chunk of frames of each of the given sessions, as parallel sequences of one minibatch
+    // sessionIds - the sessions to continue, each at most once
+    // inputs - per session, map from node name to the input frames of the chunk (the chunks may have different numbers of frames)
+    // outputs - per session, map from node name to output vector; all sessions must request the same nodes, sizing will happen during evaluation
+    virtual void EvaluateSessions(const std::vector<size_t>& sessionIds, std::vector<std::map<std::wstring, std::vector<ElemType>*>>& inputs, std::vector<std::map<std::wstring, std::vector<ElemType>*>>& outputs);
 };
 } } }
@@ -0,0 +1,247 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalBatchingServer.h -- in-process inference server that coalesces requests into minibatches for an IEvaluateModel
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "Eval.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// when the queued requests are evaluated
+struct EvalBatchingPolicy
+{
+    size_t maxRequests;  // most requests per minibatch
+    size_t maxFrames;    // most frames per minibatch (a single request with more is evaluated on its own)
+    double maxLatencyMs; // longest time the oldest queued request waits for others to be coalesced with it
+
+    EvalBatchingPolicy()
+        : maxRequests(64), maxFrames(10240), maxLatencyMs(5)
+    {
+    }
+};
+
+// counts since the server was started
+struct EvalBatchingStatistics
+{
+    size_t numRequests;
+    size_t numFrames;
+    size_t numMinibatches;
+
+    EvalBatchingStatistics()
+        : numRequests(0), numFrames(0), numMinibatches(0)
+    {
+    }
+};
+
+// -----------------------------------------------------------------------
+// EvalBatchingServer -- queues requests from any number of threads and evaluates them in minibatches
+//
+// Submit() queues a request (the input frames of one sequence) and returns a future for its outputs.
+// A worker thread waits until the queue holds maxRequests requests or maxFrames frames, or until the oldest
+// request has waited maxLatencyMs, and then evaluates the oldest requests as the parallel sequences of one
+// minibatch, through a streaming session each (IEvaluateModel::EvaluateSessions()). So requests are
+// independent also for recurrent models. The worker is the only user of the model while the server runs.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class EvalBatchingServer
+{
+public:
+    typedef std::map<std::wstring, std::vector<ElemType>> Values; // node name -> frames
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Request
+    {
+        Values inputs;
+        size_t numFrames;
+        Clock::time_point arrivalTime;
+        std::promise<Values> result;
+    };
+
+    IEvaluateModel<ElemType>* m_model;
+    std::vector<std::wstring> m_outputNodeNames;
+    std::map<std::wstring, size_t> m_inputDimensions;
+    EvalBatchingPolicy m_policy;
+
+    std::mutex m_mutex; // guards all below
+    std::condition_variable m_wakeUp;
+    std::deque<Request> m_queue;
+    size_t m_queuedFrames;
+    bool m_stopping;
+    EvalBatchingStatistics m_statistics;
+
+    std::thread m_worker;
+
+    // no copying
+    EvalBatchingServer(const EvalBatchingServer&);
+    void operator=(const EvalBatchingServer&);
+
+    bool IsMinibatchFull() const
+    {
+        return m_queue.size() >= m_policy.maxRequests || m_queuedFrames >= m_policy.maxFrames;
+    }
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_wakeUp.wait(lock, [this]
+                          {
+                              return m_stopping || !m_queue.empty();
+                          });
+            if (m_queue.empty()) // (stopping)
+                return;
+
+            // give later requests until the deadline of the oldest to join it
+            const auto deadline = m_queue.front().arrivalTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(m_policy.maxLatencyMs));
+            m_wakeUp.wait_until(lock, deadline, [this]
+                                {
+                                    return m_stopping || IsMinibatchFull();
+                                });
+
+            // take the oldest requests that fit (at least one)
+            std::vector<Request> minibatch;
+            size_t numFrames = 0;
+            while (!m_queue.empty() && minibatch.size() < m_policy.maxRequests &&
+                   (minibatch.empty() || numFrames + m_queue.front().numFrames <= m_policy.maxFrames))
+            {
+                numFrames += m_queue.front().numFrames;
+                m_queuedFrames -= m_queue.front().numFrames;
+                minibatch.push_back(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+            m_statistics.numRequests += minibatch.size();
+            m_statistics.numFrames += numFrames;
+            m_statistics.numMinibatches++;
+
+            lock.unlock();
+            Evaluate(minibatch);
+            lock.lock();
+        }
+    }
+
+    // evaluate a minibatch and fulfill its requests
+    void Evaluate(std::vector<Request>& minibatch)
+    {
+        const size_t numRequests = minibatch.size();
+        std::vector<size_t> sessionIds;
+        std::vector<Values> outputs(numRequests);
+        try
+        {
+            std::vector<std::map<std::wstring, std::vector<ElemType>*>> inputPointers(numRequests), outputPointers(numRequests);
+            for (size_t i = 0; i < numRequests; i++)
+            {
+                sessionIds.push_back(m_model->OpenSession());
+                for (auto& iter : minibatch[i].inputs)
+                    inputPointers[i][iter.first] = &iter.second;
+                for (const auto& name : m_outputNodeNames)
+                    outputPointers[i][name] = &outputs[i][name];
+            }
+            m_model->EvaluateSessions(sessionIds, inputPointers, outputPointers);
+        }
+        catch (...)
+        {
+            for (auto sessionId : sessionIds)
+                m_model->CloseSession(sessionId);
+            for (auto& request : minibatch)
+                request.result.set_exception(std::current_exception());
+            return;
+        }
+        for (auto sessionId : sessionIds)
+            m_model->CloseSession(sessionId);
+        for (size_t i = 0; i < numRequests; i++)
+            minibatch[i].result.set_value(std::move(outputs[i]));
+    }
+
+public:
+    // 'model' must have its model loaded, and must not be used by others until Stop()
+    EvalBatchingServer(IEvaluateModel<ElemType>* model, const std::vector<std::wstring>& outputNodeNames, const EvalBatchingPolicy& policy)
+        : m_model(model), m_outputNodeNames(outputNodeNames), m_policy(policy), m_queuedFrames(0), m_stopping(false)
+    {
+        if (m_outputNodeNames.empty())
+            InvalidArgument("EvalBatchingServer: No outputs requested.");
+        if (m_policy.maxRequests == 0 || m_policy.maxFrames == 0)
+            InvalidArgument("EvalBatchingServer: maxRequests and maxFrames must be at least 1.");
+        m_model->GetNodeDimensions(m_inputDimensions, nodeInput);
+        m_worker = std::thread([this]
+                               {
+                                   Run();
+                               });
+    }
+
+    ~EvalBatchingServer()
+    {
+        Stop();
+    }
+
+    // queue a request
+    // 'inputs' holds the frames of each input node, the same number for all. A request that violates this is rejected
+    // (InvalidArgument) without affecting the queued ones.
+    std::future<Values> Submit(Values&& inputs)
+    {
+        Request request;
+        request.numFrames = 0;
+        for (const auto& iter : m_inputDimensions)
+        {
+            auto input = inputs.find(iter.first);
+            if (input == inputs.end())
+                InvalidArgument("EvalBatchingServer: No data for input %ls.", iter.first.c_str());
+            if (iter.second == 0 || input->second.size() % iter.second != 0 || input->second.empty())
+                InvalidArgument("EvalBatchingServer: The data for input %ls is not a whole, non-zero number of frames.", iter.first.c_str());
+            const size_t numFrames = input->second.size() / iter.second;
+            if (request.numFrames != 0 && numFrames != request.numFrames)
+                InvalidArgument("EvalBatchingServer: Input %ls has %d frames, other inputs have %d.", iter.first.c_str(), (int) numFrames, (int) request.numFrames);
+            request.numFrames = numFrames;
+        }
+        request.inputs = std::move(inputs);
+        std::future<Values> result = request.result.get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping)
+                LogicError("EvalBatchingServer: Submit() called after Stop().");
+            request.arrivalTime = Clock::now();
+            m_queuedFrames += request.numFrames;
+            m_queue.push_back(std::move(request));
+        }
+        m_wakeUp.notify_one();
+        return result;
+    }
+
+    // evaluate the queued requests without waiting for further ones, and end the worker
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wakeUp.notify_one();
+        if (m_worker.joinable())
+            m_worker.join();
+    }
+
+    EvalBatchingStatistics GetStatistics()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_statistics;
+    }
+};
+} } }
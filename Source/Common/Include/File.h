@@ -109,6 +109,8 @@ public:
     ~File(void);
 
     void Flush();
+    void Sync();
+    void Close();
 
     bool CanSeek() const
     {
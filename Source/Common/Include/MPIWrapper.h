@@ -10,6 +10,7 @@
 #include <string>
 #include <array>
 #include <vector>
+#include <algorithm>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -49,6 +50,14 @@ static int operator||(int rc, const MpiFail &what)
     RuntimeError("%s", what.c_str());
 }
 
+// algorithm used by MPIWrapper::AllReduce() for raw buffers
+enum class MPIAllReduceAlgorithm : int
+{
+    Native,      // MPI_Allreduce() of the MPI implementation
+    Ring,        // ring all-reduce over all ranks, pipelined in chunks
+    Hierarchical // reduce within each host, ring all-reduce across hosts, broadcast within each host
+};
+
 class MPIWrapper
 {
     int m_myRank;
@@ -58,6 +67,13 @@ class MPIWrapper
     // MPI communicator that reflects the current subset selection
     MPI_Comm m_currentComm;
 
+    // all-reduce algorithm (SetAllReduceAlgorithm())
+    MPIAllReduceAlgorithm m_allReduceAlgorithm;
+    size_t m_allReduceChunkBytes;
+    MPI_Comm m_ringComm;       // all ranks; separate from m_currentComm so that ring messages cannot match other point-to-point traffic
+    MPI_Comm m_hostComm;       // the ranks on this host (shared memory)
+    MPI_Comm m_hostLeaderComm; // the first rank of each host; MPI_COMM_NULL on the other ranks
+
     // MPI_Init() with delay-loading the msmpi.dll (possibly causing a failure if missing; we want to catch that)
     int MPI_Init_DL()
     {
@@ -100,7 +116,7 @@ class MPIWrapper
 
 public:
     MPIWrapper()
-        : m_currentComm(MPI_COMM_WORLD)
+        : m_currentComm(MPI_COMM_WORLD), m_allReduceAlgorithm(MPIAllReduceAlgorithm::Native), m_allReduceChunkBytes(1 << 20), m_ringComm(MPI_COMM_NULL), m_hostComm(MPI_COMM_NULL), m_hostLeaderComm(MPI_COMM_NULL)
     {
         static bool initialized = false;
         if (initialized)
@@ -150,6 +166,12 @@ public:
     {
         fprintf(stderr, "~MPIWrapper\n");
         fflush(stderr);
+        // free the communicators of SetAllReduceAlgorithm() (since destructors may not throw, we ignore the return codes here)
+        for (MPI_Comm *comm : {&m_hostLeaderComm, &m_hostComm, &m_ringComm})
+        {
+            if (*comm != MPI_COMM_NULL)
+                MPI_Comm_free(comm);
+        }
         MPI_Finalize();
     }
 
@@ -286,15 +308,149 @@ public:
     }
 
     // for raw pointer
+    // This uses the algorithm selected with SetAllReduceAlgorithm(). Buffers smaller than one chunk always use MPI_Allreduce(),
+    // since for them the latency of the 2 (n-1) steps of the ring would dominate.
     template <class ElemType>
     void AllReduce(ElemType *pData, size_t nData)
     {
         if ((NumNodesInUse() > 1 && (Communicator() != MPI_COMM_NULL)))
         {
-            MPI_Allreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, Communicator()) || MpiFail("Allreduce: MPI_Allreduce");
+            const bool large = nData * sizeof(ElemType) >= m_allReduceChunkBytes && UsingAllNodes(); // (RequestNodes() may have been called since)
+            if (m_allReduceAlgorithm == MPIAllReduceAlgorithm::Ring && large)
+                RingAllReduce(pData, nData, m_ringComm);
+            else if (m_allReduceAlgorithm == MPIAllReduceAlgorithm::Hierarchical && large)
+                HierarchicalAllReduce(pData, nData);
+            else
+                MPI_Allreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, Communicator()) || MpiFail("Allreduce: MPI_Allreduce");
         }
     }
 
+    // select the algorithm of AllReduce() for raw buffers, and the chunk size in which the ring algorithms transfer data
+    // This must be called by all ranks, since it creates communicators. The CNTK algorithms need all nodes to be in use.
+    void SetAllReduceAlgorithm(MPIAllReduceAlgorithm algorithm, size_t chunkBytes)
+    {
+        if (chunkBytes == 0)
+            InvalidArgument("SetAllReduceAlgorithm: The chunk size must not be 0.");
+        if (algorithm != MPIAllReduceAlgorithm::Native && !UsingAllNodes())
+        {
+            fprintf(stderr, "SetAllReduceAlgorithm: not all MPI nodes are in use, using MPI_Allreduce\n");
+            algorithm = MPIAllReduceAlgorithm::Native;
+        }
+        if (algorithm != MPIAllReduceAlgorithm::Native && m_ringComm == MPI_COMM_NULL)
+        {
+            MPI_Comm_dup(MPI_COMM_WORLD, &m_ringComm) || MpiFail("SetAllReduceAlgorithm: MPI_Comm_dup");
+            MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, m_myRank, MPI_INFO_NULL, &m_hostComm) || MpiFail("SetAllReduceAlgorithm: MPI_Comm_split_type");
+            int hostRank;
+            MPI_Comm_rank(m_hostComm, &hostRank) || MpiFail("SetAllReduceAlgorithm: MPI_Comm_rank");
+            MPI_Comm_split(MPI_COMM_WORLD, hostRank == 0 ? 0 : MPI_UNDEFINED, m_myRank, &m_hostLeaderComm) || MpiFail("SetAllReduceAlgorithm: MPI_Comm_split");
+            int numHosts = hostRank == 0 ? 1 : 0;
+            MPI_Allreduce(MPI_IN_PLACE, &numHosts, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD) || MpiFail("SetAllReduceAlgorithm: MPI_Allreduce");
+            fprintf(stderr, "SetAllReduceAlgorithm: %d MPI nodes on %d hosts\n", m_numMPINodes, numHosts);
+        }
+        m_allReduceAlgorithm = algorithm;
+        m_allReduceChunkBytes = chunkBytes;
+    }
+    MPIAllReduceAlgorithm GetAllReduceAlgorithm() const
+    {
+        return m_allReduceAlgorithm;
+    }
+
+    // ring all-reduce (sum) of pData[0..nData) over the ranks of 'comm'
+    // The data are cut into one segment per rank. In n-1 reduce-scatter steps, each rank sends a segment to its right
+    // neighbor and adds the segment it receives from its left neighbor into its data, after which each rank holds the sum
+    // of one segment. In n-1 all-gather steps, the summed segments travel once around the ring. Each rank sends and
+    // receives 2 (n-1)/n times the data, independent of the number of ranks.
+    // The segment sent in a step is the one received in the step before. Segments are transferred in chunks, and a chunk
+    // is passed on as soon as it has arrived (and been added), so that large buffers stream through the ring.
+    template <class ElemType>
+    void RingAllReduce(ElemType *pData, size_t nData, MPI_Comm comm) const
+    {
+        int rank, n;
+        MPI_Comm_rank(comm, &rank) || MpiFail("RingAllReduce: MPI_Comm_rank");
+        MPI_Comm_size(comm, &n) || MpiFail("RingAllReduce: MPI_Comm_size");
+        if (n <= 1 || nData == 0)
+            return;
+        const int left = (rank + n - 1) % n;
+        const int right = (rank + 1) % n;
+        const size_t numSteps = 2 * (size_t)(n - 1);
+        const size_t maxSegmentSize = (nData + n - 1) / n;
+        const size_t maxChunksPerSegment = 1024; // (chunk indices are used as message tags)
+        const size_t chunkSize = (std::max)((std::max)(m_allReduceChunkBytes / sizeof(ElemType), (size_t) 1), (maxSegmentSize + maxChunksPerSegment - 1) / maxChunksPerSegment);
+
+        // step t sends segment (rank - t) and receives segment (rank - t - 1), modulo n
+        auto segmentBegin = [&](int segment) { return nData * segment / n; };
+        auto segmentEnd = [&](int segment) { return nData * (segment + 1) / n; };
+        auto sentSegment = [&](size_t step) { return (int)((rank + 2 * n - step) % n); };
+        auto receivedSegment = [&](size_t step) { return (int)((rank + 2 * n - 1 - step) % n); };
+
+        std::vector<std::vector<MPI_Request>> sendRequests(numSteps); // [step]
+        auto sendChunk = [&](size_t step, size_t chunk, size_t begin, size_t end)
+        {
+            sendRequests[step].push_back(MPI_REQUEST_NULL);
+            MPI_Isend(pData + begin, (int)(end - begin), GetDataType(pData), right, (int) chunk, comm, &sendRequests[step].back()) || MpiFail("RingAllReduce: MPI_Isend");
+        };
+        for (size_t begin = segmentBegin(sentSegment(0)), chunk = 0; begin < segmentEnd(sentSegment(0)); begin += chunkSize, chunk++)
+            sendChunk(0, chunk, begin, (std::min)(begin + chunkSize, segmentEnd(sentSegment(0))));
+
+        std::vector<ElemType> receiveBuffer(maxSegmentSize);
+        std::vector<MPI_Request> receiveRequests;
+        for (size_t step = 0; step < numSteps; step++)
+        {
+            const bool reduce = step < (size_t)(n - 1); // reduce-scatter phase; then all-gather
+            const size_t segmentBeginStep = segmentBegin(receivedSegment(step));
+            const size_t segmentEndStep = segmentEnd(receivedSegment(step));
+            const size_t numChunks = (segmentEndStep - segmentBeginStep + chunkSize - 1) / chunkSize;
+
+            // all-gather receives directly into the data, which must not be read by a pending send anymore;
+            // the received segment was last sent in step (step + 1 - n)
+            if (!reduce && !sendRequests[step + 1 - n].empty())
+                MPI_Waitall((int) sendRequests[step + 1 - n].size(), sendRequests[step + 1 - n].data(), MPI_STATUSES_IGNORE) || MpiFail("RingAllReduce: MPI_Waitall");
+
+            receiveRequests.assign(numChunks, MPI_REQUEST_NULL);
+            for (size_t chunk = 0; chunk < numChunks; chunk++)
+            {
+                const size_t begin = segmentBeginStep + chunk * chunkSize;
+                const size_t end = (std::min)(begin + chunkSize, segmentEndStep);
+                ElemType *target = reduce ? receiveBuffer.data() + (begin - segmentBeginStep) : pData + begin;
+                MPI_Irecv(target, (int)(end - begin), GetDataType(pData), left, (int) chunk, comm, &receiveRequests[chunk]) || MpiFail("RingAllReduce: MPI_Irecv");
+            }
+            for (size_t i = 0; i < numChunks; i++)
+            {
+                int chunk = MPI_UNDEFINED;
+                MPI_Waitany((int) numChunks, receiveRequests.data(), &chunk, MPI_STATUS_IGNORE) || MpiFail("RingAllReduce: MPI_Waitany");
+                const size_t begin = segmentBeginStep + chunk * chunkSize;
+                const size_t end = (std::min)(begin + chunkSize, segmentEndStep);
+                if (reduce)
+                {
+                    const ElemType *received = receiveBuffer.data() + (begin - segmentBeginStep);
+                    for (size_t j = begin; j < end; j++)
+                        pData[j] += received[j - begin];
+                }
+                if (step + 1 < numSteps)
+                    sendChunk(step + 1, chunk, begin, end);
+            }
+        }
+        for (auto &requests : sendRequests)
+        {
+            if (!requests.empty())
+                MPI_Waitall((int) requests.size(), requests.data(), MPI_STATUSES_IGNORE) || MpiFail("RingAllReduce: MPI_Waitall");
+        }
+    }
+
+    // two-level all-reduce: sum on the first rank of each host (within the host, MPI uses shared memory), ring all-reduce
+    // among those, and broadcast back within each host
+    // Only one rank per host sends across the network, so the inter-host traffic does not grow with the ranks per host.
+    template <class ElemType>
+    void HierarchicalAllReduce(ElemType *pData, size_t nData) const
+    {
+        int hostRank;
+        MPI_Comm_rank(m_hostComm, &hostRank) || MpiFail("HierarchicalAllReduce: MPI_Comm_rank");
+        MPI_Reduce(hostRank == 0 ? MPI_IN_PLACE : pData, hostRank == 0 ? pData : nullptr, (int) nData, GetDataType(pData), MPI_SUM, 0, m_hostComm) || MpiFail("HierarchicalAllReduce: MPI_Reduce");
+        if (m_hostLeaderComm != MPI_COMM_NULL)
+            RingAllReduce(pData, nData, m_hostLeaderComm);
+        MPI_Bcast(pData, (int) nData, GetDataType(pData), 0, m_hostComm) || MpiFail("HierarchicalAllReduce: MPI_Bcast");
+    }
+
     template <class ElemType>
     void Bcast(ElemType *pData, size_t nData, size_t srcRank)
     {
@@ -0,0 +1,83 @@
+// MappedFile.h -- maps an entire open file into memory, with copy-on-write pages
+
+#pragma once
+
+// implementations differ between Windows and Linux
+
+#include "Basics.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include "Windows.h"
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Pages are loaded on first access and shared through the OS file cache with all other processes that map the same file.
+// Writing to the memory is allowed; it creates a private copy of the affected pages, and the file itself is never modified.
+// The mapping remains valid after the FILE has been closed.
+class MappedFile
+{
+    // no-copying
+    MappedFile(const MappedFile&);
+    void operator=(const MappedFile&);
+
+    char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_mapping;
+#endif
+
+public:
+    MappedFile(FILE* f)
+        : m_data(nullptr), m_size(0)
+    {
+#ifdef _WIN32
+        HANDLE file = (HANDLE) _get_osfhandle(_fileno(f));
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !::GetFileSizeEx(file, &size))
+            RuntimeError("MappedFile: Cannot determine the size of the file.");
+        m_size = (size_t) size.QuadPart;
+        m_mapping = ::CreateFileMapping(file, NULL /*security attr*/, PAGE_WRITECOPY, 0, 0, NULL /*name*/);
+        if (m_mapping == NULL)
+            RuntimeError("MappedFile: CreateFileMapping() failed with error %d.", (int) ::GetLastError());
+        m_data = (char*) ::MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0 /*entire file*/);
+        if (m_data == nullptr)
+        {
+            int err = (int) ::GetLastError();
+            ::CloseHandle(m_mapping);
+            RuntimeError("MappedFile: MapViewOfFile() failed with error %d.", err);
+        }
+#else
+        int fd = fileno(f);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0)
+            RuntimeError("MappedFile: Cannot determine the size of the file.");
+        m_size = (size_t) st.st_size;
+        void* p = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+            RuntimeError("MappedFile: mmap() failed with errno %d.", (int) errno);
+        m_data = (char*) p;
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        ::UnmapViewOfFile(m_data);
+        ::CloseHandle(m_mapping);
+#else
+        munmap(m_data, m_size);
+#endif
+    }
+
+    char* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+};
+} } }
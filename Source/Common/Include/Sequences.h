@@ -49,6 +49,10 @@ typedef size_t UniqueSequenceId;
 //
 // Gaps may also arise due to invalid input data (e.g. a speech utterance for which no alignment could be generated).
 //
+// Recurrent loops do not compute the trailing gaps of a time step: they only process the parallel sequences
+// up to the last one that has data at that step (GetNumActiveSequences()). Readers that place longer
+// sequences in lower parallel-sequence indices thus get a shrinking set of active sequences over time.
+//
 // An MBLayout provides the following functions:
 //  - (building:) add a new sequence (or gap range) to the MBLayout
 //  - inquire the set of sequences (sequence ids) that intersect with this minibatch
@@ -132,6 +136,7 @@ public:
         m_distanceToNearestStart.assign(m_numTimeSteps, PTRDIFF_MAX);
         m_distanceToNearestEnd.assign(m_numTimeSteps, PTRDIFF_MAX);
         m_timeStepHasGap.assign(m_numTimeSteps, false);
+        m_numActiveSequences.assign(m_numTimeSteps, 0);
         m_columnsValidityMask.Resize(0, 0); // invalidate
         // reset state
         m_numFramesDeclared = 0;
@@ -251,6 +256,8 @@ public:
                     m_distanceToNearestStart[t] = distanceToStart;
                 if (m_distanceToNearestEnd[t] > distanceToEnd)
                     m_distanceToNearestEnd[t] = distanceToEnd;
+                if (m_numActiveSequences[t] < s + 1)
+                    m_numActiveSequences[t] = s + 1;
             }
     }
 
@@ -280,6 +287,7 @@ public:
         m_distanceToEnd.SetValue(0);
         m_distanceToNearestStart[0] = 0;
         m_distanceToNearestEnd[0] = 0;
+        m_numActiveSequences[0] = numSamples;
 
         Lock();
     }
@@ -329,6 +337,14 @@ public:
         return false;
     }
 
+    // number of parallel sequences at time step t up to and including the last one that is not a gap
+    // All parallel sequences beyond are gaps at t. (Returns at least 1, also if t is all gaps.)
+    size_t GetNumActiveSequences(size_t t) const
+    {
+        CheckIsValid();
+        return max(m_numActiveSequences[t], (size_t) 1);
+    }
+
 private:
     // we are trying to access content--this verifies that the structure is consistent
     // All frames must now be declared.
@@ -393,6 +409,8 @@ private:
 
     vector<bool> m_timeStepHasGap; // [t] true if at least one gap in time step t
 
+    vector<size_t> m_numActiveSequences; // [t] 1 + index of the last parallel sequence that is not a gap in time step t (0 if none)
+
     // Cached mask indicating the validity of each column in the MBLayout
     // TODO: We actually just need a boolean matrix for this.
     // A value of 1 indicates that the column has valid content
@@ -449,6 +467,7 @@ public:                       // TODO: make private (currently used from masking
     ptrdiff_t m_timeOffset;   // this is added to timeIdxInSeq wherever it is used
     size_t m_timeRange;       // use this to describe a custom range > 1 frame
     size_t seqIndex;          // parallel-sequence index; SIZE_MAX = all sequences in MB (most common case)  --TODO: Bad name, 'sequence' and 'parallel sequence' are two different things
+    size_t m_numActiveSequences; // if seqIndex == SIZE_MAX: only the first this many parallel sequences of the time step; SIZE_MAX = all
     MBLayoutPtr m_pMBLayout;  // layout associated with this
     bool m_broadcastAllowed;  // frame range may be broadcast from outer layout (e.g. a matrix with NULL layout and 1 column is acceptable to this frame range). Only applies when iterating over time; otherwise broadcasting is always OK.
     const FrameRange *parent; // or NULL: parent range, relative to which this FrameRange is interpreted  --TODO: not used yet
@@ -456,7 +475,7 @@ public:                       // TODO: make private (currently used from masking
 public:
     // can construct from a single size_t -> a single-frame range
     FrameRange(MBLayoutPtr pMBLayout, size_t timeIdxInSeq)
-        : timeIdxInSeq(timeIdxInSeq), m_timeOffset(0), m_timeRange(1), seqIndex(SIZE_MAX), m_pMBLayout(pMBLayout), m_broadcastAllowed(false), parent(nullptr)
+        : timeIdxInSeq(timeIdxInSeq), m_timeOffset(0), m_timeRange(1), seqIndex(SIZE_MAX), m_numActiveSequences(SIZE_MAX), m_pMBLayout(pMBLayout), m_broadcastAllowed(false), parent(nullptr)
     {
     }
 
@@ -490,6 +509,15 @@ public:
         return ret;
     }
 
+    // create a FrameRange that accesses only the first 'numSequences' parallel sequences of a single time step
+    // Used by recurrent loops to skip the trailing gaps of a time step: FrameRange(t).WithNumActiveSequences(pMBLayout->GetNumActiveSequences(t))
+    FrameRange WithNumActiveSequences(size_t numSequences) const
+    {
+        FrameRange ret = *this;
+        ret.m_numActiveSequences = numSequences;
+        return ret;
+    }
+
     // create a FrameRange with its MBLayout replaced by another
     // You must check yourself whether this is correct.
     FrameRange WithLayout(MBLayoutPtr pMBLayout) const
@@ -554,7 +582,7 @@ public:
     };
     IndexIteration GetSequenceRange(const shared_ptr<MBLayout> &pMBLayout) const
     {
-        return IndexIteration(seqIndex == SIZE_MAX ? 0 : seqIndex, seqIndex == SIZE_MAX ? pMBLayout->GetNumParallelSequences() : seqIndex + 1);
+        return IndexIteration(seqIndex == SIZE_MAX ? 0 : seqIndex, seqIndex == SIZE_MAX ? min(pMBLayout->GetNumParallelSequences(), m_numActiveSequences) : seqIndex + 1);
     }
 
     // code that can only handle single-frame ranges will call t() to get the time index, which will throw if numFrames != 1
@@ -823,7 +851,13 @@ static inline std::pair<size_t, size_t> ColumnRangeWithMBLayoutFor(size_t numCol
         size_t startColumn = (fr.timeIdxInSeq + fr.m_timeOffset) * numParallelSequences;
         if (startColumn >= numCols)
             LogicError("DataFor: FrameRange specifies a time index that is out of range.");
-        if (fr.seqIndex == SIZE_MAX)
+        if (fr.seqIndex == SIZE_MAX && fr.m_numActiveSequences < numParallelSequences)
+        {
+            if (fr.m_timeRange != 1)
+                LogicError("DataFor: FrameRange only supports a subset of parallel sequences for single time steps.");
+            return std::pair<size_t, size_t>(startColumn, fr.m_numActiveSequences);
+        }
+        else if (fr.seqIndex == SIZE_MAX)
             return std::pair<size_t, size_t>(startColumn, numParallelSequences * fr.m_timeRange);
         else if (fr.m_timeRange != 1)
             LogicError("DataFor: FrameRange only support per-sequence time ranges with tensor slices, not matrix slices.");
@@ -926,6 +960,9 @@ static inline std::pair<DimensionVector, DimensionVector> TensorSliceWithMBLayou
         result.first[sequenceDim] = (ElemType) s;
         result.second[sequenceDim] = (ElemType) s + 1;
     }
+    // or the leading parallel sequences of a time step
+    else if (fr.seqIndex == SIZE_MAX && !fr.IsAllFrames() && pMBLayout && result.second[sequenceDim] > fr.m_numActiveSequences)
+        result.second[sequenceDim] = (ElemType) fr.m_numActiveSequences;
 
     return result;
 }
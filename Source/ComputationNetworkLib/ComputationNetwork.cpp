@@ -19,6 +19,7 @@
 #include "EvaluationNodes.h"
 #include "SpecialPurposeNodes.h"
 #include "MPIWrapper.h" // TODO: does not belong here
+#include "MappedFile.h"
 #include <string>
 #include <vector>
 #include <list>
@@ -102,6 +103,23 @@ void ComputationNetwork::Save(const wstring& fileName, const FileOptions fileFor
 void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptions fileFormat) const
 {
     File fstream(fileName, fileFormat | FileOptions::fileOptionsWrite);
+    WriteModel(fstream);
+    fstream.Flush();
+}
+
+static void SaveLearnableParameterWithoutValue(const ComputationNodeBasePtr& node, File& fstream)
+{
+    auto floatParameter = dynamic_pointer_cast<LearnableParameter<float>>(node);
+    if (floatParameter)
+        floatParameter->SaveWithoutValue(fstream);
+    else
+        dynamic_pointer_cast<LearnableParameter<double>>(node)->SaveWithoutValue(fstream);
+}
+
+// write the model (BCN ... ECN)
+// If 'saveLearnableParameter' is given, it writes the LearnableParameters instead of their Save(), e.g. without their values (for the mapped model format).
+void ComputationNetwork::WriteModel(File& fstream, const function<void(const ComputationNodeBasePtr&, File&)>& saveLearnableParameter) const
+{
     fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BCN");
 
     // model version
@@ -116,7 +134,10 @@ void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptio
     for (auto nodeIter = m_nameToNodeMap.begin(); nodeIter != m_nameToNodeMap.end(); nodeIter++)
     {
         ComputationNodeBasePtr nodePtr = nodeIter->second;
-        nodePtr->Save(fstream);
+        if (saveLearnableParameter && nodePtr->OperationName() == OperationNameOf(LearnableParameter))
+            saveLearnableParameter(nodePtr, fstream);
+        else
+            nodePtr->Save(fstream);
     }
 
     fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ENodeList");
@@ -184,16 +205,169 @@ void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptio
     fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ERootNodes");
 
     fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ECN");
+}
+
+// -----------------------------------------------------------------------
+// saving in two steps
+// -----------------------------------------------------------------------
+
+// The snapshot is the serialized model itself. This way it includes the complete state of all nodes (e.g. the values of
+// PreCompute nodes), and its contents have been copied off the GPU before training goes on.
+shared_ptr<File> ComputationNetwork::SaveSnapshot(const wstring& fileName) const
+{
+    // see Save()
+    if ((g_mpi != nullptr) && !g_mpi->IsMainNode())
+        return nullptr;
+    auto snapshot = make_shared<File>(fileName + L".tmp", FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+    WriteModel(*snapshot);
+    snapshot->Flush();
+    return snapshot;
+}
 
+void ComputationNetwork::CommitSnapshot(const shared_ptr<File>& snapshot, const wstring& fileName)
+{
+    if (!snapshot)
+        return;
+    snapshot->Sync(); // the file must be complete on disk before it replaces a previous one
+    snapshot->Close();
+    renameOrDie(fileName + L".tmp", fileName);
+}
+
+// -----------------------------------------------------------------------
+// mapped model format
+// -----------------------------------------------------------------------
+
+// A mapped model file is loaded by memory-mapping it, with LearnableParameter values on the CPU pointing directly into the mapping.
+// The pages are only read when used, and are shared by all processes that load the same file. The file consists of
+//  - the BMappedModel section: format version, element size, and the file offset of the value table
+//  - the model as written by Save(), except that LearnableParameters are written without their values
+//  - the values of all LearnableParameters as raw column-major arrays, each starting at a multiple of MappedModelValueAlignment
+//  - the value table: name, file offset, and dimensions of the value of each LearnableParameter
+// Read() recognizes the format.
+
+static const size_t MappedModelVersion = 1;
+static const size_t MappedModelValueAlignment = 64; // (the mapping itself starts at a page boundary)
+
+struct MappedParameterValue
+{
+    size_t offset;
+    size_t rows;
+    size_t cols;
+};
+
+template <class ElemType>
+void ComputationNetwork::SaveMapped(const wstring& fileName) const
+{
+    VerifyIsCompiled("SaveMapped");
+    // see Save()
+    if ((g_mpi == nullptr) || g_mpi->IsMainNode())
+    {
+        wstring tmpFileName = fileName + L".tmp";
+        SaveMappedToFileImpl<ElemType>(tmpFileName);
+        renameOrDie(tmpFileName, fileName);
+    }
+}
+
+template <class ElemType>
+void ComputationNetwork::SaveMappedToFileImpl(const wstring& fileName) const
+{
+    File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+
+    fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BMappedModel");
+    fstream << MappedModelVersion << sizeof(ElemType);
+    uint64_t tableOffsetPosition = fstream.GetPosition();
+    fstream << (size_t) 0; // offset of the value table, updated at the end
+    fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EMappedModel");
+
+    WriteModel(fstream, SaveLearnableParameterWithoutValue);
+
+    // values
+    map<wstring, MappedParameterValue> table;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        if (iter.second->OperationName() != OperationNameOf(LearnableParameter))
+            continue;
+        const auto& value = dynamic_pointer_cast<LearnableParameter<ElemType>>(iter.second)->Value();
+
+        size_t position = fstream.GetPosition();
+        MappedParameterValue& entry = table[iter.first];
+        entry.offset = (position + MappedModelValueAlignment - 1) / MappedModelValueAlignment * MappedModelValueAlignment;
+        entry.rows = value.GetNumRows();
+        entry.cols = value.GetNumCols();
+        vector<char> padding(entry.offset - position, 0);
+        if (!padding.empty())
+            fwriteOrDie(padding.data(), 1, padding.size(), fstream);
+        if (value.GetNumElements() > 0)
+        {
+            unique_ptr<ElemType[]> data(value.CopyToArray()); // (values may live on the GPU)
+            fwriteOrDie(data.get(), sizeof(ElemType), value.GetNumElements(), fstream);
+        }
+    }
+
+    // value table
+    size_t tableOffset = fstream.GetPosition();
+    fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BValueTable");
+    fstream << table.size();
+    for (const auto& iter : table)
+        fstream << iter.first << iter.second.offset << iter.second.rows << iter.second.cols;
+    fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EValueTable");
+
+    fstream.SetPosition(tableOffsetPosition);
+    fstream << tableOffset;
     fstream.Flush();
 }
 
+// read the BMappedModel section and the value table, and map the file
+// The file position is left at the beginning of the model (BCN).
+template <class ElemType>
+static shared_ptr<MappedFile> ReadMappedModelHeader(File& fstream, map<wstring, MappedParameterValue>& table)
+{
+    size_t version, elementSize, tableOffset;
+    fstream >> version >> elementSize >> tableOffset;
+    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EMappedModel");
+    if (version > MappedModelVersion)
+        RuntimeError("Read: The mapped model file has format version %d, which is newer than this version of CNTK supports (%d).", (int) version, (int) MappedModelVersion);
+    if (elementSize != sizeof(ElemType))
+        RuntimeError("Read: The mapped model file holds %d-byte values, but is loaded with %d-byte precision.", (int) elementSize, (int) sizeof(ElemType));
+    if (!fstream.CanSeek())
+        RuntimeError("Read: A mapped model must be loaded from a regular file.");
+
+    uint64_t modelPosition = fstream.GetPosition();
+    fstream.SetPosition(tableOffset);
+    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BValueTable");
+    size_t numValues;
+    fstream >> numValues;
+    for (size_t i = 0; i < numValues; i++)
+    {
+        wstring nodeName;
+        MappedParameterValue entry;
+        fstream >> nodeName >> entry.offset >> entry.rows >> entry.cols;
+        table[nodeName] = entry;
+    }
+    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EValueTable");
+    fstream.SetPosition(modelPosition);
+
+    auto mapping = make_shared<MappedFile>((FILE*) fstream);
+    for (const auto& iter : table)
+    {
+        if (iter.second.offset + iter.second.rows * iter.second.cols * sizeof(ElemType) > mapping->Size())
+            RuntimeError("Read: The value of %ls extends beyond the end of the mapped model file, which appears to be truncated.", iter.first.c_str());
+    }
+    return mapping;
+}
+
 // load the section of nodes that contain persistable parameters
 // This is used for reloading a model without recreating it, e.g. during training.
 // TODO: Why not just reload it? Because SGD::Train() holds pointers to the parameters directly? That should be fixed.
 template <class ElemType>
 void ComputationNetwork::ReadPersistableParameters(File& fstream, bool create)
 {
+    // mapped model format: LearnableParameter values are taken from the mapping instead of the stream
+    shared_ptr<MappedFile> mapping;
+    map<wstring, MappedParameterValue> mappedValues;
+    if (fstream.TryGetMarker(FileMarker::fileMarkerBeginSection, L"BMappedModel"))
+        mapping = ReadMappedModelHeader<ElemType>(fstream, mappedValues);
+
     fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BCN");
 
     // model version
@@ -220,7 +394,19 @@ void ComputationNetwork::ReadPersistableParameters(File& fstream, bool create)
         else // reloading existing
             node = GetNodeFromName(nodeName);
 
-        node->Load(fstream, modelVersion);
+        if (mapping && opName == OperationNameOf(LearnableParameter))
+        {
+            auto parameter = dynamic_pointer_cast<LearnableParameter<ElemType>>(node);
+            TensorShape sampleLayout = parameter->LoadWithoutValue(fstream, modelVersion);
+            auto iter = mappedValues.find(nodeName);
+            if (iter == mappedValues.end())
+                RuntimeError("Read: The mapped model file has no value for %ls.", nodeName.c_str());
+            const auto& entry = iter->second;
+            // when reloading (e.g. during training), the data is copied into the existing value
+            parameter->SetMappedValue(sampleLayout, entry.rows, entry.cols, (ElemType*) (mapping->Data() + entry.offset), create ? mapping : nullptr);
+        }
+        else
+            node->Load(fstream, modelVersion);
 
         if (create) // loaded from scratch
             AddNodeToNet(node);
@@ -386,9 +572,7 @@ bool ComputationNetwork::IsTypicalCriterionNode(ComputationNodeBasePtr nodePtr)
         nodePtr->OperationName() == OperationNameOf(CrossEntropyNode) ||
         nodePtr->OperationName() == OperationNameOf(ClassBasedCrossEntropyWithSoftmaxNode) ||
         nodePtr->OperationName() == OperationNameOf(ErrorPredictionNode) ||
-#ifdef COMING_SOON
         nodePtr->OperationName() == OperationNameOf(CRFNode) ||
-#endif
         nodePtr->OperationName() == OperationNameOf(DummyCriterionNode))
         return true;
 
@@ -1026,6 +1210,7 @@ void ComputationNetwork::PerformSVDecomposition(const map<wstring, float>& SVDCo
 template void ComputationNetwork::InitLearnableParameters<float>(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const float initValueScale, bool initOnCPUOnly);
 template void ComputationNetwork::Read<float>(const wstring& fileName, const FileOptions fileFormat, const bool bAllowNoCriterionNode, ComputationNetwork* anotherNetwork);
 template void ComputationNetwork::ReadPersistableParameters<float>(File& fstream, bool create);
+template void ComputationNetwork::SaveMapped<float>(const wstring& fileName) const;
 template void ComputationNetwork::PerformSVDecomposition<float>(const map<wstring, float>& SVDConfig, size_t alignedsize);
 template /*static*/ void ComputationNetwork::SetDropoutRate<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, unsigned long& dropOutSeed);
 template void ComputationNetwork::SetSeqParam<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr criterionNode, const double& hsmoothingWeight, const double& frameDropThresh, const bool& doreferencealign,
@@ -1034,6 +1219,7 @@ template void ComputationNetwork::SetSeqParam<float>(ComputationNetworkPtr net,
 template void ComputationNetwork::InitLearnableParameters<double>(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const double initValueScale, bool initOnCPUOnly);
 template void ComputationNetwork::Read<double>(const wstring& fileName, const FileOptions fileFormat, const bool bAllowNoCriterionNode, ComputationNetwork* anotherNetwork);
 template void ComputationNetwork::ReadPersistableParameters<double>(File& fstream, bool create);
+template void ComputationNetwork::SaveMapped<double>(const wstring& fileName) const;
 template void ComputationNetwork::PerformSVDecomposition<double>(const map<wstring, float>& SVDConfig, size_t alignedsize);
 template /*static*/ void ComputationNetwork::SetDropoutRate<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, unsigned long& dropOutSeed);
 template void ComputationNetwork::SetSeqParam<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr criterionNode, const double& hsmoothingWeight, const double& frameDropThresh, const bool& doreferencealign,
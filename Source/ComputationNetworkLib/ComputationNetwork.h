@@ -45,6 +45,10 @@ public:
     ComputationNetwork()
         : m_randomSeedOffset(0),
           m_isCompiled(false),
+          m_traceLevel(0),
+          m_hoistLoopInvariants(false),
+          m_optimizeGraph(false),
+          m_freezeParametersForOptimization(false),
           m_pMBLayout(make_shared<MBLayout>())
     {
     }
@@ -113,10 +117,23 @@ public:
 
     void Save(const std::wstring& fileName, const FileOptions fileFormat = FileOptions::fileOptionsBinary) const;
     void SaveEdited(const std::wstring& fileName, const FileOptions fileFormat = FileOptions::fileOptionsBinary);
+    // save in the mapped model format, which Read() loads by memory-mapping the parameter values
+    template <class ElemType>
+    void SaveMapped(const std::wstring& fileName) const;
+
+    // Saving in two steps allows to complete the write on a background thread while training continues to modify the network:
+    // SaveSnapshot() writes the complete model, as Save() does, to fileName + ".tmp" and returns the still open file;
+    // CommitSnapshot() then waits until that file is on disk and renames it to 'fileName'. It does not access the network.
+    // Only the main node writes; on the other nodes, SaveSnapshot() returns nullptr and CommitSnapshot() does nothing.
+    std::shared_ptr<File> SaveSnapshot(const std::wstring& fileName) const;
+    static void CommitSnapshot(const std::shared_ptr<File>& snapshot, const std::wstring& fileName);
 
 private:
 
     void SaveToFileImpl(const std::wstring& fileName, const FileOptions fileFormat) const;
+    template <class ElemType>
+    void SaveMappedToFileImpl(const std::wstring& fileName) const;
+    void WriteModel(File& fstream, const std::function<void(const ComputationNodeBasePtr&, File&)>& saveLearnableParameter = nullptr) const;
 
 public:
 
@@ -140,11 +157,17 @@ public:
     static void BumpEvalTimeStamp(const std::vector<ComputationNodeBasePtr>& nodes);
     void ResetEvalTimeStamps();
 
+    // run independent nodes of CPU networks concurrently on 'numWorkers' threads, each using 'numThreadsPerWorker' OpenMP/BLAS threads
+    // (see PARTraversalFlowControlNode); 0 workers: off. This must be called before any network is evaluated.
+    static void SetConcurrentNodeExecution(size_t numWorkers, int numThreadsPerWorker);
+    static bool IsConcurrentNodeExecutionEnabled();
+
     // and for a set of nodes
     void StartEvaluateMinibatchLoop(const ComputationNodeBasePtr& rootNode) // (ugly name; meant to be unique so we can rename if needed)
     {
         VerifyIsCompiled("StartEvaluateMinibatchLoop");
         ResetEvalTimeStamps(); // invalidate all m_value fields  --TODO: redundant (called over again for every root node). Make this private and only call for sets of nodes.
+        PrepareFrozenWeights(rootNode);
     }
     template <class NODESET>
     void StartEvaluateMinibatchLoop(const NODESET& nodes) // (ugly name; meant to be unique so we can rename if needed)
@@ -165,6 +188,47 @@ public:
 
     void CompileNetwork(); // call this after creation, Load(), and any modification
 
+    // 0 = only summaries; 1 = also log every rewrite done by CompileNetwork()
+    void SetTraceLevel(int traceLevel) { m_traceLevel = traceLevel; }
+    int TraceLevel() const { return m_traceLevel; }
+
+    // enable moving loop-invariant additions out of recurrent loops in CompileNetwork(), see HoistLoopInvariantNodes()
+    // This rewrites the graph, so a model saved afterwards differs from the one that was described.
+    // This takes effect with the next call to CompileNetwork().
+    void EnableLoopInvariantHoisting(bool enable)
+    {
+        m_hoistLoopInvariants = enable;
+        InvalidateCompiledNetwork();
+    }
+
+    // enable the optional graph-optimization stage of CompileNetwork() (fusion, constant folding, dead-node elimination)
+    // If 'freezeParameters' then all LearnableParameters are considered constant (e.g. for evaluation); otherwise only those
+    // that do not require updates. Nodes not reachable from the node groups or from 'requestedNodeNames' are removed.
+    // If 'dumpPath' is given, the rewritten network is written there.
+    // This takes effect with the next call to CompileNetwork().
+    void EnableGraphOptimization(bool freezeParameters, const std::vector<std::wstring>& requestedNodeNames = std::vector<std::wstring>(), const std::wstring& dumpPath = L"")
+    {
+        m_optimizeGraph = true;
+        m_freezeParametersForOptimization = freezeParameters;
+        m_requestedNodeNamesForOptimization = requestedNodeNames;
+        m_optimizedGraphDumpPath = dumpPath;
+        InvalidateCompiledNetwork();
+    }
+
+    // post-training int8 quantization of the weight products of Times and Convolution nodes for CPU inference, see QuantizableNode
+    // Typical use: SetQuantizationCalibration(true), evaluate over a sample set, SetQuantizationCalibration(false), QuantizeForInference().
+    // The calibrated ranges can be saved and loaded by node name, so that a served model can be quantized without a sample set.
+    void SetQuantizationCalibration(bool enable);
+    size_t QuantizeForInference();
+    void ReleaseQuantization();
+    // let the weight products below 'rootNode' make their copies of frozen weights (see QuantizableNode::PrepareFrozenWeights())
+    void PrepareFrozenWeights(const ComputationNodeBasePtr& rootNode);
+    void SaveQuantizationRanges(const std::wstring& fileName) const;
+    void LoadQuantizationRanges(const std::wstring& fileName);
+    // freeze all LearnableParameters of a model that is only evaluated, so that the weight products use packed copies of their weights,
+    // or int8 copies if 'quantizationRangesPath' names ranges saved by SaveQuantizationRanges()
+    void PrepareForInference(const std::wstring& quantizationRangesPath = L"");
+
     // void ValidateNetwork(bool allowFragment = false, const bool bAllowNoCriterion = false);
     // prepares the network for computation
     // void BuildAndValidateSubNetwork(const ComputationNodeBasePtr rootNode);
@@ -207,6 +271,15 @@ private:
     void DetermineLoopForwardOrder(std::unordered_set<ComputationNodeBasePtr>& visited, std::unordered_set<ComputationNodeBasePtr>& recStack, std::list<ComputationNodeBasePtr>& nodesStack, ComputationNodeBasePtr cur);
     void GatherLoopNodesR(const ComputationNodeBasePtr& rootNode, std::unordered_set<ComputationNodeBasePtr>& visited, std::map<int, std::list<ComputationNodeBasePtr>>& recurrentResult, std::list<ComputationNodeBasePtr>& noRecurrentResult);
     void ReorderLoops(std::list<ComputationNodeBasePtr>& nodes, const std::map<int, std::list<ComputationNodeBasePtr>>& /*recurrentNodes*/, const std::list<ComputationNodeBasePtr>& /*noRecurrentNodes*/);
+    // This is called by CompileNetwork() after loops have been formed if enabled through EnableLoopInvariantHoisting(). It modifies the graph.
+    bool HoistLoopInvariantNodes();
+
+    // These are called by CompileNetwork() if enabled through EnableGraphOptimization(). They modify the graph.
+    bool OptimizeNetwork();
+    size_t FoldConstantNodes();
+    size_t FuseElementwiseNodes();
+    size_t EliminateDeadNodes();
+    void ReplaceNodeInNetwork(const ComputationNodeBasePtr& oldNode, const ComputationNodeBasePtr& newNode);
 
 public:
     // -----------------------------------------------------------------------
@@ -330,6 +403,12 @@ public:
     ComputationNodeBasePtr CopyNode(const ComputationNetwork& fromNet, const std::wstring fromName, std::wstring toName, const CopyNodeFlags flags);
     void CopySubTree(const ComputationNetwork& fromNet, const std::wstring fromName, std::wstring toNamePrefix, const CopyNodeFlags flags);
     void CopyInputs(const std::wstring fromName, std::wstring toName);
+    // let the LearnableParameters use the value matrices of the same-named ones in another network
+    template <class ElemType>
+    void ShareParametersWith(const ComputationNetwork& other);
+    // a copy of this network in memory that shares its LearnableParameters, e.g. for evaluating the model on several threads
+    template <class ElemType>
+    ComputationNetworkPtr CopySharingParameters();
     void RenameNode(const std::wstring& nodeNameOrig, const std::wstring& nodeNameNew);
     void RenameNode(ComputationNodeBasePtr node, const std::wstring& newNodeName);
     void DeleteNode(const std::wstring& nodeName);
@@ -852,6 +931,15 @@ protected:
         // There is currently no other constructor for inner nested PAR-traversed sub-networks, but there will be.
         PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes);
         // Base::m_nestedNodes contains all top-level nodes, in evaluation order
+
+    private:
+        // dependencies between the m_nestedNodes for concurrent execution; determined on first use
+        struct ConcurrentSchedule;
+        shared_ptr<ConcurrentSchedule> m_concurrentSchedule; // null if the nodes are executed serially
+        bool m_concurrentScheduleDetermined;
+        const ConcurrentSchedule* GetConcurrentSchedule();
+        static void RunConcurrently(const ConcurrentSchedule* schedule, const std::vector<size_t>& numPredecessors,
+                                    const std::vector<std::vector<size_t>>& successors, const std::function<void(size_t)>& task);
     };
 
 public:
@@ -907,6 +995,17 @@ private:
     // cache for evaluation ordering:
     bool m_isCompiled; // CompileNetwork has been called
 
+    int m_traceLevel;
+
+    // see EnableLoopInvariantHoisting()
+    bool m_hoistLoopInvariants;
+
+    // graph optimization, see EnableGraphOptimization()
+    bool m_optimizeGraph;
+    bool m_freezeParametersForOptimization;
+    std::vector<std::wstring> m_requestedNodeNamesForOptimization;
+    std::wstring m_optimizedGraphDumpPath;
+
     // cached network iterations
     std::map<const ComputationNodeBasePtr, std::list<ComputationNodeBasePtr>> m_evalOrders; // [out node] flat depth-first traversal starting from out node
     std::map<const ComputationNodeBasePtr, ComputationNodeBasePtr> m_nestedNetworks;        // [out node] network rewritten as recursive traveral, potentially optimized; execution plan
@@ -9,6 +9,7 @@
 #include "ComputationNode.h"
 #include "ComputationNetwork.h"
 #include "RecurrentNodes.h"
+#include "LinearAlgebraNodes.h"
 #include <string>
 #include <set>
 
@@ -169,6 +170,93 @@ void ComputationNetwork::FormRecurrentLoops(const ComputationNodeBasePtr& rootNo
 #endif
 }
 
+// HoistLoopInvariantNodes() -- move computation that does not depend on the recurrence out of recurrent loops
+// Nodes inside a loop always have at least one input from inside the loop. However, a sum such as
+// (W x) + ((R h) + b), where only (R h) depends on the recurrence, still performs both additions per time step.
+// We re-associate such sums into ((W x) + b) + (R h), so that the loop-invariant part is computed once
+// over the whole minibatch in PAR mode, and only one addition is left inside the loop.
+// The re-associated sum now computes something else, so it is renamed to make that visible in saved models.
+// Returns true if the graph was modified, in which case the network must be recompiled.
+bool ComputationNetwork::HoistLoopInvariantNodes()
+{
+    // count the consumers of each node; we only rewrite sums that are not consumed by anyone else
+    map<ComputationNodeBasePtr, size_t> numConsumers;
+    for (const auto& iter : m_nameToNodeMap)
+        for (size_t i = 0; i < iter.second->GetNumInputs(); i++)
+            numConsumers[iter.second->Input(i)]++;
+    // nodes that are referenced from outside (criteria, outputs, ...) must keep their value
+    set<ComputationNodeBasePtr> groupNodes;
+    for (auto groupIter : GetAllNodeGroups())
+        groupNodes.insert(groupIter->begin(), groupIter->end());
+
+    size_t numHoisted = 0;
+    for (const auto& loop : m_allSEQNodes)
+    {
+        set<ComputationNodeBasePtr> loopNodes(loop->m_nestedNodes.begin(), loop->m_nestedNodes.end());
+        // an operand can be moved if it is outside the loop and can be added to the sum without changing its dimensions,
+        // i.e. it is minibatch data with the sum's sample shape and layout, or a column vector that is broadcast over all frames
+        auto isMovableOperand = [&](const ComputationNodeBasePtr& operand, const ComputationNodeBasePtr& sum)
+        {
+            if (loopNodes.find(operand) != loopNodes.end())
+                return false;
+            if (operand->HasMBLayout())
+                return operand->GetMBLayout() == sum->GetMBLayout() && operand->GetSampleLayout() == sum->GetSampleLayout();
+            const size_t rank = operand->GetSampleLayout().GetRank();
+            return rank >= 1 && rank <= 2 && operand->GetAsMatrixNumCols() == 1 &&
+                   operand->GetAsMatrixNumRows() == sum->GetSampleMatrixNumRows();
+        };
+
+        for (const auto& node : loop->m_nestedNodes)
+        {
+            if (node->OperationName() != OperationNameOf(PlusNode))
+                continue;
+            bool hoisted = false;
+            for (size_t i = 0; i < 2 && !hoisted; i++)
+            {
+                // node = outer + inner, where inner = innerVariant + innerInvariant
+                auto outer = node->Input(1 - i);
+                auto inner = node->Input(i);
+                if (!isMovableOperand(outer, node) || inner->OperationName() != OperationNameOf(PlusNode) ||
+                    loopNodes.find(inner) == loopNodes.end() || numConsumers[inner] != 1 || groupNodes.find(inner) != groupNodes.end())
+                    continue;
+                for (size_t j = 0; j < 2 && !hoisted; j++)
+                {
+                    auto innerVariant = inner->Input(j);
+                    auto innerInvariant = inner->Input(1 - j);
+                    if (loopNodes.find(innerVariant) == loopNodes.end() || !isMovableOperand(innerInvariant, node))
+                        continue;
+                    // rewrite as node = (outer + innerInvariant) + innerVariant; 'inner' has no other consumer, so we can reuse it
+                    wstring newName = inner->NodeName() + L".hoisted";
+                    for (size_t k = 1; NodeNameExists(newName); k++)
+                        newName = inner->NodeName() + msra::strfun::wstrprintf(L".hoisted%d", (int) k);
+                    if (m_traceLevel > 0)
+                        fprintf(stderr, "HoistLoopInvariantNodes: Moving %ls %ls operation out of loop %d as %ls (now computing %ls + %ls).\n",
+                                inner->NodeName().c_str(), inner->OperationName().c_str(), (int) loop->m_loopId, newName.c_str(), outer->NodeName().c_str(), innerInvariant->NodeName().c_str());
+                    RenameNode(inner, newName);
+                    inner->SetInput(0, outer);
+                    inner->SetInput(1, innerInvariant);
+                    node->SetInput(0, inner);
+                    node->SetInput(1, innerVariant);
+                    hoisted = true;
+                }
+            }
+            if (hoisted)
+                numHoisted++;
+        }
+    }
+
+    if (numHoisted == 0)
+        return false;
+
+    // loop membership will be determined anew; FormRecurrentLoops() only ever sets m_isPartOfLoop, so clear it here
+    for (const auto& loop : m_allSEQNodes)
+        for (const auto& node : loop->m_nestedNodes)
+            node->m_isPartOfLoop = false;
+
+    fprintf(stderr, "HoistLoopInvariantNodes: %d nodes moved out of recurrent loops.\n", (int) numHoisted);
+    return true;
+}
+
 // checks whether a node is recurrent, and which direction
 static int GetRecurrenceSteppingDirection(const ComputationNodeBasePtr& node)
 {
@@ -94,6 +94,68 @@ void ComputationNetwork::CopySubTree(const ComputationNetwork& fromNet,
     }
 }
 
+// let the LearnableParameters of this network use the value matrices of the same-named ones in 'other', e.g. the same model loaded before
+// This network then has its own activations and MBLayout but no parameter memory, so that it can be evaluated concurrently with 'other'
+// and with other such networks, e.g. one per thread that serves the model. The shared parameters must not be modified while they are shared.
+// The packed or int8 copies of frozen weights are shared as well; 'other' should make them (PrepareFrozenWeights()) before it is shared,
+// so that the networks only read them.
+template <class ElemType>
+void ComputationNetwork::ShareParametersWith(const ComputationNetwork& other)
+{
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        auto parameter = dynamic_pointer_cast<LearnableParameter<ElemType>>(iter.second);
+        if (!parameter)
+            continue;
+        const auto& otherNode = other.GetNodeFromName(iter.first);
+        auto otherParameter = dynamic_pointer_cast<LearnableParameter<ElemType>>(otherNode);
+        if (!otherParameter || otherNode->GetSampleLayout() != iter.second->GetSampleLayout())
+            RuntimeError("ShareParametersWith: The other network has no parameter %ls of the same dimensions.", iter.first.c_str());
+        parameter->ShareValueWith(otherParameter);
+    }
+}
+
+// CopySharingParameters() -- a copy of this network, made in memory, whose LearnableParameters share the value matrices of this one
+// The copy has the same nodes, inputs and node groups; see ShareParametersWith() for what can be done with it.
+template <class ElemType>
+ComputationNetworkPtr ComputationNetwork::CopySharingParameters()
+{
+    auto net = make_shared<ComputationNetwork>(m_deviceId);
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        ComputationNodeBasePtr node;
+        if (iter.second->OperationName() == OperationNameOf(LearnableParameter))
+        {
+            // (its value is set by ShareParametersWith() below)
+            node = New<LearnableParameter<ElemType>>(m_deviceId, iter.first);
+            node->SetDims(iter.second->GetSampleLayout(), false);
+            node->SetParameterUpdateRequired(iter.second->IsParameterUpdateRequired());
+        }
+        else
+            node = iter.second->Duplicate(iter.first, CopyNodeFlags::copyNodeValue);
+        net->AddNodeToNet(node);
+    }
+
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        vector<ComputationNodeBasePtr> inputs;
+        for (const auto& input : iter.second->GetInputs())
+            inputs.push_back(net->GetNodeFromName(input->NodeName()));
+        if (!inputs.empty())
+            net->GetNodeFromName(iter.first)->AttachInputs(inputs);
+    }
+
+    auto groups = GetAllNodeGroups();
+    auto netGroups = net->GetAllNodeGroups();
+    for (size_t i = 0; i < groups.size(); i++)
+        for (const auto& node : *groups[i])
+            netGroups[i]->push_back(net->GetNodeFromName(node->NodeName()));
+
+    net->ShareParametersWith<ElemType>(*this);
+    net->CompileNetwork();
+    return net;
+}
+
 // you can only copy inputs from nodes in the same network
 void ComputationNetwork::CopyInputs(const std::wstring fromName, std::wstring toName)
 {
@@ -360,4 +422,9 @@ void ComputationNetwork::SetBatchNormlizationNodesBelowEvalMode(const bool evalM
         }
     }
 }
+
+template void ComputationNetwork::ShareParametersWith<float>(const ComputationNetwork& other);
+template void ComputationNetwork::ShareParametersWith<double>(const ComputationNetwork& other);
+template ComputationNetworkPtr ComputationNetwork::CopySharingParameters<float>();
+template ComputationNetworkPtr ComputationNetwork::CopySharingParameters<double>();
 } } }
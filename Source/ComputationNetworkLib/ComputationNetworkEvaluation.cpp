@@ -10,12 +10,19 @@
 #include "ComputationNetwork.h"
 #include "RecurrentNodes.h"
 #include "InputAndParamNodes.h"
+#include "CPUMatrix.h" // for SetNumThreadsOfCurrentThread()
 #include <string>
 #include <vector>
 #include <list>
 #include <set>
 #include <algorithm>
 #include <map>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 using namespace std;
 
@@ -92,6 +99,247 @@ ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const ComputationNod
     return m_nestedNetworks[rootNode];
 }
 
+// -----------------------------------------------------------------------
+// concurrent execution of independent nodes
+//
+// Optionally, PARTraversalFlowControlNode runs its nested nodes (regular nodes and whole SEQ loops) on a
+// pool of worker threads as soon as their dependencies are met, so that independent branches (e.g. the
+// forward and backward LSTM stacks of a bidirectional model) run at the same time. This is only done for
+// nodes on the CPU, where a chain of operations on small minibatches cannot keep all cores busy. Each
+// worker runs the OpenMP/BLAS code of its nodes with fewer threads.
+// A node runs after its inputs (forward) or after all nodes that back-propagate into it (backward), and the
+// nodes that back-propagate into the same node run in the serial order, so that each gradient is accumulated
+// in the same order. Results still differ from serial execution in the last bits, since BLAS and OpenMP
+// reductions with a different number of threads sum in a different order. The calling thread does not run
+// nodes itself, so all nodes run with the same number of threads.
+// State that the nodes share is prepared before they run: the validity masks of the MBLayouts are created
+// (they are otherwise created on first use), and the gaps of values that several nodes read are set to zero
+// once (nodes otherwise mask the gaps of their inputs in place). ConstOnes() is locked.
+// Matrices are not shared through the MatrixPool when this is enabled, since that relies on the serial order.
+// -----------------------------------------------------------------------
+
+static size_t s_numNodeWorkers = 0;
+static int s_numThreadsPerNodeWorker = 1;
+
+/*static*/ void ComputationNetwork::SetConcurrentNodeExecution(size_t numWorkers, int numThreadsPerWorker)
+{
+    if (numWorkers > 0 && numThreadsPerWorker <= 0)
+        numThreadsPerWorker = (std::max)(1, (int) std::thread::hardware_concurrency() / (int) numWorkers);
+    s_numNodeWorkers = numWorkers;
+    s_numThreadsPerNodeWorker = numThreadsPerWorker;
+    if (numWorkers > 0)
+        fprintf(stderr, "Concurrent node execution: %d workers with %d threads each.\n", (int) numWorkers, numThreadsPerWorker);
+}
+
+/*static*/ bool ComputationNetwork::IsConcurrentNodeExecutionEnabled()
+{
+    return s_numNodeWorkers > 0;
+}
+
+// pool of worker threads that run the tasks of dependency graphs
+// Tasks of several graphs (from different threads) may be interleaved. The threads are never ended.
+class NodeWorkerPool
+{
+    struct Job
+    {
+        const std::function<void(size_t)>* task;
+        const vector<vector<size_t>>* successors; // [task] -> tasks that depend on it
+        vector<size_t> numPendingPredecessors;    // [task]
+        size_t numRemaining;
+        exception_ptr error; // once set, the remaining tasks are skipped
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_taskReady;
+    std::condition_variable m_taskDone;
+    std::deque<std::pair<Job*, size_t>> m_readyTasks;
+
+    NodeWorkerPool(size_t numWorkers, int numThreadsPerWorker)
+    {
+        for (size_t i = 0; i < numWorkers; i++)
+            std::thread([this, numThreadsPerWorker]
+                        {
+                            CPUMatrix<float>::SetNumThreadsOfCurrentThread(numThreadsPerWorker);
+                            WorkerLoop();
+                        }).detach();
+    }
+
+    void WorkerLoop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_taskReady.wait(lock, [this] { return !m_readyTasks.empty(); });
+            Job& job = *m_readyTasks.front().first;
+            size_t taskIndex = m_readyTasks.front().second;
+            m_readyTasks.pop_front();
+
+            if (!job.error)
+            {
+                lock.unlock();
+                exception_ptr error;
+                try
+                {
+                    (*job.task)(taskIndex);
+                }
+                catch (...)
+                {
+                    error = current_exception();
+                }
+                lock.lock();
+                if (error && !job.error)
+                    job.error = error;
+            }
+
+            bool newTasks = false;
+            for (size_t successor : (*job.successors)[taskIndex])
+            {
+                if (--job.numPendingPredecessors[successor] == 0)
+                {
+                    m_readyTasks.push_back(std::make_pair(&job, successor));
+                    newTasks = true;
+                }
+            }
+            if (newTasks)
+                m_taskReady.notify_all();
+            if (--job.numRemaining == 0)
+                m_taskDone.notify_all();
+        }
+    }
+
+public:
+    static NodeWorkerPool& Get()
+    {
+        static NodeWorkerPool* pool = new NodeWorkerPool(s_numNodeWorkers, s_numThreadsPerNodeWorker); // (never deleted, see above)
+        return *pool;
+    }
+
+    // run task(i) for all tasks i, each after its predecessors, and wait until all are done
+    // 'numPredecessors' and 'successors' describe the dependency graph, which must be acyclic.
+    // The first exception thrown by a task is rethrown.
+    void Run(const vector<size_t>& numPredecessors, const vector<vector<size_t>>& successors, const std::function<void(size_t)>& task)
+    {
+        Job job;
+        job.task = &task;
+        job.successors = &successors;
+        job.numPendingPredecessors = numPredecessors;
+        job.numRemaining = numPredecessors.size();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < numPredecessors.size(); i++)
+        {
+            if (numPredecessors[i] == 0)
+                m_readyTasks.push_back(std::make_pair(&job, i));
+        }
+        m_taskReady.notify_all();
+        m_taskDone.wait(lock, [&job] { return job.numRemaining == 0; });
+        lock.unlock();
+
+        if (job.error)
+            rethrow_exception(job.error);
+    }
+};
+
+// dependency graphs over the nested nodes of a PARTraversalFlowControlNode, as edges from each node to those that must wait for it
+struct ComputationNetwork::PARTraversalFlowControlNode::ConcurrentSchedule
+{
+    vector<size_t> forwardNumPredecessors, backwardNumPredecessors;
+    vector<vector<size_t>> forwardSuccessors, backwardSuccessors;
+    vector<vector<ComputationNodeBasePtr>> members; // [nested node] -> the node itself, or the nodes of a SEQ loop
+    vector<MBLayoutPtr> layouts;                    // all MBLayouts of the members
+};
+
+// create the validity masks of 'layouts', which MBLayout::GetColumnsValidityMask() would otherwise create on first use
+static void CreateColumnsValidityMasks(const vector<MBLayoutPtr>& layouts)
+{
+    for (const auto& pMBLayout : layouts)
+    {
+        if (pMBLayout->HasGaps())
+            pMBLayout->GetColumnsValidityMask(CPUDEVICE);
+    }
+}
+
+const ComputationNetwork::PARTraversalFlowControlNode::ConcurrentSchedule* ComputationNetwork::PARTraversalFlowControlNode::GetConcurrentSchedule()
+{
+    if (m_concurrentScheduleDetermined)
+        return m_concurrentSchedule.get();
+    m_concurrentScheduleDetermined = true;
+    if (!IsConcurrentNodeExecutionEnabled() || m_nestedNodes.size() < 2)
+        return nullptr;
+
+    // the nodes that make up each nested node (itself, or the nodes of a SEQ loop)
+    const size_t n = m_nestedNodes.size();
+    vector<vector<ComputationNodeBasePtr>> members(n);
+    map<ComputationNodeBasePtr, size_t> indexOf;
+    for (size_t i = 0; i < n; i++)
+    {
+        auto recInfo = dynamic_pointer_cast<SEQTraversalFlowControlNode>(m_nestedNodes[i]);
+        members[i] = recInfo ? recInfo->m_nestedNodes : vector<ComputationNodeBasePtr>{m_nestedNodes[i]};
+        for (const auto& node : members[i])
+        {
+            if (node->GetDeviceId() != CPUDEVICE)
+                return nullptr; // GPU kernels are serialized on one stream anyway
+            indexOf[node] = i;
+        }
+    }
+
+    set<MBLayoutPtr> layouts;
+    for (const auto& nodes : members)
+    {
+        for (const auto& node : nodes)
+        {
+            if (node->HasMBLayout())
+                layouts.insert(node->GetMBLayout());
+        }
+    }
+
+    // forward: inputs before consumers
+    // backward: consumers before inputs, and the consumers of each input in reverse evaluation order, since they all add to its gradient
+    vector<set<size_t>> forwardEdges(n), backwardEdges(n); // [from] -> to
+    map<ComputationNodeBasePtr, size_t> lastConsumerOf;
+    for (size_t i = 0; i < n; i++)
+    {
+        for (const auto& node : members[i])
+        {
+            for (const auto& input : node->GetInputs())
+            {
+                auto iter = indexOf.find(input);
+                if (iter == indexOf.end() || iter->second == i) // (recurrence inside a SEQ loop)
+                    continue;
+                forwardEdges[iter->second].insert(i);
+                backwardEdges[i].insert(iter->second);
+                auto lastConsumer = lastConsumerOf.find(input);
+                if (lastConsumer != lastConsumerOf.end() && lastConsumer->second != i)
+                    backwardEdges[i].insert(lastConsumer->second);
+                lastConsumerOf[input] = i;
+            }
+        }
+    }
+
+    auto schedule = make_shared<ConcurrentSchedule>();
+    schedule->forwardNumPredecessors.assign(n, 0);
+    schedule->backwardNumPredecessors.assign(n, 0);
+    schedule->forwardSuccessors.resize(n);
+    schedule->backwardSuccessors.resize(n);
+    schedule->members = move(members);
+    schedule->layouts.assign(layouts.begin(), layouts.end());
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j : forwardEdges[i])
+        {
+            schedule->forwardSuccessors[i].push_back(j);
+            schedule->forwardNumPredecessors[j]++;
+        }
+        for (size_t j : backwardEdges[i])
+        {
+            schedule->backwardSuccessors[i].push_back(j);
+            schedule->backwardNumPredecessors[j]++;
+        }
+    }
+    m_concurrentSchedule = schedule;
+    return m_concurrentSchedule.get();
+}
+
 // -----------------------------------------------------------------------
 // PARTraversalFlowControlNode methods -- implements PAR traversal
 //
@@ -101,6 +349,7 @@ ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const ComputationNod
 // -----------------------------------------------------------------------
 
 ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes /*must be in eval order*/)
+    : m_concurrentScheduleDetermined(false)
 {
     // traverse the network in evaluation order and create a new list that replaces all recurrence by a SEQTraversalFlowControlNode
     set<shared_ptr<IComputationNode>> loopsSeen; // for consistency check only
@@ -125,37 +374,104 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
         }
     }
 }
-/*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::ForwardProp(const FrameRange& fr) /*override*/
+
+static void ForwardPropNestedNode(const ComputationNodeBasePtr& node, const FrameRange& fr)
 {
-    for (auto& node : m_nestedNodes)
+    if (node->IsOutputOlderThanInputs())
     {
-        if (node->IsOutputOlderThanInputs())
-        {
-            auto recInfo = dynamic_pointer_cast<SEQTraversalFlowControlNode>(node);
-            if (recInfo)
-                assert(recInfo->m_sourceNode->GetMBLayout() == node->GetMBLayout());
+        node->BeginForwardProp();
+        node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
+        node->EndForwardProp();
 
-            node->BeginForwardProp();
-            node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
-            node->EndForwardProp();
+        node->BumpEvalTimeStamp();
+    }
+}
 
-            node->BumpEvalTimeStamp();
+static void BackpropNestedNode(const ComputationNodeBasePtr& node, const FrameRange& fr)
+{
+    node->BeginBackprop();
+    node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
+    node->EndBackprop();
+}
+
+// run 'task' on the worker threads, and let the values of all nodes be masked in place again afterwards
+/*static*/ void ComputationNetwork::PARTraversalFlowControlNode::RunConcurrently(const ConcurrentSchedule* schedule, const vector<size_t>& numPredecessors,
+                                                                                const vector<vector<size_t>>& successors, const std::function<void(size_t)>& task)
+{
+    auto endConcurrentValueReading = [schedule]()
+    {
+        for (const auto& nodes : schedule->members)
+        {
+            for (const auto& node : nodes)
+                node->EndConcurrentValueReading();
         }
+    };
+    try
+    {
+        NodeWorkerPool::Get().Run(numPredecessors, successors, task);
     }
+    catch (...)
+    {
+        endConcurrentValueReading();
+        throw;
+    }
+    endConcurrentValueReading();
+}
+
+/*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::ForwardProp(const FrameRange& fr) /*override*/
+{
+#ifdef _DEBUG
+    for (auto& node : m_nestedNodes)
+    {
+        auto recInfo = dynamic_pointer_cast<SEQTraversalFlowControlNode>(node);
+        if (recInfo)
+            assert(recInfo->m_sourceNode->GetMBLayout() == node->GetMBLayout());
+    }
+#endif
+
+    const ConcurrentSchedule* schedule = GetConcurrentSchedule();
+    if (schedule)
+    {
+        // A node masks the gaps of its value when it is done, before its consumers run. Nodes that compute their own
+        // MBLayout thereby also create its validity mask before other nodes use it.
+        CreateColumnsValidityMasks(schedule->layouts);
+        RunConcurrently(schedule, schedule->forwardNumPredecessors, schedule->forwardSuccessors, [&](size_t i)
+                        {
+                            ForwardPropNestedNode(m_nestedNodes[i], fr);
+                            for (const auto& node : schedule->members[i])
+                                node->BeginConcurrentValueReading();
+                        });
+        return;
+    }
+
+    for (auto& node : m_nestedNodes)
+        ForwardPropNestedNode(node, fr);
 }
 
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) /*override*/
 {
     childrenInThisLoop, childrenInOuterLoop; // TODO: think through what these mean when coming from PAR mode
-    // process nodes in pre-determined order
-    for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++) // iterate backwards over evaluation order
-    {
-        auto& node = *pnode;
 
-        node->BeginBackprop();
-        node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
-        node->EndBackprop();
+    const ConcurrentSchedule* schedule = GetConcurrentSchedule();
+    if (schedule)
+    {
+        // the consumers of a value may back-propagate at the same time, so all gaps are masked before
+        CreateColumnsValidityMasks(schedule->layouts);
+        for (const auto& nodes : schedule->members)
+        {
+            for (const auto& node : nodes)
+                node->BeginConcurrentValueReading();
+        }
+        RunConcurrently(schedule, schedule->backwardNumPredecessors, schedule->backwardSuccessors, [&](size_t i)
+                        {
+                            BackpropNestedNode(m_nestedNodes[i], fr);
+                        });
+        return;
     }
+
+    // process nodes in pre-determined order
+    for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++) // iterate backwards over evaluation order
+        BackpropNestedNode(*pnode, fr);
 }
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) /*override*/
 {
@@ -210,12 +526,15 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     // for every time step run through all nodes in this particular loop (treat the loop like a little ComputationNetwork)
     // Note: Currently, this is limited to linear-time loops. But nothing stops the iteration below to, e.g., be a 2D iteration over an image
     // if we implement an according FrameRangeIteration.
-    FrameRangeIteration range(GetMBLayout(), m_steppingDirection);
+    // Parallel sequences that are gaps from some point on to the end of the time step are not computed.
+    auto pMBLayout = GetMBLayout();
+    FrameRangeIteration range(pMBLayout, m_steppingDirection);
     for (auto t = range.begin(); t != range.end(); t++)
     {
+        FrameRange fr = t.WithNumActiveSequences(pMBLayout->GetNumActiveSequences(t.t()));
         for (auto& node : m_nestedNodes)
         {
-            node->ForwardProp(t);
+            node->ForwardProp(fr);
             node->BumpEvalTimeStamp();
         }
     }
@@ -243,10 +562,11 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     FrameRangeIteration range(pMBLayout, m_steppingDirection);
     for (auto t = range.rbegin(); t != range.rend(); t++) // note: reverse iteration
     {
+        FrameRange fr = t.WithNumActiveSequences(pMBLayout->GetNumActiveSequences(t.t())); // (same as in ForwardProp())
         for (auto nodeIter2 = recurrentNodes.rbegin(); nodeIter2 != recurrentNodes.rend(); ++nodeIter2)
         {
             auto& node2 = *nodeIter2;
-            node2->Backprop(t, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/);
+            node2->Backprop(fr, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/);
             // The above flags tell Backprop() to skip back-propagation from inside a node into
             // a node that is outside the loop, which is done later in EndBackprop() in PAR mode.
         }
@@ -428,8 +748,25 @@ void ComputationNetwork::CompileNetwork()
     for (auto& node : m_allRoots)
         ValidateSubNetwork(node);
 
+    // STEP: Move loop-invariant computation out of recurrent loops.
+    // This is optional, see EnableLoopInvariantHoisting(). It modifies the graph, so if anything was moved, the network must be analyzed again from scratch.
+    // This terminates because every pass moves at least one operation out of a loop.
+    if (m_hoistLoopInvariants && HoistLoopInvariantNodes())
+    {
+        InvalidateCompiledNetwork();
+        CompileNetwork();
+        return;
+    }
+
     // STEP: Optimize the network.
-    // :)
+    // This is optional, see EnableGraphOptimization(). Like above, a modified graph must be analyzed again from scratch.
+    // This terminates because every pass that reports a change removes at least one node.
+    if (m_optimizeGraph && OptimizeNetwork())
+    {
+        InvalidateCompiledNetwork();
+        CompileNetwork();
+        return;
+    }
 
     // STEP: Some final details.
     ResetEvalTimeStamps(); // invalidate all m_value fields. Really belongs into StartEvaluateMinibatchLoop()
@@ -710,6 +1047,9 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
     // Due to special topology, if a node is solely induced by parameters, its function value should not be shared
     MarkValueNonSharableNodes();
 
+    // nodes that are executed concurrently must not share matrices
+    m_matrixPool.SetSharingEnabled(!(IsConcurrentNodeExecutionEnabled() && m_deviceId == CPUDEVICE));
+
     bool performingBackPropagation = (trainRootNode != nullptr);
 
     // Create a composite Eval order with the specified nodes as roots
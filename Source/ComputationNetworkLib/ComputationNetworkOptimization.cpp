@@ -0,0 +1,417 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "ComputationNode.h"
+#include "ComputationNetwork.h"
+#include "InputAndParamNodes.h"
+#include "LinearAlgebraNodes.h"
+#include "NonlinearityNodes.h"
+#include "TrainingNodes.h"
+#include <string>
+#include <set>
+#include <map>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// graph optimization
+// -----------------------------------------------------------------------
+
+// This source file contains the optional optimization stage of CompileNetwork(), enabled through EnableGraphOptimization().
+// The passes operate on m_nameToNodeMap and the node inputs only. They rely on dimensions from a prior validation,
+// but leave the compiled structures stale; the caller must invalidate and recompile if anything was changed.
+
+// OptimizeNetwork() -- run all optimization passes once
+// Returns true if the graph was modified.
+bool ComputationNetwork::OptimizeNetwork()
+{
+    size_t numNodesBefore = m_nameToNodeMap.size();
+
+    // constant folding must come first since it evaluates nodes, which requires validated dimensions
+    size_t numFolded = FoldConstantNodes();
+    size_t numFused = FuseElementwiseNodes();
+    size_t numRemoved = EliminateDeadNodes();
+
+    if (numFolded + numFused + numRemoved == 0)
+        return false;
+
+    fprintf(stderr, "\nOptimizeNetwork: %d nodes before, %d nodes after optimization (%d folded into constants, %d fused, %d unreachable nodes removed).\n",
+            (int) numNodesBefore, (int) m_nameToNodeMap.size(), (int) numFolded, (int) numFused, (int) numRemoved);
+
+    if (!m_optimizedGraphDumpPath.empty())
+    {
+        fprintf(stderr, "OptimizeNetwork: Writing optimized network to %ls.\n", m_optimizedGraphDumpPath.c_str());
+        DumpAllNodesToFile(false, m_optimizedGraphDumpPath);
+    }
+    return true;
+}
+
+// replace 'oldNode' by 'newNode' everywhere: as an input of other nodes, in the node groups, and in m_nameToNodeMap
+// 'newNode' must carry the same name as 'oldNode'. 'oldNode' is disconnected from its inputs.
+void ComputationNetwork::ReplaceNodeInNetwork(const ComputationNodeBasePtr& oldNode, const ComputationNodeBasePtr& newNode)
+{
+    assert(oldNode->NodeName() == newNode->NodeName());
+
+    for (auto& iter : m_nameToNodeMap)
+    {
+        const auto& node = iter.second;
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+            if (node->Input(i) == oldNode)
+                node->SetInput(i, newNode);
+    }
+
+    for (auto group : GetAllNodeGroups())
+        for (auto& node : *group)
+            if (node == oldNode)
+                node = newNode;
+
+    m_nameToNodeMap[oldNode->NodeName()] = newNode;
+    oldNode->DetachInputs();
+}
+
+// helper to count how often each node is used as an input
+static map<ComputationNodeBasePtr, size_t> CountConsumers(const map<const wstring, ComputationNodeBasePtr, nocase_compare>& nameToNodeMap)
+{
+    map<ComputationNodeBasePtr, size_t> numConsumers;
+    for (const auto& iter : nameToNodeMap)
+        for (const auto& input : iter.second->GetInputs())
+            if (input)
+                numConsumers[input]++;
+    return numConsumers;
+}
+
+// -----------------------------------------------------------------------
+// constant folding
+// -----------------------------------------------------------------------
+
+// evaluate a constant node (whose inputs have already been evaluated), and create a LearnableParameter of the same name holding the result
+// 'matrixPool' is a pool private to constant folding, see FoldConstantNodes().
+template <class ElemType>
+static ComputationNodeBasePtr EvaluateIntoConstant(const ComputationNodeBasePtr& nodeBase, MatrixPool& matrixPool, bool createConstant)
+{
+    auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(nodeBase);
+
+    node->MarkValueNonSharable(); // this allocates the value matrix outside of the pool; it is only used during folding
+    node->RequestMatricesBeforeForwardProp(matrixPool);
+    node->BeginForwardProp();
+    node->ForwardProp(FrameRange(nullptr));
+    node->EndForwardProp();
+    node->ReleaseMatricesAfterForwardProp(matrixPool); // gives back the temporaries; the value stays since it is not sharable
+
+    if (!createConstant)
+        return nullptr;
+
+    shared_ptr<ComputationNode<ElemType>> constant = make_shared<LearnableParameter<ElemType>>(node->GetDeviceId(), node->NodeName(), node->GetSampleLayout());
+    constant->SetParameterUpdateRequired(false);
+    constant->Value().SetValue(node->Value());
+    return constant;
+}
+
+// FoldConstantNodes() -- precompute subgraphs that depend only on frozen LearnableParameters
+// The outermost folded nodes are replaced by LearnableParameters (without gradient) of the same name.
+// Nodes inside a folded subgraph become unreachable and are removed by EliminateDeadNodes().
+// Returns the number of nodes replaced by constants.
+size_t ComputationNetwork::FoldConstantNodes()
+{
+    set<ComputationNodeBasePtr> constantNodes;
+    list<ComputationNodeBasePtr> foldedNodes; // in evaluation order
+    for (const auto& node : GetEvalOrder(nullptr))
+    {
+        bool isConstant;
+        if (node->IsLeaf())
+            isConstant = node->OperationName() == OperationNameOf(LearnableParameter) && (m_freezeParametersForOptimization || !node->IsParameterUpdateRequired());
+        else
+        {
+            // nodes with an MBLayout depend on the minibatch; PreCompute and Dropout nodes must not be evaluated ahead of time
+            isConstant = !node->HasMBLayout() && !node->RequiresPreCompute() && node->OperationName() != OperationNameOf(DropoutNode);
+            for (const auto& input : node->GetInputs())
+                isConstant &= constantNodes.find(input) != constantNodes.end();
+        }
+        if (!isConstant)
+            continue;
+        constantNodes.insert(node);
+        if (!node->IsLeaf())
+            foldedNodes.push_back(node);
+    }
+    if (foldedNodes.empty())
+        return 0;
+
+    // a folded node needs to be materialized if it is used by a non-folded node or is a member of a node group
+    set<ComputationNodeBasePtr> materialize;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& node = iter.second;
+        bool isFolded = !node->IsLeaf() && constantNodes.find(node) != constantNodes.end();
+        if (!isFolded)
+            for (const auto& input : node->GetInputs())
+                if (input && !input->IsLeaf() && constantNodes.find(input) != constantNodes.end())
+                    materialize.insert(input);
+    }
+    for (auto group : GetAllNodeGroups())
+        for (const auto& node : *group)
+            if (!node->IsLeaf() && constantNodes.find(node) != constantNodes.end())
+                materialize.insert(node);
+
+    // evaluate in order, and create the constants
+    // The temporaries of the folded nodes come from a pool of their own, which is gone when we return. The network's pool
+    // thus hands nothing out to nodes that are about to be removed, and the folded nodes' memory is freed together with them.
+    MatrixPool foldingPool;
+    vector<pair<ComputationNodeBasePtr, ComputationNodeBasePtr>> replacements;
+    for (const auto& node : foldedNodes)
+    {
+        bool createConstant = materialize.find(node) != materialize.end();
+        ComputationNodeBasePtr constant;
+        if (dynamic_pointer_cast<ComputationNode<float>>(node))
+            constant = EvaluateIntoConstant<float>(node, foldingPool, createConstant);
+        else if (dynamic_pointer_cast<ComputationNode<double>>(node))
+            constant = EvaluateIntoConstant<double>(node, foldingPool, createConstant);
+        else
+            LogicError("FoldConstantNodes: Unexpected element type of node %ls %ls operation.", node->NodeName().c_str(), node->OperationName().c_str());
+        if (constant)
+            replacements.push_back(make_pair(node, constant));
+    }
+
+    for (const auto& replacement : replacements)
+    {
+        fprintf(stderr, "FoldConstantNodes: Replacing %ls %ls operation by a constant.\n", replacement.first->NodeName().c_str(), replacement.first->OperationName().c_str());
+        ReplaceNodeInNetwork(replacement.first, replacement.second);
+    }
+    return replacements.size();
+}
+
+// -----------------------------------------------------------------------
+// fusion of elementwise operations
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+static ComputationNodeBasePtr NewPlusNonlinearityNode(const wstring& nonlinearity, DEVICEID_TYPE deviceId, const wstring& name)
+{
+    if (nonlinearity == OperationNameOf(SigmoidNode))
+        return New<PlusSigmoidNode<ElemType>>(deviceId, name);
+    else if (nonlinearity == OperationNameOf(TanhNode))
+        return New<PlusTanhNode<ElemType>>(deviceId, name);
+    else if (nonlinearity == OperationNameOf(RectifiedLinearNode))
+        return New<PlusRectifiedLinearNode<ElemType>>(deviceId, name);
+    else
+        return nullptr;
+}
+
+// FuseElementwiseNodes() -- replace chains of elementwise operations by fused nodes
+// Currently this fuses Sigmoid/Tanh/RectifiedLinear(Plus(a, b)), which typically follows the bias addition of a layer,
+// into a single node that writes its output in one pass. The Plus node must not be used anywhere else.
+// Returns the number of fused nodes.
+size_t ComputationNetwork::FuseElementwiseNodes()
+{
+    auto numConsumers = CountConsumers(m_nameToNodeMap);
+
+    set<ComputationNodeBasePtr> groupMembers;
+    for (auto group : GetAllNodeGroups())
+        groupMembers.insert(group->begin(), group->end());
+
+    vector<ComputationNodeBasePtr> candidates;
+    for (const auto& iter : m_nameToNodeMap)
+        candidates.push_back(iter.second);
+
+    size_t numFused = 0;
+    for (const auto& node : candidates)
+    {
+        if (node->GetNumInputs() != 1)
+            continue;
+        auto sum = node->Input(0); // (copy, since 'node' gets disconnected below)
+        if (sum->OperationName() != OperationNameOf(PlusNode) || numConsumers[sum] != 1 || groupMembers.find(sum) != groupMembers.end())
+            continue;
+
+        ComputationNodeBasePtr fused;
+        if (dynamic_pointer_cast<ComputationNode<float>>(node))
+            fused = NewPlusNonlinearityNode<float>(node->OperationName(), node->GetDeviceId(), node->NodeName());
+        else if (dynamic_pointer_cast<ComputationNode<double>>(node))
+            fused = NewPlusNonlinearityNode<double>(node->OperationName(), node->GetDeviceId(), node->NodeName());
+        if (!fused)
+            continue;
+
+        fprintf(stderr, "FuseElementwiseNodes: Fusing %ls %ls operation with its input %ls %ls operation into %ls.\n",
+                node->NodeName().c_str(), node->OperationName().c_str(), sum->NodeName().c_str(), sum->OperationName().c_str(), fused->OperationName().c_str());
+
+        auto inputs = sum->GetInputs();
+        ReplaceNodeInNetwork(node, fused);
+        fused->AttachInputs(inputs);
+
+        sum->DetachInputs();
+        m_nameToNodeMap.erase(sum->NodeName());
+        numFused++;
+    }
+    return numFused;
+}
+
+// -----------------------------------------------------------------------
+// dead-node elimination
+// -----------------------------------------------------------------------
+
+// EliminateDeadNodes() -- remove all nodes that cannot be reached from any node group (criteria, outputs, inputs, etc.)
+// or from the nodes requested in EnableGraphOptimization().
+// Networks without any of these are left alone since then there is no notion of what is requested.
+// Returns the number of removed nodes.
+size_t ComputationNetwork::EliminateDeadNodes()
+{
+    vector<ComputationNodeBasePtr> requestedNodes;
+    for (auto group : GetAllNodeGroups())
+        requestedNodes.insert(requestedNodes.end(), group->begin(), group->end());
+    for (const auto& nodeName : m_requestedNodeNamesForOptimization)
+        if (NodeNameExists(nodeName))
+            requestedNodes.push_back(GetNodeFromName(nodeName));
+    if (requestedNodes.empty())
+        return 0;
+
+    auto reachableList = ComputationNodeBase::EnumerateNodes(requestedNodes);
+    set<ComputationNodeBasePtr> reachable(reachableList.begin(), reachableList.end());
+
+    vector<ComputationNodeBasePtr> deadNodes;
+    for (const auto& iter : m_nameToNodeMap)
+        if (reachable.find(iter.second) == reachable.end())
+            deadNodes.push_back(iter.second);
+
+    for (const auto& node : deadNodes)
+    {
+        fprintf(stderr, "EliminateDeadNodes: Removing unreachable node %ls %ls operation.\n", node->NodeName().c_str(), node->OperationName().c_str());
+        node->DetachInputs(); // break circular references in loops
+        m_nameToNodeMap.erase(node->NodeName());
+    }
+    return deadNodes.size();
+}
+
+// -----------------------------------------------------------------------
+// post-training quantization
+// -----------------------------------------------------------------------
+
+// start or stop recording the data input ranges of all quantizable nodes; starting resets the ranges
+void ComputationNetwork::SetQuantizationCalibration(bool enable)
+{
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        auto node = dynamic_pointer_cast<QuantizableNode>(iter.second);
+        if (node)
+            node->SetQuantizationCalibration(enable);
+    }
+}
+
+// QuantizeForInference() -- switch the weight products of all quantizable nodes to int8, using the calibrated input ranges
+// The weights are frozen since their int8 copies are not updated by training. Nodes whose weights are not LearnableParameters
+// or are not on the CPU remain in float. Nodes that were never calibrated determine the input range from the data at every call.
+// Returns the number of quantized nodes.
+size_t ComputationNetwork::QuantizeForInference()
+{
+    size_t numQuantizable = 0, numQuantized = 0;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        auto node = dynamic_pointer_cast<QuantizableNode>(iter.second);
+        if (!node)
+            continue;
+        numQuantizable++;
+        const auto& weights = iter.second->Input(0);
+        if (weights->OperationName() != OperationNameOf(LearnableParameter))
+            continue;
+        weights->SetParameterUpdateRequired(false);
+        if (node->QuantizeWeights())
+        {
+            fprintf(stderr, "QuantizeForInference: %ls %ls operation uses int8 weights, input range %.6g.\n",
+                    iter.second->NodeName().c_str(), iter.second->OperationName().c_str(), node->GetCalibratedInputRange());
+            numQuantized++;
+        }
+    }
+    fprintf(stderr, "QuantizeForInference: %d out of %d weight products quantized.\n", (int) numQuantized, (int) numQuantizable);
+    return numQuantized;
+}
+
+// revert all quantizable nodes to float (the weights remain frozen)
+void ComputationNetwork::ReleaseQuantization()
+{
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        auto node = dynamic_pointer_cast<QuantizableNode>(iter.second);
+        if (node)
+            node->ReleaseQuantizedWeights();
+    }
+}
+
+// PrepareFrozenWeights() -- make the packed copies of frozen weights that the weight products below 'rootNode' multiply with
+// This is done here, before evaluation, rather than in ForwardProp(), so that nodes evaluated concurrently only read their weights.
+// Copies that are still valid are kept, so calling this before every minibatch is cheap.
+void ComputationNetwork::PrepareFrozenWeights(const ComputationNodeBasePtr& rootNode)
+{
+    for (const auto& node : GetEvalOrder(rootNode))
+    {
+        auto quantizable = dynamic_pointer_cast<QuantizableNode>(node);
+        if (quantizable)
+            quantizable->PrepareFrozenWeights();
+    }
+}
+
+// PrepareForInference() -- freeze all LearnableParameters of a model loaded for evaluation, and optionally quantize its weight products
+// Models are saved with the parameters that were trained marked as such; without this the weight products would not use any copies.
+// The copies are made here already, so that networks that share the parameters (see CopySharingParameters()) only read them.
+void ComputationNetwork::PrepareForInference(const wstring& quantizationRangesPath)
+{
+    SetLearnableNodesBelowNeedGradient(false);
+    if (!quantizationRangesPath.empty())
+    {
+        LoadQuantizationRanges(quantizationRangesPath);
+        QuantizeForInference();
+    }
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        auto node = dynamic_pointer_cast<QuantizableNode>(iter.second);
+        if (node && iter.second->Input(0)->OperationName() == OperationNameOf(LearnableParameter))
+            node->PrepareFrozenWeights();
+    }
+}
+
+// save the calibrated input ranges of all quantizable nodes by node name
+void ComputationNetwork::SaveQuantizationRanges(const wstring& fileName) const
+{
+    map<wstring, double> ranges;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        auto node = dynamic_pointer_cast<QuantizableNode>(iter.second);
+        if (node)
+            ranges[iter.first] = node->GetCalibratedInputRange();
+    }
+
+    File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+    fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BQuantizationRanges");
+    fstream << (uint64_t) ranges.size();
+    for (const auto& iter : ranges)
+        fstream << iter.first << iter.second;
+    fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EQuantizationRanges");
+}
+
+// load input ranges saved by SaveQuantizationRanges(), e.g. before QuantizeForInference() when serving
+// Ranges of nodes that do not exist (anymore) are ignored.
+void ComputationNetwork::LoadQuantizationRanges(const wstring& fileName)
+{
+    File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BQuantizationRanges");
+    uint64_t numRanges;
+    fstream >> numRanges;
+    for (uint64_t i = 0; i < numRanges; i++)
+    {
+        wstring nodeName;
+        double range;
+        fstream >> nodeName >> range;
+        auto iter = m_nameToNodeMap.find(nodeName);
+        auto node = iter != m_nameToNodeMap.end() ? dynamic_pointer_cast<QuantizableNode>(iter->second) : nullptr;
+        if (node)
+            node->SetCalibratedInputRange(range);
+        else
+            fprintf(stderr, "LoadQuantizationRanges: Ignoring range of %ls, which is not a quantizable node in this network.\n", nodeName.c_str());
+    }
+    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EQuantizationRanges");
+}
+
+} } }
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <assert.h>
 #include <atomic>
+#include <mutex>
 
 #define DEFAULT_HIDDEN_ACTIVATION 0.1
 
@@ -681,6 +682,10 @@ public:
     virtual void MaskMissingGradientColumnsToZero(const FrameRange&) = 0;
     virtual void InvalidateMissingValueColumns(const FrameRange&) = 0;
     virtual void InvalidateMissingGradientColumns(const FrameRange&) = 0;
+    // While several nodes may read the value at the same time (see PARTraversalFlowControlNode), its gaps are masked once
+    // up front, and MaskMissingValueColumnsToZero() does not write it.
+    virtual void BeginConcurrentValueReading() = 0;
+    virtual void EndConcurrentValueReading() = 0;
 
     virtual void ZeroGradientsOfInputs() = 0;
 
@@ -880,7 +885,7 @@ public:
     // public constructor
     // Note: use the New<> helper function that is declared next, which gives you the convenience of returning a shared_ptr
     ComputationNode(DEVICEID_TYPE deviceId, const wstring& name)
-        : ComputationNodeBase(deviceId, name)
+        : ComputationNodeBase(deviceId, name), m_valueGapsMasked(false)
     {
     }
 
@@ -903,9 +908,9 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = UpCast(nodeP);
-            *node->m_value = *m_value;
+            CopyMatrixIfAllocated(m_value, node->m_value);
             if (m_gradient)
-                *node->m_gradient = *m_gradient;
+                CopyMatrixIfAllocated(m_gradient, node->m_gradient);
             else
                 node->m_gradient = nullptr;
         }
@@ -916,7 +921,7 @@ public:
     {
         const std::wstring& name = (newName == L"") ? NodeName() : newName;
         ComputationNodeBasePtr node(NewThis(m_deviceId, name)); // NewThis() is a virtual function that creates a new node of the actual type of 'this'
-        node->CopyTo(shared_from_this(), newName, flags);       // note: shared_from_this() is the base class, but CopyTo() up-casts it as needed
+        CopyTo(node, name, flags);                              // note: CopyTo() up-casts 'node' as needed
         return node;
     }
 
@@ -1063,6 +1068,8 @@ public:
 
     void /*ComputationNodeBase::*/ MaskMissingValueColumnsToZero(const FrameRange& fr) override final
     {
+        if (m_valueGapsMasked) // (all gaps are zero already, see BeginConcurrentValueReading())
+            return;
         // fprintf(stderr, "%ls %ls m_value ", NodeName().c_str(), OperationName().c_str());
         MaskMissingColumnsToZero(*m_value, m_pMBLayout, fr);
     }
@@ -1072,6 +1079,20 @@ public:
         MaskMissingColumnsToZero(*m_gradient, m_pMBLayout, fr);
     }
 
+    void /*ComputationNodeBase::*/ BeginConcurrentValueReading() override final
+    {
+        m_valueGapsMasked = false;
+        if (m_value && m_value->GetMatrixType() == DENSE) // (sparse matrices cannot be masked)
+        {
+            MaskMissingValueColumnsToZero(FrameRange(m_pMBLayout));
+            m_valueGapsMasked = true;
+        }
+    }
+    void /*ComputationNodeBase::*/ EndConcurrentValueReading() override final
+    {
+        m_valueGapsMasked = false;
+    }
+
     // for debugging, set the gaps to NaN instead (to track whether it bubbles up somewhere)
     void InvalidateMissingValueColumns(const FrameRange& fr) override final
     {
@@ -1406,6 +1427,13 @@ public:
         CreateMatrixIfNull(m_gradient);
     }
 
+    // replace the gradient, which may come from the matrix pool and thus be used by other nodes at other times,
+    // by a copy that belongs to this node alone, e.g. to make it a view into a buffer that outlives the minibatch
+    void MakeGradientMatrixPrivate()
+    {
+        m_gradient = make_shared<Matrix<ElemType>>(*m_gradient, m_deviceId);
+    }
+
     void MarkValueNonSharable() override
     {
         m_valueSharable = false;
@@ -1423,6 +1451,17 @@ protected:
             matrixPtr = make_shared<Matrix<ElemType>>(m_deviceId);
     }
 
+    // for CopyTo(): deep-copy a matrix of this node into the same matrix of the copy
+    // Matrices that are requested from the matrix pool do not exist before the network is prepared for computation; those are not copied.
+    void CopyMatrixIfAllocated(const shared_ptr<Matrix<ElemType>>& from, shared_ptr<Matrix<ElemType>>& to) const
+    {
+        if (!from)
+            return;
+        if (!to)
+            to = make_shared<Matrix<ElemType>>(m_deviceId);
+        *to = *from;
+    }
+
     void RequestMatrixFromPool(shared_ptr<Matrix<ElemType>>& matrixPtr, MatrixPool& matrixPool)
     {
         if (matrixPtr == nullptr)
@@ -1520,13 +1559,15 @@ public:
         }
     }
 
-    // NOTE: we should reimplement this to be thread-safe and use a larger than requested initialized memory block
+    // NOTE: we should reimplement this to use a larger than requested initialized memory block
     // we can then just wrap that memory block in a matrix of the correct dimensions since it will be const no one can change it
     // should only need one memory block per device
-    // Thread-safety could be achieved by changing this to a shared_ptr.
+    // The lookup is locked, since nodes may run concurrently (see PARTraversalFlowControlNode). A returned matrix is not modified
+    // afterwards, unless it is requested for another device, which concurrent execution (CPU only) does not do.
     // When using the TensorView interface, one could instead just use a 1x1 matrix with a view that broadcasts its columns (stride 0).
     static const Matrix<ElemType>& ConstOnes(const size_t rows, const size_t cols, const DEVICEID_TYPE deviceId)
     {
+        std::lock_guard<std::mutex> lock(s_constOnesMutex);
         if (s_constOnes.find(rows) == s_constOnes.end() ||
             s_constOnes[rows].find(cols) == s_constOnes[rows].end()) // not found
         {
@@ -1548,8 +1589,10 @@ public:
 protected:
 
     shared_ptr<Matrix<ElemType>> m_value, m_gradient;
+    bool m_valueGapsMasked; // between Begin- and EndConcurrentValueReading()
 
     static std::map<size_t, std::map<size_t, Matrix<ElemType>*>> s_constOnes;
+    static std::mutex s_constOnesMutex;
 };
 
 // convenience wrapper for ComputationNode::New()
@@ -1632,6 +1675,8 @@ public:
     virtual void MaskMissingGradientColumnsToZero(const Microsoft::MSR::CNTK::FrameRange&) override { NOT_IMPLEMENTED; }
     virtual void InvalidateMissingValueColumns(const Microsoft::MSR::CNTK::FrameRange&) override { NOT_IMPLEMENTED; }
     virtual void InvalidateMissingGradientColumns(const Microsoft::MSR::CNTK::FrameRange&) override { NOT_IMPLEMENTED; }
+    virtual void BeginConcurrentValueReading() override { NOT_IMPLEMENTED; }
+    virtual void EndConcurrentValueReading() override { NOT_IMPLEMENTED; }
     virtual void NotifyFunctionValuesMBSizeModified(void) override { NOT_IMPLEMENTED; }
     virtual std::wstring ToString(void) const override { NOT_IMPLEMENTED; }
     // these are meant to be called during computation, so provide dummy implementations
@@ -1682,6 +1727,72 @@ public:
 
 struct IRecurrentNode { virtual int GetRecurrenceSteppingDirection() const = 0; };
 
+// =======================================================================
+// QuantizableNode -- helper base class for ComputationNodes that multiply a weight
+// matrix with their data input, and can do so with an int8 copy of the weights at inference
+// =======================================================================
+
+// Quantization is post-training: run the float network over a sample set with calibration enabled to record the
+// largest absolute value seen at the data input, then call QuantizeWeights(). See ComputationNetwork::QuantizeForInference().
+// Frozen weights that are not quantized may be pre-packed for the GEMM instead, see PrepareFrozenWeights().
+class QuantizableNode
+{
+public:
+    void SetQuantizationCalibration(bool enable)
+    {
+        if (enable && !m_calibrating)
+            m_calibratedInputRange = 0;
+        m_calibrating = enable;
+    }
+    double GetCalibratedInputRange() const { return m_calibratedInputRange; }
+    void SetCalibratedInputRange(double range) { m_calibratedInputRange = range; }
+    bool IsQuantized() const { return m_quantized; }
+
+    // returns false if the weights cannot be quantized, e.g. because they are not on the CPU
+    virtual bool QuantizeWeights() = 0;
+    virtual void ReleaseQuantizedWeights() = 0;
+
+    // make the (packed or int8) copy of frozen weights that ForwardProp() multiplies with, or drop it if the weights are being trained
+    // This is called by ComputationNetwork::StartEvaluateMinibatchLoop() and never from ForwardProp(), so that nodes that are
+    // evaluated concurrently only read the weights. A copy goes stale with the next write to the weights and is then not used.
+    virtual void PrepareFrozenWeights() = 0;
+
+protected:
+    QuantizableNode()
+        : m_calibrating(false), m_calibratedInputRange(0), m_quantized(false)
+    {
+    }
+    // record the largest absolute value of 'input', the data input for 'fr' with layout 'pMBLayout'
+    // Gaps hold arbitrary values, so they are set to zero in a copy; the input itself is left alone since other nodes read it.
+    template <class ElemType>
+    void CalibrateInputRange(const Matrix<ElemType>& input, const MBLayoutPtr& pMBLayout, const FrameRange& fr)
+    {
+        if (!m_calibrating || input.IsEmpty())
+            return;
+        if (pMBLayout && pMBLayout->HasGaps(fr))
+        {
+            Matrix<ElemType> masked(input.GetDeviceId());
+            masked.SetValue(input);
+            masked.MaskColumnsValue(DataWithMBLayoutFor(pMBLayout->GetColumnsValidityMask(masked.GetDeviceId()), fr, pMBLayout), 0);
+            m_calibratedInputRange = max(m_calibratedInputRange, (double) masked.MatrixNormInf());
+        }
+        else
+            m_calibratedInputRange = max(m_calibratedInputRange, (double) input.MatrixNormInf());
+    }
+
+    // for CopyTo(): the copy multiplies with the same kind of copy of its weights
+    void CopyQuantizationTo(QuantizableNode& node) const
+    {
+        node.m_calibrating = m_calibrating;
+        node.m_calibratedInputRange = m_calibratedInputRange;
+        node.m_quantized = m_quantized;
+    }
+
+    bool m_calibrating;
+    double m_calibratedInputRange; // 0 means the range is determined from the data at every call
+    bool m_quantized;
+};
+
 // =======================================================================
 // helper macro to ease access to base members in presence of C++ two-phase name lookup
 // =======================================================================
@@ -1700,6 +1811,7 @@ protected:
     typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;                                                                                    \
     using Base::BackpropTo;                                                                                                                              \
     using Base::ConstOnes;                                                                                                                               \
+    using Base::CopyMatrixIfAllocated;                                                                                                                   \
     using Base::CopyTo;                                                                                                                                  \
     using Base::CreateMatrixIfNull;                                                                                                                      \
     using Base::CreateUniqId;                                                                                                                            \
@@ -56,7 +56,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 //     - for hidden layer: dimension of activation vector for each pixel
 //  - C' = output channels = dimension of activation vector for each pixel (also called N by NVidia, inconsistently)
 template <class ElemType>
-class ConvolutionNode : public ComputationNode<ElemType>, public NumInputs<2>
+class ConvolutionNode : public ComputationNode<ElemType>, public NumInputs<2>, public QuantizableNode
 {
     typedef ComputationNode<ElemType> Base;
     UsingComputationNodeMembersBoilerplate;
@@ -132,6 +132,7 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<ConvolutionNode<ElemType>>(nodeP);
+            node->m_outputChannels = m_outputChannels;
             node->m_kernelWidth = m_kernelWidth;
             node->m_kernelHeight = m_kernelHeight;
 
@@ -143,8 +144,10 @@ public:
             node->m_maxTempMemSizeInSamples = m_maxTempMemSizeInSamples;
 
             node->m_imageLayoutKind = m_imageLayoutKind;
+            node->m_factory = ConvolutionEngineFactory<ElemType>::Create(GetDeviceId(), ConvolutionEngineFactory<ElemType>::EngineType::Auto, m_imageLayoutKind);
 
-            *node->m_tempMatrix = *m_tempMatrix;
+            CopyMatrixIfAllocated(m_tempMatrix, node->m_tempMatrix);
+            CopyQuantizationTo(*node);
         }
     }
 
@@ -179,10 +182,15 @@ public:
 
     void ForwardProp(const FrameRange& fr) override
     {
-        const Matrix<ElemType>& input0 = Input(0)->ValueAsMatrix();
+        Matrix<ElemType>& input0 = Input(0)->ValueAsMatrix();
         Matrix<ElemType> sliceInput1Value = Input(1)->ValueFor(fr);
         Matrix<ElemType> sliceOutputValue = ValueFor(fr);
 
+        if (m_calibrating && sliceInput1Value.GetMatrixType() == DENSE)
+            CalibrateInputRange(sliceInput1Value, Input(1)->GetMBLayout(), fr);
+        // The CPU engine multiplies the filters with the unrolled input, so it picks up an int8 copy of the filters (see PrepareFrozenWeights()).
+        // The unrolled input holds the same values as the input, plus zero padding, so the calibrated range applies.
+
         // update the tensor dimension w.r.t. number of samples
         size_t batchSize = sliceInput1Value.GetNumCols();
         m_inT->setN(batchSize);
@@ -198,6 +206,31 @@ public:
 #endif
     }
 
+    // use an int8 copy of the (frozen) filters in ForwardProp()
+    bool /*QuantizableNode::*/ QuantizeWeights() override
+    {
+        if (Input(0)->OperationName() != OperationNameOf(LearnableParameter) || Input(0)->IsParameterUpdateRequired())
+            LogicError("%ls %ls operation: Only frozen LearnableParameters can be quantized.", NodeName().c_str(), OperationName().c_str());
+        m_quantized = Input(0)->ValueAsMatrix().QuantizeForMultiply(false, (ElemType) m_calibratedInputRange);
+        return m_quantized;
+    }
+
+    void /*QuantizableNode::*/ ReleaseQuantizedWeights() override
+    {
+        m_quantized = false;
+        Input(0)->ValueAsMatrix().ReleaseQuantizedCopy();
+    }
+
+    // the int8 copy is made again if writing to the filters dropped it; the convolution engines do not use packed filters
+    void /*QuantizableNode::*/ PrepareFrozenWeights() override
+    {
+        auto& input0 = Input(0)->ValueAsMatrix();
+        if (m_quantized && !Input(0)->IsParameterUpdateRequired())
+            input0.QuantizeForMultiply(false, (ElemType) m_calibratedInputRange); // no-op if still valid
+        else
+            input0.ReleaseQuantizedCopy();
+    }
+
     // BUGBUG: Should not be here. Use PlusNode and m_sampleLayout.  TODO: Bad naming:'output' is actually an 'input'
     void AddBias(const Matrix<ElemType>& output, const Matrix<ElemType>& bias, Matrix<ElemType>& dst)
     {
@@ -402,6 +435,7 @@ public:
             node->m_outputSizePerSample = m_outputSizePerSample;
 
             node->m_imageLayoutKind = m_imageLayoutKind;
+            node->m_factory = ConvolutionEngineFactory<ElemType>::Create(GetDeviceId(), ConvolutionEngineFactory<ElemType>::EngineType::Auto, m_imageLayoutKind);
         }
     }
 
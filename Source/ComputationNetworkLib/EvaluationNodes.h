@@ -100,9 +100,9 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<ErrorPredictionNode<ElemType>>(nodeP);
-            *node->m_maxIndexes0 = *m_maxIndexes0;
-            *node->m_maxIndexes1 = *m_maxIndexes1;
-            *node->m_maxValues = *m_maxValues;
+            CopyMatrixIfAllocated(m_maxIndexes0, node->m_maxIndexes0);
+            CopyMatrixIfAllocated(m_maxIndexes1, node->m_maxIndexes1);
+            CopyMatrixIfAllocated(m_maxValues, node->m_maxValues);
         }
     }
     // request matrices needed to do node function value evaluation
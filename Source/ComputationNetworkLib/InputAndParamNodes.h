@@ -9,6 +9,7 @@
 #include "ScriptableObjects.h"
 #include "Matrix.h"
 #include "File.h" // for LoadMatrixFromTextFile()
+#include "MappedFile.h"
 
 #include <unordered_set>
 #include <map>
@@ -89,15 +90,30 @@ public:
     }
 
     virtual void Save(File& fstream) const override
+    {
+        SaveWithoutValue(fstream);
+        fstream << Value();
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        TensorShape sampleLayout = LoadWithoutValue(fstream, modelVersion);
+        LoadValue(fstream);
+        SetDims(sampleLayout, false); // note: call this after LoadValue() since LoadValue() overwrites m_sampleLayout
+        VerifyDataSize(Value());      // sanity check
+    }
+
+    // the mapped model format (see ComputationNetwork::SaveMapped()) stores the value separately from the rest of the node
+    void SaveWithoutValue(File& fstream) const
     {
         Base::Save(fstream);
         fstream << m_parameterUpdateRequired;
         fstream << (size_t) 0 /*#rows in a legacy file format*/ << (size_t) 0 /*#cols in a legacy file format*/;
         m_sampleLayout.Save(fstream);
-        fstream << Value();
     }
 
-    virtual void Load(File& fstream, size_t modelVersion) override
+    // returns the sample layout, which must be set once the value has been loaded
+    TensorShape LoadWithoutValue(File& fstream, size_t modelVersion)
     {
         Base::Load(fstream, modelVersion);
 
@@ -114,9 +130,39 @@ public:
             if (cols > 1) // in some legacy format, last tensor dimension was split off as an explicit column dimension
                 sampleLayout.AppendInPlace(sampleLayout.GetRank(), cols);
         }
-        LoadValue(fstream);
-        SetDims(sampleLayout, false); // note: call this after LoadValue() since LoadValue() overwrites m_sampleLayout
-        VerifyDataSize(Value());      // sanity check
+        return sampleLayout;
+    }
+
+    // set the value from a memory-mapped model file
+    // On the CPU, if 'mapping' is given, the value points into it (the pages are copy-on-write, so training works) and keeps it alive.
+    // Otherwise the data is copied (into the current mapping if the value already points into one).
+    void SetMappedValue(const TensorShape& sampleLayout, size_t rows, size_t cols, ElemType* data, const shared_ptr<MappedFile>& mapping)
+    {
+        CreateMatrixIfNull(m_value);
+        if (mapping && Value().GetDeviceId() == CPUDEVICE)
+        {
+            Value().SetValue(rows, cols, CPUDEVICE, data, matrixFlagDontOwnBuffer);
+            m_valueMapping = mapping;
+        }
+        else
+        {
+            Value().SetValue(rows, cols, Value().GetDeviceId(), data, matrixFlagNormal);
+        }
+        SetDims(sampleLayout, false);
+        VerifyDataSize(Value()); // sanity check
+    }
+
+    // use the value matrix of 'other' (the same parameter in another network), and keep 'other' alive
+    // The matrix is shared together with the packed or int8 copies that the weight products make of it (see CPUMatrix::PackForMultiply()).
+    // The value must then be treated as read-only, since it is shared. See ComputationNetwork::ShareParametersWith().
+    void ShareValueWith(const shared_ptr<LearnableParameter<ElemType>>& other)
+    {
+        if (other->Value().GetDeviceId() != m_deviceId)
+            LogicError("ShareValueWith: The value of %ls can only be shared on the same device.", NodeName().c_str());
+        m_value = other->m_value;
+        m_valueMapping = nullptr;
+        m_valueOwner = other;
+        SetDims(other->GetSampleLayout(), false);
     }
 
     // initialize with random numbers
@@ -208,6 +254,10 @@ public:
 
         PrintNodeValuesToFile(printValues, fstream);
     }
+
+private:
+    shared_ptr<MappedFile> m_valueMapping; // model file that Value() points into, see SetMappedValue()
+    ComputationNodeBasePtr m_valueOwner;   // parameter whose value matrix this one uses, see ShareValueWith()
 };
 
 // -----------------------------------------------------------------------
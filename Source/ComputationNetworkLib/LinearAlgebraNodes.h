@@ -6,6 +6,7 @@
 
 #include "Basics.h"
 #include "ComputationNode.h"
+#include "InputAndParamNodes.h"
 #include "ConvolutionalNodes.h"
 #include "Matrix.h"
 #include "TensorView.h"
@@ -182,7 +183,7 @@ template class NegateNode<double>;
 // -----------------------------------------------------------------------
 
 template <class ElemType, bool m_transpose>
-class TimesNodeBase : public ComputationNode<ElemType>, public NumInputs<2>
+class TimesNodeBase : public ComputationNode<ElemType>, public NumInputs<2>, public QuantizableNode
 {
     typedef ComputationNode<ElemType> Base;
     UsingComputationNodeMembers;
@@ -236,6 +237,9 @@ public:
 #if DUMPOUTPUT
         Input(0)->ValueAsMatrix().Print("TimesNode - Input0");
 #endif
+        if (m_calibrating && sliceInput1Value.GetMatrixType() == DENSE)
+            CalibrateInputRange(sliceInput1Value, Input(1)->GetMBLayout(), fr);
+        // The product picks up the int8 or packed copy of frozen weights (see PrepareFrozenWeights()) if it is still valid.
         // BUGBUG: This uses correct Matrix dimensions when multiplying with a non-minibatch only by luck. To be fixed when we allow to apply TimesNode to a subset of tensor dimensions.
         sliceOutputValue.AssignProductOf(Input(0)->ValueAsMatrix(), m_transpose, sliceInput1Value, false);
 #if NANCHECK
@@ -287,6 +291,44 @@ public:
             InvalidArgument("The inner matrix dimension in the %ls Times operation does not match (%d vs. %d).", NodeName().c_str(), (int) rows1, (int) cols0);
     }
 
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+            CopyQuantizationTo(*dynamic_pointer_cast<TimesNodeBase<ElemType, m_transpose>>(nodeP));
+    }
+
+    // use an int8 copy of the (frozen) weights in ForwardProp()
+    virtual bool /*QuantizableNode::*/ QuantizeWeights() override
+    {
+        if (Input(0)->OperationName() != OperationNameOf(LearnableParameter) || Input(0)->IsParameterUpdateRequired())
+            LogicError("%ls %ls operation: Only frozen LearnableParameters can be quantized.", NodeName().c_str(), Base::OperationName().c_str());
+        m_quantized = Input(0)->ValueAsMatrix().QuantizeForMultiply(m_transpose, (ElemType) m_calibratedInputRange);
+        return m_quantized;
+    }
+
+    virtual void /*QuantizableNode::*/ ReleaseQuantizedWeights() override
+    {
+        m_quantized = false;
+        Input(0)->ValueAsMatrix().ReleaseQuantizedCopy();
+    }
+
+    // Parameters that are not updated (e.g. at inference) are quantized or packed once for the GEMM and reused across minibatches.
+    // A copy that was dropped because the weights were written to is made again here. Weights that are trained have no copy.
+    virtual void /*QuantizableNode::*/ PrepareFrozenWeights() override
+    {
+        auto& input0Value = Input(0)->ValueAsMatrix();
+        bool isFrozen = Input(0)->OperationName() == OperationNameOf(LearnableParameter) && !Input(0)->IsParameterUpdateRequired();
+        if (isFrozen && m_quantized)
+            input0Value.QuantizeForMultiply(m_transpose, (ElemType) m_calibratedInputRange); // no-op if still valid
+        else
+            input0Value.ReleaseQuantizedCopy();
+        if (isFrozen && !m_quantized)
+            input0Value.PackForMultiply(m_transpose);
+        else
+            input0Value.ReleasePackedCopy();
+    }
+
     virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) override
     {
         // this is a special handling case. We need to allocate sparse matrix directly instead of from pool.
@@ -509,8 +551,8 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<DiagTimesNode<ElemType>>(nodeP);
-            *node->m_innerproduct = *m_innerproduct;
-            *node->m_rightGradient = *m_rightGradient;
+            CopyMatrixIfAllocated(m_innerproduct, node->m_innerproduct);
+            CopyMatrixIfAllocated(m_rightGradient, node->m_rightGradient);
         }
     }
     // request matrices that are needed for gradient computation
@@ -835,11 +877,11 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<CosDistanceNode<ElemType>>(nodeP);
-            *node->m_invNorm0 = *m_invNorm0;
-            *node->m_invNorm1 = *m_invNorm1;
-            *node->m_leftTerm = *m_leftTerm;
-            *node->m_rightTerm = *m_rightTerm;
-            *node->m_temp = *m_temp;
+            CopyMatrixIfAllocated(m_invNorm0, node->m_invNorm0);
+            CopyMatrixIfAllocated(m_invNorm1, node->m_invNorm1);
+            CopyMatrixIfAllocated(m_leftTerm, node->m_leftTerm);
+            CopyMatrixIfAllocated(m_rightTerm, node->m_rightTerm);
+            CopyMatrixIfAllocated(m_temp, node->m_temp);
         }
     }
     // request matrices needed to do node function value evaluation
@@ -1152,12 +1194,12 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<CosDistanceWithNegativeSamplesNode<ElemType>>(nodeP);
-            *node->m_invNorm0 = *m_invNorm0;
-            *node->m_invNorm1 = *m_invNorm1;
-            *node->m_invNormSquare = *m_invNormSquare;
-            *node->m_leftTerm = *m_leftTerm;
-            *node->m_rightTerm = *m_rightTerm;
-            *node->m_temp = *m_temp;
+            CopyMatrixIfAllocated(m_invNorm0, node->m_invNorm0);
+            CopyMatrixIfAllocated(m_invNorm1, node->m_invNorm1);
+            CopyMatrixIfAllocated(m_invNormSquare, node->m_invNormSquare);
+            CopyMatrixIfAllocated(m_leftTerm, node->m_leftTerm);
+            CopyMatrixIfAllocated(m_rightTerm, node->m_rightTerm);
+            CopyMatrixIfAllocated(m_temp, node->m_temp);
         }
     }
     // request matrices needed to do node function value evaluation
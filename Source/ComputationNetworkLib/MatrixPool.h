@@ -21,11 +21,24 @@ class MatrixPool
 {
     vector<shared_ptr<Matrix<float>>> m_releasedFloatMatrices;
     vector<shared_ptr<Matrix<double>>> m_releasedDoubleMatrices;
+    bool m_sharingEnabled;
 
     template <class ElemType>
     vector<shared_ptr<Matrix<ElemType>>>& GetReleasedMatrices();
 
 public:
+    MatrixPool()
+        : m_sharingEnabled(true)
+    {
+    }
+
+    // if disabled, released matrices are not handed out again, i.e. each Request() creates a new matrix
+    // Sharing relies on the nodes being executed in the order in which the matrices were requested and released.
+    void SetSharingEnabled(bool enabled)
+    {
+        m_sharingEnabled = enabled;
+    }
+
     // release here means the matrix can be put back and shared by others
     template <class ElemType>
     void Release(shared_ptr<Matrix<ElemType>> freeMatrix)
@@ -41,7 +54,8 @@ public:
         }
 
 #endif
-        releasedMatrices.push_back(freeMatrix);
+        if (m_sharingEnabled)
+            releasedMatrices.push_back(freeMatrix);
     }
 
     template <class ElemType>
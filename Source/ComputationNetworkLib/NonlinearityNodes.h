@@ -120,6 +120,86 @@ DeclareUnaryElementWiseWithOpCodeNode(Cosine, Cosine, ElementwiseProductWithCosD
 
 #pragma pop_macro("DeclareUnaryTensorOp")
 
+// -----------------------------------------------------------------------
+// PlusNonlinearityNodeBase (summand1, summand2) -- base for a Plus node fused
+// with a subsequent elementwise non-linearity, e.g. Sigmoid(Plus(a, b)).
+// These are not meant to be written by hand; they are created by the graph
+// optimization in CompileNetwork() (see ComputationNetworkOptimization.cpp).
+// -----------------------------------------------------------------------
+
+template <class ElemType, ElementWiseOperator opForward, ElementWiseOperator opBackward>
+class PlusNonlinearityNodeBase : public BinaryElementWiseNode<ElemType>
+{
+    typedef BinaryElementWiseNode<ElemType> Base;
+    UsingComputationNodeMembers;
+
+public:
+    PlusNonlinearityNodeBase(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name)
+    {
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        size_t rank = DetermineElementwiseTensorRank();
+        auto result = ValueTensorFor(rank, fr);
+        auto input0 = Input(0)->ValueTensorFor(rank, fr.AllowBroadcast());
+        auto input1 = Input(1)->ValueTensorFor(rank, fr.AllowBroadcast());
+        result.DoBinaryOpOf(0, input0, input1, 1, opForward);
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        size_t rank = DetermineElementwiseTensorRank();
+        auto gradient = GradientTensorFor(rank, fr);
+        auto value = ValueTensorFor(rank, fr);
+        auto inputGradient = Input(inputIndex)->GradientTensorFor(rank, fr.AllowBroadcast());
+
+        // if reduction then mask the respective input(s) (zero out the gaps)
+        if (Input(inputIndex)->ReducesInTimeWrt(shared_from_this()))
+            MaskMissingGradientColumnsToZero(fr);
+
+        // the derivative of the non-linearity is computed from the output, as in the unfused node
+        inputGradient.DoBinaryOpOf(1, gradient, value, 1, opBackward);
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return true; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+};
+
+// -----------------------------------------------------------------------
+// PlusSigmoidNode (summand1, summand2)
+// PlusTanhNode (summand1, summand2)
+// PlusRectifiedLinearNode (summand1, summand2)
+// -----------------------------------------------------------------------
+
+#pragma push_macro("DeclarePlusNonlinearityNode")
+#define DeclarePlusNonlinearityNode(Name, Forward, Backward)                                      \
+    template <class ElemType>                                                                     \
+    class Name##Node : public PlusNonlinearityNodeBase<ElemType, op##Forward, op##Backward>       \
+    {                                                                                             \
+        typedef PlusNonlinearityNodeBase<ElemType, op##Forward, op##Backward> Base;               \
+        UsingBinaryElementwiseNodeBaseMembers;                                                    \
+        static const std::wstring TypeName()                                                      \
+        {                                                                                         \
+            return L## #Name;                                                                     \
+        }                                                                                         \
+                                                                                                  \
+    public:                                                                                       \
+        DeclareConstructorFromConfigWithNumInputs(Name##Node);                                    \
+        Name##Node(DEVICEID_TYPE deviceId, const wstring& Name)                                   \
+            : Base(deviceId, Name)                                                                \
+        {                                                                                         \
+        }                                                                                         \
+    }
+
+//                          Name                 Forward and           Backward opcodes
+DeclarePlusNonlinearityNode(PlusSigmoid, SigmoidOfSum, ElementwiseProductWithSigmoidDerivativeFromOutput);
+DeclarePlusNonlinearityNode(PlusTanh, TanhOfSum, ElementwiseProductWithTanhDerivativeFromOutput);
+DeclarePlusNonlinearityNode(PlusRectifiedLinear, LinearRectifierOfSum, ElementwiseProductWithLinearRectifierDerivativeFromOutput);
+
+#pragma pop_macro("DeclarePlusNonlinearityNode")
+
 // -----------------------------------------------------------------------
 // SoftmaxNodeBase (input) -- shared base of Softmax and LogSoftmax
 // -----------------------------------------------------------------------
@@ -180,7 +260,7 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<SoftmaxNodeBase<ElemType>>(nodeP);
-            *node->m_gradientTemp = *m_gradientTemp;
+            CopyMatrixIfAllocated(m_gradientTemp, node->m_gradientTemp);
         }
     }
 
@@ -258,7 +338,7 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<SoftmaxNode<ElemType>>(nodeP);
-            *node->m_diff = *m_diff;
+            CopyMatrixIfAllocated(m_diff, node->m_diff);
         }
     }
     // request matrices that are needed for gradient computation
@@ -331,7 +411,7 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<LogSoftmaxNode<ElemType>>(nodeP);
-            *node->m_softmax = *m_softmax;
+            CopyMatrixIfAllocated(m_softmax, node->m_softmax);
         }
     }
     // request matrices that are needed for gradient computation
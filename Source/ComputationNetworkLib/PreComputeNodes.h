@@ -13,6 +13,7 @@
 #include <string>
 #include <stdexcept>
 #include <list>
+#include <vector>
 #include <iostream>
 
 // this file will contain computation nodes that require several atomic computation.
@@ -179,6 +180,13 @@ public:
         }
     }
 
+    // the statistics accumulated so far, as sums over the samples, so that the statistics of several workers that
+    // each see a part of the data can be combined by adding them up (e.g. with an MPI AllReduce)
+    // The first element is the number of samples. Only valid between MarkComputed(false) and MarkComputed(true).
+    virtual std::vector<double> GetAccumulatedSums() const = 0;
+    // replace the statistics accumulated so far, e.g. by the sums over all workers, before MarkComputed(true)
+    virtual void SetAccumulatedSums(const std::vector<double>& sums) = 0;
+
     virtual void BackpropToNonLooping(size_t /*inputIndex*/) override
     {
         // LogicError("Mean operation should not be involved in the gradient calculation.");
@@ -202,13 +210,42 @@ protected:
     {
         return m_numSamples != SIZE_MAX;
     }
+
+    // helpers for Get/SetAccumulatedSums()
+    void VerifyAccumulatedSums(const std::vector<double>& sums, size_t numVectors) const
+    {
+        if (!IsAccumulating())
+            LogicError("%ls %ls operation: Accumulated statistics can only be accessed while accumulating.", NodeName().c_str(), OperationName().c_str());
+        if (sums.size() != 1 + numVectors * Input(0)->GetSampleMatrixNumRows())
+            LogicError("%ls %ls operation: Accumulated statistics have the wrong dimension.", NodeName().c_str(), OperationName().c_str());
+    }
+    // append 'scale' * 'column' to 'sums'
+    static void AppendScaledColumn(std::vector<double>& sums, const Matrix<ElemType>& column, double scale)
+    {
+        ElemType* values = column.CopyToArray();
+        for (size_t i = 0; i < column.GetNumElements(); i++)
+            sums.push_back(scale * values[i]);
+        delete[] values;
+    }
+    // set 'column' to 'scale' * 'sums'[begin..begin+dim), plus 'offset'[i] if given
+    static void AssignScaledColumn(Matrix<ElemType>& column, const std::vector<double>& sums, size_t begin, double scale, const std::vector<double>* offset = nullptr)
+    {
+        size_t dim = column.GetNumRows();
+        std::vector<ElemType> values(dim);
+        for (size_t i = 0; i < dim; i++)
+            values[i] = (ElemType)(scale * sums[begin + i] + (offset ? (*offset)[i] : 0));
+        column.SetValue(dim, 1, column.GetDeviceId(), values.data());
+    }
 };
 
 #define UsingMeanInvStdDevNodeBaseNodeMembers \
     ComputationNodeBoilerplate;               \
     UsingPreComputedNodeMembers;              \
     using Base::m_numSamples;                 \
-    using Base::IsAccumulating
+    using Base::IsAccumulating;               \
+    using Base::VerifyAccumulatedSums;        \
+    using Base::AppendScaledColumn;           \
+    using Base::AssignScaledColumn
 
 // -----------------------------------------------------------------------
 // MeanNode (features)
@@ -277,6 +314,23 @@ public:
 
         m_numSamples += numNewSamples;
     }
+
+    // sums: [number of samples, sum of the samples]
+    virtual std::vector<double> GetAccumulatedSums() const override
+    {
+        std::vector<double> sums(1, (double) m_numSamples);
+        AppendScaledColumn(sums, Value(), (double) m_numSamples);
+        VerifyAccumulatedSums(sums, 1);
+        return sums;
+    }
+
+    virtual void SetAccumulatedSums(const std::vector<double>& sums) override
+    {
+        VerifyAccumulatedSums(sums, 1);
+        double numSamples = sums[0];
+        AssignScaledColumn(Value(), sums, 1, numSamples > 0 ? 1 / numSamples : 0);
+        m_numSamples = (size_t) numSamples;
+    }
 };
 
 template class MeanNode<float>;
@@ -390,6 +444,34 @@ public:
 #endif
     }
 
+    // sums: [number of samples, sum of the samples, sum of the squared samples]
+    // m_var holds the variance around the current mean, so the sum of squares is numSamples * (var + mean^2).
+    virtual std::vector<double> GetAccumulatedSums() const override
+    {
+        std::vector<double> sums(1, (double) m_numSamples);
+        AppendScaledColumn(sums, m_mean, (double) m_numSamples);
+        AppendScaledColumn(sums, m_var, (double) m_numSamples);
+        size_t dim = m_mean.GetNumRows();
+        for (size_t i = 0; i < dim; i++)
+            sums[1 + dim + i] += sums[1 + i] * sums[1 + i] / (m_numSamples > 0 ? m_numSamples : 1);
+        VerifyAccumulatedSums(sums, 2);
+        return sums;
+    }
+
+    virtual void SetAccumulatedSums(const std::vector<double>& sums) override
+    {
+        VerifyAccumulatedSums(sums, 2);
+        double numSamples = sums[0];
+        double scale = numSamples > 0 ? 1 / numSamples : 0;
+        size_t dim = m_mean.GetNumRows();
+        std::vector<double> negMeanSquare(dim);
+        for (size_t i = 0; i < dim; i++)
+            negMeanSquare[i] = -(scale * sums[1 + i]) * (scale * sums[1 + i]);
+        AssignScaledColumn(m_mean, sums, 1, scale);
+        AssignScaledColumn(m_var, sums, 1 + dim, scale, &negMeanSquare); // (may come out slightly negative; MarkComputed(true) truncates it)
+        m_numSamples = (size_t) numSamples;
+    }
+
     virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
     {
         Base::CopyTo(nodeP, newName, flags);
@@ -25,6 +25,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 // -----------------------------------------------------------------------
 // DelayedValueNodeState -- helper class for exporting/importing state from/to DelayedValueNodes.
 // This is used for sub-minibatching in case of truncated BPTT.
+// DelayedValueNodes hand their buffers to and from this by swapping (SwapState()), without copying,
+// so ImportState() consumes the state.
 // -----------------------------------------------------------------------
 
 template <class ElemType>
@@ -33,7 +35,7 @@ class DelayedValueNodeState : public INodeState
 public:
     DelayedValueNodeState(int deviceID)
         : m_cachedActivity((size_t) 0, (size_t) 0, deviceID),
-          m_delayedActivationMBLayout(nullptr),
+          m_delayedActivationMBLayout(make_shared<MBLayout>()), // (never null, since SwapState() hands it to a node)
           m_isEmpty(true)
     {
     }
@@ -51,6 +53,13 @@ public:
     {
         pMBLayout->CopyFrom(m_delayedActivationMBLayout);
     }
+    // exchange the cached activity and layout with the given ones; 'isEmpty' tells whether the activity given is a state
+    void SwapState(Matrix<ElemType>& activity, MBLayoutPtr& pMBLayout, bool isEmpty)
+    {
+        std::swap(m_cachedActivity, activity);
+        std::swap(m_delayedActivationMBLayout, pMBLayout);
+        m_isEmpty = isEmpty;
+    }
     bool IsEmpty()
     {
         return m_isEmpty;
@@ -59,6 +68,10 @@ public:
     {
         return m_cachedActivity;
     }
+    const MBLayoutPtr& GetDelayedMBLayout() const
+    {
+        return m_delayedActivationMBLayout;
+    }
     ~DelayedValueNodeState()
     {
     }
@@ -249,19 +262,51 @@ public:
         // In truncated BPTT, we carry over left-to-right state across minibatches.
         // It is kept in m_delayedValue, m_delayedActivationMBLayout.
         // This could be optimized as follows:
-        //  - only keep the required number of frames (m_timeStep)
         //  - we don't need to keep anything in full-sequence mode
         //  - we don't need to keep anything if all sequences are closed (sentence end)
         //    This condition includes full-sequence mode.
         // TODO: Can we optimize this and only copy if there is a sequence spanning across the end of the MB? And add a check to BeginForwardProp() to make sure we got one if there is a boundary at the start?
-        m_delayedValue = Input(0)->Value();
-        if (!m_delayedActivationMBLayout)
-            m_delayedActivationMBLayout = make_shared<MBLayout>();
-        m_delayedActivationMBLayout->CopyFrom(m_pMBLayout);
+        CacheDelayedFrames();
 
         Base::EndForwardProp();
     }
 
+    // keep the frames that the next minibatch reaches into: the last m_timeStep time steps (or the first, for FutureValue)
+    // m_delayedActivationMBLayout becomes the part of the layout for these time steps.
+    void CacheDelayedFrames()
+    {
+        const auto& value = Input(0)->Value();
+        size_t T = GetNumTimeSteps();
+        size_t nU = GetNumParallelSequences();
+        size_t numSteps = min((size_t) m_timeStep, T);
+        size_t tBegin = direction < 0 ? T - numSteps : 0; // first time step kept
+
+        m_delayedValue.SetValue(value.ColumnSlice(tBegin * nU, numSteps * nU)); // (no reallocation once the size is stable)
+
+        // Sequences that are shorter than the minibatch (e.g. chunks of streams of different lengths, see CNTKEval::EvaluateSessions())
+        // hand over their last frame that is not a gap. For sequences that end within the minibatch, the state is not used anyway.
+        if (direction < 0 && numSteps == 1 && m_pMBLayout->IsGap(FrameRange(m_pMBLayout, T - 1)))
+        {
+            for (size_t s = 0; s < nU; s++)
+            {
+                size_t t = T - 1;
+                while (t > 0 && m_pMBLayout->IsGap(FrameRange(m_pMBLayout, t).Sequence(s)))
+                    t--;
+                if (t != T - 1)
+                    m_delayedValue.SetColumnSlice(value.ColumnSlice(t * nU + s, 1), s, 1);
+            }
+        }
+
+        if (!m_delayedActivationMBLayout)
+            m_delayedActivationMBLayout = make_shared<MBLayout>();
+        m_delayedActivationMBLayout->Init(nU, numSteps);
+        for (const auto& seq : m_pMBLayout->GetAllSequences())
+        {
+            if (seq.tEnd > tBegin && seq.tBegin < (ptrdiff_t)(tBegin + numSteps))
+                m_delayedActivationMBLayout->AddSequence(MBLayout::SequenceInfo{seq.seqId, seq.s, seq.tBegin - (ptrdiff_t) tBegin, seq.tEnd - tBegin});
+        }
+    }
+
     // This function assumes BeginForwardProp/EndForwardProp() to be called before/after the iteration loop.
     // TODO: In the future, there may be value for one more way of handling the boundary condition: Fill as 'NoInput'. Then we can use this to implement rolling windows (albeit inefficiently). Would require to unshare the layout.
     virtual void ForwardProp(const FrameRange& fr) override
@@ -329,9 +374,9 @@ public:
             Matrix<ElemType> out = ValueFor(fr);
 
             if (t_delayed < 0)
-                inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed + T_delayedActivation), m_delayedActivationMBLayout);
+                inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed + T_delayedActivation).WithNumActiveSequences(fr.m_numActiveSequences), m_delayedActivationMBLayout);
             else if (t_delayed >= T)
-                inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed - T), m_delayedActivationMBLayout);
+                inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed - T).WithNumActiveSequences(fr.m_numActiveSequences), m_delayedActivationMBLayout);
             else
                 inp = Input(0)->ValueFor(frDelayed);
             // inp = Input(0)->ValueFor(FrameRange(m_pMBLayout, t_delayed));
@@ -366,54 +411,33 @@ public:
         }
     }
 
+    // The state is handed over by swapping buffers, not copied. The node's own state is therefore undefined
+    // after ExportState() until the next ImportState() or the end of the next minibatch (but its layout is never null).
     virtual NodeStatePtr /*IStatefulNode::*/ ExportState() override
     {
-        NodeStatePtr pExportedState;
-        size_t nT = m_pMBLayout->GetNumTimeSteps();
-        size_t nU = m_pMBLayout->GetNumParallelSequences();
-        int dir = direction;
         if (m_timeStep != 1)
         {
             // not support yet; give user a hint
             RuntimeError("Currently importing/exporting state info for timeStep>1 is not supported. Contact erw@microsoft.com for more detail");
         }
+        // only need to export state if anything crosses the MB boundary
+        // Otherwise the state is empty, but still carries the layout.
+        bool crossesBoundary;
+        int dir = direction;
         if (dir == -1) // we look into past
-        {
-            if (!m_pMBLayout->HasSequenceBeyondEnd()) // only need to export state if anything crosses the MB boundary
-            {
-                auto pState = make_shared<DelayedValueNodeState<ElemType>>(m_deviceId);
-                pState->CacheDelayedMBLayout(m_delayedActivationMBLayout);
-                // return an empty one
-            }
-            else
-            {
-                auto pState = make_shared<DelayedValueNodeState<ElemType>>(m_deviceId);
-                pState->CacheState(m_delayedValue.ColumnSlice((nT - 1) * nU, nU));
-                pState->CacheDelayedMBLayout(m_delayedActivationMBLayout);
-                pExportedState = pState;
-            }
-        }
+            crossesBoundary = m_pMBLayout->HasSequenceBeyondEnd();
         else if (dir == 1) // we look into future
-        {
-            if (!m_pMBLayout->HasSequenceBeyondBegin()) // only need to export state if anything crosses the MB boundary
-            {
-                auto pState = make_shared<DelayedValueNodeState<ElemType>>(m_deviceId);
-                pState->CacheDelayedMBLayout(m_delayedActivationMBLayout);
-                pExportedState = pState;
-            }
-            else
-            {
-                auto pState = make_shared<DelayedValueNodeState<ElemType>>(m_deviceId);
-                pState->CacheState(m_delayedValue.ColumnSlice((nT - 1) * nU, nU));
-                pState->CacheDelayedMBLayout(m_delayedActivationMBLayout);
-                pExportedState = pState;
-            }
-        }
+            crossesBoundary = m_pMBLayout->HasSequenceBeyondBegin();
         else
-        {
             LogicError("Unrecognized direction in DelayedValueNodeBase");
-        }
-        return pExportedState;
+
+        // m_delayedValue holds exactly the frames to hand over (see CacheDelayedFrames())
+        auto pState = make_shared<DelayedValueNodeState<ElemType>>(m_deviceId);
+        if (crossesBoundary)
+            pState->SwapState(m_delayedValue, m_delayedActivationMBLayout, /*isEmpty=*/false);
+        else
+            pState->CacheDelayedMBLayout(m_delayedActivationMBLayout);
+        return pState;
     }
 
     virtual void /*IStatefulNode::*/ ImportState(const NodeStatePtr& pImportedState) override
@@ -422,16 +446,32 @@ public:
 
         if (!pState)
             LogicError("Expecting DelayValueNodeState after downcasting");
+        if (m_timeStep != 1) // (same as ExportState(), which exported one frame per sequence)
+            RuntimeError("Currently importing/exporting state info for timeStep>1 is not supported. Contact erw@microsoft.com for more detail");
 
-        pState->ExportDelayedMBLayout(m_delayedActivationMBLayout); // pstate copy to m_delayedActivationMBLayout
+        if (!m_delayedActivationMBLayout)
+            m_delayedActivationMBLayout = make_shared<MBLayout>();
         if (pState->IsEmpty())
         {
+            pState->ExportDelayedMBLayout(m_delayedActivationMBLayout); // pstate copy to m_delayedActivationMBLayout
+            return;
+        }
+
+        // states that hold one frame per parallel sequence, as exported by ExportState(), are swapped in
+        size_t nT = pState->GetDelayedMBLayout()->GetNumTimeSteps();
+        size_t nU = pState->GetDelayedMBLayout()->GetNumParallelSequences();
+        if (nT == 1 && pState->ExportCachedActivity().GetNumCols() == nU)
+        {
+            pState->SwapState(m_delayedValue, m_delayedActivationMBLayout, /*isEmpty=*/true); // (the state object now holds our previous buffer)
             return;
         }
 
+        pState->ExportDelayedMBLayout(m_delayedActivationMBLayout); // pstate copy to m_delayedActivationMBLayout
         const Matrix<ElemType>& delayedActivation = pState->ExportCachedActivity();
-        size_t nT = m_delayedActivationMBLayout->GetNumTimeSteps();
-        size_t nU = m_delayedActivationMBLayout->GetNumParallelSequences();
+
+        // the state may come from a minibatch of a different shape than the last one seen by this node (or none, e.g. right after loading)
+        if (m_delayedValue.GetNumRows() != delayedActivation.GetNumRows() || m_delayedValue.GetNumCols() != nT * nU)
+            m_delayedValue.Resize(delayedActivation.GetNumRows(), nT * nU);
 
         int dir = direction;
         if (dir == -1) // looking backward
@@ -530,6 +570,230 @@ public:
 template class FutureValueNode<float>;
 template class FutureValueNode<double>;
 
+// -----------------------------------------------------------------------
+// LSTMCellNode (weights, bias, input, prevState) -- fused LSTM cell
+//
+// Computes one step of an LSTM cell with all four gates at once:
+//  - weights:   [4H x (I+H)] gate weights for [input; h_prev], gates stacked as [i; f; o; g]
+//  - bias:      [4H x 1] gate biases
+//  - input:     [I x T] input sequence
+//  - prevState: [2H x T] previous state [h; c], typically PastValue(2H, this node)
+// The output is the new state [h; c]; use RowSlice(0, H, ...) to get h.
+// The input and h_prev are stacked into one [(I+H) x T] buffer, so that all four gate pre-activations
+// are computed by a single GEMM into a [4H x T] buffer. The non-linearities and cell update are then
+// applied by one fused kernel (Matrix::LSTMCellForward()), and likewise for the gradient.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class LSTMCellNode : public ComputationNode<ElemType>, public NumInputs<4>
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName()
+    {
+        return L"LSTMCell";
+    }
+
+public:
+    DeclareConstructorFromConfigWithNumInputs(LSTMCellNode);
+    LSTMCellNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name)
+    {
+    }
+
+    size_t GetCellDim() const { return Input(0)->GetAsMatrixNumRows() / 4; }
+    size_t GetInputDim() const { return Input(0)->GetAsMatrixNumCols() - GetCellDim(); }
+
+    virtual void UpdateFunctionMBSize() override
+    {
+        Base::UpdateFunctionMBSize();
+        // resize temporaries to their proper size
+        size_t cols = Value().GetNumCols();
+        m_gates->Resize(4 * GetCellDim(), cols);
+        m_stackedInput->Resize(GetInputDim() + GetCellDim(), cols);
+        m_tempMatrix->Resize(GetCellDim(), cols);
+        // the gradient temporaries only exist if we compute gradients
+        if (m_gatesGradient)
+            m_gatesGradient->Resize(4 * GetCellDim(), cols);
+        if (m_prevCellGradient)
+            m_prevCellGradient->Resize(GetCellDim(), cols);
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        const size_t cellDim = GetCellDim();
+        const size_t inputDim = GetInputDim();
+        auto& weights = Input(0)->ValueAsMatrix();
+        auto sliceGates = DataFor(*m_gates, fr);
+        auto slicePrevState = Input(3)->ValueFor(fr);
+
+        // all four gate pre-activations in one GEMM: W * [x; h_prev]
+        auto sliceStackedInput = DataFor(*m_stackedInput, fr);
+        auto sliceHPrev = DataFor(*m_tempMatrix, fr);
+        sliceHPrev.AssignRowSliceValuesOf(slicePrevState, 0, cellDim);
+        sliceStackedInput.AssignToRowSliceValuesOf(Input(2)->ValueFor(fr), 0, inputDim);
+        sliceStackedInput.AssignToRowSliceValuesOf(sliceHPrev, inputDim, cellDim);
+        sliceGates.AssignProductOf(weights, false, sliceStackedInput, false);
+
+        // gate non-linearities and cell update
+        auto sliceOutputValue = ValueFor(fr);
+        Matrix<ElemType>::LSTMCellForward(sliceGates, Input(1)->ValueAsMatrix(), slicePrevState, sliceOutputValue);
+#if NANCHECK
+        sliceOutputValue.HasNan("LSTMCell");
+#endif
+    }
+
+    // the gradient w.r.t. the gate pre-activations is shared by all inputs, so compute it once before handing it to the inputs
+    virtual void Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) override
+    {
+        // Inside a loop, this is called once per frame with childrenInThisLoop, and once more for the whole batch
+        // with childrenInOuterLoop (for the weights, bias, and input), when the gate gradients are complete.
+        if (childrenInThisLoop && Base::NeedGradient())
+        {
+            auto sliceGatesGradient = DataFor(*m_gatesGradient, fr);
+            auto slicePrevCellGradient = DataFor(*m_prevCellGradient, fr);
+            Matrix<ElemType>::LSTMCellBackward(DataFor(*m_gates, fr), Input(3)->ValueFor(fr), ValueFor(fr), GradientFor(fr),
+                                               sliceGatesGradient, slicePrevCellGradient);
+        }
+        Base::Backprop(fr, childrenInThisLoop, childrenInOuterLoop);
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        const size_t cellDim = GetCellDim();
+        const size_t inputDim = GetInputDim();
+        auto sliceGatesGradient = DataFor(*m_gatesGradient, fr);
+
+        if (inputIndex == 0) // weights
+        {
+            // this computes inner products over time, so we need to mask the gaps
+            // The stacked [x; h_prev] from the forward pass gives the gradient of all weights in one GEMM.
+            MaskMissingColumnsToZero(*m_gatesGradient, m_pMBLayout, fr);
+            MaskMissingColumnsToZero(*m_stackedInput, m_pMBLayout, fr);
+            Matrix<ElemType>::MultiplyAndAdd(sliceGatesGradient, false, DataFor(*m_stackedInput, fr), true, Input(0)->GradientAsMatrix());
+        }
+        else if (inputIndex == 1) // bias
+        {
+            MaskMissingColumnsToZero(*m_gatesGradient, m_pMBLayout, fr);
+            Matrix<ElemType>::MultiplyAndAdd(sliceGatesGradient, false, ConstOnes(sliceGatesGradient.GetNumCols(), 1, sliceGatesGradient.GetDeviceId()), false, Input(1)->GradientAsMatrix());
+        }
+        else if (inputIndex == 2) // input
+        {
+            auto sliceInputGrad = Input(2)->GradientFor(fr);
+            Matrix<ElemType>::MultiplyAndAdd(Input(0)->ValueAsMatrix().ColumnSlice(0, inputDim), true, sliceGatesGradient, false, sliceInputGrad);
+        }
+        else if (inputIndex == 3) // prevState
+        {
+            auto slicePrevStateGrad = Input(3)->GradientFor(fr);
+            auto sliceHPrevGrad = DataFor(*m_tempMatrix, fr);
+            sliceHPrevGrad.AssignProductOf(Input(0)->ValueAsMatrix().ColumnSlice(inputDim, cellDim), true, sliceGatesGradient, false);
+            slicePrevStateGrad.AddToRowSliceValuesOf(sliceHPrevGrad, 0, cellDim);
+            slicePrevStateGrad.AddToRowSliceValuesOf(DataFor(*m_prevCellGradient, fr), cellDim, cellDim);
+        }
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase();
+
+        if (isFinalValidationPass && (Input(0)->HasMBLayout() || Input(1)->HasMBLayout()))
+            InvalidArgument("%ls %ls operation requires the weights and bias to not be minibatch data (must not have an MBLayout).", NodeName().c_str(), OperationName().c_str());
+
+        // the cell dimension is determined by the weights; their number of columns and the bias can be inferred
+        size_t rows0 = Input(0)->GetAsMatrixNumRows();
+        size_t cellDim = rows0 / 4;
+        size_t inputDim = Input(2)->GetSampleMatrixNumRows();
+        Input(0)->ValidateInferInputDimsFrom(TensorShape(rows0, inputDim + cellDim));
+        Input(1)->ValidateInferInputDimsFrom(TensorShape(rows0, 1));
+
+        if (isFinalValidationPass)
+        {
+            if (rows0 == 0 || rows0 % 4 != 0)
+                InvalidArgument("%ls %ls operation requires the number of rows of the weights (%d) to be a non-zero multiple of 4.", NodeName().c_str(), OperationName().c_str(), (int) rows0);
+            if (Input(0)->GetAsMatrixNumCols() != inputDim + cellDim)
+                InvalidArgument("%ls %ls operation requires the weights to have dimension [%d x %d] which is [4 * cellDim x (inputDim + cellDim)].", NodeName().c_str(), OperationName().c_str(), (int) rows0, (int) (inputDim + cellDim));
+            if (Input(1)->GetAsMatrixNumRows() != rows0 || Input(1)->GetAsMatrixNumCols() != 1)
+                InvalidArgument("%ls %ls operation requires the bias to have dimension [%d x 1].", NodeName().c_str(), OperationName().c_str(), (int) rows0);
+            if (Input(3)->GetSampleMatrixNumRows() != 2 * cellDim)
+                InvalidArgument("%ls %ls operation requires the previous state to have dimension %d which is 2 * cellDim.", NodeName().c_str(), OperationName().c_str(), (int) (2 * cellDim));
+        }
+
+        SetDims(TensorShape(2 * cellDim), true);
+    }
+
+    virtual bool InputUsedInComputingInputNodesGradients(size_t childIndex) const override
+    {
+        // the bias is folded into the gate activations, which we keep ourselves
+        return childIndex != 1;
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<LSTMCellNode<ElemType>>(nodeP);
+            CopyMatrixIfAllocated(m_gates, node->m_gates);
+            CopyMatrixIfAllocated(m_stackedInput, node->m_stackedInput);
+            CopyMatrixIfAllocated(m_gatesGradient, node->m_gatesGradient);
+            CopyMatrixIfAllocated(m_prevCellGradient, node->m_prevCellGradient);
+            CopyMatrixIfAllocated(m_tempMatrix, node->m_tempMatrix);
+        }
+    }
+
+    // request matrices needed to do node function value evaluation
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool)
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_gates, matrixPool);
+        RequestMatrixFromPool(m_stackedInput, matrixPool);
+        RequestMatrixFromPool(m_tempMatrix, matrixPool);
+    }
+
+    // the forward temporaries are kept for backprop; without gradient they can be shared right away
+    virtual void ReleaseMatricesAfterForwardProp(MatrixPool& matrixPool)
+    {
+        Base::ReleaseMatricesAfterForwardProp(matrixPool);
+        if (!Base::NeedGradient())
+        {
+            ReleaseMatrixToPool(m_gates, matrixPool);
+            ReleaseMatrixToPool(m_stackedInput, matrixPool);
+            ReleaseMatrixToPool(m_tempMatrix, matrixPool);
+        }
+    }
+
+    // request matrices that are needed for gradient computation
+    // Inside a loop, this is called for all nodes of the loop before its first frame is backpropagated.
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool)
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_gatesGradient, matrixPool);
+        RequestMatrixFromPool(m_prevCellGradient, matrixPool);
+    }
+
+    // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool)
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_gates, matrixPool);
+        ReleaseMatrixToPool(m_stackedInput, matrixPool);
+        ReleaseMatrixToPool(m_tempMatrix, matrixPool);
+        ReleaseMatrixToPool(m_gatesGradient, matrixPool);
+        ReleaseMatrixToPool(m_prevCellGradient, matrixPool);
+    }
+
+private:
+    shared_ptr<Matrix<ElemType>> m_gates;            // [4H x T] gate activations [i; f; o; g], kept for backprop
+    shared_ptr<Matrix<ElemType>> m_stackedInput;     // [(I+H) x T] stacked [x; h_prev], kept for backprop
+    shared_ptr<Matrix<ElemType>> m_gatesGradient;    // [4H x T] gradient w.r.t. gate pre-activations
+    shared_ptr<Matrix<ElemType>> m_prevCellGradient; // [H x T] gradient w.r.t. c_prev
+    shared_ptr<Matrix<ElemType>> m_tempMatrix;       // [H x T] h_prev, resp. its gradient
+};
+
+template class LSTMCellNode<float>;
+template class LSTMCellNode<double>;
+
 #ifdef COMING_SOON
 
 // -----------------------------------------------------------------------
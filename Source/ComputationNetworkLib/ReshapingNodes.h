@@ -8,6 +8,7 @@
 
 #include "Basics.h"
 #include "Matrix.h"
+#include "ScratchArena.h"
 #include "ComputationNode.h"
 #include "Sequences.h"
 
@@ -635,15 +636,14 @@ public:
         auto& inputGradientValues = Input(0)->GradientAsMatrix();
         auto& gradientValues = GradientAsMatrix();
 
-        // BUGBUG: This should use the memshare mechanism.
-        // TODO: use tensor lib, then this will be easy, no memsharing needed
-        Matrix<ElemType> diag(gradientValues.GetNumRows(), gradientValues.GetNumCols(), gradientValues.GetDeviceId());
-        diag = gradientValues;
-        diag.Resize(gradientValues.GetNumCols(), 1);
+        // TODO: use tensor lib, then this will be easy, no temporary needed
+        auto diag = ScratchArena<ElemType>::ForCurrentThread().Take(gradientValues.GetDeviceId(), OperationName());
+        diag->SetValue(gradientValues);
+        diag->Resize(gradientValues.GetNumCols(), 1);
 
         inputGradientValues.SetValue(0);
         // BUGBUG: Must *add* to gradient!
-        inputGradientValues.SetDiagonalValue(diag);
+        inputGradientValues.SetDiagonalValue(*diag);
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override
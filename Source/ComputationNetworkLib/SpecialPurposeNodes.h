@@ -356,11 +356,11 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<GMMLogLikelihoodNode<ElemType>>(nodeP);
-            *node->m_prior = *m_prior;
-            *node->m_normedDeviation = *m_normedDeviation;
-            *node->m_normedDeviationVectors = *m_normedDeviationVectors;
-            *node->m_stddev = *m_stddev;
-            *node->m_posterior = *m_posterior;
+            CopyMatrixIfAllocated(m_prior, node->m_prior);
+            CopyMatrixIfAllocated(m_normedDeviation, node->m_normedDeviation);
+            CopyMatrixIfAllocated(m_normedDeviationVectors, node->m_normedDeviationVectors);
+            CopyMatrixIfAllocated(m_stddev, node->m_stddev);
+            CopyMatrixIfAllocated(m_posterior, node->m_posterior);
         }
     }
 
@@ -564,9 +564,9 @@ public:
         {
             auto node = dynamic_pointer_cast<SequenceWithSoftmaxNode<ElemType>>(nodeP);
 
-            *node->m_logSoftmaxOfRight = *m_logSoftmaxOfRight;
-            *node->m_softmaxOfRight = *m_softmaxOfRight;
-            *node->m_gammaFromLattice = *m_gammaFromLattice;
+            CopyMatrixIfAllocated(m_logSoftmaxOfRight, node->m_logSoftmaxOfRight);
+            CopyMatrixIfAllocated(m_softmaxOfRight, node->m_softmaxOfRight);
+            CopyMatrixIfAllocated(m_gammaFromLattice, node->m_gammaFromLattice);
             node->m_fsSmoothingWeight = m_fsSmoothingWeight;
             node->m_frameDropThreshold = m_frameDropThreshold;
             node->m_doReferenceAlignment = m_doReferenceAlignment;
@@ -85,7 +85,7 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<SquareErrorNode<ElemType>>(nodeP);
-            *node->m_leftMinusRight = *m_leftMinusRight;
+            CopyMatrixIfAllocated(m_leftMinusRight, node->m_leftMinusRight);
         }
     }
 
@@ -214,8 +214,8 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<CrossEntropyWithSoftmaxNode<ElemType>>(nodeP);
-            *node->m_logSoftmaxOfRight = *m_logSoftmaxOfRight;
-            *node->m_softmaxOfRight = *m_softmaxOfRight;
+            CopyMatrixIfAllocated(m_logSoftmaxOfRight, node->m_logSoftmaxOfRight);
+            CopyMatrixIfAllocated(m_softmaxOfRight, node->m_softmaxOfRight);
         }
     }
 
@@ -325,8 +325,8 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<CrossEntropyNode<ElemType>>(nodeP);
-            *node->m_logOfRight = *m_logOfRight;
-            *node->m_leftDivRight = *m_leftDivRight;
+            CopyMatrixIfAllocated(m_logOfRight, node->m_logOfRight);
+            CopyMatrixIfAllocated(m_leftDivRight, node->m_leftDivRight);
         }
     }
 
@@ -430,7 +430,7 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<MatrixL1RegNode<ElemType>>(nodeP);
-            *node->m_gradientOfL1Norm = *m_gradientOfL1Norm;
+            CopyMatrixIfAllocated(m_gradientOfL1Norm, node->m_gradientOfL1Norm);
         }
     }
 
@@ -998,8 +998,6 @@ protected:
 template class ClassBasedCrossEntropyWithSoftmaxNode<float>;
 template class ClassBasedCrossEntropyWithSoftmaxNode<double>;
 
-#ifdef COMING_SOON
-
 // -----------------------------------------------------------------------
 // CRFNode (labels, position_dependent_scores, transition_scores)
 //  - labels: output label vector of [0:T-1]
@@ -1007,7 +1005,8 @@ template class ClassBasedCrossEntropyWithSoftmaxNode<double>;
 //    in the R-CRF case, it is the RNN output score before softmax
 //  - transition scores: square transition matrix,  --TODO: log?
 //    in the R-CRF case, it is the transition probability between labels
-// BUGBUG: This node cannot operate with truncated BPTT, but does not detect it. It also does not handle gaps or test boundary flags.
+// All sequences of the minibatch are processed at once, in parallel on the CPU. Each sequence must be complete
+// in the minibatch, i.e. this node cannot operate with truncated BPTT.
 // -----------------------------------------------------------------------
 
 /**
@@ -1039,77 +1038,67 @@ public:
     DeclareConstructorFromConfigWithNumInputs(CRFNode);
     CRFNode(DEVICEID_TYPE deviceId, const wstring& name)
         : Base(deviceId, name),
-          mAlpha(deviceId),
-          mBeta(deviceId),
-          mPostProb(deviceId)
+          mAlpha(CPUDEVICE),
+          mPostProb(CPUDEVICE),
+          mLabelsOnCPU(CPUDEVICE),
+          mPosScoresOnCPU(CPUDEVICE),
+          mPairScoresOnCPU(CPUDEVICE),
+          mNumParallelSequences(0)
     {
     }
 
     // compute posterior probability of label y at position t
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
     {
-        FrameRange fr(Input(0)->GetMBLayout());
-        size_t nrow = Input(0)->Value().GetNumRows();
-        size_t ncol = Input(0)->Value().GetNumCols();
-
-        mAlpha.Resize(nrow, ncol);
-        mBeta.Resize(nrow, ncol);
-        mPostProb.Resize(nrow, ncol);
-
-        Value().SetValue(0.0);
-        Matrix<ElemType> funcVal = Value(); // TODO: This just creates a 1x1 matrix set to 0.
-
-        size_t nS = Input(0)->GetNumParallelSequences();
-        if (nS != 1)
-            LogicError("CRFNode: >1 parallel sequences are curently not implemented correctly.");
-        for (size_t i = 0; i < nS; i++) // process parallel sequences one by one  --BUGBUG: We should loop over individual sequences.
+        // the sequences of the minibatch
+        const MBLayoutPtr& pMBLayout = Input(0)->GetMBLayout();
+        mNumParallelSequences = pMBLayout->GetNumParallelSequences();
+        mSequences.clear();
+        for (const auto& sequence : pMBLayout->GetAllSequences())
         {
-            FrameRange sequenceRange = fr.Sequence(i); // FrameRange to select one sequence
-            // BUGBUG: This ^^ is neither supported nor correct, since this code does not handle gaps or start/end flags.
-            ForwardPropS(
-                DataWithMBLayoutFor(mPostProb, sequenceRange, Input(0)->GetMBLayout()),
-                DataWithMBLayoutFor(mAlpha, sequenceRange, Input(0)->GetMBLayout()),
-                DataWithMBLayoutFor(mBeta, sequenceRange, Input(0)->GetMBLayout()),
-                funcVal,
-                Input(0)->ValueFor(sequenceRange),
-                Input(1)->ValueFor(sequenceRange),
-                Input(2)->ValueAsMatrix(), mStartLbl,
-                mEndLbl);
-
-            Value() += funcVal; // aggregate over sequences
+            if (sequence.seqId == GAP_SEQUENCE_ID)
+                continue;
+            if (sequence.tBegin < 0 || sequence.tEnd > pMBLayout->GetNumTimeSteps())
+                InvalidArgument("%ls %ls operation requires complete sequences in each minibatch (truncated BPTT is not supported).", NodeName().c_str(), OperationName().c_str());
+            mSequences.push_back(ParallelSequenceSpan{sequence.s, (size_t) sequence.tBegin, sequence.tEnd});
         }
+
+        const ElemType negLogLikelihood = Matrix<ElemType>::RCRFForwardBackward(ValueOnCPU(Input(0)->Value(), mLabelsOnCPU), ValueOnCPU(Input(1)->Value(), mPosScoresOnCPU),
+                                                                                ValueOnCPU(Input(2)->ValueAsMatrix(), mPairScoresOnCPU),
+                                                                                mNumParallelSequences, mSequences, mAlpha, mPostProb);
+        Value().SetValue(negLogLikelihood);
     }
 
-    virtual void BackpropToNonLooping(size_t inputIndex) override // scaled by 2*number of colmns (samples) in the Matrix<ElemType>
+    virtual void BackpropToNonLooping(size_t inputIndex) override
     {
         FrameRange fr(Input(0)->GetMBLayout());
         // inputIndex 0 should not get us here, it should be prevented by the needGradient flag of input[0]
         if (inputIndex != 1 && inputIndex != 2)
             InvalidArgument("CRFNode only takes with respect to input and weight.");
 
-        if (inputIndex == 1)
+        if (inputIndex == 1) // posterior minus label; both are the labels in columns that belong to no sequence
         {
             auto gradient = Input(1)->GradientFor(fr);
-            Matrix<ElemType>::AddScaledDifference(Gradient(), mPostProb, Input(0)->ValueFor(fr), gradient);
+            if (gradient.GetDeviceId() == CPUDEVICE)
+                Matrix<ElemType>::AddScaledDifference(Gradient(), mPostProb, Input(0)->ValueFor(fr), gradient);
+            else
+                Matrix<ElemType>::AddScaledDifference(Gradient(), Matrix<ElemType>(mPostProb, gradient.GetDeviceId()), Input(0)->ValueFor(fr), gradient);
         }
         else if (inputIndex == 2)
         {
-            assert(Input(inputIndex)->GradientFor(fr).GetNumElements() > 0);
-            size_t nS = Input(0)->GetNumParallelSequences();
-            for (size_t i = 0; i < nS; i++) // process all sequences one by one
+            auto& gradient = Input(2)->GradientAsMatrix();
+            const ElemType scale = Gradient().Get00Element();
+            const Matrix<ElemType>& labels = ValueOnCPU(Input(0)->Value(), mLabelsOnCPU);
+            const Matrix<ElemType>& pairScores = ValueOnCPU(Input(2)->ValueAsMatrix(), mPairScoresOnCPU);
+            if (gradient.GetDeviceId() == CPUDEVICE)
+                Matrix<ElemType>::RCRFTransGrdAccumulate(labels, mAlpha, mPostProb, pairScores, mNumParallelSequences, mSequences, scale, gradient);
+            else
             {
-                FrameRange sequenceRange = fr.Sequence(i); // FrameRange to select one sequence
-                auto& gradient = Input(2)->GradientAsMatrix();
-                TransGrdCompute(Input(0)->ValueFor(sequenceRange),
-                                DataWithMBLayoutFor(mAlpha, sequenceRange, Input(0)->GetMBLayout()),
-                                DataWithMBLayoutFor(mBeta, sequenceRange, Input(0)->GetMBLayout()),
-                                Input(2)->ValueAsMatrix(),
-                                gradient,
-                                mStartLbl, 1);
+                Matrix<ElemType> gradientOnCPU = Matrix<ElemType>::Zeros(gradient.GetNumRows(), gradient.GetNumCols(), CPUDEVICE);
+                Matrix<ElemType>::RCRFTransGrdAccumulate(labels, mAlpha, mPostProb, pairScores, mNumParallelSequences, mSequences, scale, gradientOnCPU);
+                gradient += Matrix<ElemType>(gradientOnCPU, gradient.GetDeviceId());
             }
         }
-        else
-            return;
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override
@@ -1117,147 +1106,6 @@ public:
         return false;
     }
 
-    // compute forward backward algorithm
-    /*TODO: merge with call site*/ void ForwardPropS(Matrix<ElemType> postprob, Matrix<ElemType> alpha, Matrix<ElemType> beta, Matrix<ElemType>& functionValues, const Matrix<ElemType>& lbls, const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores, int& firstLbl, int& lastLbl, const int iStep = 1)
-    {
-        // to-do, each slice is for one sentence
-        // to-do, number of slices correspond to number of frames
-        // this implementation only supports one sentence per minibatch
-
-        int nObs = lbls.GetNumCols();
-
-        // change to other values so can support multiple sentences in each minibatch
-        assert(iStep == 1);
-        ForwardCompute(alpha, lbls, pos_scores, pair_scores);
-        BackwardCompute(alpha, beta, functionValues, lbls, pos_scores, pair_scores, iStep);
-        PostProbCompute(postprob, alpha, beta);
-
-        firstLbl = -1;
-        for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-            if (lbls(ik, 0) != 0)
-            {
-                firstLbl = ik;
-                break;
-            }
-
-        lastLbl = -1;
-        for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-            if (lbls(ik, nObs - 1) != 0)
-            {
-                lastLbl = ik;
-                break;
-            }
-
-        functionValues.AssignInnerProductOfMatrices(lbls, pos_scores);
-
-        Matrix<ElemType> a = alpha.ColumnSlice(nObs - 1, 1);
-        ElemType fAlpha;
-        fAlpha = a.LogAddSumOfElements();
-
-        // transition score
-        ElemType tscore = 0;
-        for (int t = 0; t < nObs - 1; t++)
-        {
-            int i = -1;
-            for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-                if (lbls(ik, t) != 0)
-                {
-                    i = ik;
-                    break;
-                }
-            int j = -1;
-            for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-                if (lbls(ik, t + 1) != 0)
-                {
-                    j = ik;
-                    break;
-                }
-            tscore += pair_scores(j, i);
-        }
-        tscore += functionValues.Get00Element(); // correct path score
-        tscore -= fAlpha;                        // reduced by the scores from all paths
-        functionValues.SetValue(tscore);
-
-        functionValues *= (-1);
-    }
-
-    // compute forward backward algorithm
-    static void ForwardCompute(Matrix<ElemType>& alpha,
-                               const Matrix<ElemType>& lbls,
-                               const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores)
-    {
-        // to-do, shift more than 1 to support muliple sentences per minibatch
-        int iNumPos = lbls.GetNumCols();
-        int iNumLab = lbls.GetNumRows();
-
-        int firstLbl = -1;
-        for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-            if (lbls(ik, 0) != 0)
-            {
-                firstLbl = ik;
-                break;
-            }
-
-        // need to have
-        alpha.Resize(iNumLab, iNumPos);
-
-        for (int t = 0; t < iNumPos; t++)
-        {
-            for (int k = 0; k < iNumLab; k++)
-            {
-                ElemType fTmp = (ElemType) LZERO;
-                for (int j = 0; j < iNumLab; j++)
-                {
-                    ElemType fAlpha = (j == firstLbl) ? (ElemType) 0.0 : (ElemType) LZERO;
-                    if (t > 0)
-                        fAlpha = alpha(j, t - 1);
-                    fTmp = alpha.LogAdd(fTmp, fAlpha + pair_scores(k, j));
-                }
-                fTmp += pos_scores(k, t); // include position dependent score
-                alpha(k, t) = fTmp;
-            }
-        }
-    }
-
-    // compute backward algorithm
-    static void BackwardCompute(const Matrix<ElemType>& alpha, Matrix<ElemType>& beta,
-                                Matrix<ElemType>& functionValues, const Matrix<ElemType>& lbls,
-                                const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores, const int shift = 1)
-    {
-        assert(shift == 1);
-
-        alpha.RCRFBackwardCompute(alpha, beta, functionValues, lbls, pos_scores, pair_scores, shift);
-    }
-
-    static void TransGrdCompute(const Matrix<ElemType>& lbls,
-                                const Matrix<ElemType>& alpha,
-                                const Matrix<ElemType>& beta,
-                                const Matrix<ElemType>& pair_scores,
-                                Matrix<ElemType>& grd,
-                                const int startLbl,
-                                const int shift = 1)
-    {
-        assert(shift == 1);
-
-        alpha.RCRFTransGrdCompute(lbls,
-                                  alpha,
-                                  beta,
-                                  pair_scores,
-                                  grd,
-                                  startLbl, shift);
-    }
-
-    // compute forward backward algorithm
-    static void PostProbCompute(Matrix<ElemType>& postprob, const Matrix<ElemType>& alpha, const Matrix<ElemType>& beta)
-    {
-        int iNumPos = alpha.GetNumCols();
-        int iNumLab = alpha.GetNumRows();
-
-        postprob.Resize(iNumLab, iNumPos);
-        postprob.SetValue(beta);
-        postprob.InplaceExp();
-    }
-
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
         Base::Validate(isFinalValidationPass);
@@ -1282,24 +1130,29 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<CRFNode<ElemType>>(nodeP);
-            node->mAlpha = mAlpha;
-            node->mBeta = mBeta;
-            node->mPostProb = mPostProb;
-
-            node->mStartLbl = mStartLbl;
-            node->mEndLbl = mEndLbl;
+            node->mAlpha.SetValue(mAlpha);
+            node->mPostProb.SetValue(mPostProb);
+            node->mNumParallelSequences = mNumParallelSequences;
+            node->mSequences = mSequences;
         }
     }
 
 private:
-    Matrix<ElemType> mAlpha; // TODO: m_Alpha etc.
-    Matrix<ElemType> mBeta;
-    Matrix<ElemType> mPostProb;
-    int mStartLbl;
-    int mEndLbl;
-};
+    // the CRF is computed on the CPU; a value on a GPU is copied into 'copyOnCPU'
+    static const Matrix<ElemType>& ValueOnCPU(const Matrix<ElemType>& value, Matrix<ElemType>& copyOnCPU)
+    {
+        if (value.GetDeviceId() == CPUDEVICE)
+            return value;
+        copyOnCPU = Matrix<ElemType>(value, CPUDEVICE);
+        return copyOnCPU;
+    }
 
-#endif
+    Matrix<ElemType> mAlpha;    // log forward scores, on the CPU
+    Matrix<ElemType> mPostProb; // label posteriors, on the CPU
+    Matrix<ElemType> mLabelsOnCPU, mPosScoresOnCPU, mPairScoresOnCPU;
+    size_t mNumParallelSequences;
+    std::vector<ParallelSequenceSpan> mSequences; // of the current minibatch
+};
 
 // -----------------------------------------------------------------------
 // LogisticNode (labels, prediction, weight)
@@ -1444,9 +1297,9 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<LogisticNode<ElemType>>(nodeP);
-            *node->m_classZeroLabels = *m_classZeroLabels;
-            *node->m_result = *m_result;
-            *node->m_temp = *m_temp;
+            CopyMatrixIfAllocated(m_classZeroLabels, node->m_classZeroLabels);
+            CopyMatrixIfAllocated(m_result, node->m_result);
+            CopyMatrixIfAllocated(m_temp, node->m_temp);
         }
     }
 
@@ -1563,7 +1416,7 @@ public:
             auto node = dynamic_pointer_cast<DropoutNode<ElemType>>(nodeP);
             node->m_dropoutRate = m_dropoutRate;
             node->m_randomSeed = m_randomSeed;
-            node->m_maskOfDropout = m_maskOfDropout;
+            CopyMatrixIfAllocated(m_maskOfDropout, node->m_maskOfDropout);
         }
     }
     // request matrices needed to do node function value evaluation
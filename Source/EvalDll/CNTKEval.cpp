@@ -10,6 +10,7 @@
 #include "Eval.h"
 #include "CNTKEval.h"
 #include "CPUMatrix.h" // for SetNumThreads()
+#include "RecurrentNodes.h"
 #include "SimpleOutputWriter.h"
 #ifdef LEAKDETECT
 #include <vld.h> // leak detection
@@ -47,6 +48,8 @@ void CNTKEval<ElemType>::Init(const std::string& config)
 {
     m_start = 0;
     m_config.Parse(config);
+    m_minibatchSize = m_config(L"minibatchSize", (size_t) 10240);
+    m_concurrentEvaluation = m_config(L"concurrentEvaluation", false);
     if (m_config.Exists("modelPath"))
     {
         std::wstring path = m_config("modelPath");
@@ -78,6 +81,27 @@ void CNTKEval<ElemType>::LoadModel(const std::wstring& modelFileName)
     DEVICEID_TYPE deviceId = DeviceFromConfig(m_config);
     fprintf(stderr, "DeviceID=%d\n", (int) deviceId);
     m_net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName);
+
+    // the state of open sessions belongs to the previous model
+    m_sessionOutputNodes.clear();
+    m_sessionInputNodes.clear();
+    m_sessionStateNodes.clear();
+    m_sessionStateOffsets.clear();
+    for (auto& iter : m_sessions)
+        iter.second.hasState = false;
+
+    // the parameters are not trained here, so the weight products can use packed copies of them, or optionally
+    // int8 copies with input ranges calibrated by the "quantize" command (CPU only)
+    std::wstring quantizationRangesPath;
+    if (m_config.Exists("quantizationRanges"))
+        quantizationRangesPath = (std::wstring) m_config(L"quantizationRanges");
+    m_net->PrepareForInference(quantizationRangesPath);
+
+    // contexts of the previous model (those still in use by Evaluate() calls keep it alive until they return)
+    {
+        std::lock_guard<std::mutex> lock(m_contextsMutex);
+        m_idleContexts.clear();
+    }
 }
 
 // GetNodeDimensions - Get the node dimensions of the specified nodes
@@ -93,13 +117,18 @@ void CNTKEval<ElemType>::GetNodeDimensions(std::map<std::wstring, size_t>& dimen
             iter->second = 0;
         return;
     }
+    GetNodeDimensions(m_net, dimensions, nodeGroup);
+}
 
-    const auto& outputNodes = m_net->OutputNodes();
+template <class ElemType>
+/*static*/ void CNTKEval<ElemType>::GetNodeDimensions(const ComputationNetworkPtr& net, std::map<std::wstring, size_t>& dimensions, NodeGroup nodeGroup)
+{
+    const auto& outputNodes = net->OutputNodes();
     switch (nodeGroup)
     {
     case nodeInput:
     {
-        auto& nodes = m_net->InputNodes(outputNodes[0]);
+        auto& nodes = net->InputNodes(outputNodes[0]);
         for (auto& node : nodes)
         {
             std::wstring name = node->NodeName();
@@ -122,7 +151,7 @@ void CNTKEval<ElemType>::GetNodeDimensions(std::map<std::wstring, size_t>& dimen
     case nodeSpecified:
         for (auto iter = dimensions.begin(); iter != dimensions.end(); iter++)
         {
-            auto node = m_net->GetNodeFromName(iter->first);
+            auto node = net->GetNodeFromName(iter->first);
             iter->second = node->GetSampleMatrixNumRows();
         }
         break;
@@ -143,7 +172,12 @@ void CNTKEval<ElemType>::StartEvaluateMinibatchLoop(const std::wstring& outputNo
 template <class ElemType>
 void CNTKEval<ElemType>::Evaluate(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs)
 {
-    size_t minibatchSize = m_config(L"minibatchSize", (size_t) 10240);
+    if (m_concurrentEvaluation)
+    {
+        EvaluateInContext(inputs, outputs);
+        return;
+    }
+
     // get the evaluation names from the output string
     vector<wstring> outNodeNames;
 
@@ -172,7 +206,65 @@ void CNTKEval<ElemType>::Evaluate(std::map<std::wstring, std::vector<ElemType>*>
 
     // call the evaluator
     SimpleOutputWriter<ElemType> eval(m_net);
-    eval.WriteOutput(*m_reader, minibatchSize, *m_writer, outNodeNames);
+    eval.WriteOutput(*m_reader, m_minibatchSize, *m_writer, outNodeNames);
+    m_sessionOutputNodes.clear(); // (the matrices have been reallocated)
+}
+
+// AcquireContext - get an idle context, or create one
+template <class ElemType>
+ComputationNetworkPtr CNTKEval<ElemType>::AcquireContext()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_contextsMutex);
+        if (!m_idleContexts.empty())
+        {
+            ComputationNetworkPtr context = m_idleContexts.back();
+            m_idleContexts.pop_back();
+            return context;
+        }
+    }
+
+    // (the packed or int8 copies of the weights that PrepareForInference() made are shared along with the parameters)
+    return m_net->CopySharingParameters<ElemType>();
+}
+
+// ReleaseContext - return a context after use
+template <class ElemType>
+void CNTKEval<ElemType>::ReleaseContext(const ComputationNetworkPtr& context)
+{
+    std::lock_guard<std::mutex> lock(m_contextsMutex);
+    m_idleContexts.push_back(context);
+}
+
+// EvaluateInContext - Evaluate() in concurrent mode
+// Everything that the call modifies is local to it or to its context, so that calls can run concurrently.
+// The frames of the call are one sequence, or one per minibatch if there are more than minibatchSize.
+template <class ElemType>
+void CNTKEval<ElemType>::EvaluateInContext(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs)
+{
+    ComputationNetworkPtr context = AcquireContext();
+    try
+    {
+        ConfigParameters config;
+        std::map<std::wstring, size_t> inputDimensions, outputDimensions;
+        GetNodeDimensions(context, inputDimensions, nodeInput);
+        GetNodeDimensions(context, outputDimensions, nodeOutput);
+
+        EvalReader<ElemType> reader(config);
+        reader.SetData(&inputs, &inputDimensions);
+        reader.SetBoundary(0); // (a new reader starts a sequence)
+        EvalWriter<ElemType> writer(config);
+        writer.SetData(&outputs, &outputDimensions);
+
+        SimpleOutputWriter<ElemType> eval(context);
+        eval.WriteOutput(reader, m_minibatchSize, writer, vector<wstring>());
+    }
+    catch (...)
+    {
+        ReleaseContext(context);
+        throw;
+    }
+    ReleaseContext(context);
 }
 
 // ResetState - Reset the cell state when we get start of an utterance
@@ -182,6 +274,224 @@ void CNTKEval<ElemType>::ResetState()
     m_start = 1 - m_start;
 }
 
+// OpenSession - open a streaming session, an independent stream of frames with its own recurrent state
+// Sessions share the model. Each EvaluateSessions() call evaluates a chunk of frames for some of them,
+// as parallel sequences of one minibatch, and carries their recurrent state over to the next chunk.
+template <class ElemType>
+size_t CNTKEval<ElemType>::OpenSession()
+{
+    size_t sessionId = m_nextSessionId++;
+    m_sessions[sessionId].hasState = false;
+    return sessionId;
+}
+
+// CloseSession - close a session and free its state
+template <class ElemType>
+void CNTKEval<ElemType>::CloseSession(size_t sessionId)
+{
+    if (m_sessions.erase(sessionId) == 0)
+        InvalidArgument("CloseSession: Session %d is not open.", (int) sessionId);
+}
+
+// PrepareSessionOutputs - allocate the network for evaluating the given output nodes, and determine their inputs and PastValue nodes
+template <class ElemType>
+void CNTKEval<ElemType>::PrepareSessionOutputs(const std::vector<ComputationNodeBasePtr>& outputNodes)
+{
+    if (outputNodes == m_sessionOutputNodes)
+        return;
+
+    m_net->AllocateAllMatrices({}, outputNodes, nullptr);
+    m_net->StartEvaluateMinibatchLoop(outputNodes);
+
+    std::vector<ComputationNodeBasePtr> inputNodes;
+    std::vector<shared_ptr<IStatefulNode>> stateNodes;
+    std::vector<size_t> stateOffsets(1, 0);
+    for (const auto& outputNode : outputNodes)
+    {
+        for (const auto& node : m_net->InputNodes(outputNode))
+        {
+            if (std::find(inputNodes.begin(), inputNodes.end(), node) == inputNodes.end())
+                inputNodes.push_back(node);
+        }
+        for (const auto& node : m_net->GetEvalOrder(outputNode))
+        {
+            auto stateNode = dynamic_pointer_cast<IStatefulNode>(node);
+            if (!stateNode || std::find(stateNodes.begin(), stateNodes.end(), stateNode) != stateNodes.end())
+                continue;
+            if (!dynamic_pointer_cast<PastValueNode<ElemType>>(node)) // FutureValue nodes would need the frames of the next chunk
+                RuntimeError("EvaluateSessions: %ls %ls operation cannot carry its state from one chunk of a stream to the next, only PastValue nodes can.", node->NodeName().c_str(), node->OperationName().c_str());
+            stateNodes.push_back(stateNode);
+            stateOffsets.push_back(stateOffsets.back() + node->GetSampleMatrixNumRows());
+        }
+    }
+
+    // sessions keep their state across calls that request different outputs, as long as these depend on the same PastValue nodes
+    if (stateNodes != m_sessionStateNodes)
+    {
+        for (const auto& iter : m_sessions)
+        {
+            if (iter.second.hasState)
+                RuntimeError("EvaluateSessions: The requested outputs depend on other recurrent nodes than in earlier calls. Close the open sessions first.");
+        }
+    }
+
+    m_sessionOutputNodes = outputNodes;
+    m_sessionInputNodes = std::move(inputNodes);
+    m_sessionStateNodes = std::move(stateNodes);
+    m_sessionStateOffsets = std::move(stateOffsets);
+}
+
+// EvaluateSessions - Evaluate the next chunk of frames of each of the given sessions, as parallel sequences of one minibatch
+// sessionIds - the sessions to continue, each at most once
+// inputs - per session, map from node name to the input frames of the chunk (the chunks may have different numbers of frames)
+// outputs - per session, map from node name to output vector; all sessions must request the same nodes, sizing will happen during evaluation
+template <class ElemType>
+void CNTKEval<ElemType>::EvaluateSessions(const std::vector<size_t>& sessionIds, std::vector<std::map<std::wstring, std::vector<ElemType>*>>& inputs, std::vector<std::map<std::wstring, std::vector<ElemType>*>>& outputs)
+{
+    const size_t numSessions = sessionIds.size();
+    if (inputs.size() != numSessions || outputs.size() != numSessions)
+        InvalidArgument("EvaluateSessions: Expected inputs and outputs for each of the %d sessions.", (int) numSessions);
+    if (numSessions == 0)
+        return;
+
+    std::vector<Session*> sessions;
+    for (size_t sessionId : sessionIds)
+    {
+        auto iter = m_sessions.find(sessionId);
+        if (iter == m_sessions.end())
+            InvalidArgument("EvaluateSessions: Session %d is not open.", (int) sessionId);
+        if (std::find(sessions.begin(), sessions.end(), &iter->second) != sessions.end())
+            InvalidArgument("EvaluateSessions: Session %d is given more than once.", (int) sessionId);
+        sessions.push_back(&iter->second);
+    }
+
+    std::vector<ComputationNodeBasePtr> outputNodes;
+    for (const auto& iter : outputs[0])
+        outputNodes.push_back(m_net->GetNodeFromName(iter.first));
+    if (outputNodes.empty())
+        InvalidArgument("EvaluateSessions: No outputs requested.");
+    for (const auto& sessionOutputs : outputs)
+    {
+        if (sessionOutputs.size() != outputNodes.size())
+            InvalidArgument("EvaluateSessions: All sessions must request the same outputs.");
+        for (const auto& node : outputNodes)
+        {
+            if (sessionOutputs.find(node->NodeName()) == sessionOutputs.end())
+                InvalidArgument("EvaluateSessions: All sessions must request the same outputs.");
+        }
+    }
+    PrepareSessionOutputs(outputNodes);
+
+    // number of frames of each chunk
+    std::vector<size_t> numFrames(numSessions, 0);
+    size_t numTimeSteps = 0;
+    for (size_t i = 0; i < numSessions; i++)
+    {
+        for (const auto& node : m_sessionInputNodes)
+        {
+            auto iter = inputs[i].find(node->NodeName());
+            if (iter == inputs[i].end())
+                InvalidArgument("EvaluateSessions: No data for input %ls of session %d.", node->NodeName().c_str(), (int) sessionIds[i]);
+            const size_t rows = node->GetSampleMatrixNumRows();
+            const size_t count = iter->second->size();
+            if (count == 0 || count % rows != 0 || (numFrames[i] != 0 && count / rows != numFrames[i]))
+                InvalidArgument("EvaluateSessions: The data for input %ls of session %d is not a whole, non-zero number of frames of dimension %d, equal for all inputs.", node->NodeName().c_str(), (int) sessionIds[i], (int) rows);
+            numFrames[i] = count / rows;
+        }
+        numTimeSteps = (std::max)(numTimeSteps, numFrames[i]);
+    }
+
+    // one parallel sequence per session; chunks that continue a stream start before the minibatch, and shorter chunks are padded with gaps
+    auto pMBLayout = m_net->GetMBLayoutPtr();
+    pMBLayout->Init(numSessions, numTimeSteps);
+    for (size_t i = 0; i < numSessions; i++)
+    {
+        pMBLayout->AddSequence(NEW_SEQUENCE_ID, i, sessions[i]->hasState ? -1 : 0, numFrames[i] < numTimeSteps ? numFrames[i] : numTimeSteps + 1);
+        pMBLayout->AddGap(i, numFrames[i], numTimeSteps);
+    }
+
+    // interleave the chunks into the input nodes
+    const DEVICEID_TYPE deviceId = m_net->GetDeviceId();
+    std::vector<ElemType> buffer;
+    for (const auto& node : m_sessionInputNodes)
+    {
+        const size_t rows = node->GetSampleMatrixNumRows();
+        buffer.assign(rows * numSessions * numTimeSteps, 0);
+        for (size_t i = 0; i < numSessions; i++)
+        {
+            const ElemType* data = inputs[i][node->NodeName()]->data();
+            for (size_t t = 0; t < numFrames[i]; t++)
+                std::copy(data + t * rows, data + (t + 1) * rows, buffer.begin() + (t * numSessions + i) * rows);
+        }
+        auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+        value.SetValue(rows, numSessions * numTimeSteps, deviceId, buffer.data(), matrixFlagNormal);
+        node->NotifyFunctionValuesMBSizeModified();
+    }
+    m_net->DetermineActualMBSizeFromFeatures();
+
+    // import the state of the sessions, as if they had been the parallel sequences of the previous minibatch
+    auto pDelayedMBLayout = make_shared<MBLayout>();
+    pDelayedMBLayout->Init(numSessions, 1);
+    for (size_t i = 0; i < numSessions; i++)
+        pDelayedMBLayout->AddSequence(NEW_SEQUENCE_ID, i, 0, 2);
+    for (size_t k = 0; k < m_sessionStateNodes.size(); k++)
+    {
+        const size_t offset = m_sessionStateOffsets[k];
+        const size_t rows = m_sessionStateOffsets[k + 1] - offset;
+        buffer.assign(rows * numSessions, 0); // (sessions without state start a sequence, so their column is not used)
+        for (size_t i = 0; i < numSessions; i++)
+        {
+            if (sessions[i]->hasState)
+                std::copy(sessions[i]->state.begin() + offset, sessions[i]->state.begin() + offset + rows, buffer.begin() + i * rows);
+        }
+        auto pState = make_shared<DelayedValueNodeState<ElemType>>(deviceId);
+        pState->CacheState(Matrix<ElemType>(rows, numSessions, buffer.data(), matrixFlagNormal, deviceId));
+        pState->CacheDelayedMBLayout(pDelayedMBLayout);
+        m_sessionStateNodes[k]->ImportState(pState);
+    }
+
+    ComputationNetwork::BumpEvalTimeStamp(m_sessionInputNodes);
+    for (const auto& node : m_sessionOutputNodes)
+        m_net->ForwardProp(node);
+
+    // keep the state of each session, i.e. the delayed values after its last frame
+    for (size_t k = 0; k < m_sessionStateNodes.size(); k++)
+    {
+        auto pState = dynamic_pointer_cast<DelayedValueNodeState<ElemType>>(m_sessionStateNodes[k]->ExportState());
+        if (!pState || pState->IsEmpty())
+            LogicError("EvaluateSessions: No state exported.");
+        const size_t offset = m_sessionStateOffsets[k];
+        const size_t rows = m_sessionStateOffsets[k + 1] - offset;
+        ElemType* state = pState->ExportCachedActivity().CopyToArray();
+        for (size_t i = 0; i < numSessions; i++)
+        {
+            sessions[i]->state.resize(m_sessionStateOffsets.back());
+            std::copy(state + i * rows, state + (i + 1) * rows, sessions[i]->state.begin() + offset);
+        }
+        delete[] state;
+    }
+    for (auto session : sessions)
+        session->hasState = true;
+
+    // de-interleave the outputs
+    for (const auto& node : m_sessionOutputNodes)
+    {
+        const auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+        if (value.GetNumCols() != numSessions * numTimeSteps)
+            RuntimeError("EvaluateSessions: Output %ls does not have one column per frame.", node->NodeName().c_str());
+        const size_t rows = value.GetNumRows();
+        ElemType* data = value.CopyToArray();
+        for (size_t i = 0; i < numSessions; i++)
+        {
+            std::vector<ElemType>& output = *outputs[i][node->NodeName()];
+            output.resize(rows * numFrames[i]);
+            for (size_t t = 0; t < numFrames[i]; t++)
+                std::copy(data + (t * numSessions + i) * rows, data + (t * numSessions + i + 1) * rows, output.begin() + t * rows);
+        }
+        delete[] data;
+    }
+}
+
 // instantiate all the combinations we expect to be used
 template class CNTKEval<double>;
 template class CNTKEval<float>;
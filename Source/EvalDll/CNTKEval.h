@@ -9,6 +9,7 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <mutex>
 
 #include "Eval.h"
 #include "EvalReader.h"
@@ -28,11 +29,42 @@ class CNTKEval : public IEvaluateModel<ElemType>
     ComputationNetworkPtr m_net;
     std::map<std::wstring, size_t> m_dimensions;
     size_t m_start;
+    size_t m_minibatchSize;
+
+    // concurrent evaluation
+    // Each concurrent Evaluate() call uses a context, a copy of m_net made in memory whose parameters share the value matrices of m_net,
+    // so that it only holds activations and an MBLayout. Contexts are created on demand and reused, so there are as many as the largest
+    // number of concurrent calls so far.
+    bool m_concurrentEvaluation;
+    std::mutex m_contextsMutex;                        // guards m_idleContexts
+    std::vector<ComputationNetworkPtr> m_idleContexts; // contexts not in use by an Evaluate() call
+
+    ComputationNetworkPtr AcquireContext();
+    void ReleaseContext(const ComputationNetworkPtr& context);
+    void EvaluateInContext(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs);
+    static void GetNodeDimensions(const ComputationNetworkPtr& net, std::map<std::wstring, size_t>& dimensions, NodeGroup nodeGroup);
+
+    // streaming sessions
+    // The recurrent state of a session is the delayed value of each PastValue node that the requested outputs depend on,
+    // kept as the concatenation of one column per node between calls.
+    struct Session
+    {
+        std::vector<ElemType> state;
+        bool hasState; // false until the first chunk has been evaluated
+    };
+    std::map<size_t, Session> m_sessions;
+    size_t m_nextSessionId;
+    std::vector<ComputationNodeBasePtr> m_sessionOutputNodes;   // outputs for which the network has been prepared
+    std::vector<ComputationNodeBasePtr> m_sessionInputNodes;    // inputs they depend on
+    std::vector<shared_ptr<IStatefulNode>> m_sessionStateNodes; // PastValue nodes they depend on
+    std::vector<size_t> m_sessionStateOffsets;                  // offset of each node's column in Session::state, and the total size at the end
+
+    void PrepareSessionOutputs(const std::vector<ComputationNodeBasePtr>& outputNodes);
 
 public:
     // constructor
     CNTKEval()
-        : m_reader(nullptr), m_net(nullptr)
+        : m_reader(nullptr), m_writer(nullptr), m_net(nullptr), m_concurrentEvaluation(false), m_nextSessionId(0)
     {
     }
 
@@ -57,5 +89,10 @@ public:
     virtual void Init(const std::string& config);
     virtual void Destroy();
     virtual void ResetState();
+
+    // streaming sessions that share the model, see Eval.h
+    virtual size_t OpenSession();
+    virtual void CloseSession(size_t sessionId);
+    virtual void EvaluateSessions(const std::vector<size_t>& sessionIds, std::vector<std::map<std::wstring, std::vector<ElemType>*>>& inputs, std::vector<std::map<std::wstring, std::vector<ElemType>*>>& outputs);
 };
 } } }
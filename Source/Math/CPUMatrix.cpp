@@ -21,6 +21,7 @@
 #include <thread>
 #include <iostream>
 #include <algorithm>
+#include <emmintrin.h> // SSE2, for the int8 GEMM
 #ifdef _WIN32
 #define NOMINMAX
 #include "Windows.h"
@@ -121,6 +122,8 @@ void CPUMatrix<ElemType>::ZeroInit()
     m_matrixName = NULL;
     m_format = matrixFormatDense;
     m_externalBuffer = false;
+    m_packedForMultiply.reset();
+    m_quantizedForMultiply.reset();
 }
 
 template <class ElemType>
@@ -204,6 +207,8 @@ CPUMatrix<ElemType>::CPUMatrix(CPUMatrix<ElemType>&& moveFrom)
     m_matrixName = moveFrom.m_matrixName;
     m_format = moveFrom.m_format;
     m_externalBuffer = moveFrom.m_externalBuffer;
+    m_packedForMultiply = moveFrom.m_packedForMultiply; // still valid since it refers to the same buffer
+    m_quantizedForMultiply = moveFrom.m_quantizedForMultiply;
     // release the pointer from the source object so that the destructor won't release it twice
     moveFrom.ZeroInit();
 }
@@ -224,6 +229,8 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::operator=(CPUMatrix<ElemType>&& moveFr
         m_pArray = moveFrom.m_pArray;
         m_format = moveFrom.m_format;
         m_externalBuffer = moveFrom.m_externalBuffer;
+        m_packedForMultiply = moveFrom.m_packedForMultiply;
+        m_quantizedForMultiply = moveFrom.m_quantizedForMultiply;
 
         // release the pointer from the source object so that the destructor won't release it twice
         moveFrom.ZeroInit();
@@ -690,6 +697,8 @@ void CPUMatrix<ElemType>::SetValue(const ElemType v)
 {
     if (IsEmpty())
         LogicError("SetValue: Matrix is empty.");
+    ReleasePackedCopy();
+    ReleaseQuantizedCopy();
     bool isFinite = std::numeric_limits<ElemType>::is_integer || std::isfinite((double) v);
     if (isFinite && v == 0)
     {
@@ -830,6 +839,8 @@ void CPUMatrix<ElemType>::SetValue(const CPUMatrix<ElemType>& deepCopyFrom)
     if (this == &deepCopyFrom)
         return;
 
+    ReleasePackedCopy();
+    ReleaseQuantizedCopy();
     Resize(deepCopyFrom.GetNumRows(), deepCopyFrom.GetNumCols());
     memcpy(m_pArray, deepCopyFrom.m_pArray, deepCopyFrom.GetNumElements() * sizeof(ElemType));
 }
@@ -840,6 +851,8 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
     if (pArray == nullptr)
         InvalidArgument("Invalid pArray.");
 
+    ReleasePackedCopy();
+    ReleaseQuantizedCopy();
     m_format = matrixFormatDense;
     m_computeDevice = CPUDEVICE;
 
@@ -847,7 +860,7 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
     if (matrixFlags & matrixFlagDontOwnBuffer)
     {
         // free previous array allocation if any before overwriting
-        if (m_pArray != nullptr)
+        if (OwnBuffer() && m_pArray != nullptr)
             delete[] m_pArray;
 
         m_pArray = pArray;
@@ -995,6 +1008,8 @@ void CPUMatrix<ElemType>::SetUniformRandomValue(const ElemType low, const ElemTy
 {
     if (IsEmpty())
         LogicError("SetUniformRandomValue: Matrix is empty.");
+    ReleasePackedCopy();
+    ReleaseQuantizedCopy();
 
 #ifdef _MSC_VER // TODO: check if available under GCC/Linux
     std::ranlux64_base_01 generator;
@@ -1028,6 +1043,8 @@ void CPUMatrix<ElemType>::SetGaussianRandomValue(const ElemType mean, const Elem
 
     if (IsEmpty())
         LogicError("SetUniformRandomValue: Matrix is empty.");
+    ReleasePackedCopy();
+    ReleaseQuantizedCopy();
 
     auto& us = *this;
 #ifdef _MSC_VER // TODO: check if available under GCC/Linux
@@ -1357,6 +1374,8 @@ void CPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
     if (m_numRows == numRows && m_numCols == numCols)
         return;
 
+    ReleasePackedCopy();
+    ReleaseQuantizedCopy();
     size_t numElements = numRows * numCols;
     if (numElements > m_elemSizeAllocated ||                 // grow allocation
         (!growOnly && (numElements != m_elemSizeAllocated))) // shrink allocation (not if 'growOnly')
@@ -3963,6 +3982,290 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddAveragePoolingGradient(const CPUMat
 }
 #pragma endregion Other Helper Functions
 
+#pragma region Packed GEMM Operands
+
+// MKL 2017 added an API to pack a GEMM operand once and reuse it across calls (cblas_?gemm_pack/compute).
+// Regular cblas_?gemm() repacks both operands internally on every call, which is a large fraction of the cost for small minibatches.
+// This is only available when building with MATHLIB=mkl (USE_MKL) against MKL 2017 or later. With ACML (the default, and the
+// Windows build) PackForMultiply() returns false and nothing below is used.
+#if defined(USE_MKL) && defined(INTEL_MKL_VERSION) && INTEL_MKL_VERSION >= 20170000
+#define USE_MKL_PACKED_GEMM
+
+static float* PackedGEMMAlloc(const float*, int m, int k)   { return cblas_sgemm_alloc(CblasAMatrix, m, 1, k); }
+static double* PackedGEMMAlloc(const double*, int m, int k) { return cblas_dgemm_alloc(CblasAMatrix, m, 1, k); }
+static void PackedGEMMFree(float* packed)  { cblas_sgemm_free(packed); }
+static void PackedGEMMFree(double* packed) { cblas_dgemm_free(packed); }
+
+// pack 'a' with alpha = 1
+static void PackedGEMMPack(const bool transpose, int m, int k, const float* a, int lda, float* packed)
+{
+    cblas_sgemm_pack(CblasColMajor, CblasAMatrix, transpose ? CblasTrans : CblasNoTrans, m, 1, k, 1.0f, a, lda, packed);
+}
+static void PackedGEMMPack(const bool transpose, int m, int k, const double* a, int lda, double* packed)
+{
+    cblas_dgemm_pack(CblasColMajor, CblasAMatrix, transpose ? CblasTrans : CblasNoTrans, m, 1, k, 1.0, a, lda, packed);
+}
+
+// c = packed(a) * op(b) + beta * c
+static void PackedGEMMCompute(int m, int n, int k, const float* packed, const bool transposeB, const float* b, int ldb, float beta, float* c, int ldc)
+{
+    cblas_sgemm_compute(CblasColMajor, CblasPacked, transposeB ? CblasTrans : CblasNoTrans, m, n, k, packed, m, b, ldb, beta, c, ldc);
+}
+static void PackedGEMMCompute(int m, int n, int k, const double* packed, const bool transposeB, const double* b, int ldb, double beta, double* c, int ldc)
+{
+    cblas_dgemm_compute(CblasColMajor, CblasPacked, transposeB ? CblasTrans : CblasNoTrans, m, n, k, packed, m, b, ldb, beta, c, ldc);
+}
+#endif
+
+// packed copy of a matrix, and what it was made from
+// The source buffer and dimensions are remembered so that a stale copy is never used if the matrix was reallocated or reshaped.
+template <class ElemType>
+struct CPUPackedGEMMOperand
+{
+    const ElemType* m_source;
+    size_t m_numRows;
+    size_t m_numCols;
+    bool m_transposed;
+    ElemType* m_packed;
+
+    CPUPackedGEMMOperand(const ElemType* source, size_t numRows, size_t numCols, bool transposed)
+        : m_source(source), m_numRows(numRows), m_numCols(numCols), m_transposed(transposed), m_packed(nullptr)
+    {
+    }
+    ~CPUPackedGEMMOperand()
+    {
+#ifdef USE_MKL_PACKED_GEMM
+        if (m_packed)
+            PackedGEMMFree(m_packed);
+#endif
+    }
+    bool IsPackOf(const ElemType* source, size_t numRows, size_t numCols, bool transposed) const
+    {
+        return m_source == source && m_numRows == numRows && m_numCols == numCols && m_transposed == transposed;
+    }
+};
+
+// pack this matrix for use as the left operand of MultiplyAndWeightedAdd() with the given transposition
+// This is a no-op if a valid packed copy exists already.
+template <class ElemType>
+bool CPUMatrix<ElemType>::PackForMultiply(const bool transpose)
+{
+#ifdef USE_MKL_PACKED_GEMM
+    if (m_packedForMultiply && m_packedForMultiply->IsPackOf(m_pArray, m_numRows, m_numCols, transpose))
+        return true;
+    if (IsEmpty())
+        LogicError("PackForMultiply: Matrix is empty.");
+
+    int m = (int) (transpose ? m_numCols : m_numRows);
+    int k = (int) (transpose ? m_numRows : m_numCols);
+    auto packed = make_shared<CPUPackedGEMMOperand<ElemType>>(m_pArray, m_numRows, m_numCols, transpose);
+    packed->m_packed = PackedGEMMAlloc(m_pArray, m, k);
+    if (!packed->m_packed)
+        RuntimeError("PackForMultiply: Failed to allocate the packed matrix.");
+    PackedGEMMPack(transpose, m, k, m_pArray, (int) m_numRows, packed->m_packed);
+    m_packedForMultiply = packed;
+    return true;
+#else
+    transpose;
+    return false;
+#endif
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::ReleasePackedCopy()
+{
+    if (m_packedForMultiply) // (no write otherwise, so that networks that share this matrix can call this while others multiply with it)
+        m_packedForMultiply.reset();
+}
+
+#pragma endregion Packed GEMM Operands
+
+#pragma region Quantized GEMM Operands
+
+// The int8 dot products are computed with SSE2 (_mm_madd_epi16 on values sign-extended to 16 bits), which every x64 CPU has.
+// Rows of op(a) and columns of op(b) are stored with a stride that is a multiple of the vector width, and padded with zeros
+// to whole register blocks (see QuantizedDotProducts()), so that the kernel needs no edge cases.
+static const size_t QuantizedGEMMStep = 8;     // int8 values per multiply-add
+static const size_t QuantizedGEMMRowBlock = 4; // rows of op(a) per register block
+static const size_t QuantizedGEMMColBlock = 2; // columns of op(b) per register block
+
+static size_t QuantizedGEMMRoundUp(size_t n, size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+// int8 copy of a matrix for use as the left operand of MultiplyAndWeightedAdd(), and what it was made from
+// op(a) is stored row-major so that each output element is a contiguous int8 dot product. Each row has its own scale,
+// which for a weight matrix W of a Times or unrolled Convolution is one scale per output channel.
+template <class ElemType>
+struct CPUQuantizedGEMMOperand
+{
+    const ElemType* m_source;
+    size_t m_numRows;
+    size_t m_numCols;
+    bool m_transposed;
+    ElemType m_rightRange;             // op(b) is clipped to [-m_rightRange, m_rightRange]; 0 means per column from the data
+    size_t m_stride;                   // distance between rows in m_values: k rounded up to QuantizedGEMMStep
+    std::vector<signed char> m_values; // op(a)(i,p) ~= m_rowScales[i] * m_values[i * m_stride + p]; rows padded with zeros to QuantizedGEMMRowBlock
+    std::vector<ElemType> m_rowScales;
+
+    CPUQuantizedGEMMOperand(const ElemType* source, size_t numRows, size_t numCols, bool transposed, ElemType rightRange)
+        : m_source(source), m_numRows(numRows), m_numCols(numCols), m_transposed(transposed), m_rightRange(rightRange), m_stride(0)
+    {
+    }
+    bool IsQuantizationOf(const ElemType* source, size_t numRows, size_t numCols, bool transposed) const
+    {
+        return m_source == source && m_numRows == numRows && m_numCols == numCols && m_transposed == transposed;
+    }
+};
+
+static const int QuantizedGEMMMaxValue = 127; // symmetric range, -128 is not used
+
+// quantize this matrix to int8 for use as the left operand of MultiplyAndWeightedAdd() with the given transposition
+// 'rightOperandRange' is the (calibrated) largest absolute value expected in the right operand; values beyond it are clipped.
+// This is a no-op if a valid copy for the same transposition and range exists already.
+template <class ElemType>
+void CPUMatrix<ElemType>::QuantizeForMultiply(const bool transpose, const ElemType rightOperandRange)
+{
+    if (m_quantizedForMultiply && m_quantizedForMultiply->IsQuantizationOf(m_pArray, m_numRows, m_numCols, transpose) && m_quantizedForMultiply->m_rightRange == rightOperandRange)
+        return;
+    if (IsEmpty())
+        LogicError("QuantizeForMultiply: Matrix is empty.");
+    if (rightOperandRange < 0)
+        InvalidArgument("QuantizeForMultiply: The range of the right operand must not be negative.");
+
+    const size_t m = transpose ? m_numCols : m_numRows;
+    const size_t k = transpose ? m_numRows : m_numCols;
+    if (k > (size_t) (numeric_limits<int>::max)() / (QuantizedGEMMMaxValue * QuantizedGEMMMaxValue))
+        InvalidArgument("QuantizeForMultiply: Inner dimension %d is too large for int32 accumulation.", (int) k);
+
+    auto quantized = make_shared<CPUQuantizedGEMMOperand<ElemType>>(m_pArray, m_numRows, m_numCols, transpose, rightOperandRange);
+    quantized->m_stride = QuantizedGEMMRoundUp(k, QuantizedGEMMStep);
+    quantized->m_values.assign(QuantizedGEMMRoundUp(m, QuantizedGEMMRowBlock) * quantized->m_stride, 0);
+    quantized->m_rowScales.resize(m);
+    const auto& us = *this;
+#pragma omp parallel for
+    for (long i = 0; i < (long) m; i++)
+    {
+        ElemType maxAbs = 0;
+        for (size_t p = 0; p < k; p++)
+            maxAbs = max(maxAbs, (ElemType) fabs(transpose ? us(p, i) : us(i, p)));
+        const ElemType scale = maxAbs / QuantizedGEMMMaxValue;
+        quantized->m_rowScales[i] = scale;
+        signed char* row = quantized->m_values.data() + i * quantized->m_stride;
+        for (size_t p = 0; p < k; p++)
+            row[p] = scale > 0 ? (signed char) round((transpose ? us(p, i) : us(i, p)) / scale) : 0;
+    }
+    m_quantizedForMultiply = quantized;
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::ReleaseQuantizedCopy()
+{
+    if (m_quantizedForMultiply) // (see ReleasePackedCopy())
+        m_quantizedForMultiply.reset();
+}
+
+// load QuantizedGEMMStep int8 values and sign-extend them to int16
+static inline __m128i QuantizedGEMMLoad(const signed char* p)
+{
+    const __m128i v = _mm_loadl_epi64((const __m128i*) p);
+    return _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+}
+
+// sum of the four int32 lanes
+static inline int QuantizedGEMMSum(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+// int32 dot products of a block of 4 rows of op(a) with 2 columns of op(b), both 'stride' apart (a multiple of QuantizedGEMMStep)
+// Each loaded value is used two or four times, and the 8 accumulators stay in registers.
+static void QuantizedDotProducts(const signed char* rows, const signed char* cols, size_t stride, int result[QuantizedGEMMRowBlock][QuantizedGEMMColBlock])
+{
+    __m128i s00 = _mm_setzero_si128(), s01 = s00, s10 = s00, s11 = s00, s20 = s00, s21 = s00, s30 = s00, s31 = s00;
+    for (size_t p = 0; p < stride; p += QuantizedGEMMStep)
+    {
+        const __m128i y0 = QuantizedGEMMLoad(cols + p);
+        const __m128i y1 = QuantizedGEMMLoad(cols + stride + p);
+        __m128i x = QuantizedGEMMLoad(rows + p);
+        s00 = _mm_add_epi32(s00, _mm_madd_epi16(x, y0));
+        s01 = _mm_add_epi32(s01, _mm_madd_epi16(x, y1));
+        x = QuantizedGEMMLoad(rows + stride + p);
+        s10 = _mm_add_epi32(s10, _mm_madd_epi16(x, y0));
+        s11 = _mm_add_epi32(s11, _mm_madd_epi16(x, y1));
+        x = QuantizedGEMMLoad(rows + 2 * stride + p);
+        s20 = _mm_add_epi32(s20, _mm_madd_epi16(x, y0));
+        s21 = _mm_add_epi32(s21, _mm_madd_epi16(x, y1));
+        x = QuantizedGEMMLoad(rows + 3 * stride + p);
+        s30 = _mm_add_epi32(s30, _mm_madd_epi16(x, y0));
+        s31 = _mm_add_epi32(s31, _mm_madd_epi16(x, y1));
+    }
+    result[0][0] = QuantizedGEMMSum(s00);
+    result[0][1] = QuantizedGEMMSum(s01);
+    result[1][0] = QuantizedGEMMSum(s10);
+    result[1][1] = QuantizedGEMMSum(s11);
+    result[2][0] = QuantizedGEMMSum(s20);
+    result[2][1] = QuantizedGEMMSum(s21);
+    result[3][0] = QuantizedGEMMSum(s30);
+    result[3][1] = QuantizedGEMMSum(s31);
+}
+
+// c = alpha * quantized(a) * op(b) + beta * c
+// op(b) is quantized first, one column at a time with a single scale, in the same padded layout as the rows of 'a'.
+// The product is then computed in register blocks of 4 x 2 output elements, see QuantizedDotProducts().
+template <class ElemType>
+static void QuantizedGEMM(int m, int n, int k, ElemType alpha, const CPUQuantizedGEMMOperand<ElemType>& a, const bool transposeB, const ElemType* b, int ldb, ElemType beta, ElemType* c, int ldc)
+{
+    const size_t stride = a.m_stride;
+    std::vector<signed char> columns(QuantizedGEMMRoundUp(n, QuantizedGEMMColBlock) * stride, 0);
+    std::vector<ElemType> columnScales(n);
+#pragma omp parallel for
+    for (long j = 0; j < n; j++)
+    {
+        ElemType range = a.m_rightRange;
+        if (range == 0)
+        {
+            for (int p = 0; p < k; p++)
+                range = max(range, (ElemType) fabs(transposeB ? b[j + p * (size_t) ldb] : b[p + j * (size_t) ldb]));
+        }
+        const ElemType scale = range / QuantizedGEMMMaxValue;
+        const ElemType invScale = scale > 0 ? 1 / scale : 0;
+        signed char* column = columns.data() + j * stride;
+        for (int p = 0; p < k; p++)
+        {
+            ElemType v = round((transposeB ? b[j + p * (size_t) ldb] : b[p + j * (size_t) ldb]) * invScale);
+            column[p] = (signed char) max((ElemType) -QuantizedGEMMMaxValue, min((ElemType) QuantizedGEMMMaxValue, v));
+        }
+        columnScales[j] = scale;
+    }
+
+    // one loop over all blocks, so that a product with a single column (e.g. one sample at a time) is parallelized as well
+    const long numRowBlocks = (long) QuantizedGEMMRoundUp(m, QuantizedGEMMRowBlock) / QuantizedGEMMRowBlock;
+    const long numColBlocks = (long) QuantizedGEMMRoundUp(n, QuantizedGEMMColBlock) / QuantizedGEMMColBlock;
+#pragma omp parallel for
+    for (long block = 0; block < numRowBlocks * numColBlocks; block++)
+    {
+        const int i0 = (int) (block % numRowBlocks * QuantizedGEMMRowBlock);
+        const int j0 = (int) (block / numRowBlocks * QuantizedGEMMColBlock);
+        int acc[QuantizedGEMMRowBlock][QuantizedGEMMColBlock];
+        QuantizedDotProducts(a.m_values.data() + i0 * stride, columns.data() + j0 * stride, stride, acc);
+        for (int jj = 0; jj < (int) QuantizedGEMMColBlock && j0 + jj < n; jj++)
+        {
+            ElemType* cj = c + (j0 + jj) * (size_t) ldc;
+            for (int ii = 0; ii < (int) QuantizedGEMMRowBlock && i0 + ii < m; ii++)
+            {
+                ElemType value = alpha * a.m_rowScales[i0 + ii] * columnScales[j0 + jj] * acc[ii][jj];
+                cj[i0 + ii] = beta == 0 ? value : value + beta * cj[i0 + ii];
+            }
+        }
+    }
+}
+
+#pragma endregion Quantized GEMM Operands
+
 #pragma region Static BLAS Functions
 
 /// <summary>Matrix-matrix multiply with col-major matrices (a and b may be transposed): c = alpha * op(a) * op(b) + beta*c</summary>
@@ -4047,6 +4350,22 @@ void CPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix
 
     ldc = (int) c.GetNumRows();
 
+    // use the int8 copy of 'a' if there is a valid one (see QuantizeForMultiply())
+    if (a.m_quantizedForMultiply && a.m_quantizedForMultiply->IsQuantizationOf(a.m_pArray, a.m_numRows, a.m_numCols, transposeA))
+    {
+        QuantizedGEMM(m, n, k, alpha, *a.m_quantizedForMultiply, transposeB, b.m_pArray, ldb, beta, c.m_pArray, ldc);
+        return;
+    }
+
+#ifdef USE_MKL_PACKED_GEMM
+    // use the pre-packed copy of 'a' if there is a valid one (see PackForMultiply()); it was packed with alpha = 1
+    if (alpha == 1 && a.m_packedForMultiply && a.m_packedForMultiply->IsPackOf(a.m_pArray, a.m_numRows, a.m_numCols, transposeA))
+    {
+        PackedGEMMCompute(m, n, k, a.m_packedForMultiply->m_packed, transposeB, b.m_pArray, ldb, beta, c.m_pArray, ldc);
+        return;
+    }
+#endif
+
     if (sizeof(ElemType) == sizeof(double))
     {
 #ifndef USE_MKL
@@ -5418,6 +5737,313 @@ void CPUMatrix<ElemType>::_rcrfTransGrdCompute(size_t i,
         }
     }
 };
+
+// -----------------------------------------------------------------------
+// RCRF for all sequences of a minibatch
+// -----------------------------------------------------------------------
+
+// log(sum_j exp(a[j] + b[j])), with the maximum taken out; 'tmp' has 'n' elements
+// Unlike LogAdd(), this is exact, and the loops are simple enough to be vectorized.
+template <class ElemType>
+static ElemType LogSumExpOfSum(const ElemType* a, const ElemType* b, size_t n, ElemType* tmp)
+{
+    ElemType maxVal = a[0] + b[0];
+    for (size_t j = 0; j < n; j++)
+    {
+        tmp[j] = a[j] + b[j];
+        maxVal = (std::max)(maxVal, tmp[j]);
+    }
+    ElemType sum = 0;
+    for (size_t j = 0; j < n; j++)
+        sum += exp(tmp[j] - maxVal);
+    return maxVal + log(sum);
+}
+
+// the label of each frame of 'sequences' (index of the first non-zero row of 'lbls'), or -1 in columns that belong to no sequence
+template <class ElemType>
+static std::vector<int> RCRFFrameLabels(const CPUMatrix<ElemType>& lbls, size_t numParallelSequences, const std::vector<ParallelSequenceSpan>& sequences)
+{
+    const size_t numLabels = lbls.GetNumRows();
+    const size_t numCols = lbls.GetNumCols();
+    std::vector<int> frameLabels(numCols, -1);
+    for (const auto& sequence : sequences)
+    {
+        if (sequence.s >= numParallelSequences || sequence.tBegin >= sequence.tEnd || sequence.tEnd * numParallelSequences > numCols)
+            InvalidArgument("RCRF: Sequence %d [%d, %d) lies outside of the minibatch.", (int) sequence.s, (int) sequence.tBegin, (int) sequence.tEnd);
+        for (size_t t = sequence.tBegin; t < sequence.tEnd; t++)
+        {
+            const size_t col = t * numParallelSequences + sequence.s;
+            const ElemType* lbl = lbls.BufferPointer() + col * numLabels;
+            for (size_t k = 0; k < numLabels && frameLabels[col] < 0; k++)
+            {
+                if (lbl[k] != 0)
+                    frameLabels[col] = (int) k;
+            }
+            if (frameLabels[col] < 0)
+                InvalidArgument("RCRF: Frame %d of sequence %d has no label.", (int) t, (int) sequence.s);
+        }
+    }
+    return frameLabels;
+}
+
+// forward-backward for one sequence; returns its negative log-likelihood
+// The label of the first frame serves as the start state, as in RCRFBackwardCompute() and RCRFTransGrdCompute(),
+// so the score of the correct path includes the transition from it into the first frame.
+template <class ElemType>
+static ElemType RCRFForwardBackwardOfSequence(const ElemType* pos, const ElemType* pair, const ElemType* pairT, const std::vector<int>& frameLabels,
+                                              size_t numLabels, size_t numParallelSequences, const ParallelSequenceSpan& sequence,
+                                              ElemType* alpha, ElemType* logPost)
+{
+    std::vector<ElemType> tmp(numLabels), norm(numLabels), zeros(numLabels, 0);
+    auto col = [&](size_t t)
+    {
+        return (t * numParallelSequences + sequence.s) * numLabels;
+    };
+
+    // alpha(k,t) = pos(k,t) + log sum_j exp(alpha(j,t-1) + pair(k,j))
+    double goldScore = 0;
+    int prevLabel = frameLabels[col(sequence.tBegin) / numLabels];
+    for (size_t t = sequence.tBegin; t < sequence.tEnd; t++)
+    {
+        const int label = frameLabels[col(t) / numLabels];
+        goldScore += pos[col(t) + label];
+        for (size_t k = 0; k < numLabels; k++)
+        {
+            if (t == sequence.tBegin)
+                alpha[col(t) + k] = pos[col(t) + k] + pairT[k * numLabels + prevLabel];
+            else
+                alpha[col(t) + k] = pos[col(t) + k] + LogSumExpOfSum(alpha + col(t - 1), pairT + k * numLabels, numLabels, tmp.data());
+        }
+        goldScore += pair[prevLabel * numLabels + label]; // pair(label, prevLabel)
+        prevLabel = label;
+    }
+    const size_t tLast = sequence.tEnd - 1;
+    const ElemType logZ = LogSumExpOfSum(alpha + col(tLast), zeros.data(), numLabels, tmp.data());
+
+    // log posteriors, backwards: post(k,t) = sum_j post(j,t+1) P(label k at t | label j at t+1)
+    // with P(k at t | j at t+1) = exp(alpha(k,t) + pair(j,k) - norm(j)), norm(j) = log sum_m exp(alpha(m,t) + pair(j,m))
+    for (size_t k = 0; k < numLabels; k++)
+        logPost[col(tLast) + k] = alpha[col(tLast) + k] - logZ;
+    for (size_t t = tLast; t-- > sequence.tBegin;)
+    {
+        for (size_t j = 0; j < numLabels; j++)
+            norm[j] = logPost[col(t + 1) + j] - LogSumExpOfSum(alpha + col(t), pairT + j * numLabels, numLabels, tmp.data());
+        for (size_t k = 0; k < numLabels; k++)
+            logPost[col(t) + k] = alpha[col(t) + k] + LogSumExpOfSum(norm.data(), pair + k * numLabels, numLabels, tmp.data());
+    }
+
+    return (ElemType)(logZ - goldScore);
+}
+
+template <class ElemType>
+ElemType CPUMatrix<ElemType>::RCRFForwardBackward(const CPUMatrix<ElemType>& lbls, const CPUMatrix<ElemType>& pos_scores, const CPUMatrix<ElemType>& pair_scores,
+                                                  size_t numParallelSequences, const std::vector<ParallelSequenceSpan>& sequences,
+                                                  CPUMatrix<ElemType>& alpha, CPUMatrix<ElemType>& postprob)
+{
+    const size_t numLabels = pair_scores.GetNumRows();
+    if (pair_scores.GetNumCols() != numLabels || lbls.GetNumRows() != numLabels || pos_scores.GetNumRows() != numLabels || pos_scores.GetNumCols() != lbls.GetNumCols() || numLabels == 0)
+        InvalidArgument("RCRFForwardBackward: The dimensions of the labels and scores do not match.");
+    const std::vector<int> frameLabels = RCRFFrameLabels(lbls, numParallelSequences, sequences);
+
+    alpha.Resize(numLabels, lbls.GetNumCols());
+    postprob.Resize(numLabels, lbls.GetNumCols());
+    alpha.SetValue(0);
+    postprob.SetValue(lbls); // (columns that belong to no sequence)
+
+    // pair_scores transposed, so that the scores of all transitions into a label are contiguous
+    std::vector<ElemType> pairT(numLabels * numLabels);
+    for (size_t j = 0; j < numLabels; j++)
+        for (size_t k = 0; k < numLabels; k++)
+            pairT[k * numLabels + j] = pair_scores(k, j);
+
+    // each sequence in parallel; postprob holds the log posteriors until the end
+    std::vector<ElemType> negLogLikelihoods(sequences.size());
+#pragma omp parallel for schedule(dynamic)
+    for (long i = 0; i < (long) sequences.size(); i++)
+    {
+        negLogLikelihoods[i] = RCRFForwardBackwardOfSequence(pos_scores.BufferPointer(), pair_scores.BufferPointer(), pairT.data(), frameLabels,
+                                                             numLabels, numParallelSequences, sequences[i], alpha.BufferPointer(), postprob.BufferPointer());
+    }
+
+    ElemType* post = postprob.BufferPointer();
+#pragma omp parallel for
+    for (long col = 0; col < (long) frameLabels.size(); col++)
+    {
+        if (frameLabels[col] >= 0)
+        {
+            for (size_t k = 0; k < numLabels; k++)
+                post[col * numLabels + k] = exp(post[col * numLabels + k]);
+        }
+    }
+
+    double negLogLikelihood = 0;
+    for (auto value : negLogLikelihoods) // (in a fixed order, for reproducible results)
+        negLogLikelihood += value;
+    return (ElemType) negLogLikelihood;
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::RCRFTransGrdAccumulate(const CPUMatrix<ElemType>& lbls, const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& postprob, const CPUMatrix<ElemType>& pair_scores,
+                                                 size_t numParallelSequences, const std::vector<ParallelSequenceSpan>& sequences,
+                                                 ElemType scale, CPUMatrix<ElemType>& grd)
+{
+    const size_t numLabels = pair_scores.GetNumRows();
+    if (alpha.GetNumRows() != numLabels || alpha.GetNumCols() != lbls.GetNumCols() || postprob.GetNumRows() != numLabels || postprob.GetNumCols() != lbls.GetNumCols() ||
+        grd.GetNumRows() != numLabels || grd.GetNumCols() != numLabels)
+        InvalidArgument("RCRFTransGrdAccumulate: The dimensions of the inputs do not match.");
+    const std::vector<int> frameLabels = RCRFFrameLabels(lbls, numParallelSequences, sequences);
+
+    std::vector<ElemType> pairT(numLabels * numLabels);
+    for (size_t j = 0; j < numLabels; j++)
+        for (size_t k = 0; k < numLabels; k++)
+            pairT[k * numLabels + j] = pair_scores(k, j);
+
+    // the gradient of each sequence separately, then summed in a fixed order
+    // expected transition counts: P(label i at t-1, label j at t) = post(j,t) exp(alpha(i,t-1) + pair(j,i) - norm(j)), minus the observed ones
+    std::vector<std::vector<ElemType>> sequenceGradients(sequences.size());
+#pragma omp parallel for schedule(dynamic)
+    for (long n = 0; n < (long) sequences.size(); n++)
+    {
+        const ParallelSequenceSpan& sequence = sequences[n];
+        std::vector<ElemType>& g = sequenceGradients[n];
+        g.assign(numLabels * numLabels, 0); // column-major like grd
+        std::vector<ElemType> tmp(numLabels), norm(numLabels);
+        int prevLabel = -1;
+        for (size_t t = sequence.tBegin; t < sequence.tEnd; t++)
+        {
+            const size_t col = t * numParallelSequences + sequence.s;
+            const ElemType* post = postprob.BufferPointer() + col * numLabels;
+            const int label = frameLabels[col];
+            if (t == sequence.tBegin) // the start state is the first label
+            {
+                for (size_t j = 0; j < numLabels; j++)
+                    g[label * numLabels + j] += post[j];
+                g[label * numLabels + label] -= 1;
+            }
+            else
+            {
+                const ElemType* prevAlpha = alpha.BufferPointer() + (col - numParallelSequences) * numLabels;
+                for (size_t j = 0; j < numLabels; j++)
+                    norm[j] = LogSumExpOfSum(prevAlpha, pairT.data() + j * numLabels, numLabels, tmp.data());
+                for (size_t i = 0; i < numLabels; i++)
+                {
+                    const ElemType* pair = pair_scores.BufferPointer() + i * numLabels;
+                    ElemType* gi = g.data() + i * numLabels;
+                    for (size_t j = 0; j < numLabels; j++)
+                        gi[j] += post[j] * exp(prevAlpha[i] + pair[j] - norm[j]);
+                }
+                g[prevLabel * numLabels + label] -= 1;
+            }
+            prevLabel = label;
+        }
+    }
+
+    ElemType* grdData = grd.BufferPointer();
+    for (const auto& g : sequenceGradients)
+    {
+        for (size_t k = 0; k < g.size(); k++)
+            grdData[k] += scale * g[k];
+    }
+}
+
+// -----------------------------------------------------------------------
+// fused LSTM cell
+// -----------------------------------------------------------------------
+
+// Applies the gate non-linearities and the cell update of an LSTM cell in a single pass.
+//  - gates:     [4H x N] in: gate pre-activations without bias, stacked as [i; f; o; g]; out: gate activations (kept for LSTMCellBackward())
+//  - bias:      [4H x 1] gate biases
+//  - prevState: [2H x N] previous state [h; c]
+//  - state:     [2H x N] new state [h; c], where c = f .* c_prev + i .* g and h = o .* tanh(c)
+template <class ElemType>
+void CPUMatrix<ElemType>::LSTMCellForward(CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& bias, const CPUMatrix<ElemType>& prevState, CPUMatrix<ElemType>& state)
+{
+    if (gates.IsEmpty() || bias.IsEmpty() || prevState.IsEmpty())
+        LogicError("LSTMCellForward: one of the input matrices is empty.");
+
+    const size_t cellDim = gates.GetNumRows() / 4;
+    const long n = (long) gates.GetNumCols();
+    if (gates.GetNumRows() != 4 * cellDim || bias.GetNumRows() != gates.GetNumRows() || bias.GetNumCols() != 1 ||
+        prevState.GetNumRows() != 2 * cellDim || prevState.GetNumCols() != n)
+        LogicError("LSTMCellForward: matrix dimensions mismatched.");
+
+    state.Resize(2 * cellDim, n);
+
+    const ElemType* pb = bias.m_pArray;
+#pragma omp parallel for
+    for (long j = 0; j < n; j++)
+    {
+        ElemType* pg = gates.m_pArray + j * 4 * cellDim;
+        const ElemType* pPrevC = prevState.m_pArray + j * 2 * cellDim + cellDim;
+        ElemType* pH = state.m_pArray + j * 2 * cellDim;
+        ElemType* pC = pH + cellDim;
+        for (size_t k = 0; k < cellDim; k++)
+        {
+            ElemType i = Sigmoid(pg[k] + pb[k]);
+            ElemType f = Sigmoid(pg[cellDim + k] + pb[cellDim + k]);
+            ElemType o = Sigmoid(pg[2 * cellDim + k] + pb[2 * cellDim + k]);
+            ElemType g = tanh_(pg[3 * cellDim + k] + pb[3 * cellDim + k]);
+            ElemType c = f * pPrevC[k] + i * g;
+            pg[k] = i;
+            pg[cellDim + k] = f;
+            pg[2 * cellDim + k] = o;
+            pg[3 * cellDim + k] = g;
+            pC[k] = c;
+            pH[k] = o * tanh_(c);
+        }
+    }
+}
+
+// Back-propagates through LSTMCellForward() in a single pass.
+//  - gates:            [4H x N] gate activations as left behind by LSTMCellForward()
+//  - prevState, state: [2H x N] previous and new state [h; c]
+//  - stateGradient:    [2H x N] gradient w.r.t. the new state [h; c]
+//  - gatesGradient:    [4H x N] (out) gradient w.r.t. the gate pre-activations
+//  - prevCellGradient: [H x N]  (out) gradient w.r.t. c_prev
+template <class ElemType>
+void CPUMatrix<ElemType>::LSTMCellBackward(const CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& prevState, const CPUMatrix<ElemType>& state, const CPUMatrix<ElemType>& stateGradient,
+                                           CPUMatrix<ElemType>& gatesGradient, CPUMatrix<ElemType>& prevCellGradient)
+{
+    if (gates.IsEmpty() || prevState.IsEmpty() || state.IsEmpty() || stateGradient.IsEmpty())
+        LogicError("LSTMCellBackward: one of the input matrices is empty.");
+
+    const size_t cellDim = gates.GetNumRows() / 4;
+    const long n = (long) gates.GetNumCols();
+    if (gates.GetNumRows() != 4 * cellDim ||
+        prevState.GetNumRows() != 2 * cellDim || prevState.GetNumCols() != n ||
+        state.GetNumRows() != 2 * cellDim || state.GetNumCols() != n ||
+        stateGradient.GetNumRows() != 2 * cellDim || stateGradient.GetNumCols() != n)
+        LogicError("LSTMCellBackward: matrix dimensions mismatched.");
+
+    gatesGradient.Resize(4 * cellDim, n);
+    prevCellGradient.Resize(cellDim, n);
+
+#pragma omp parallel for
+    for (long j = 0; j < n; j++)
+    {
+        const ElemType* pg = gates.m_pArray + j * 4 * cellDim;
+        const ElemType* pPrevC = prevState.m_pArray + j * 2 * cellDim + cellDim;
+        const ElemType* pC = state.m_pArray + j * 2 * cellDim + cellDim;
+        const ElemType* pdH = stateGradient.m_pArray + j * 2 * cellDim;
+        const ElemType* pdCIn = pdH + cellDim;
+        ElemType* pdg = gatesGradient.m_pArray + j * 4 * cellDim;
+        ElemType* pdPrevC = prevCellGradient.m_pArray + j * cellDim;
+        for (size_t k = 0; k < cellDim; k++)
+        {
+            ElemType i = pg[k];
+            ElemType f = pg[cellDim + k];
+            ElemType o = pg[2 * cellDim + k];
+            ElemType g = pg[3 * cellDim + k];
+            ElemType tanhC = tanh_(pC[k]);
+            ElemType dc = pdCIn[k] + pdH[k] * o * (1 - tanhC * tanhC);
+            pdg[k] = dc * g * i * (1 - i);
+            pdg[cellDim + k] = dc * pPrevC[k] * f * (1 - f);
+            pdg[2 * cellDim + k] = pdH[k] * tanhC * o * (1 - o);
+            pdg[3 * cellDim + k] = dc * i * (1 - g * g);
+            pdPrevC[k] = dc * f;
+        }
+    }
+}
 template <class ElemType>
 CPUMatrix<ElemType>& CPUMatrix<ElemType>::DropFrame(const CPUMatrix<ElemType>& label, const CPUMatrix<ElemType>& gamma, const ElemType& threshhold)
 {
@@ -5486,6 +6112,24 @@ int CPUMatrix<ElemType>::SetNumThreads(int numThreads)
     return numThreads;
 }
 
+// note: this function does not depend on the <ElemType> parameter
+// The OpenMP thread count is a per-thread setting; ACML uses OpenMP, while MKL has its own per-thread setting.
+template <class ElemType>
+int CPUMatrix<ElemType>::SetNumThreadsOfCurrentThread(int numThreads)
+{
+    if (numThreads <= 0)
+        InvalidArgument("SetNumThreadsOfCurrentThread: The number of threads must be positive.");
+
+#ifdef _OPENMP
+    omp_set_num_threads(numThreads);
+    numThreads = omp_get_max_threads();
+#ifdef USE_MKL
+    mkl_set_num_threads_local(numThreads);
+#endif
+#endif
+    return numThreads;
+}
+
 // =======================================================================
 // TensorView support
 // =======================================================================
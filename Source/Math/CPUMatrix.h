@@ -22,6 +22,11 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 double logadd(double x, double y);
 
+template <class ElemType>
+struct CPUPackedGEMMOperand; // see CPUMatrix::PackForMultiply()
+template <class ElemType>
+struct CPUQuantizedGEMMOperand; // see CPUMatrix::QuantizeForMultiply()
+
 //To compy with BLAS libraries matrices are stored in ColMajor. However, by default C/C++/C# use RowMajor
 //convertion is need when passing data between CPUMatrix and C++ matrices
 template <class ElemType>
@@ -318,6 +323,7 @@ public:
 
 public:
     static int SetNumThreads(int numThreads); // note: this does not depend on <ElemType>, i.e. you can call it on any <ElemType>
+    static int SetNumThreadsOfCurrentThread(int numThreads); // same, but only for the OpenMP and BLAS code called from the calling thread
 
     // static BLAS functions
     static void SVD(const CPUMatrix<ElemType>& A, CPUMatrix<ElemType>& SIGMA, CPUMatrix<ElemType>& U, CPUMatrix<ElemType>& VT, CPUMatrix<ElemType>& W);
@@ -328,6 +334,21 @@ public:
     static void Multiply(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c);
     static void Multiply1x1AndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, ElemType beta, CPUMatrix<ElemType>& c);
 
+    // pre-packed copy of this matrix for repeated use as the left operand 'a' of MultiplyAndWeightedAdd(), e.g. frozen weights at inference
+    // This needs MKL 2017 or later (MATHLIB=mkl); otherwise PackForMultiply() returns false and the regular GEMM is used.
+    // The copy is dropped when the matrix is resized or overwritten through SetValue() and friends, and by every write through
+    // the owning Matrix (see Matrix::SetDataLocation()). Code that modifies the CPUMatrix elements directly must call ReleasePackedCopy().
+    bool PackForMultiply(const bool transpose);
+    void ReleasePackedCopy();
+    bool HasPackedCopy() const { return m_packedForMultiply != nullptr; }
+
+    // int8 copy of this matrix for use as the left operand 'a' of MultiplyAndWeightedAdd() at inference, with one scale per row of op(a)
+    // op(b) is quantized on the fly, clipped to 'rightOperandRange' (0 means per column from the data). This is an approximation;
+    // it takes precedence over a packed copy and is dropped under the same conditions.
+    void QuantizeForMultiply(const bool transpose, const ElemType rightOperandRange);
+    void ReleaseQuantizedCopy();
+    bool HasQuantizedCopy() const { return m_quantizedForMultiply != nullptr; }
+
     static void ScaleAndAdd(ElemType alpha, const CPUMatrix<ElemType>& a, CPUMatrix<ElemType>& c);
     static void AddScaledDifference(const ElemType alpha, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c);
     static void AssignScaledDifference(const ElemType alpha, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c);
@@ -449,6 +470,20 @@ public:
                                      const size_t tPos // position
                                      );
 
+    // RCRF for all sequences of a minibatch at once, see Matrix::RCRFForwardBackward()
+    static ElemType RCRFForwardBackward(const CPUMatrix<ElemType>& lbls, const CPUMatrix<ElemType>& pos_scores, const CPUMatrix<ElemType>& pair_scores,
+                                        size_t numParallelSequences, const std::vector<ParallelSequenceSpan>& sequences,
+                                        CPUMatrix<ElemType>& alpha, CPUMatrix<ElemType>& postprob);
+    static void RCRFTransGrdAccumulate(const CPUMatrix<ElemType>& lbls, const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& postprob, const CPUMatrix<ElemType>& pair_scores,
+                                       size_t numParallelSequences, const std::vector<ParallelSequenceSpan>& sequences,
+                                       ElemType scale, CPUMatrix<ElemType>& grd);
+
+public:
+    // fused LSTM cell
+    static void LSTMCellForward(CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& bias, const CPUMatrix<ElemType>& prevState, CPUMatrix<ElemType>& state);
+    static void LSTMCellBackward(const CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& prevState, const CPUMatrix<ElemType>& state, const CPUMatrix<ElemType>& stateGradient,
+                                 CPUMatrix<ElemType>& gatesGradient, CPUMatrix<ElemType>& prevCellGradient);
+
 protected:
     size_t LocateElement(const size_t i, const size_t j) const;
     size_t LocateColumn(const size_t j) const;
@@ -456,6 +491,9 @@ protected:
 private:
     void ZeroInit(); // should only be used by constructors.
     void Clear();
+
+    std::shared_ptr<CPUPackedGEMMOperand<ElemType>> m_packedForMultiply;       // see PackForMultiply()
+    std::shared_ptr<CPUQuantizedGEMMOperand<ElemType>> m_quantizedForMultiply; // see QuantizeForMultiply()
 };
 
 typedef CPUMatrix<float> CPUSingleMatrix;
@@ -113,6 +113,9 @@ enum ElementWiseOperator
     opElementwiseProductWithLinearRectifierDerivativeFromOutput,
     opElementwiseProductWithLogDerivativeFromOutput,
     opElementwiseProductWithCosDerivative,
+    opSigmoidOfSum,
+    opTanhOfSum,
+    opLinearRectifierOfSum,
     // binary ops for indexing
     // opIndex,
     // ternary
@@ -160,7 +163,10 @@ enum ElementWiseOperator
     Macro(ElementwiseProductWithTanhDerivativeFromOutput);            \
     Macro(ElementwiseProductWithLinearRectifierDerivativeFromOutput); \
     Macro(ElementwiseProductWithLogDerivativeFromOutput);             \
-    Macro(ElementwiseProductWithCosDerivative); \
+    Macro(ElementwiseProductWithCosDerivative);                       \
+    Macro(SigmoidOfSum);                                              \
+    Macro(TanhOfSum);                                                 \
+    Macro(LinearRectifierOfSum);                                      \
 //Macro(Index);
 
 #define ForAllTernaryOps(Macro) \
@@ -206,6 +212,17 @@ enum MatrixFlags
     matrixFlagSetValueOnDevice = 1 << bitPosSetValueOnDevice, // SetValue() call has a buffer that is already on the device
 };
 
+// -----------------------------------------------------------------------
+// ParallelSequenceSpan -- the frames of one sequence in a minibatch of parallel sequences
+// Frame t of parallel sequence s is stored in column t * numParallelSequences + s.
+// -----------------------------------------------------------------------
+
+struct ParallelSequenceSpan
+{
+    size_t s;            // index of the parallel sequence
+    size_t tBegin, tEnd; // time steps [tBegin, tEnd) of the minibatch
+};
+
 // -----------------------------------------------------------------------
 // BaseMatrix -- base class for all matrix types (CPU, GPU) x (dense, sparse)
 // -----------------------------------------------------------------------
@@ -6,6 +6,7 @@
 #include "stdafx.h"
 #include "ConvolutionEngine.h"
 #include "CuDnnConvolutionEngine.h"
+#include "ScratchArena.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -217,17 +218,22 @@ public:
                 // [Scenario 3] Sparse all others: convert to dense. Temporary work-around - allocating/de-allocating memory is costly!
                 if (m_gpuSparseOpt)
                 {
-                    Matrix<ElemType> inputSubBatch;
-                    inputSubBatch.SetValue(in.ColumnSlice(startSampleID, smallBatchSize));
-                    inputSubBatch.Reshape(inT.c(), smallBatchSize * inT.w() * inT.h());
-                    Matrix<ElemType> inputSubBatchSparseReordered(inputSubBatch.GetNumCols(), inputSubBatch.GetNumRows(), inputSubBatch.GetDeviceId(), MatrixType::SPARSE, MatrixFormat::matrixFormatSparseCSC);
-                    Matrix<ElemType>::TensorShuffleScaleAndAdd(0.0f, inputSubBatch.Transpose(), 1, inT.w(), 1, smallBatchSize * inT.h(), inT.c(), 1.0f, inputSubBatchSparseReordered, inputSubBatchSparseReordered);
-
-                    Matrix<ElemType> outputGradientSubBatchReordered = Matrix<ElemType>::Zeros(smallBatchSize * srcGradT.h() * srcGradT.w(), srcGradT.c(), outputGradientSubBatch.GetDeviceId());
-                    Matrix<ElemType>::TensorShuffleScaleAndAdd(0.0f, outputGradientSubBatch.Transpose(), 1, srcGradT.w(), 1, smallBatchSize * srcGradT.h(), srcGradT.c(), 1.0f, outputGradientSubBatchReordered, outputGradientSubBatchReordered);
+                    // (the temporaries are taken from the scratch arena to avoid reallocating them for every sub-batch)
+                    auto& scratchArena = ScratchArena<ElemType>::ForCurrentThread();
+                    auto inputSubBatch = scratchArena.Take(in.GetDeviceId(), L"ConvolutionEngine", in.GetMatrixType(), in.GetFormat());
+                    inputSubBatch->SetValue(in.ColumnSlice(startSampleID, smallBatchSize));
+                    inputSubBatch->Reshape(inT.c(), smallBatchSize * inT.w() * inT.h());
+                    auto inputSubBatchSparseReordered = scratchArena.Take(inputSubBatch->GetDeviceId(), L"ConvolutionEngine", MatrixType::SPARSE, MatrixFormat::matrixFormatSparseCSC);
+                    inputSubBatchSparseReordered->Resize(inputSubBatch->GetNumCols(), inputSubBatch->GetNumRows());
+                    Matrix<ElemType>::TensorShuffleScaleAndAdd(0.0f, inputSubBatch->Transpose(), 1, inT.w(), 1, smallBatchSize * inT.h(), inT.c(), 1.0f, *inputSubBatchSparseReordered, *inputSubBatchSparseReordered);
+
+                    auto outputGradientSubBatchReordered = scratchArena.Take(outputGradientSubBatch.GetDeviceId(), L"ConvolutionEngine");
+                    outputGradientSubBatchReordered->Resize(smallBatchSize * srcGradT.h() * srcGradT.w(), srcGradT.c());
+                    outputGradientSubBatchReordered->SetValue(0);
+                    Matrix<ElemType>::TensorShuffleScaleAndAdd(0.0f, outputGradientSubBatch.Transpose(), 1, srcGradT.w(), 1, smallBatchSize * srcGradT.h(), srcGradT.c(), 1.0f, *outputGradientSubBatchReordered, *outputGradientSubBatchReordered);
 
                     filter.Reshape(srcGradT.c() * filterT.w(), inT.c());
-                    Matrix<ElemType>::ConvolveAndWeightedAdd(1, outputGradientSubBatchReordered, true, inputSubBatchSparseReordered, false, 1, filter, smallBatchSize * inT.h(), convDesc.wStride(), convDesc.padding(), false);
+                    Matrix<ElemType>::ConvolveAndWeightedAdd(1, *outputGradientSubBatchReordered, true, *inputSubBatchSparseReordered, false, 1, filter, smallBatchSize * inT.h(), convDesc.wStride(), convDesc.padding(), false);
                     filter.Reshape(srcGradT.c(), inT.c() * filterT.w());
                 }
                 else
@@ -4793,6 +4793,55 @@ void GPUMatrix<ElemType>::RCRFTransGrdCompute(const GPUMatrix<ElemType>& lbls,
     TracingGPUMemoryAllocator::Free<ElemType>(alpha.GetComputeDeviceId(), d_zeta);
 };
 
+// -----------------------------------------------------------------------
+// fused LSTM cell
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+void GPUMatrix<ElemType>::LSTMCellForward(GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& bias, const GPUMatrix<ElemType>& prevState, GPUMatrix<ElemType>& state)
+{
+    if (gates.IsEmpty() || bias.IsEmpty() || prevState.IsEmpty())
+        LogicError("LSTMCellForward: one of the input matrices is empty.");
+
+    const size_t cellDim = gates.GetNumRows() / 4;
+    const size_t n = gates.GetNumCols();
+    if (gates.GetNumRows() != 4 * cellDim || bias.GetNumRows() != gates.GetNumRows() || bias.GetNumCols() != 1 ||
+        prevState.GetNumRows() != 2 * cellDim || prevState.GetNumCols() != n)
+        LogicError("LSTMCellForward: matrix dimensions mismatched.");
+
+    state.Resize(2 * cellDim, n);
+
+    CUDA_LONG N = (CUDA_LONG)(cellDim * n);
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    gates.PrepareDevice();
+    _lstmCellForward<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(gates.m_pArray, bias.m_pArray, prevState.m_pArray, state.m_pArray, (CUDA_LONG) cellDim, N);
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::LSTMCellBackward(const GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& prevState, const GPUMatrix<ElemType>& state, const GPUMatrix<ElemType>& stateGradient,
+                                           GPUMatrix<ElemType>& gatesGradient, GPUMatrix<ElemType>& prevCellGradient)
+{
+    if (gates.IsEmpty() || prevState.IsEmpty() || state.IsEmpty() || stateGradient.IsEmpty())
+        LogicError("LSTMCellBackward: one of the input matrices is empty.");
+
+    const size_t cellDim = gates.GetNumRows() / 4;
+    const size_t n = gates.GetNumCols();
+    if (gates.GetNumRows() != 4 * cellDim ||
+        prevState.GetNumRows() != 2 * cellDim || prevState.GetNumCols() != n ||
+        state.GetNumRows() != 2 * cellDim || state.GetNumCols() != n ||
+        stateGradient.GetNumRows() != 2 * cellDim || stateGradient.GetNumCols() != n)
+        LogicError("LSTMCellBackward: matrix dimensions mismatched.");
+
+    gatesGradient.Resize(4 * cellDim, n);
+    prevCellGradient.Resize(cellDim, n);
+
+    CUDA_LONG N = (CUDA_LONG)(cellDim * n);
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    gates.PrepareDevice();
+    _lstmCellBackward<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(gates.m_pArray, prevState.m_pArray, state.m_pArray, stateGradient.m_pArray,
+                                                                                             gatesGradient.m_pArray, prevCellGradient.m_pArray, (CUDA_LONG) cellDim, N);
+}
+
 // -----------------------------------------------------------------------
 // TensorView entry points from Matrix.cpp
 // -----------------------------------------------------------------------
@@ -481,6 +481,11 @@ public:
                                     const int startLbl, // the time 0 start symbol in the output layer
                                     const int shift);
 
+    // fused LSTM cell
+    static void LSTMCellForward(GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& bias, const GPUMatrix<ElemType>& prevState, GPUMatrix<ElemType>& state);
+    static void LSTMCellBackward(const GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& prevState, const GPUMatrix<ElemType>& state, const GPUMatrix<ElemType>& stateGradient,
+                                 GPUMatrix<ElemType>& gatesGradient, GPUMatrix<ElemType>& prevCellGradient);
+
 public:
     friend File& operator>>(File& stream, GPUMatrix<ElemType>& us)
     {
@@ -4995,6 +4995,50 @@ __global__ void _maskColumnsValue(ElemType* a, const char* columnsMask, CUDA_LON
         a[IDX2C(rowIdx, colIdx, numRows)] = val;
     }
 }
+
+// fused LSTM cell, one thread per cell (row k of column j); see CPUMatrix::LSTMCellForward() for the layout
+template <class ElemType>
+__global__ void _lstmCellForward(ElemType* gates, const ElemType* bias, const ElemType* prevState, ElemType* state, const CUDA_LONG cellDim, const CUDA_LONG N)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+    CUDA_LONG k = id % cellDim;
+    CUDA_LONG j = id / cellDim;
+    ElemType* pg = gates + 4 * cellDim * j;
+    ElemType i = Microsoft::MSR::CNTK::Sigmoid(pg[k] + bias[k]);
+    ElemType f = Microsoft::MSR::CNTK::Sigmoid(pg[cellDim + k] + bias[cellDim + k]);
+    ElemType o = Microsoft::MSR::CNTK::Sigmoid(pg[2 * cellDim + k] + bias[2 * cellDim + k]);
+    ElemType g = tanh_(pg[3 * cellDim + k] + bias[3 * cellDim + k]);
+    ElemType c = f * prevState[2 * cellDim * j + cellDim + k] + i * g;
+    pg[k] = i;
+    pg[cellDim + k] = f;
+    pg[2 * cellDim + k] = o;
+    pg[3 * cellDim + k] = g;
+    state[2 * cellDim * j + cellDim + k] = c;
+    state[2 * cellDim * j + k] = o * tanh_(c);
+}
+
+template <class ElemType>
+__global__ void _lstmCellBackward(const ElemType* gates, const ElemType* prevState, const ElemType* state, const ElemType* stateGradient,
+                                  ElemType* gatesGradient, ElemType* prevCellGradient, const CUDA_LONG cellDim, const CUDA_LONG N)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+    CUDA_LONG k = id % cellDim;
+    CUDA_LONG j = id / cellDim;
+    const ElemType* pg = gates + 4 * cellDim * j;
+    ElemType* pdg = gatesGradient + 4 * cellDim * j;
+    ElemType i = pg[k];
+    ElemType f = pg[cellDim + k];
+    ElemType o = pg[2 * cellDim + k];
+    ElemType g = pg[3 * cellDim + k];
+    ElemType tanhC = tanh_(state[2 * cellDim * j + cellDim + k]);
+    ElemType dh = stateGradient[2 * cellDim * j + k];
+    ElemType dc = stateGradient[2 * cellDim * j + cellDim + k] + dh * o * (1 - tanhC * tanhC);
+    pdg[k] = dc * g * i * (1 - i);
+    pdg[cellDim + k] = dc * prevState[2 * cellDim * j + cellDim + k] * f * (1 - f);
+    pdg[2 * cellDim + k] = dh * tanhC * o * (1 - o);
+    pdg[3 * cellDim + k] = dc * i * (1 - g * g);
+    prevCellGradient[id] = dc * f;
+}
 }
 }
 }
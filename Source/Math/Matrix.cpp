@@ -222,6 +222,14 @@ void Matrix<ElemType>::SetDataLocation(CurrentDataLocation location, MatrixType
 {
     m_currentDataLocation = location;
 
+    // The data may have changed, so any copy derived from it for the GEMM is stale (see CPUMatrix::PackForMultiply() and QuantizeForMultiply()).
+    // Writes through a view (e.g. a ColumnSlice()) or a raw buffer pointer bypass this and must release the copies explicitly.
+    if (m_CPUMatrix)
+    {
+        m_CPUMatrix->ReleasePackedCopy();
+        m_CPUMatrix->ReleaseQuantizedCopy();
+    }
+
     // set the matrix type if passed in
     if (type != MatrixType::UNDETERMINED)
     {
@@ -1450,8 +1458,10 @@ ElemType Matrix<ElemType>::Adagrad(Matrix<ElemType>& gradients, const bool needA
                             SetDataLocation(GPU));
 }
 
+// compute the weights for the next FSAdagrad() update
+// Each call advances the aggregate frame count, which is shared by all calls.
 template <class ElemType>
-void Matrix<ElemType>::FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum)
+/*static*/ void Matrix<ElemType>::FSAdagradNextWeights(size_t mbSize, ElemType& adaWeight, ElemType& adaMul)
 {
     // TODO: The values of 'adagradT' and 'targetadagradavdenom' are currently hardcoded constants taken from DBN (empirically determined).
     // These should be made configurable if needed
@@ -1463,6 +1473,16 @@ void Matrix<ElemType>::FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Mat
     aggadagradsqrframes = adagradkeepweight * aggadagradsqrframes + (1.0f - adagradkeepweight) * mbSize;
     const ElemType targetadagradavdenom_x_sqrtadagradsqrframes = static_cast<ElemType>(targetadagradavdenom * sqrt(aggadagradsqrframes));
 
+    adaWeight = adagradkeepweight;
+    adaMul = targetadagradavdenom_x_sqrtadagradsqrframes;
+}
+
+template <class ElemType>
+void Matrix<ElemType>::FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum)
+{
+    ElemType adagradkeepweight, targetadagradavdenom_x_sqrtadagradsqrframes;
+    FSAdagradNextWeights(mbSize, adagradkeepweight, targetadagradavdenom_x_sqrtadagradsqrframes);
+
     DISPATCH_MATRIX_ON_FLAG(&gradients,
                             &gradients,
                             m_CPUMatrix->FSAdagrad(*gradients.m_CPUMatrix, *functionValues.m_CPUMatrix, learnRatePerSample, momentum, adagradkeepweight, targetadagradavdenom_x_sqrtadagradsqrframes);
@@ -4165,6 +4185,56 @@ template <class ElemType>
                             NOT_IMPLEMENTED);
 }
 
+// pre-pack a constant left operand of MultiplyAndWeightedAdd() (dense CPU only); returns false if not supported
+template <class ElemType>
+bool Matrix<ElemType>::PackForMultiply(const bool transpose)
+{
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            nullptr,
+                            return m_CPUMatrix->PackForMultiply(transpose),
+                            return false,
+                            return false,
+                            return false);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::ReleasePackedCopy()
+{
+    if (m_CPUMatrix)
+        m_CPUMatrix->ReleasePackedCopy();
+}
+
+// quantize a constant left operand of MultiplyAndWeightedAdd() to int8 (dense CPU only); returns false if not supported
+template <class ElemType>
+bool Matrix<ElemType>::QuantizeForMultiply(const bool transpose, const ElemType rightOperandRange)
+{
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            nullptr,
+                            m_CPUMatrix->QuantizeForMultiply(transpose, rightOperandRange); return true,
+                            return false,
+                            return false,
+                            return false);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::ReleaseQuantizedCopy()
+{
+    if (m_CPUMatrix)
+        m_CPUMatrix->ReleaseQuantizedCopy();
+}
+
+template <class ElemType>
+bool Matrix<ElemType>::HasPackedCopy() const
+{
+    return m_CPUMatrix && m_CPUMatrix->HasPackedCopy();
+}
+
+template <class ElemType>
+bool Matrix<ElemType>::HasQuantizedCopy() const
+{
+    return m_CPUMatrix && m_CPUMatrix->HasQuantizedCopy();
+}
+
 /// <summary>Matrix-matrix multiply with col-major matrices (a and b may be transposed): c =  op(a) * op(b) + c</summary>
 /// <param name="a">Input matrix</param>
 /// <param name="transposeA">Whether matrix a is transposed</param>
@@ -4987,6 +5057,83 @@ void Matrix<ElemType>::RCRFTransGrdCompute(const Matrix<ElemType>& lbls,
                             NOT_IMPLEMENTED);
 }
 
+template <class ElemType>
+ElemType Matrix<ElemType>::RCRFForwardBackward(const Matrix<ElemType>& lbls, const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores,
+                                               size_t numParallelSequences, const std::vector<ParallelSequenceSpan>& sequences,
+                                               Matrix<ElemType>& alpha, Matrix<ElemType>& postprob)
+{
+    DecideAndMoveToRightDevice(lbls, pos_scores, pair_scores);
+    alpha._transferToDevice(lbls.GetDeviceId());
+    postprob._transferToDevice(lbls.GetDeviceId());
+
+    ElemType negLogLikelihood = 0;
+    DISPATCH_MATRIX_ON_FLAG(&lbls,
+                            nullptr,
+                            negLogLikelihood = CPUMatrix<ElemType>::RCRFForwardBackward(*lbls.m_CPUMatrix, *pos_scores.m_CPUMatrix, *pair_scores.m_CPUMatrix,
+                                                                                         numParallelSequences, sequences, *alpha.m_CPUMatrix, *postprob.m_CPUMatrix);
+                            alpha.SetDataLocation(CPU, DENSE);
+                            postprob.SetDataLocation(CPU, DENSE),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+    return negLogLikelihood;
+}
+
+template <class ElemType>
+void Matrix<ElemType>::RCRFTransGrdAccumulate(const Matrix<ElemType>& lbls, const Matrix<ElemType>& alpha, const Matrix<ElemType>& postprob, const Matrix<ElemType>& pair_scores,
+                                              size_t numParallelSequences, const std::vector<ParallelSequenceSpan>& sequences,
+                                              ElemType scale, Matrix<ElemType>& grd)
+{
+    DecideAndMoveToRightDevice(lbls, alpha, postprob, pair_scores);
+    grd._transferToDevice(lbls.GetDeviceId());
+
+    DISPATCH_MATRIX_ON_FLAG(&lbls,
+                            &grd,
+                            CPUMatrix<ElemType>::RCRFTransGrdAccumulate(*lbls.m_CPUMatrix, *alpha.m_CPUMatrix, *postprob.m_CPUMatrix, *pair_scores.m_CPUMatrix,
+                                                                        numParallelSequences, sequences, scale, *grd.m_CPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::LSTMCellForward(Matrix<ElemType>& gates, const Matrix<ElemType>& bias, const Matrix<ElemType>& prevState, Matrix<ElemType>& state)
+{
+    DecideAndMoveToRightDevice(gates, bias, prevState, state);
+    state.SwitchToMatrixType(gates.GetMatrixType(), gates.GetFormat(), false);
+
+    DISPATCH_MATRIX_ON_FLAG(&gates,
+                            &state,
+                            CPUMatrix<ElemType>::LSTMCellForward(*gates.m_CPUMatrix, *bias.m_CPUMatrix, *prevState.m_CPUMatrix, *state.m_CPUMatrix);
+                            gates.SetDataLocation(CPU, DENSE),
+                            GPUMatrix<ElemType>::LSTMCellForward(*gates.m_GPUMatrix, *bias.m_GPUMatrix, *prevState.m_GPUMatrix, *state.m_GPUMatrix);
+                            gates.SetDataLocation(GPU, DENSE),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::LSTMCellBackward(const Matrix<ElemType>& gates, const Matrix<ElemType>& prevState, const Matrix<ElemType>& state, const Matrix<ElemType>& stateGradient,
+                                        Matrix<ElemType>& gatesGradient, Matrix<ElemType>& prevCellGradient)
+{
+    DecideAndMoveToRightDevice(gates, prevState, state, stateGradient);
+    gatesGradient._transferToDevice(gates.GetDeviceId());
+    prevCellGradient._transferToDevice(gates.GetDeviceId());
+    gatesGradient.SwitchToMatrixType(gates.GetMatrixType(), gates.GetFormat(), false);
+    prevCellGradient.SwitchToMatrixType(gates.GetMatrixType(), gates.GetFormat(), false);
+
+    DISPATCH_MATRIX_ON_FLAG(&gates,
+                            &gatesGradient,
+                            CPUMatrix<ElemType>::LSTMCellBackward(*gates.m_CPUMatrix, *prevState.m_CPUMatrix, *state.m_CPUMatrix, *stateGradient.m_CPUMatrix,
+                                                                  *gatesGradient.m_CPUMatrix, *prevCellGradient.m_CPUMatrix);
+                            prevCellGradient.SetDataLocation(CPU, DENSE),
+                            GPUMatrix<ElemType>::LSTMCellBackward(*gates.m_GPUMatrix, *prevState.m_GPUMatrix, *state.m_GPUMatrix, *stateGradient.m_GPUMatrix,
+                                                                  *gatesGradient.m_GPUMatrix, *prevCellGradient.m_GPUMatrix);
+                            prevCellGradient.SetDataLocation(GPU, DENSE),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 template <class ElemType>
 Matrix<ElemType>& Matrix<ElemType>::DropFrame(const Matrix<ElemType>& label, const Matrix<ElemType>& gamma, const ElemType& threshhold)
 {
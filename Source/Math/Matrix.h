@@ -197,6 +197,7 @@ public:
     void NormalGrad(Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum, const bool useNAG);
     ElemType Adagrad(Matrix<ElemType>& gradients, const bool needAveMultiplier);
     void FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum);
+    static void FSAdagradNextWeights(size_t mbSize, ElemType& adaWeight, ElemType& adaMul); // advance the state shared by all FSAdagrad() calls
     ElemType RmsProp(Matrix<ElemType>& gradients, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier);
 
     void Resize(const size_t numRows, const size_t numCols, const size_t numNZElemToReserve = 10000, bool growOnly = true); // by default we only reallocate if need to grow
@@ -486,6 +487,14 @@ public:
     static void Multiply(const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, Matrix<ElemType>& c);
     static void Multiply(const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c);
     static void Multiply1x1AndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, ElemType beta, Matrix<ElemType>& c);
+    // keep a pre-packed copy of a constant left operand of MultiplyAndWeightedAdd() (dense CPU only), see CPUMatrix::PackForMultiply()
+    bool PackForMultiply(const bool transpose);
+    void ReleasePackedCopy();
+    // keep an int8 copy of a constant left operand of MultiplyAndWeightedAdd() (dense CPU only), see CPUMatrix::QuantizeForMultiply()
+    bool QuantizeForMultiply(const bool transpose, const ElemType rightOperandRange);
+    void ReleaseQuantizedCopy();
+    bool HasPackedCopy() const;
+    bool HasQuantizedCopy() const;
     static void ConvolveAndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, ElemType beta, Matrix<ElemType>& c, size_t numChannels, size_t horizontalSubsample, bool padding, bool channelwise);
 
     static void ScaleAndAdd(ElemType alpha, const Matrix<ElemType>& a, Matrix<ElemType>& c);
@@ -551,6 +560,24 @@ public:
                                     const int startLbl, // the time 0 start symbol in the output layer
                                     const int shift);
 
+    // RCRF forward-backward for all 'sequences' of a minibatch at once (CPU only)
+    // 'lbls' (one-hot) and 'pos_scores' hold the sequences in parallel (see ParallelSequenceSpan). The label of the first
+    // frame of a sequence serves as its start state. Computes the log forward scores 'alpha' and the label posteriors
+    // 'postprob' (which is set to 'lbls' in columns that belong to no sequence) and returns the sum of the negative
+    // log-likelihoods of the sequences.
+    static ElemType RCRFForwardBackward(const Matrix<ElemType>& lbls, const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores,
+                                        size_t numParallelSequences, const std::vector<ParallelSequenceSpan>& sequences,
+                                        Matrix<ElemType>& alpha, Matrix<ElemType>& postprob);
+    // grd += scale * gradient of that sum w.r.t. 'pair_scores', from the results of RCRFForwardBackward() (CPU only)
+    static void RCRFTransGrdAccumulate(const Matrix<ElemType>& lbls, const Matrix<ElemType>& alpha, const Matrix<ElemType>& postprob, const Matrix<ElemType>& pair_scores,
+                                       size_t numParallelSequences, const std::vector<ParallelSequenceSpan>& sequences,
+                                       ElemType scale, Matrix<ElemType>& grd);
+
+    // fused LSTM cell, see CPUMatrix::LSTMCellForward() for the layout of the arguments
+    static void LSTMCellForward(Matrix<ElemType>& gates, const Matrix<ElemType>& bias, const Matrix<ElemType>& prevState, Matrix<ElemType>& state);
+    static void LSTMCellBackward(const Matrix<ElemType>& gates, const Matrix<ElemType>& prevState, const Matrix<ElemType>& state, const Matrix<ElemType>& stateGradient,
+                                 Matrix<ElemType>& gatesGradient, Matrix<ElemType>& prevCellGradient);
+
     template <typename T>
     friend class MatrixQuantizer;
 
@@ -2007,6 +2007,17 @@ void GPUMatrix<ElemType>::RCRFTransGrdCompute(const GPUMatrix<ElemType>& lbls,
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::LSTMCellForward(GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& bias, const GPUMatrix<ElemType>& prevState, GPUMatrix<ElemType>& state)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::LSTMCellBackward(const GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& prevState, const GPUMatrix<ElemType>& state, const GPUMatrix<ElemType>& stateGradient,
+                                           GPUMatrix<ElemType>& gatesGradient, GPUMatrix<ElemType>& prevCellGradient)
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::AssignNoiseContrastiveEstimation(const GPUMatrix<ElemType>& a,
                                                            const GPUMatrix<ElemType>& b, const GPUMatrix<ElemType>& bias, size_t sampleCount, GPUMatrix<ElemType>& tmp, GPUMatrix<ElemType>& c)
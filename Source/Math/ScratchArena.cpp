@@ -0,0 +1,185 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ScratchArena.cpp -- per-thread pool of temporary matrices that keep their memory from call to call
+//
+
+#include "stdafx.h"
+#include "ScratchArena.h"
+#include <mutex>
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread) // (VS 2013 does not support thread_local; only for pointers here)
+#else
+#define THREAD_LOCAL thread_local
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// all arenas, for statistics and for releasing their memory
+// Arenas are never deleted, since threads may still refer to them, and because freeing GPU memory
+// during process shutdown may fail. Call ReleaseMemoryOfAllThreads() to free their memory.
+template <class ElemType>
+struct ScratchArenaRegistry
+{
+    std::mutex m_mutex;
+    std::vector<ScratchArena<ElemType>*> m_arenas;
+
+    static ScratchArenaRegistry& Get()
+    {
+        static ScratchArenaRegistry* registry = new ScratchArenaRegistry();
+        return *registry;
+    }
+};
+
+template <class ElemType>
+static ScratchArena<ElemType>*& CurrentThreadArena();
+template <>
+ScratchArena<float>*& CurrentThreadArena<float>()
+{
+    static THREAD_LOCAL ScratchArena<float>* arena = nullptr;
+    return arena;
+}
+template <>
+ScratchArena<double>*& CurrentThreadArena<double>()
+{
+    static THREAD_LOCAL ScratchArena<double>* arena = nullptr;
+    return arena;
+}
+
+template <class ElemType>
+/*static*/ ScratchArena<ElemType>& ScratchArena<ElemType>::ForCurrentThread()
+{
+    ScratchArena<ElemType>*& arena = CurrentThreadArena<ElemType>();
+    if (!arena)
+    {
+        arena = new ScratchArena<ElemType>();
+        auto& registry = ScratchArenaRegistry<ElemType>::Get();
+        std::lock_guard<std::mutex> lock(registry.m_mutex);
+        registry.m_arenas.push_back(arena);
+    }
+    return *arena;
+}
+
+template <class ElemType>
+ScratchArena<ElemType>::~ScratchArena()
+{
+}
+
+template <class ElemType>
+ScratchMatrix<ElemType> ScratchArena<ElemType>::Take(DEVICEID_TYPE deviceId, const std::wstring& owner, MatrixType matrixType, MatrixFormat matrixFormat)
+{
+    // reuse a free matrix of the same kind
+    Matrix<ElemType>* matrix = nullptr;
+    for (size_t i = m_freeMatrices.size(); i-- > 0;) // (most recently given back first)
+    {
+        Matrix<ElemType>* candidate = m_freeMatrices[i];
+        if (candidate->GetDeviceId() == deviceId && candidate->GetMatrixType() == matrixType && (matrixType == MatrixType::DENSE || candidate->GetFormat() == matrixFormat))
+        {
+            matrix = candidate;
+            m_freeMatrices.erase(m_freeMatrices.begin() + i);
+            break;
+        }
+    }
+    if (!matrix) // none: create one
+    {
+        if (matrixType == MatrixType::DENSE)
+            m_matrices.push_back(std::unique_ptr<Matrix<ElemType>>(new Matrix<ElemType>(deviceId)));
+        else
+            m_matrices.push_back(std::unique_ptr<Matrix<ElemType>>(new Matrix<ElemType>(0, 0, deviceId, matrixType, matrixFormat)));
+        matrix = m_matrices.back().get();
+    }
+
+    auto iter = m_statistics.find(owner);
+    if (iter == m_statistics.end())
+        iter = m_statistics.insert(std::make_pair(owner, OwnerStatistics())).first;
+    OwnerStatistics& statistics = iter->second;
+    statistics.numTaken++;
+    statistics.numInUse++;
+    statistics.peakInUse = (std::max)(statistics.peakInUse, statistics.numInUse);
+
+    ScratchMatrix<ElemType> scratch(this, matrix, &statistics);
+    statistics.bytesInUse += scratch.m_bytesWhenTaken;
+    return scratch;
+}
+
+template <class ElemType>
+void ScratchArena<ElemType>::GiveBack(ScratchMatrix<ElemType>& scratch)
+{
+    if (scratch.m_arena != this)
+        LogicError("ScratchArena: A temporary matrix was given back to a different thread's arena.");
+
+    // the temporary may have grown since it was taken
+    OwnerStatistics& statistics = *(OwnerStatistics*) scratch.m_ownerStatistics;
+    statistics.bytesInUse -= scratch.m_bytesWhenTaken;
+    statistics.peakBytes = (std::max)(statistics.peakBytes, statistics.bytesInUse + scratch.m_matrix->BufferSize());
+    statistics.numInUse--;
+
+    m_freeMatrices.push_back(scratch.m_matrix);
+}
+
+template <class ElemType>
+size_t ScratchArena<ElemType>::TotalBytes() const
+{
+    size_t bytes = 0;
+    for (const auto& matrix : m_matrices)
+        bytes += matrix->BufferSize();
+    return bytes;
+}
+
+template <class ElemType>
+void ScratchArena<ElemType>::BeginMinibatch()
+{
+    if (m_freeMatrices.size() != m_matrices.size())
+        LogicError("ScratchArena::BeginMinibatch: %d temporary matrices are still held from the previous minibatch.", (int) (m_matrices.size() - m_freeMatrices.size()));
+    m_peakBytes = (std::max)(m_peakBytes, TotalBytes());
+}
+
+template <class ElemType>
+/*static*/ void ScratchArena<ElemType>::ReleaseMemoryOfAllThreads()
+{
+    auto& registry = ScratchArenaRegistry<ElemType>::Get();
+    std::lock_guard<std::mutex> lock(registry.m_mutex);
+    for (auto* arena : registry.m_arenas)
+    {
+        if (arena->m_freeMatrices.size() != arena->m_matrices.size())
+            LogicError("ScratchArena::ReleaseMemoryOfAllThreads: Temporary matrices are still held.");
+        arena->m_peakBytes = (std::max)(arena->m_peakBytes, arena->TotalBytes());
+        arena->m_freeMatrices.clear();
+        arena->m_matrices.clear();
+    }
+}
+
+template <class ElemType>
+/*static*/ void ScratchArena<ElemType>::PrintStatisticsOfAllThreads()
+{
+    auto& registry = ScratchArenaRegistry<ElemType>::Get();
+    std::lock_guard<std::mutex> lock(registry.m_mutex);
+
+    std::map<std::wstring, OwnerStatistics> statistics;
+    size_t peakBytes = 0;
+    for (auto* arena : registry.m_arenas)
+    {
+        for (const auto& entry : arena->m_statistics)
+        {
+            auto& sum = statistics[entry.first];
+            sum.numTaken += entry.second.numTaken;
+            sum.peakInUse += entry.second.peakInUse; // (threads may hold their peaks at the same time)
+            sum.peakBytes += entry.second.peakBytes;
+        }
+        peakBytes += (std::max)(arena->m_peakBytes, arena->TotalBytes());
+    }
+    if (statistics.empty())
+        return;
+
+    fprintf(stderr, "\nScratch arenas: %d thread(s), high-water mark %.1f MB\n", (int) registry.m_arenas.size(), peakBytes / 1048576.0);
+    for (const auto& entry : statistics)
+        fprintf(stderr, "    %-40ls %12llu temporaries taken, at most %3d held, high-water mark %10.3f MB\n",
+                entry.first.c_str(), (unsigned long long) entry.second.numTaken, (int) entry.second.peakInUse, entry.second.peakBytes / 1048576.0);
+}
+
+// Explicit instantiation
+template class ScratchArena<float>;
+template class ScratchArena<double>;
+} } }
@@ -0,0 +1,174 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ScratchArena.h -- per-thread pool of temporary matrices that keep their memory from call to call
+//
+
+#pragma once
+
+#include "Matrix.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class ScratchArena;
+
+// ===========================================================================
+// ScratchMatrix -- a temporary matrix taken from a ScratchArena
+// It is given back to the arena when this goes out of scope.
+// ===========================================================================
+
+template <class ElemType>
+class ScratchMatrix
+{
+    friend class ScratchArena<ElemType>;
+
+    ScratchArena<ElemType>* m_arena;
+    Matrix<ElemType>* m_matrix;
+    void* m_ownerStatistics; // (opaque to this class)
+    size_t m_bytesWhenTaken;
+
+    ScratchMatrix(ScratchArena<ElemType>* arena, Matrix<ElemType>* matrix, void* ownerStatistics)
+        : m_arena(arena), m_matrix(matrix), m_ownerStatistics(ownerStatistics), m_bytesWhenTaken(matrix->BufferSize())
+    {
+    }
+
+    void GiveBack()
+    {
+        if (m_matrix)
+            m_arena->GiveBack(*this);
+        m_matrix = nullptr;
+    }
+
+    // no copying
+    ScratchMatrix(const ScratchMatrix&);
+    void operator=(const ScratchMatrix&);
+
+public:
+    ScratchMatrix()
+        : m_arena(nullptr), m_matrix(nullptr), m_ownerStatistics(nullptr), m_bytesWhenTaken(0)
+    {
+    }
+    ScratchMatrix(ScratchMatrix&& other)
+        : m_arena(other.m_arena), m_matrix(other.m_matrix), m_ownerStatistics(other.m_ownerStatistics), m_bytesWhenTaken(other.m_bytesWhenTaken)
+    {
+        other.m_matrix = nullptr;
+    }
+    ScratchMatrix& operator=(ScratchMatrix&& other)
+    {
+        if (this != &other)
+        {
+            GiveBack();
+            m_arena = other.m_arena;
+            m_matrix = other.m_matrix;
+            m_ownerStatistics = other.m_ownerStatistics;
+            m_bytesWhenTaken = other.m_bytesWhenTaken;
+            other.m_matrix = nullptr;
+        }
+        return *this;
+    }
+    ~ScratchMatrix()
+    {
+        GiveBack();
+    }
+
+    bool IsEmpty() const
+    {
+        return m_matrix == nullptr;
+    }
+    Matrix<ElemType>& operator*() const
+    {
+        return *m_matrix;
+    }
+    Matrix<ElemType>* operator->() const
+    {
+        return m_matrix;
+    }
+};
+
+// ===========================================================================
+// ScratchArena -- per-thread pool of matrices for temporaries
+//
+// Temporaries that are created inside ForwardProp()/BackpropTo() and similar functions allocate and
+// free their memory on every call. Taking them from the arena instead reuses the matrix objects and,
+// since Resize() only grows the allocation, their memory.
+//
+//     auto temp = ScratchArena<ElemType>::ForCurrentThread().Take(deviceId, OperationName());
+//     temp->AssignProductOf(...);
+//
+// A taken matrix has the device and matrix type that were requested, but otherwise undefined
+// dimensions and content. It must not be moved (operator= from an rvalue Matrix), since that
+// would hand its buffer over to another matrix object; use SetValue() instead.
+//
+// Each thread has its own arena, so taking and giving back needs no locking. Statistics are
+// kept per owner (e.g. node type). BeginMinibatch() must be called when no temporaries are held;
+// it checks that none were leaked and updates the high-water mark of the arena's memory.
+// ===========================================================================
+
+template <class ElemType>
+class MATH_API ScratchArena
+{
+    friend class ScratchMatrix<ElemType>;
+
+    struct OwnerStatistics
+    {
+        size_t numTaken;    // number of temporaries taken
+        size_t numInUse;    // number of temporaries currently held
+        size_t peakInUse;   // max number of temporaries held at the same time
+        size_t bytesInUse;  // memory of the temporaries currently held (as of when taken)
+        size_t peakBytes;   // max memory held at the same time
+        OwnerStatistics()
+            : numTaken(0), numInUse(0), peakInUse(0), bytesInUse(0), peakBytes(0)
+        {
+        }
+    };
+
+    std::vector<std::unique_ptr<Matrix<ElemType>>> m_matrices; // all matrices of this arena
+    std::vector<Matrix<ElemType>*> m_freeMatrices;              // those not currently taken
+    std::map<std::wstring, OwnerStatistics> m_statistics;      // [owner]
+    size_t m_peakBytes;                                        // high-water mark of the memory of all matrices in this arena
+
+    ScratchArena()
+        : m_peakBytes(0)
+    {
+    }
+    DISABLE_COPY_AND_MOVE(ScratchArena);
+
+    void GiveBack(ScratchMatrix<ElemType>& scratch);
+    size_t TotalBytes() const;
+
+public:
+    ~ScratchArena();
+
+    // the arena of the calling thread
+    static ScratchArena<ElemType>& ForCurrentThread();
+
+    // take a temporary matrix; it is given back when the returned object goes out of scope
+    ScratchMatrix<ElemType> Take(DEVICEID_TYPE deviceId, const std::wstring& owner, MatrixType matrixType = MatrixType::DENSE, MatrixFormat matrixFormat = matrixFormatDense);
+
+    // called at the start of each minibatch (see above)
+    void BeginMinibatch();
+
+    // free the memory of all arenas' matrices, e.g. at the end of training; no temporaries may be held at that time
+    static void ReleaseMemoryOfAllThreads();
+
+    // print the statistics of all arenas, summed up by owner
+    // Other threads must not use their arenas while this is called.
+    static void PrintStatisticsOfAllThreads();
+};
+} } }
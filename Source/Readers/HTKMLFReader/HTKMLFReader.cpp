@@ -18,6 +18,7 @@
 
 #include "rollingwindowsource.h" // minibatch sources
 #include "utterancesourcemulti.h"
+#include "scpmlfcache.h"
 #include "chunkevalsource.h"
 #include "minibatchiterator.h"
 #define DATAREADER_EXPORTS // creating the exports here
@@ -58,6 +59,7 @@ template <class ConfigRecordType>
 void HTKMLFReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfig)
 {
     m_truncated = readerConfig(L"truncated", false);
+    m_maxFramesPerMB = readerConfig(L"maxFramesPerMinibatch", (size_t) 0);
     m_convertLabelsToTargets = false;
 
     intargvector numberOfuttsPerMinibatchForAllEpochs = readerConfig(L"nbruttsineachrecurrentiter", ConfigRecordType::Array(intargvector(vector<int>{1})));
@@ -72,6 +74,7 @@ void HTKMLFReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfig
     }
 
     m_numSeqsPerMB = m_numSeqsPerMBForAllEpochs[0];
+    m_numSeqsInMB = m_numSeqsPerMB;
     m_pMBLayout->Init(m_numSeqsPerMB, 0); // (SGD will ask before entering actual reading --TODO: This is hacky.)
 
     m_noData = false;
@@ -299,6 +302,8 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
 
     m_frameMode = readerConfig(L"frameMode", true);
     m_verbosity = readerConfig(L"verbosity", 2);
+    if (m_maxFramesPerMB > 0 && (m_frameMode || m_truncated))
+        InvalidArgument("'maxFramesPerMinibatch' requires whole-utterance mode (frameMode=false, truncated=false).");
 
     // determine if we partial minibatches are desired
     wstring minibatchMode(readerConfig(L"minibatchMode", L"partial"));
@@ -310,11 +315,43 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
     if (readMethod == L"blockRandomize" && randomize == randomizeNone)
         InvalidArgument("'randomize' cannot be 'none' when 'readMethod' is 'blockRandomize'.");
 
+    double htktimetoframe = 100000.0; // default is 10ms
+    // std::vector<msra::asr::htkmlfreader<msra::asr::htkmlfentry,msra::lattices::lattice::htkmlfwordsequence>> labelsmulti;
+    std::vector<std::map<std::wstring, std::vector<msra::asr::htkmlfentry>>> labelsmulti;
+
+    // the parsed script and label files can be cached, since parsing them takes long for large corpora
+    std::unique_ptr<msra::asr::scpmlfcache> scpMlfCache;
+    bool loadedFromCache = false;
+    wstring scpMlfCacheFile(readerConfig(L"scpMlfCacheFile", L""));
+    if (!scpMlfCacheFile.empty())
+    {
+        vector<wstring> sourceFiles(scriptpaths);
+        for (const auto& paths : mlfpathsmulti)
+            sourceFiles.insert(sourceFiles.end(), paths.begin(), paths.end());
+        for (const auto& path : statelistpaths)
+            if (!path.empty())
+                sourceFiles.push_back(path);
+        wstring settings = msra::strfun::wstrprintf(L"htktimetoframe=%.17g", htktimetoframe);
+        for (const auto& rootpath : RootPathInScripts)
+            settings += L"\nprefixPathInSCP=" + rootpath;
+        scpMlfCache.reset(new msra::asr::scpmlfcache(scpMlfCacheFile, sourceFiles, settings));
+        loadedFromCache = scpMlfCache->tryload(infilesmulti, labelsmulti) &&
+                          infilesmulti.size() == scriptpaths.size() && labelsmulti.size() == mlfpathsmulti.size();
+        if (!loadedFromCache)
+        {
+            infilesmulti.clear();
+            labelsmulti.clear();
+        }
+    }
+
     // read all input files (from multiple inputs)
     // TO DO: check for consistency (same number of files in each script file)
     numFiles = 0;
     foreach_index (i, scriptpaths)
     {
+        if (loadedFromCache) // (already have them)
+            break;
+
         vector<wstring> filelist;
         std::wstring scriptpath = scriptpaths[i];
         fprintf(stderr, "reading script file %ls ...", scriptpath.c_str());
@@ -429,12 +466,11 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
     // if (readerConfig.Exists(L"statelist"))
     //    statelistpath = readerConfig(L"statelist");
 
-    double htktimetoframe = 100000.0; // default is 10ms
-    // std::vector<msra::asr::htkmlfreader<msra::asr::htkmlfentry,msra::lattices::lattice::htkmlfwordsequence>> labelsmulti;
-    std::vector<std::map<std::wstring, std::vector<msra::asr::htkmlfentry>>> labelsmulti;
     // std::vector<std::wstring> pagepath;
     foreach_index (i, mlfpathsmulti)
     {
+        if (loadedFromCache) // (already have them)
+            break;
         const msra::lm::CSymbolSet* wordmap = unigram ? &unigramsymbols : NULL;
         msra::asr::htkmlfreader<msra::asr::htkmlfentry, msra::lattices::lattice::htkmlfwordsequence>
         labels(mlfpathsmulti[i], restrictmlftokeys, statelistpaths[i], wordmap, (map<string, size_t>*) NULL, htktimetoframe); // label MLF
@@ -446,6 +482,8 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
 
         labelsmulti.push_back(std::move(labels));
     }
+    if (scpMlfCache && !loadedFromCache)
+        scpMlfCache->save(infilesmulti, labelsmulti);
 
     if (!_wcsicmp(readMethod.c_str(), L"blockRandomize"))
     {
@@ -454,8 +492,15 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
         m_lattices.reset(new msra::dbn::latticesource(latticetocs, m_hset.getsymmap(), RootPathInLatticeTocs));
         m_lattices->setverbosity(m_verbosity);
 
+        // in frame mode, randomized frames can be computed on the fly instead of being stored in a table for the whole sweep
+        const bool hashedFrameRandomization = readerConfig(L"hashedFrameRandomization", false);
+
+        // in utterance mode, blocks of this many randomized utterances can be sorted by length, so that a minibatch gets utterances of similar lengths
+        // (best combined with maxFramesPerMinibatch, so that minibatches of short utterances get more parallel sequences)
+        const size_t lengthBucketSize = readerConfig(L"lengthBucketSize", (size_t) 0);
+
         // now get the frame source. This has better randomization and doesn't create temp files
-        m_frameSource.reset(new msra::dbn::minibatchutterancesourcemulti(infilesmulti, labelsmulti, m_featDims, m_labelDims, numContextLeft, numContextRight, randomize, *m_lattices, m_latticeMap, m_frameMode));
+        m_frameSource.reset(new msra::dbn::minibatchutterancesourcemulti(infilesmulti, labelsmulti, m_featDims, m_labelDims, numContextLeft, numContextRight, randomize, *m_lattices, m_latticeMap, m_frameMode, hashedFrameRandomization, lengthBucketSize));
         m_frameSource->setverbosity(m_verbosity);
     }
     else if (!_wcsicmp(readMethod.c_str(), L"rollingWindow"))
@@ -645,6 +690,7 @@ void HTKMLFReader<ElemType>::StartDistributedMinibatchLoop(size_t requestedMBSiz
     m_mbNumTimeSteps = requestedMBSize; // note: ignored in frame mode and full-sequence mode
 
     m_numSeqsPerMB = m_numSeqsPerMBForAllEpochs[epoch];
+    m_numSeqsInMB = m_numSeqsPerMB;
 
     // For distributed reading under utterance mode, we distribute the utterances per minibatch among all the subsets
     if (m_trainOrTest && !m_frameMode)
@@ -655,6 +701,7 @@ void HTKMLFReader<ElemType>::StartDistributedMinibatchLoop(size_t requestedMBSiz
         }
 
         m_numSeqsPerMB = (m_numSeqsPerMB / numSubsets) + ((subsetNum < (m_numSeqsPerMB % numSubsets)) ? 1 : 0);
+        m_numSeqsInMB = m_numSeqsPerMB;
     }
 
     m_pMBLayout->Init(m_numSeqsPerMB, 0); // (SGD will ask before entering actual reading --TODO: This is hacky.)
@@ -913,13 +960,30 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
             // BUGBUG: We should decide how many utterances we are going to take, until the desired number of frames has been filled.
             //         Currently it seems to fill a fixed number of utterances, regardless of their length.
 
+            // decide how many of the parallel sequences to use: all, unless limited by m_maxFramesPerMB
+            m_numSeqsInMB = m_maxFramesPerMB > 0 ? NumSeqsWithinFrameBudget() : m_numSeqsPerMB;
+
+            // put the longest utterances into the lowest parallel sequences, so that the gaps of each time step are
+            // its trailing parallel sequences, which recurrent loops skip (MBLayout::GetNumActiveSequences())
+            if (!m_frameMode && m_numSeqsInMB > 1)
+            {
+                std::vector<size_t> order(m_numSeqsPerMB);
+                for (size_t i = 0; i < m_numSeqsPerMB; i++)
+                    order[i] = i;
+                std::stable_sort(order.begin(), order.begin() + m_numSeqsInMB, [this](size_t a, size_t b)
+                                 {
+                                     return m_numFramesToProcess[a] > m_numFramesToProcess[b];
+                                 });
+                ReorderChannels(order);
+            }
+
             // decide the m_mbNumTimeSteps
             // The number of columns is determined by the longest utterance amongst the desired set.
             // I.e. whatever is user-specified as the MB size, will be ignored here (that value is, however, passed down to the underlying reader).  BUGBUG: That is even more wrong.
             // BUGBUG: We should honor the mbSize parameter and fill up to the requested number of samples, using the requested #parallel sequences.
             // m_mbNumTimeSteps  = max (m_numFramesToProcess[.])
             m_mbNumTimeSteps = m_numFramesToProcess[0];
-            for (size_t i = 1; i < m_numSeqsPerMB; i++)
+            for (size_t i = 1; i < m_numSeqsInMB; i++)
             {
                 if (m_mbNumTimeSteps < m_numFramesToProcess[i])
                     m_mbNumTimeSteps = m_numFramesToProcess[i];
@@ -932,7 +996,7 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
             }
             else
             {
-                m_pMBLayout->Init(m_numSeqsPerMB, m_mbNumTimeSteps);
+                m_pMBLayout->Init(m_numSeqsInMB, m_mbNumTimeSteps);
             }
 
             // create a MB with the desired utterances
@@ -941,7 +1005,7 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
             // In frame mode, this reader thinks it has only one parallel sequence (m_numSeqsPerMB == 1),
             // but it reports it to the outside as N parallel sequences of one frame each.
             skip = (m_frameMode && !m_partialMinibatch && (m_mbiter->requestedframes() != m_mbNumTimeSteps) && (m_frameSource->totalframes() > m_mbNumTimeSteps));
-            for (size_t i = 0; i < m_numSeqsPerMB; i++)
+            for (size_t i = 0; i < m_numSeqsInMB; i++)
             {
                 if (!skip)
                 {
@@ -1012,7 +1076,7 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
                         }
 
                         bool slotFound = false;
-                        for (size_t des = 0; des < m_numSeqsPerMB; des++) // try to found a slot
+                        for (size_t des = 0; des < m_numSeqsInMB; des++) // try to found a slot
                         {
                             if (framenum + m_numValidFrames[des] < m_mbNumTimeSteps)
                             { // found !
@@ -1040,8 +1104,23 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
                     }
 
                     // and declare the remaining gaps as such
-                    for (size_t i = 0; i < m_numSeqsPerMB; i++)
+                    for (size_t i = 0; i < m_numSeqsInMB; i++)
                         m_pMBLayout->AddGap(i, m_numValidFrames[i], m_mbNumTimeSteps);
+
+                    // parallel sequences that were not used keep their utterances for the next minibatch, ahead of the new ones
+                    if (m_numSeqsInMB < m_numSeqsPerMB)
+                    {
+                        std::vector<size_t> order;
+                        for (size_t i = m_numSeqsInMB; i < m_numSeqsPerMB; i++)
+                            order.push_back(i);
+                        for (size_t i = 0; i < m_numSeqsInMB; i++)
+                            order.push_back(i);
+                        std::stable_partition(order.begin(), order.end(), [this](size_t i)
+                                              {
+                                                  return m_numFramesToProcess[i] > 0; // (the end of the data is detected by an empty first one)
+                                              });
+                        ReorderChannels(order);
+                    }
                 } // if (!frameMode)
 
                 for (auto iter = matrices.begin(); iter != matrices.end(); iter++)
@@ -1053,13 +1132,13 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
                     {
                         id = m_featureNameToIdMap[iter->first];
                         dim = m_featureNameToDimMap[iter->first];
-                        data.SetValue(dim, m_mbNumTimeSteps * m_numSeqsPerMB, data.GetDeviceId(), m_featuresBufferMultiIO[id].get(), matrixFlagNormal);
+                        data.SetValue(dim, m_mbNumTimeSteps * m_numSeqsInMB, data.GetDeviceId(), m_featuresBufferMultiIO[id].get(), matrixFlagNormal);
                     }
                     else if (m_nameToTypeMap[iter->first] == InputOutputTypes::category)
                     {
                         id = m_labelNameToIdMap[iter->first];
                         dim = m_labelNameToDimMap[iter->first];
-                        data.SetValue(dim, m_mbNumTimeSteps * m_numSeqsPerMB, data.GetDeviceId(), m_labelsBufferMultiIO[id].get(), matrixFlagNormal);
+                        data.SetValue(dim, m_mbNumTimeSteps * m_numSeqsInMB, data.GetDeviceId(), m_labelsBufferMultiIO[id].get(), matrixFlagNormal);
                     }
                 }
             }
@@ -1374,11 +1453,11 @@ void HTKMLFReader<ElemType>::fillOneUttDataforParallelmode(std::map<std::wstring
             id = m_featureNameToIdMap[iter->first];
             dim = m_featureNameToDimMap[iter->first];
 
-            if (m_featuresBufferMultiIO[id] == nullptr || m_featuresBufferAllocatedMultiIO[id] < dim * m_mbNumTimeSteps * m_numSeqsPerMB)
+            if (m_featuresBufferMultiIO[id] == nullptr || m_featuresBufferAllocatedMultiIO[id] < dim * m_mbNumTimeSteps * m_numSeqsInMB)
             {
-                m_featuresBufferMultiIO[id] = AllocateIntermediateBuffer(data.GetDeviceId(), dim * m_mbNumTimeSteps * m_numSeqsPerMB);
-                memset(m_featuresBufferMultiIO[id].get(), 0, sizeof(ElemType) * dim * m_mbNumTimeSteps * m_numSeqsPerMB);
-                m_featuresBufferAllocatedMultiIO[id] = dim * m_mbNumTimeSteps * m_numSeqsPerMB;
+                m_featuresBufferMultiIO[id] = AllocateIntermediateBuffer(data.GetDeviceId(), dim * m_mbNumTimeSteps * m_numSeqsInMB);
+                memset(m_featuresBufferMultiIO[id].get(), 0, sizeof(ElemType) * dim * m_mbNumTimeSteps * m_numSeqsInMB);
+                m_featuresBufferAllocatedMultiIO[id] = dim * m_mbNumTimeSteps * m_numSeqsInMB;
             }
 
             if (sizeof(ElemType) == sizeof(float))
@@ -1386,7 +1465,7 @@ void HTKMLFReader<ElemType>::fillOneUttDataforParallelmode(std::map<std::wstring
                 for (size_t j = 0, k = startFr; j < framenum; j++, k++) // column major, so iterate columns
                 {
                     // copy over the entire column at once, need to do this because SSEMatrix may have gaps at the end of the columns
-                    memcpy_s(&m_featuresBufferMultiIO[id].get()[(k * m_numSeqsPerMB + channelIndex) * dim], sizeof(ElemType) * dim, &m_featuresBufferMultiUtt[sourceChannelIndex].get()[j * dim + m_featuresStartIndexMultiUtt[id + sourceChannelIndex * numOfFea]], sizeof(ElemType) * dim);
+                    memcpy_s(&m_featuresBufferMultiIO[id].get()[(k * m_numSeqsInMB + channelIndex) * dim], sizeof(ElemType) * dim, &m_featuresBufferMultiUtt[sourceChannelIndex].get()[j * dim + m_featuresStartIndexMultiUtt[id + sourceChannelIndex * numOfFea]], sizeof(ElemType) * dim);
                 }
             }
             else
@@ -1395,7 +1474,7 @@ void HTKMLFReader<ElemType>::fillOneUttDataforParallelmode(std::map<std::wstring
                 {
                     for (int d = 0; d < dim; d++)
                     {
-                        m_featuresBufferMultiIO[id].get()[(k * m_numSeqsPerMB + channelIndex) * dim + d] = m_featuresBufferMultiUtt[sourceChannelIndex].get()[j * dim + d + m_featuresStartIndexMultiUtt[id + sourceChannelIndex * numOfFea]];
+                        m_featuresBufferMultiIO[id].get()[(k * m_numSeqsInMB + channelIndex) * dim + d] = m_featuresBufferMultiUtt[sourceChannelIndex].get()[j * dim + d + m_featuresStartIndexMultiUtt[id + sourceChannelIndex * numOfFea]];
                     }
                 }
             }
@@ -1404,18 +1483,18 @@ void HTKMLFReader<ElemType>::fillOneUttDataforParallelmode(std::map<std::wstring
         {
             id = m_labelNameToIdMap[iter->first];
             dim = m_labelNameToDimMap[iter->first];
-            if (m_labelsBufferMultiIO[id] == nullptr || m_labelsBufferAllocatedMultiIO[id] < dim * m_mbNumTimeSteps * m_numSeqsPerMB)
+            if (m_labelsBufferMultiIO[id] == nullptr || m_labelsBufferAllocatedMultiIO[id] < dim * m_mbNumTimeSteps * m_numSeqsInMB)
             {
-                m_labelsBufferMultiIO[id] = AllocateIntermediateBuffer(data.GetDeviceId(), dim * m_mbNumTimeSteps * m_numSeqsPerMB);
-                memset(m_labelsBufferMultiIO[id].get(), 0, sizeof(ElemType) * dim * m_mbNumTimeSteps * m_numSeqsPerMB);
-                m_labelsBufferAllocatedMultiIO[id] = dim * m_mbNumTimeSteps * m_numSeqsPerMB;
+                m_labelsBufferMultiIO[id] = AllocateIntermediateBuffer(data.GetDeviceId(), dim * m_mbNumTimeSteps * m_numSeqsInMB);
+                memset(m_labelsBufferMultiIO[id].get(), 0, sizeof(ElemType) * dim * m_mbNumTimeSteps * m_numSeqsInMB);
+                m_labelsBufferAllocatedMultiIO[id] = dim * m_mbNumTimeSteps * m_numSeqsInMB;
             }
 
             for (size_t j = 0, k = startFr; j < framenum; j++, k++)
             {
                 for (int d = 0; d < dim; d++)
                 {
-                    m_labelsBufferMultiIO[id].get()[(k * m_numSeqsPerMB + channelIndex) * dim + d] = m_labelsBufferMultiUtt[sourceChannelIndex].get()[j * dim + d + m_labelsStartIndexMultiUtt[id + sourceChannelIndex * numOfLabel]];
+                    m_labelsBufferMultiIO[id].get()[(k * m_numSeqsInMB + channelIndex) * dim + d] = m_labelsBufferMultiUtt[sourceChannelIndex].get()[j * dim + d + m_labelsStartIndexMultiUtt[id + sourceChannelIndex * numOfLabel]];
                 }
             }
         }
@@ -1543,7 +1622,7 @@ bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
 {
     if (m_noData)
     {
-        if ((i == 0) && !m_truncated)
+        if (!m_truncated) // (an empty parallel sequence, rather than the utterance just returned once more)
             m_numFramesToProcess[i] = 0;
         return false;
     }
@@ -1699,6 +1778,52 @@ bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
     return true;
 }
 
+// NumSeqsWithinFrameBudget - number of parallel sequences for the next minibatch in whole-utterance mode with m_maxFramesPerMB
+// This is the largest n such that the first n parallel sequences, padded to the longest of them, fit into m_maxFramesPerMB frames (at least 1).
+template <class ElemType>
+size_t HTKMLFReader<ElemType>::NumSeqsWithinFrameBudget() const
+{
+    size_t numSeqs = 1;
+    size_t numTimeSteps = m_numFramesToProcess[0];
+    while (numSeqs < m_numSeqsPerMB)
+    {
+        const size_t newNumTimeSteps = max(numTimeSteps, m_numFramesToProcess[numSeqs]);
+        if (newNumTimeSteps * (numSeqs + 1) > m_maxFramesPerMB)
+            break;
+        numTimeSteps = newNumTimeSteps;
+        numSeqs++;
+    }
+    return numSeqs;
+}
+
+// ReorderChannels - permute the per-parallel-sequence state; parallel sequence i takes the state of order[i]
+template <class T>
+static void ReorderBlocks(std::vector<T>& v, const std::vector<size_t>& order, size_t blockSize)
+{
+    std::vector<T> reordered;
+    reordered.reserve(v.size());
+    for (size_t i : order)
+        for (size_t j = 0; j < blockSize; j++)
+            reordered.push_back(std::move(v[i * blockSize + j]));
+    v = std::move(reordered);
+}
+
+template <class ElemType>
+void HTKMLFReader<ElemType>::ReorderChannels(const std::vector<size_t>& order)
+{
+    ReorderBlocks(m_featuresBufferMultiUtt, order, 1);
+    ReorderBlocks(m_featuresBufferAllocatedMultiUtt, order, 1);
+    ReorderBlocks(m_featuresStartIndexMultiUtt, order, m_featuresBufferMultiIO.size());
+    ReorderBlocks(m_labelsBufferMultiUtt, order, 1);
+    ReorderBlocks(m_labelsBufferAllocatedMultiUtt, order, 1);
+    ReorderBlocks(m_labelsStartIndexMultiUtt, order, m_labelsBufferMultiIO.size());
+    ReorderBlocks(m_latticeBufferMultiUtt, order, 1);
+    ReorderBlocks(m_labelsIDBufferMultiUtt, order, 1);
+    ReorderBlocks(m_phoneboundaryIDBufferMultiUtt, order, 1);
+    ReorderBlocks(m_numFramesToProcess, order, 1);
+    ReorderBlocks(m_processedFrame, order, 1);
+}
+
 // GetLabelMapping - Gets the label mapping from integer to type in file
 // mappingTable - a map from numeric datatype to native label type stored as a string
 template <class ElemType>
@@ -1827,6 +1952,8 @@ void HTKMLFReader<ElemType>::CopyMBLayoutTo(MBLayoutPtr pMBLayout)
 template <class ElemType>
 size_t HTKMLFReader<ElemType>::GetNumParallelSequences()
 {
+    if (m_maxFramesPerMB > 0) // (minibatches may have fewer; this is the maximum)
+        return m_numSeqsPerMB;
     if (!m_frameMode)
         if (m_numSeqsPerMB != m_pMBLayout->GetNumParallelSequences())
             LogicError("HTKMLFReader: Number of parallel sequences in m_pMBLayout did not get set to m_numSeqsPerMB.");
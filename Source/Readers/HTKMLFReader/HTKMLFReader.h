@@ -30,6 +30,8 @@ private:
     vector<size_t> m_processedFrame; // [seq index] (truncated BPTT only) current time step (cursor)
     intargvector m_numSeqsPerMBForAllEpochs;
     size_t m_numSeqsPerMB;      // requested number of parallel sequences
+    size_t m_numSeqsInMB;       // number of parallel sequences of the current minibatch (whole-utterance mode: fewer than m_numSeqsPerMB if limited by m_maxFramesPerMB)
+    size_t m_maxFramesPerMB;    // if > 0, whole-utterance mode uses only as many parallel sequences as fit into this many frames, padding included
     size_t m_mbNumTimeSteps;    // number of time steps  to fill/filled (note: for frame randomization, this the #frames, and not 1 as later reported)
     size_t m_mbMaxNumTimeSteps; // max time steps we take in a MB layout; any setence longer than this max will be discarded (and a warning will be issued )
                                 // this is used to prevent CUDA out-of memory errors
@@ -106,6 +108,8 @@ private:
     void StartMinibatchLoopToWrite(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize);
 
     bool ReNewBufferForMultiIO(size_t i);
+    size_t NumSeqsWithinFrameBudget() const;
+    void ReorderChannels(const std::vector<size_t>& order);
 
     size_t GetNumParallelSequences();
     void SetNumParallelSequences(const size_t){};
@@ -21,6 +21,9 @@
 #include <wchar.h>
 #include "simplesenonehmm.h"
 #include <array>
+#include <thread>
+#include <future>
+#include <atomic>
 #include "minibatchsourcehelpers.h"
 
 namespace msra { namespace asr {
@@ -815,6 +818,7 @@ class htkmlfreader : public map<wstring, vector<ENTRY>> // [key][i] the data
     unordered_map<std::string, size_t> statelistmap; // for state <=> index
     map<wstring, WORDSEQUENCE> wordsequences;        // [key] word sequences (if we are building word entries as well, for MMI)
     std::unordered_map<std::string, size_t> symmap;
+    bool verbose = true; // (false for the readers of individual files when reading in parallel)
 
     void strtok(char* s, const char* delim, vector<char*>& toks)
     {
@@ -981,9 +985,8 @@ public:
         if (stateListPath != L"")
             readstatelist(stateListPath);
 
-        // read MLF(s) --note: there can be multiple, so this is a loop
-        foreach_index (i, paths)
-            read(paths[i], restricttokeys, (nullmap * /*to satisfy C++ template resolution*/) NULL, (map<string, size_t>*) NULL, htkTimeToFrame);
+        // read MLF(s) --note: there can be multiple
+        readall(paths, restricttokeys, (nullmap * /*to satisfy C++ template resolution*/) NULL, (map<string, size_t>*) NULL, htkTimeToFrame);
     }
 
     // alternate constructor that optionally also reads word alignments (for MMI training); triggered by providing a 'wordmap'
@@ -995,9 +998,8 @@ public:
         if (stateListPath != L"")
             readstatelist(stateListPath);
 
-        // read MLF(s) --note: there can be multiple, so this is a loop
-        foreach_index (i, paths)
-            read(paths[i], restricttokeys, wordmap, unitmap, htkTimeToFrame);
+        // read MLF(s) --note: there can be multiple
+        readall(paths, restricttokeys, wordmap, unitmap, htkTimeToFrame);
     }
 
     // phone boundary
@@ -1008,8 +1010,57 @@ public:
         if (stateListPath != L"")
             readstatelist(stateListPath);
         symmap = hset.symmap;
+        readall(paths, restricttokeys, wordmap, unitmap, htkTimeToFrame);
+    }
+
+    // read multiple MLF files
+    // Large corpora often come as many MLF files (shards). These are parsed in parallel, each into its own reader, which are then merged.
+    template <typename WORDSYMBOLTABLE, typename UNITSYMBOLTABLE>
+    void readall(const vector<wstring>& paths, const set<wstring>& restricttokeys, const WORDSYMBOLTABLE* wordmap, const UNITSYMBOLTABLE* unitmap, const double htkTimeToFrame)
+    {
+        // (reading restricted to some keys stops once all have been found, which is inherently sequential)
+        if (paths.size() <= 1 || !restricttokeys.empty() || !this->empty())
+        {
+            foreach_index (i, paths)
+                read(paths[i], restricttokeys, wordmap, unitmap, htkTimeToFrame);
+            return;
+        }
+
+        size_t numthreads = std::thread::hardware_concurrency();
+        if (numthreads == 0 || numthreads > paths.size())
+            numthreads = paths.size();
+        fprintf(stderr, "htkmlfreader: reading %lu MLF files on %lu threads ...", paths.size(), numthreads);
+
+        // each file is read into a copy of this (empty) reader, which shares the state list
+        htkmlfreader emptyreader(*this);
+        emptyreader.verbose = false;
+        vector<htkmlfreader> shards(paths.size(), emptyreader);
+        std::atomic<size_t> nextpath(0);
+        vector<std::future<void>> threads;
+        for (size_t k = 0; k < numthreads; k++)
+        {
+            threads.push_back(std::async(std::launch::async, [&]()
+                                         {
+                                             for (size_t i = nextpath++; i < paths.size(); i = nextpath++)
+                                                 shards[i].read(paths[i], restricttokeys, wordmap, unitmap, htkTimeToFrame);
+                                         }));
+        }
+        for (auto& thread : threads)
+            thread.get(); // (rethrows a parse error)
+
+        // merge in order of the files
         foreach_index (i, paths)
-            read(paths[i], restricttokeys, wordmap, unitmap, htkTimeToFrame);
+        {
+            for (auto& entry : shards[i])
+            {
+                if (!this->insert(make_pair(entry.first, std::move(entry.second))).second)
+                    RuntimeError("htkmlfreader: duplicate entry '%ls' in '%ls'", entry.first.c_str(), paths[i].c_str());
+            }
+            for (auto& wordsequence : shards[i].wordsequences)
+                wordsequences[wordsequence.first] = std::move(wordsequence.second);
+            shards[i].clear();
+        }
+        fprintf(stderr, " total %lu entries\n", this->size());
     }
 
     // note: this function is not designed to be pretty but to be fast
@@ -1019,7 +1070,8 @@ public:
         if (!restricttokeys.empty() && this->size() >= restricttokeys.size()) // no need to even read the file if we are there (we support multiple files)
             return;
 
-        fprintf(stderr, "htkmlfreader: reading MLF file %ls ...", path.c_str());
+        if (verbose)
+            fprintf(stderr, "htkmlfreader: reading MLF file %ls ...", path.c_str());
         curpath = path; // for error messages only
 
         auto_file_ptr f(fopenOrDie(path, L"rb"));
@@ -1099,7 +1151,8 @@ public:
             malformed("unexpected end in mid-utterance");
 
         curpath.clear();
-        fprintf(stderr, " total %lu entries\n", this->size());
+        if (verbose)
+            fprintf(stderr, " total %lu entries\n", this->size());
     }
 
     // read state list, index is from 0
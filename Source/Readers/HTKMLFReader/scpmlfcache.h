@@ -0,0 +1,221 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// scpmlfcache.h -- binary cache of the parsed script (SCP) and label (MLF) files, for fast reader startup
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "fileutil.h"
+#include "MappedFile.h"
+#include "htkfeatio.h" // for htkmlfentry
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace msra { namespace asr {
+
+// ===========================================================================
+// scpmlfcache -- binary cache of the feature paths and parsed labels
+//
+// Parsing the SCP and MLF files of a large corpus takes minutes. The cache stores the result, i.e. the
+// feature paths after prefix and '...' expansion and the labels after state-list mapping, and is loaded
+// by mapping it into memory.
+// The cache is only used if it was built from the same source files (by path, size, and modification time)
+// and the same settings; otherwise it is rebuilt.
+//
+// File format (native byte order):
+//  - magic, format version, sizeof(wchar_t), sizeof(htkmlfentry)
+//  - fingerprint of sources and settings
+//  - [script file][utterance] feature path
+//  - [label set][key] entries
+// Strings are stored as their length followed by their characters.
+// ===========================================================================
+
+class scpmlfcache
+{
+public:
+    typedef std::map<std::wstring, std::vector<htkmlfentry>> labelmap;
+
+private:
+    static const uint64_t magic = 0x31434d4c46504353; // "SCPFLMC1"
+    static const uint64_t version = 1;
+
+    std::wstring cachepath;
+    std::wstring fingerprint; // identifies the sources and settings that the cache was built from
+
+    // --- reading from the mapped file
+
+    class mappedreader
+    {
+        const char* p;
+        const char* end;
+        const std::wstring& path; // for error messages
+
+    public:
+        mappedreader(const Microsoft::MSR::CNTK::MappedFile& mapping, const std::wstring& path)
+            : p(mapping.Data()), end(mapping.Data() + mapping.Size()), path(path)
+        {
+        }
+        void read(void* buf, size_t size)
+        {
+            if (size > (size_t)(end - p))
+                RuntimeError("scpmlfcache: cache file '%ls' is truncated", path.c_str());
+            memcpy(buf, p, size);
+            p += size;
+        }
+        uint64_t readint()
+        {
+            uint64_t v;
+            read(&v, sizeof(v));
+            return v;
+        }
+        std::wstring readstring()
+        {
+            std::wstring s(readint(), L'\0');
+            if (!s.empty())
+                read(&s[0], s.size() * sizeof(wchar_t));
+            return s;
+        }
+    };
+
+    // --- writing
+
+    static void writeint(FILE* f, uint64_t v)
+    {
+        fwriteOrDie(&v, sizeof(v), 1, f);
+    }
+    static void writestring(FILE* f, const std::wstring& s)
+    {
+        writeint(f, s.size());
+        if (!s.empty())
+            fwriteOrDie(s.data(), sizeof(wchar_t), s.size(), f);
+    }
+
+    // size and modification time of a source file, which identify its version
+    static std::wstring fileversion(const std::wstring& path)
+    {
+#ifdef _WIN32
+        struct _stat64 st;
+        if (_wstat64(path.c_str(), &st) != 0)
+#else
+        struct stat st;
+        if (stat(wtocharpath(path).c_str(), &st) != 0)
+#endif
+            return L"missing";
+        return msra::strfun::wstrprintf(L"%llu,%llu", (unsigned long long) st.st_size, (unsigned long long) st.st_mtime);
+    }
+
+public:
+    // 'sourcefiles' are all files that the parsed data was read from, and 'settings' all configuration values that affect the parsing
+    scpmlfcache(const std::wstring& cachepath, const std::vector<std::wstring>& sourcefiles, const std::wstring& settings)
+        : cachepath(cachepath), fingerprint(settings)
+    {
+        for (const auto& sourcefile : sourcefiles)
+            fingerprint += L"\n" + sourcefile + L"|" + fileversion(sourcefile);
+    }
+
+    // load the cache; returns false if it does not exist or is out of date
+    bool tryload(std::vector<std::vector<std::wstring>>& infilesmulti, std::vector<labelmap>& labelsmulti) const
+    {
+        if (!fexists(cachepath))
+            return false;
+
+        try
+        {
+            auto_file_ptr f(fopenOrDie(cachepath, L"rb"));
+            Microsoft::MSR::CNTK::MappedFile mapping(f);
+            mappedreader r(mapping, cachepath);
+            if (r.readint() != magic || r.readint() != version || r.readint() != sizeof(wchar_t) || r.readint() != sizeof(htkmlfentry) || r.readstring() != fingerprint)
+            {
+                fprintf(stderr, "scpmlfcache: cache file %ls is out of date, rebuilding it\n", cachepath.c_str());
+                return false;
+            }
+
+            infilesmulti.resize(r.readint());
+            for (auto& infiles : infilesmulti)
+            {
+                infiles.resize(r.readint());
+                for (auto& infile : infiles)
+                    infile = r.readstring();
+            }
+
+            labelsmulti.resize(r.readint());
+            for (auto& labels : labelsmulti)
+            {
+                size_t numkeys = r.readint();
+                for (size_t i = 0; i < numkeys; i++)
+                {
+                    std::wstring key = r.readstring();
+                    std::vector<htkmlfentry> entries(r.readint());
+                    if (!entries.empty())
+                        r.read(entries.data(), entries.size() * sizeof(htkmlfentry));
+                    labels.emplace_hint(labels.end(), std::move(key), std::move(entries)); // (keys are stored in order)
+                }
+            }
+        }
+        catch (const std::exception& e) // (e.g. a truncated file)
+        {
+            fprintf(stderr, "scpmlfcache: cannot read cache file %ls, rebuilding it: %s\n", cachepath.c_str(), e.what());
+            infilesmulti.clear();
+            labelsmulti.clear();
+            return false;
+        }
+
+        fprintf(stderr, "scpmlfcache: loaded %lu feature paths and %lu label sets from cache file %ls\n",
+                infilesmulti.empty() ? 0 : infilesmulti[0].size(), labelsmulti.size(), cachepath.c_str());
+        return true;
+    }
+
+    // write the cache
+    // This is done after parsing; since the cache is only an optimization, failure to write it is not an error.
+    void save(const std::vector<std::vector<std::wstring>>& infilesmulti, const std::vector<labelmap>& labelsmulti) const
+    {
+        std::wstring tmppath = cachepath + L".tmp";
+        try
+        {
+            {
+                auto_file_ptr f(fopenOrDie(tmppath, L"wb"));
+                writeint(f, magic);
+                writeint(f, version);
+                writeint(f, sizeof(wchar_t));
+                writeint(f, sizeof(htkmlfentry));
+                writestring(f, fingerprint);
+
+                writeint(f, infilesmulti.size());
+                for (const auto& infiles : infilesmulti)
+                {
+                    writeint(f, infiles.size());
+                    for (const auto& infile : infiles)
+                        writestring(f, infile);
+                }
+
+                writeint(f, labelsmulti.size());
+                for (const auto& labels : labelsmulti)
+                {
+                    writeint(f, labels.size());
+                    for (const auto& entry : labels)
+                    {
+                        writestring(f, entry.first);
+                        writeint(f, entry.second.size());
+                        if (!entry.second.empty())
+                            fwriteOrDie(entry.second.data(), sizeof(htkmlfentry), entry.second.size(), f);
+                    }
+                }
+                fflushOrDie(f);
+            }
+            renameOrDie(tmppath, cachepath);
+            fprintf(stderr, "scpmlfcache: wrote cache file %ls\n", cachepath.c_str());
+        }
+        catch (const std::exception& e)
+        {
+            fprintf(stderr, "scpmlfcache: WARNING: could not write cache file %ls: %s\n", cachepath.c_str(), e.what());
+        }
+    }
+};
+};
+}; // namespaces
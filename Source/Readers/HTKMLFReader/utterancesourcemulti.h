@@ -31,6 +31,8 @@ class minibatchutterancesourcemulti : public minibatchsource
     std::vector<string> featkind;
     std::vector<size_t> featdim;
     const bool framemode;                    // true -> actually return frame-level randomized frames (not possible in lattice mode)
+    const bool hashedframerandomization;     // true -> in frame mode, compute randomized frames on the fly instead of keeping a lookup table for the sweep
+    const size_t lengthbucketsize;           // > 1 -> in utterance mode, sort blocks of this many randomized utterances by length (see sortblocksbylength())
     std::vector<std::vector<size_t>> counts; // [s] occurence count for all states (used for priors)
     int verbosity;
     // lattice reader
@@ -307,6 +309,61 @@ class minibatchutterancesourcemulti : public minibatchsource
     };
     biggrowablevector<frameref> randomizedframerefs; // [globalt-sweepts] -> (chunk, utt, frame) lookup table for randomized frames  --this can be REALLY big!
 
+    // alternative frame-level randomization without lookup table (hashedframerandomization)
+    // The randomized chunk sequence is cut into blocks of consecutive chunks that each lie within the randomization window
+    // of all of their chunks. Frame positions within a block are mapped to frames of the same block by a bijection
+    // seeded with sweep and block, which is evaluated on the fly in hashedframeref(). This needs memory per chunk, not per frame.
+    std::vector<size_t> chunkblockbegin; // [chunkindex] first chunk of the block that this chunk belongs to
+    std::vector<size_t> chunkblockend;   // [chunkindex] and end of that block
+
+    // seeded random permutation of [0, n)
+    // This is a Feistel network over [0, 4^k) with 4^k >= n, which is a bijection; values >= n are mapped again ('cycle walking'),
+    // which makes it a bijection of [0, n). Since 4^k < 4n, that takes less than 4 evaluations on average.
+    class framepermutation
+    {
+        size_t n;
+        size_t halfbits; // bits of each half of the Feistel network
+        size_t halfmask;
+        uint64_t seed;
+        static const int numrounds = 4;
+
+        static uint64_t hash(uint64_t z) // (splitmix64 finalizer)
+        {
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        }
+        size_t encrypt(size_t x) const
+        {
+            size_t left = x >> halfbits;
+            size_t right = x & halfmask;
+            for (int round = 0; round < numrounds; round++)
+            {
+                const size_t newright = left ^ ((size_t) hash(right + seed + (round + 1) * 0x9e3779b97f4a7c15ull) & halfmask);
+                left = right;
+                right = newright;
+            }
+            return (left << halfbits) | right;
+        }
+
+    public:
+        framepermutation(size_t n, uint64_t seed)
+            : n(n), halfbits(1), seed(hash(seed))
+        {
+            while (((size_t) 1 << (2 * halfbits)) < n)
+                halfbits++;
+            halfmask = ((size_t) 1 << halfbits) - 1;
+        }
+        size_t operator()(size_t i) const
+        {
+            assert(i < n);
+            do
+                i = encrypt(i);
+            while (i >= n);
+            return i;
+        }
+    };
+
     // TODO: this may go away if we store classids directly in the utterance data
     template <class VECTOR>
     class shiftedvector // accessing a vector with a non-0 starting index
@@ -388,8 +445,9 @@ public:
     // This mode requires utterances with time stamps.
     minibatchutterancesourcemulti(const std::vector<std::vector<wstring>> &infiles, const std::vector<map<wstring, std::vector<msra::asr::htkmlfentry>>> &labels,
                                   std::vector<size_t> vdim, std::vector<size_t> udim, std::vector<size_t> leftcontext, std::vector<size_t> rightcontext, size_t randomizationrange,
-                                  const latticesource &lattices, const map<wstring, msra::lattices::lattice::htkmlfwordsequence> &allwordtranscripts, const bool framemode)
-        : vdim(vdim), leftcontext(leftcontext), rightcontext(rightcontext), sampperiod(0), featdim(0), randomizationrange(randomizationrange), currentsweep(SIZE_MAX), lattices(lattices), allwordtranscripts(allwordtranscripts), framemode(framemode), chunksinram(0), timegetbatch(0), verbosity(2)
+                                  const latticesource &lattices, const map<wstring, msra::lattices::lattice::htkmlfwordsequence> &allwordtranscripts, const bool framemode,
+                                  const bool hashedframerandomization = false, const size_t lengthbucketsize = 0)
+        : vdim(vdim), leftcontext(leftcontext), rightcontext(rightcontext), sampperiod(0), featdim(0), randomizationrange(randomizationrange), currentsweep(SIZE_MAX), lattices(lattices), allwordtranscripts(allwordtranscripts), framemode(framemode), hashedframerandomization(hashedframerandomization), lengthbucketsize(lengthbucketsize), chunksinram(0), timegetbatch(0), verbosity(2)
     // [v-hansu] change framemode (lattices.empty()) into framemode (false) to run utterance mode without lattice
     // you also need to change another line, search : [v-hansu] comment out to run utterance mode without lattice
     {
@@ -904,6 +962,9 @@ private:
                 }
             }
 
+            if (lengthbucketsize > 1)
+                sortblocksbylength();
+
             // place the randomized utterances on the global timeline so we can find them by globalts
             size_t t = sweepts;
             foreach_index (i, randomizedutterancerefs)
@@ -933,6 +994,10 @@ private:
                 randomizedutteranceposmap[uttref.globalts] = (size_t) pos;
             }
         }
+        else if (hashedframerandomization) // frame mode, randomized on the fly
+        {
+            lazyhashedframerandomization();
+        }
         else // frame mode
         {
             // This sets up the following members:
@@ -1057,6 +1122,96 @@ private:
         return sweep;
     }
 
+    // sort each block of 'lengthbucketsize' randomized utterance positions by utterance length -> randomizedutterancerefs[]
+    // The reader fills the parallel sequences of a minibatch with consecutive utterances, which then have similar lengths,
+    // so that less of the minibatch is gaps. Blocks alternate between ascending and descending order, to avoid a jump in
+    // length at every block boundary. Since window boundaries are monotonous in the position, an utterance that is valid
+    // for the first and the last position of its block is valid for all of them; only such utterances are moved.
+    void sortblocksbylength()
+    {
+        std::vector<size_t> positions;
+        std::vector<utteranceref> movable;
+        for (size_t blockbegin = 0; blockbegin < numutterances; blockbegin += lengthbucketsize)
+        {
+            const size_t blockend = min(blockbegin + lengthbucketsize, numutterances);
+            positions.clear();
+            movable.clear();
+            for (size_t pos = blockbegin; pos < blockend; pos++)
+            {
+                const auto &uttref = randomizedutterancerefs[pos];
+                if (positionchunkwindows[blockbegin].isvalidforthisposition(uttref) && positionchunkwindows[blockend - 1].isvalidforthisposition(uttref))
+                {
+                    positions.push_back(pos);
+                    movable.push_back(uttref);
+                }
+            }
+
+            const bool descending = (blockbegin / lengthbucketsize) % 2 != 0;
+            std::stable_sort(movable.begin(), movable.end(), [&](const utteranceref &a, const utteranceref &b)
+                             {
+                                 const size_t aframes = randomizedchunks[0][a.chunkindex].getchunkdata().numframes(a.utteranceindex);
+                                 const size_t bframes = randomizedchunks[0][b.chunkindex].getchunkdata().numframes(b.utteranceindex);
+                                 return descending ? aframes > bframes : aframes < bframes;
+                             });
+            foreach_index (k, positions)
+                randomizedutterancerefs[positions[k]] = movable[k];
+        }
+    }
+
+    // set up the blocks for hashed frame randomization -> chunkblockbegin[], chunkblockend[]
+    // Block [b,e) may be randomized within if all its chunks lie within the windows of all of its chunks. Since window
+    // boundaries are monotonous in the chunk index, that is the case if windowbegin(e-1) <= b and windowend(b) >= e.
+    void lazyhashedframerandomization()
+    {
+        const auto &chunks = randomizedchunks[0];
+        chunkblockbegin.resize(chunks.size());
+        chunkblockend.resize(chunks.size());
+        size_t numblocks = 0;
+        for (size_t b = 0; b < chunks.size(); numblocks++)
+        {
+            if (chunks[b].windowbegin > b || chunks[b].windowend <= b)
+                LogicError("lazyrandomization: chunk %d lies outside its own randomization window; randomization range too small", (int) b);
+            size_t e = b + 1;
+            while (e < chunks.size() && chunks[e].windowbegin <= b && chunks[b].windowend > e)
+                e++;
+            for (size_t k = b; k < e; k++)
+            {
+                chunkblockbegin[k] = b;
+                chunkblockend[k] = e;
+            }
+            b = e;
+        }
+        if (verbosity > 0)
+            fprintf(stderr, "lazyrandomization: randomizing frames on the fly within %d blocks of chunks\n", (int) numblocks);
+    }
+
+    // get the randomized frame for a frame position [globalt-sweepts] in hashed frame randomization
+    frameref hashedframeref(const size_t framepos) const
+    {
+        const auto &chunks = randomizedchunks[0];
+        const size_t sweepts = chunks[0].globalts;
+        const size_t positionchunkindex = chunkforframepos(sweepts + framepos);
+
+        // permute within the block of the position's chunk
+        const size_t blockbegin = chunkblockbegin[positionchunkindex];
+        const size_t blockend = chunkblockend[positionchunkindex];
+        const size_t blockts = chunks[blockbegin].globalts;
+        const framepermutation permutation(chunks[blockend - 1].globalte() - blockts, ((uint64_t) currentsweep << 32) + blockbegin);
+        const size_t t = blockts + permutation(sweepts + framepos - blockts);
+
+        // find chunk, utterance, and frame of the permuted frame
+        const size_t chunkindex = chunkforframepos(t);
+        const auto &chunkdata = chunks[chunkindex].getchunkdata();
+        const size_t chunkframe = t - chunks[chunkindex].globalts;
+        const size_t utteranceindex = std::upper_bound(chunkdata.firstframes.begin(), chunkdata.firstframes.end(), chunkframe) - chunkdata.firstframes.begin() - 1;
+        return frameref(chunkindex, utteranceindex, chunkframe - chunkdata.firstframes[utteranceindex]);
+    }
+
+    frameref randomizedframeref(const size_t framepos) const
+    {
+        return hashedframerandomization ? hashedframeref(framepos) : randomizedframerefs[framepos];
+    }
+
     // helper to page out a chunk with log message
     void releaserandomizedchunk(size_t k)
     {
@@ -1381,7 +1536,7 @@ public:
             for (size_t i = 0; i < mbframes; i++) // i is input frame index; j < i in case of MPI/data-parallel sub-set mode
             {
                 const size_t framepos = (globalts + i) % _totalframes; // (for comments, see main loop below)
-                const frameref &frameref = randomizedframerefs[framepos];
+                const frameref frameref = randomizedframeref(framepos);
                 subsetsizes[frameref.chunkindex % numsubsets]++;
             }
             size_t j = subsetsizes[subsetnum];                                           // return what we have  --TODO: we can remove the above full computation again now
@@ -1420,7 +1575,7 @@ public:
 
                 // map to time index inside arrays
                 const size_t framepos = (globalts + j) % _totalframes; // using mod because we may actually run beyond the sweep for the last call
-                const frameref &frameref = randomizedframerefs[framepos];
+                const frameref frameref = randomizedframeref(framepos);
 
                 // in MPI/data-parallel mode, skip frames that are not in chunks loaded for this MPI node
                 if ((frameref.chunkindex % numsubsets) != subsetnum)
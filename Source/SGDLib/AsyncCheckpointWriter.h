@@ -0,0 +1,75 @@
+// AsyncCheckpointWriter.h -- writes model and checkpoint files on background threads while training continues
+
+#pragma once
+
+#include "Basics.h"
+#include <future>
+#include <functional>
+#include <deque>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Each submitted write runs on its own thread, but only after all previously submitted writes have completed,
+// so that writes may delete files of previous ones. At most 'maxPendingWrites' writes are in flight; Submit()
+// blocks until the oldest one has completed. The data to be written must be owned by the write function
+// (e.g. a serialized model), since training modifies the network while the write is running. Writes run on threads
+// that have not selected a GPU, so they must only touch CPU data.
+// An error in a write is rethrown by the Submit() or WaitForAll() that waits for it.
+class AsyncCheckpointWriter
+{
+    // no-copying
+    AsyncCheckpointWriter(const AsyncCheckpointWriter&);
+    void operator=(const AsyncCheckpointWriter&);
+
+    size_t m_maxPendingWrites;
+    std::deque<std::shared_future<void>> m_pendingWrites;
+
+    void WaitForOldest()
+    {
+        std::shared_future<void> oldest = m_pendingWrites.front();
+        m_pendingWrites.pop_front();
+        oldest.get(); // rethrows an exception from the write
+    }
+
+public:
+    AsyncCheckpointWriter(size_t maxPendingWrites)
+        : m_maxPendingWrites(maxPendingWrites)
+    {
+        if (m_maxPendingWrites == 0)
+            InvalidArgument("AsyncCheckpointWriter: At least one pending checkpoint must be allowed.");
+    }
+
+    ~AsyncCheckpointWriter()
+    {
+        // (since destructors may not throw, errors are ignored here; call WaitForAll() before to see them)
+        for (auto& write : m_pendingWrites)
+            write.wait();
+    }
+
+    void Submit(std::function<void()>&& write)
+    {
+        while (m_pendingWrites.size() >= m_maxPendingWrites)
+            WaitForOldest();
+
+        std::shared_future<void> previous = m_pendingWrites.empty() ? std::shared_future<void>() : m_pendingWrites.back();
+        m_pendingWrites.push_back(std::async(std::launch::async, [previous, write]()
+                                             {
+                                                 if (previous.valid())
+                                                     previous.wait();
+                                                 write();
+                                             }).share());
+    }
+
+    // must be called before any written file is read back
+    void WaitForAll()
+    {
+        while (!m_pendingWrites.empty())
+            WaitForOldest();
+    }
+
+    bool HasPendingWrites() const
+    {
+        return !m_pendingWrites.empty();
+    }
+};
+} } }
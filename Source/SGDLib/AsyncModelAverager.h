@@ -0,0 +1,202 @@
+// AsyncModelAverager.h -- model averaging in a background thread, blended into the local models with block momentum or an elastic term
+
+#pragma once
+
+#include "Basics.h"
+#include "Matrix.h"
+#include "MPIWrapper.h"
+#include <algorithm>
+#include <future>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// how the average of a round is blended into the local models
+enum class ModelAveragingBlend : int
+{
+    BlockMomentum, // global model += block momentum * previous block update + (average - global model); local model moves to the global model
+    Elastic        // local model moves by alpha * (average - local model)
+};
+
+// ===========================================================================
+// AsyncModelAverager -- model averaging that does not stop local SGD
+//
+// Start() copies the local models into CPU snapshots. A background thread then averages the snapshots over
+// all ranks, weighted by the number of samples each rank has processed since its previous round, with
+// MPIWrapper::AllReduce(). Meanwhile the caller continues local SGD. Finish() waits for the round and moves
+// each local model by the difference between the blended average and its snapshot, so that the local
+// progress made while the round was in flight is kept.
+//
+// Each rank starts its rounds independently (e.g. after a number of local samples), so fast ranks do not idle
+// while slow ones catch up; but all ranks must run the same number of rounds, since each round is a sequence of
+// collectives. A rank that has run out of data therefore keeps running rounds with isFinal = true until a
+// round is final on all ranks.
+// MPI is initialized with MPI_THREAD_SERIALIZED, so the caller must not use MPI while a round is pending.
+// ===========================================================================
+
+template <class ElemType>
+class AsyncModelAverager
+{
+    struct Parameter
+    {
+        size_t numRows, numCols;
+        std::vector<ElemType> snapshot;    // local model at Start()
+        std::vector<ElemType> average;     // average over the ranks, computed by the round
+        std::vector<ElemType> global;      // global model after the previous round (BlockMomentum)
+        std::vector<ElemType> blockUpdate; // previous block update including momentum (BlockMomentum)
+    };
+
+    MPIWrapper* m_mpi;
+    ModelAveragingBlend m_blend;
+    double m_blockMomentum;
+    double m_elasticAlpha;
+    std::vector<Parameter> m_parameters;
+    bool m_hasGlobalModel;
+    double m_roundHeader[2]; // [number of samples, 1 if final], summed over the ranks by the round
+    std::future<void> m_pendingRound;
+
+    // no copying
+    AsyncModelAverager(const AsyncModelAverager&);
+    void operator=(const AsyncModelAverager&);
+
+    // the background part of a round
+    void RunRound()
+    {
+        const double localSamples = m_roundHeader[0];
+        m_mpi->AllReduce(m_roundHeader, 2);
+        const ElemType factor = (ElemType)(m_roundHeader[0] > 0 ? localSamples / m_roundHeader[0] : 1.0 / m_mpi->NumNodesInUse());
+        for (auto& parameter : m_parameters)
+        {
+            parameter.average.resize(parameter.snapshot.size());
+            for (size_t j = 0; j < parameter.snapshot.size(); j++)
+                parameter.average[j] = factor * parameter.snapshot[j];
+            m_mpi->AllReduce(parameter.average.data(), parameter.average.size());
+        }
+    }
+
+public:
+    AsyncModelAverager()
+        : m_mpi(nullptr), m_blend(ModelAveragingBlend::BlockMomentum), m_blockMomentum(0), m_elasticAlpha(1), m_hasGlobalModel(false)
+    {
+    }
+
+    void Init(MPIWrapper* mpi, ModelAveragingBlend blend, double blockMomentum, double elasticAlpha)
+    {
+        if (IsPending())
+            LogicError("AsyncModelAverager::Init: A round is still pending.");
+        m_mpi = mpi;
+        m_blend = blend;
+        m_blockMomentum = blockMomentum;
+        m_elasticAlpha = elasticAlpha;
+        m_parameters.clear();
+        m_hasGlobalModel = false;
+    }
+
+    bool IsPending() const
+    {
+        return m_pendingRound.valid();
+    }
+    bool IsRoundFinished() const
+    {
+        return IsPending() && m_pendingRound.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // snapshot 'values' and start a round in the background
+    // 'numSamples' is the number of samples this rank has processed since its previous round.
+    void Start(const std::vector<Matrix<ElemType>*>& values, size_t numSamples, bool isFinal)
+    {
+        if (IsPending())
+            LogicError("AsyncModelAverager::Start: The previous round is still pending.");
+
+        // the global model is only kept as long as the parameters do not change
+        bool sameParameters = m_parameters.size() == values.size();
+        for (size_t i = 0; i < values.size() && sameParameters; i++)
+            sameParameters = m_parameters[i].numRows == values[i]->GetNumRows() && m_parameters[i].numCols == values[i]->GetNumCols();
+        if (!sameParameters)
+        {
+            m_parameters.assign(values.size(), Parameter());
+            m_hasGlobalModel = false;
+        }
+
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            const Matrix<ElemType>& value = *values[i];
+            if (value.GetMatrixType() != MatrixType::DENSE)
+                LogicError("AsyncModelAverager: Only dense parameters can be averaged.");
+            Parameter& parameter = m_parameters[i];
+            parameter.numRows = value.GetNumRows();
+            parameter.numCols = value.GetNumCols();
+            parameter.snapshot.resize(value.GetNumElements());
+            if (!parameter.snapshot.empty())
+            {
+                ElemType* copy = value.CopyToArray();
+                std::copy(copy, copy + parameter.snapshot.size(), parameter.snapshot.begin());
+                delete[] copy;
+            }
+        }
+
+        m_roundHeader[0] = (double) numSamples;
+        m_roundHeader[1] = isFinal ? 1 : 0;
+        m_pendingRound = std::async(std::launch::async, [this]
+                                    {
+                                        RunRound();
+                                    });
+    }
+
+    // wait for the pending round and blend its average into 'values' (the same matrices as given to Start())
+    // Returns the number of samples of the round over all ranks, and whether the round was final on all ranks.
+    void Finish(const std::vector<Matrix<ElemType>*>& values, size_t& totalSamples, bool& allFinal)
+    {
+        if (!IsPending())
+            LogicError("AsyncModelAverager::Finish: No round is pending.");
+        m_pendingRound.get(); // (rethrows errors of the round)
+        if (values.size() != m_parameters.size())
+            LogicError("AsyncModelAverager::Finish: The parameters have changed during the round.");
+
+        std::vector<ElemType> delta;
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            Matrix<ElemType>& value = *values[i];
+            Parameter& parameter = m_parameters[i];
+            if (value.GetNumRows() != parameter.numRows || value.GetNumCols() != parameter.numCols)
+                LogicError("AsyncModelAverager::Finish: The dimensions of a parameter have changed during the round.");
+            const size_t n = parameter.snapshot.size();
+            if (n == 0)
+                continue;
+
+            delta.resize(n);
+            if (m_blend == ModelAveragingBlend::BlockMomentum)
+            {
+                if (!m_hasGlobalModel) // first round: the average becomes the global model
+                {
+                    parameter.global = parameter.average;
+                    parameter.blockUpdate.assign(n, 0);
+                }
+                else
+                {
+                    for (size_t j = 0; j < n; j++)
+                    {
+                        parameter.blockUpdate[j] = (ElemType) m_blockMomentum * parameter.blockUpdate[j] + (parameter.average[j] - parameter.global[j]);
+                        parameter.global[j] += parameter.blockUpdate[j];
+                    }
+                }
+                for (size_t j = 0; j < n; j++)
+                    delta[j] = parameter.global[j] - parameter.snapshot[j];
+            }
+            else
+            {
+                for (size_t j = 0; j < n; j++)
+                    delta[j] = (ElemType) m_elasticAlpha * (parameter.average[j] - parameter.snapshot[j]);
+            }
+
+            // local model += delta, keeping what local SGD has done since the snapshot
+            Matrix<ElemType> deltaMatrix(parameter.numRows, parameter.numCols, delta.data(), matrixFlagNormal, value.GetDeviceId());
+            Matrix<ElemType>::ScaleAndAdd((ElemType) 1, deltaMatrix, value);
+        }
+        m_hasGlobalModel = true;
+
+        totalSamples = (size_t) m_roundHeader[0];
+        allFinal = m_roundHeader[1] == m_mpi->NumNodesInUse();
+    }
+};
+} } }
@@ -544,6 +544,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             }
 
             // Export node state
+            // (DelayedValueNodes swap their buffers into the state instead of copying them, and swap in the next one by ImportState())
             for (auto& x : m_NetStatefulNodes)
             {
                 wstring name = x.first;
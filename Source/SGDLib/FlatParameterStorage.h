@@ -0,0 +1,315 @@
+// FlatParameterStorage.h -- learnable parameters, their gradients and smoothed gradients as views into contiguous buffers
+
+#pragma once
+
+#include "Basics.h"
+#include "Matrix.h"
+#include "ComputationNode.h"
+#include <list>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// ===========================================================================
+// FlatMatrixBuffer -- one contiguous buffer that holds a set of dense matrices
+//
+// Each matrix is turned into a view into the buffer (Matrix::SetValue() with matrixFlagDontOwnBuffer),
+// so that the whole set can be processed by a single operation on Buffer(), a column vector.
+// Each view starts at a multiple of 'alignment' elements; the gaps are zero.
+//
+// Anything that later replaces or resizes the storage of one of the matrices (e.g. reading a checkpoint
+// into a GPU matrix, or an update rule that allocates its state on first use) makes it a standalone
+// matrix again. IsIntact() detects that, and Build() must then be called again. The Buffer() object
+// itself stays the same across Build() calls, so that pointers to it remain valid.
+// ===========================================================================
+
+template <class ElemType>
+class FlatMatrixBuffer
+{
+    struct View
+    {
+        Matrix<ElemType>* matrix;
+        size_t offset;
+        size_t numRows, numCols;
+    };
+    static const size_t alignment = 64; // (256 bytes for float)
+
+    Matrix<ElemType> m_buffer;
+    std::vector<View> m_views;
+
+    // no copying
+    FlatMatrixBuffer(const FlatMatrixBuffer&);
+    void operator=(const FlatMatrixBuffer&);
+
+public:
+    FlatMatrixBuffer()
+        : m_buffer(CPUDEVICE)
+    {
+    }
+
+    bool IsEmpty() const
+    {
+        return m_views.empty();
+    }
+
+    Matrix<ElemType>& Buffer()
+    {
+        return m_buffer;
+    }
+
+    // whether 'matrices' are exactly the views of the buffer, in this order
+    bool IsIntact(const std::vector<Matrix<ElemType>*>& matrices) const
+    {
+        if (IsEmpty() || matrices.size() != m_views.size())
+            return false;
+        for (size_t i = 0; i < m_views.size(); i++)
+        {
+            const View& view = m_views[i];
+            const Matrix<ElemType>& matrix = *matrices[i];
+            if (matrices[i] != view.matrix || matrix.GetMatrixType() != MatrixType::DENSE || matrix.GetDeviceId() != m_buffer.GetDeviceId() ||
+                matrix.GetNumRows() != view.numRows || matrix.GetNumCols() != view.numCols ||
+                matrix.BufferPointer() != m_buffer.BufferPointer() + view.offset)
+                return false;
+        }
+        return true;
+    }
+
+    // copy 'matrices' (dense, on 'deviceId') into a new buffer and make them views into it
+    void Build(const std::vector<Matrix<ElemType>*>& matrices, DEVICEID_TYPE deviceId)
+    {
+        std::vector<View> views;
+        size_t numElements = 0;
+        for (auto* matrix : matrices)
+        {
+            views.push_back(View{matrix, numElements, matrix->GetNumRows(), matrix->GetNumCols()});
+            numElements += (matrix->GetNumElements() + alignment - 1) / alignment * alignment;
+        }
+
+        // copy all first, since some of the matrices may be views into the previous buffer
+        Matrix<ElemType> buffer(numElements, 1, deviceId);
+        buffer.SetValue(0);
+        for (const auto& view : views)
+        {
+            if (view.numRows * view.numCols == 0)
+                continue;
+            Matrix<ElemType> target(deviceId);
+            target.SetValue(view.numRows, view.numCols, deviceId, buffer.BufferPointer() + view.offset, matrixFlagDontOwnBuffer);
+            target.SetValue(*view.matrix);
+        }
+        for (const auto& view : views)
+        {
+            if (view.numRows * view.numCols > 0)
+                view.matrix->SetValue(view.numRows, view.numCols, deviceId, buffer.BufferPointer() + view.offset, matrixFlagDontOwnBuffer);
+        }
+
+        m_buffer = std::move(buffer);
+        m_views = std::move(views);
+    }
+
+    // give the matrices that are still views their own memory again, and free the buffer
+    // This must be called while the matrices still exist.
+    void Release()
+    {
+        const ElemType* begin = m_buffer.BufferPointer();
+        const ElemType* end = begin + m_buffer.GetNumElements();
+        for (const auto& view : m_views)
+        {
+            Matrix<ElemType>& matrix = *view.matrix;
+            if (matrix.GetMatrixType() == MatrixType::DENSE && matrix.GetDeviceId() == m_buffer.GetDeviceId() &&
+                matrix.BufferPointer() >= begin && matrix.BufferPointer() < end)
+                matrix = Matrix<ElemType>(matrix, matrix.GetDeviceId()); // (deep copy)
+        }
+        m_views.clear();
+        m_buffer = Matrix<ElemType>(CPUDEVICE);
+    }
+};
+
+// ===========================================================================
+// FlatParameterStorage -- the values, gradients and smoothed gradients of the learnable parameters
+// in one FlatMatrixBuffer each
+//
+// With this, gradient aggregation and model averaging need one collective per buffer instead of one per
+// parameter, and element-wise update rules can update all parameters with one call.
+// The set of parameters is determined by the first Update() and stays fixed until Release(): all parameters
+// that are updated and whose value and gradient are dense on the network's device. Others (e.g. with sparse
+// gradients) are kept separately; ValueMatrices() and GradientMatrices() list them after the buffers.
+// The gradients of the parameters in the buffers are taken out of the matrix pool: a pooled gradient may be the
+// same matrix as the value of another node, which would then compute its output into the gradient buffer.
+// Smoothed gradients are only included once all of them have the shape that the update rule gives them
+// (some rules allocate more columns on first use).
+// ===========================================================================
+
+template <class ElemType>
+class FlatParameterStorage
+{
+    FlatMatrixBuffer<ElemType> m_values, m_gradients, m_smoothedGradients;
+    std::vector<ComputationNodeBasePtr> m_nodes;      // parameters in the buffers
+    std::vector<ComputationNodeBasePtr> m_otherNodes; // parameters that are updated but kept separately
+    std::vector<Matrix<ElemType>*> m_smoothedGradientsOfNodes;
+    DEVICEID_TYPE m_deviceId;
+    bool m_initialized;
+
+    static Matrix<ElemType>& ValueOf(const ComputationNodeBasePtr& node)
+    {
+        return dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+    }
+    static Matrix<ElemType>& GradientOf(const ComputationNodeBasePtr& node)
+    {
+        return dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient();
+    }
+
+    void RebuildValuesIfNeeded()
+    {
+        std::vector<Matrix<ElemType>*> values;
+        for (const auto& node : m_nodes)
+            values.push_back(&ValueOf(node));
+        if (!m_values.IsIntact(values))
+            m_values.Build(values, m_deviceId);
+    }
+
+    void RebuildGradientsIfNeeded()
+    {
+        std::vector<Matrix<ElemType>*> gradients;
+        for (const auto& node : m_nodes)
+        {
+            gradients.push_back(&GradientOf(node));
+            if (GradientOf(node).GetMatrixType() != MatrixType::DENSE)
+                LogicError("FlatParameterStorage: The gradient of %ls has become sparse.", node->NodeName().c_str());
+        }
+        if (!m_gradients.IsIntact(gradients))
+            m_gradients.Build(gradients, m_deviceId);
+    }
+
+public:
+    FlatParameterStorage()
+        : m_deviceId(CPUDEVICE), m_initialized(false)
+    {
+    }
+
+    // (re)build the buffers where needed; called before the gradients of a minibatch are used
+    // 'smoothedGradients' are parallel to 'learnableNodes'. 'smoothedColumnsFactor' is the number of columns of a
+    // smoothed gradient in units of the parameter's columns.
+    void Update(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients,
+                size_t smoothedColumnsFactor, DEVICEID_TYPE deviceId, int traceLevel)
+    {
+        if (!m_initialized)
+        {
+            m_deviceId = deviceId;
+            auto smoothedGradientIter = smoothedGradients.begin();
+            for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+            {
+                const ComputationNodeBasePtr& node = *nodeIter;
+                if (!node->IsParameterUpdateRequired())
+                    continue;
+                Matrix<ElemType>& value = ValueOf(node);
+                const Matrix<ElemType>& gradient = GradientOf(node);
+                if (value.GetMatrixType() == MatrixType::DENSE && value.GetDeviceId() == deviceId &&
+                    gradient.GetMatrixType() == MatrixType::DENSE && gradient.GetDeviceId() == deviceId && !value.IsEmpty())
+                {
+                    auto parameter = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+                    parameter->MakeGradientMatrixPrivate();
+                    if (parameter->Gradient().GetNumCols() == 0) // (not sized before the first backprop)
+                        parameter->Gradient().Resize(value.GetNumRows(), value.GetNumCols());
+                    m_nodes.push_back(node);
+                    m_smoothedGradientsOfNodes.push_back(&*smoothedGradientIter);
+                }
+                else
+                    m_otherNodes.push_back(node);
+            }
+            m_initialized = true;
+            if (traceLevel > 0)
+                fprintf(stderr, "FlatParameterStorage: %d parameters in contiguous buffers, %d kept separately.\n", (int) m_nodes.size(), (int) m_otherNodes.size());
+        }
+        if (m_nodes.empty())
+            return;
+
+        RebuildValuesIfNeeded();
+        RebuildGradientsIfNeeded();
+
+        if (!m_smoothedGradients.IsIntact(m_smoothedGradientsOfNodes))
+        {
+            bool allShaped = true;
+            for (size_t i = 0; i < m_nodes.size() && allShaped; i++)
+            {
+                const Matrix<ElemType>& value = ValueOf(m_nodes[i]);
+                const Matrix<ElemType>& smoothedGradient = *m_smoothedGradientsOfNodes[i];
+                allShaped = smoothedGradient.GetMatrixType() == MatrixType::DENSE && smoothedGradient.GetDeviceId() == m_deviceId &&
+                            smoothedGradient.GetNumRows() == value.GetNumRows() && smoothedGradient.GetNumCols() == smoothedColumnsFactor * value.GetNumCols();
+            }
+            if (allShaped)
+                m_smoothedGradients.Build(m_smoothedGradientsOfNodes, m_deviceId);
+            else if (!m_smoothedGradients.IsEmpty())
+                m_smoothedGradients.Release();
+        }
+    }
+
+    // give all matrices their own memory again, e.g. at the end of training
+    // This must be called while the smoothed gradients still exist.
+    void Release()
+    {
+        m_values.Release();
+        m_gradients.Release();
+        m_smoothedGradients.Release();
+        m_nodes.clear();
+        m_otherNodes.clear();
+        m_smoothedGradientsOfNodes.clear();
+        m_initialized = false;
+    }
+
+    bool IsEmpty() const
+    {
+        return m_nodes.empty();
+    }
+    const std::vector<ComputationNodeBasePtr>& Nodes() const
+    {
+        return m_nodes;
+    }
+
+    // the value buffer followed by the values of the other parameters
+    std::vector<Matrix<ElemType>*> ValueMatrices()
+    {
+        std::vector<Matrix<ElemType>*> matrices;
+        if (!m_nodes.empty())
+        {
+            RebuildValuesIfNeeded();
+            matrices.push_back(&m_values.Buffer());
+        }
+        for (const auto& node : m_otherNodes)
+            matrices.push_back(&ValueOf(node));
+        return matrices;
+    }
+
+    // the gradient buffer followed by the gradients of the other parameters
+    std::vector<Matrix<ElemType>*> GradientMatrices()
+    {
+        std::vector<Matrix<ElemType>*> matrices;
+        if (!m_nodes.empty())
+        {
+            RebuildGradientsIfNeeded();
+            matrices.push_back(&m_gradients.Buffer());
+        }
+        for (const auto& node : m_otherNodes)
+            matrices.push_back(&GradientOf(node));
+        return matrices;
+    }
+
+    // whether an element-wise update of Values() with Gradients() and SmoothedGradients() updates all parameters,
+    // i.e. there are no other parameters and all three buffers are in place (as of the last Update())
+    bool CanUpdateAllAtOnce() const
+    {
+        return !m_nodes.empty() && m_otherNodes.empty() && m_smoothedGradients.IsIntact(m_smoothedGradientsOfNodes);
+    }
+    Matrix<ElemType>& Values()
+    {
+        return m_values.Buffer();
+    }
+    Matrix<ElemType>& Gradients()
+    {
+        return m_gradients.Buffer();
+    }
+    Matrix<ElemType>& SmoothedGradients()
+    {
+        return m_smoothedGradients.Buffer();
+    }
+};
+} } }
@@ -0,0 +1,342 @@
+// FusedParameterUpdate.h -- single-pass update of all learnable parameters that live on the CPU
+
+#pragma once
+
+#include "Basics.h"
+#include "Matrix.h"
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// The regular update (SGD::UpdateWeightsS()) is called for each parameter and makes a separate pass over memory for
+// gradient clipping, L2 regularization, the momentum or adaptive step, and L1 regularization. This instead does all of
+// them in a single pass per element, and updates all parameters in one parallel sweep over blocks of a flattened
+// parameter list, so that many small parameters do not each pay for their own dispatch and thread fork.
+// Two cases need a reduction over each parameter and therefore one more sweep:
+//  - norm-based gradient clipping needs the gradient norms first (read-only sweep);
+//  - AdaGrad and RmsProp with average multiplier scale the step by the average of the adaptive factors,
+//    so the adaptively scaled gradients are written back in the first sweep and applied in the second.
+// The results are the same as those of the regular update, except for rounding.
+// The gradients are consumed, i.e. they are not left in the same state as after the regular update.
+template <class ElemType>
+class FusedParameterUpdate
+{
+public:
+    enum class Rule
+    {
+        Momentum,
+        NesterovMomentum,
+        AdaGrad,
+        FSAdaGrad,
+        RmsProp
+    };
+
+    // settings shared by all parameters
+    struct Settings
+    {
+        Rule rule;
+        ElemType learnRatePerSample;
+        ElemType momentum;           // per minibatch
+        double maxGradientPerMB;     // for clipping, or infinity
+        bool clipWithTruncation;     // clip each element instead of the gradient norm
+        ElemType l2Weight;           // L2 regularization weight times #samples; 0 for none
+        ElemType l1Threshold;        // learning rate times L1 regularization weight times #samples; 0 for none
+        bool needAveMultiplier;      // (AdaGrad, RmsProp) divide the learning rate by the average adaptive factor
+        ElemType rmsGamma, rmsInc, rmsMax, rmsDec, rmsMin; // (RmsProp)
+    };
+
+private:
+    struct Parameter
+    {
+        ElemType* value;
+        ElemType* gradient;
+        ElemType* smoothed;
+        size_t n;
+        ElemType adaWeight, adaMul; // (FSAdaGrad)
+        ElemType clipFactor;        // (norm clipping)
+        double stepScale;           // (average multiplier) learning rate divided by the average adaptive factor
+    };
+
+    struct Block // range of elements of a parameter, processed by one thread
+    {
+        size_t parameter;
+        size_t begin, end;
+    };
+    static const size_t elementsPerBlock = 32768;
+
+    std::vector<Parameter> m_parameters;
+    std::vector<Block> m_blocks;
+    std::vector<double> m_blockSums;
+
+    enum class Pass
+    {
+        Complete,          // the whole update in one pass
+        AdaptiveGradient,  // clip, regularize and adaptively scale the gradient, and return the sum of the adaptive factors
+        ApplyAdaptiveStep  // apply the gradient of the previous pass with stepScale, and regularize
+    };
+
+    static size_t SmoothedColumnsNeeded(Rule rule, size_t numCols)
+    {
+        switch (rule)
+        {
+        case Rule::FSAdaGrad: return 2 * numCols;
+        case Rule::RmsProp:   return 3 * numCols;
+        default:              return numCols;
+        }
+    }
+
+    static bool IsCPUDense(const Matrix<ElemType>& m)
+    {
+        return m.GetDeviceId() == CPUDEVICE && m.GetMatrixType() == MatrixType::DENSE;
+    }
+
+    double UpdateBlock(const Settings& s, Pass pass, const Parameter& p, size_t begin, size_t end) const;
+
+    // sum up the per-block results of the last sweep by parameter
+    std::vector<double> SumBlocksByParameter() const
+    {
+        std::vector<double> sums(m_parameters.size(), 0);
+        for (size_t b = 0; b < m_blocks.size(); b++)
+            sums[m_blocks[b].parameter] += m_blockSums[b];
+        return sums;
+    }
+
+public:
+    // whether a parameter can be updated this way
+    // It must be dense on the CPU, and its smoothed gradient must have been initialized (the regular update does that).
+    static bool CanUpdate(Rule rule, const Matrix<ElemType>& value, const Matrix<ElemType>& gradient, const Matrix<ElemType>& smoothedGradient)
+    {
+        if (!IsCPUDense(value) || !IsCPUDense(gradient) || !IsCPUDense(smoothedGradient) || value.IsEmpty())
+            return false;
+        if (gradient.GetNumRows() != value.GetNumRows() || gradient.GetNumCols() != value.GetNumCols())
+            return false;
+        const size_t smoothedColumnsNeeded = SmoothedColumnsNeeded(rule, value.GetNumCols());
+        if (smoothedGradient.GetNumRows() != value.GetNumRows())
+            return false;
+        if (rule == Rule::FSAdaGrad) // (FSAdagrad() only uses the first columns)
+            return smoothedGradient.GetNumCols() >= smoothedColumnsNeeded;
+        return smoothedGradient.GetNumCols() == smoothedColumnsNeeded;
+    }
+
+    // add a parameter to the next Update()
+    // For FSAdaGrad, the weights must be taken from Matrix::FSAdagradNextWeights() in the order of the regular update.
+    void Add(Matrix<ElemType>& value, Matrix<ElemType>& gradient, Matrix<ElemType>& smoothedGradient, ElemType adaWeight = 0, ElemType adaMul = 0)
+    {
+        Parameter p;
+        p.value = value.BufferPointer();
+        p.gradient = gradient.BufferPointer();
+        p.smoothed = smoothedGradient.BufferPointer();
+        p.n = value.GetNumElements();
+        p.adaWeight = adaWeight;
+        p.adaMul = adaMul;
+        p.clipFactor = 1;
+        p.stepScale = 0;
+        m_parameters.push_back(p);
+    }
+
+    bool IsEmpty() const
+    {
+        return m_parameters.empty();
+    }
+
+    // update all added parameters, then forget them
+    void Update(const Settings& s)
+    {
+        m_blocks.clear();
+        for (size_t k = 0; k < m_parameters.size(); k++)
+            for (size_t begin = 0; begin < m_parameters[k].n; begin += elementsPerBlock)
+                m_blocks.push_back(Block{k, begin, (std::min)(begin + elementsPerBlock, m_parameters[k].n)});
+        const long long numBlocks = (long long) m_blocks.size();
+
+        // norm clipping: determine the norm of each gradient first
+        if (s.maxGradientPerMB != std::numeric_limits<double>::infinity() && !s.clipWithTruncation)
+        {
+            m_blockSums.resize(m_blocks.size());
+#pragma omp parallel for schedule(dynamic)
+            for (long long b = 0; b < numBlocks; b++)
+            {
+                const Block& block = m_blocks[b];
+                const ElemType* g = m_parameters[block.parameter].gradient;
+                double sum = 0;
+                for (size_t i = block.begin; i < block.end; i++)
+                    sum += (double) g[i] * g[i];
+                m_blockSums[b] = sum;
+            }
+            const std::vector<double> sumsOfSquares = SumBlocksByParameter();
+            for (size_t k = 0; k < m_parameters.size(); k++)
+            {
+                const double gradientNorm = sqrt(sumsOfSquares[k]);
+                if (gradientNorm > s.maxGradientPerMB)
+                    m_parameters[k].clipFactor = (ElemType)(s.maxGradientPerMB / gradientNorm);
+            }
+        }
+
+        if (s.needAveMultiplier && (s.rule == Rule::AdaGrad || s.rule == Rule::RmsProp))
+        {
+            m_blockSums.resize(m_blocks.size());
+#pragma omp parallel for schedule(dynamic)
+            for (long long b = 0; b < numBlocks; b++)
+            {
+                const Block& block = m_blocks[b];
+                m_blockSums[b] = UpdateBlock(s, Pass::AdaptiveGradient, m_parameters[block.parameter], block.begin, block.end);
+            }
+            const std::vector<double> sumsOfFactors = SumBlocksByParameter();
+            for (size_t k = 0; k < m_parameters.size(); k++)
+            {
+                const double aveMultiplier = sumsOfFactors[k] / m_parameters[k].n;
+                m_parameters[k].stepScale = s.learnRatePerSample / aveMultiplier;
+            }
+#pragma omp parallel for schedule(dynamic)
+            for (long long b = 0; b < numBlocks; b++)
+            {
+                const Block& block = m_blocks[b];
+                UpdateBlock(s, Pass::ApplyAdaptiveStep, m_parameters[block.parameter], block.begin, block.end);
+            }
+        }
+        else
+        {
+#pragma omp parallel for schedule(dynamic)
+            for (long long b = 0; b < numBlocks; b++)
+            {
+                const Block& block = m_blocks[b];
+                UpdateBlock(s, Pass::Complete, m_parameters[block.parameter], block.begin, block.end);
+            }
+        }
+
+        m_parameters.clear();
+    }
+};
+
+// update elements [begin, end) of a parameter
+// The steps and their order are those of SGD::UpdateWeightsS() and the Matrix functions it calls.
+template <class ElemType>
+double FusedParameterUpdate<ElemType>::UpdateBlock(const Settings& s, Pass pass, const Parameter& p, size_t begin, size_t end) const
+{
+    const bool truncate = s.maxGradientPerMB != std::numeric_limits<double>::infinity() && s.clipWithTruncation;
+    const ElemType truncateThreshold = (ElemType) s.maxGradientPerMB;
+    const ElemType lr = s.learnRatePerSample;
+    const ElemType m = s.momentum;
+    ElemType* w = p.value;
+    ElemType* gradient = p.gradient;
+    const size_t n = p.n;
+    double sumOfFactors = 0;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        ElemType g;
+        if (pass == Pass::ApplyAdaptiveStep) // gradient was prepared by the previous pass
+            g = gradient[i];
+        else
+        {
+            // gradient clipping and L2 regularization
+            g = gradient[i];
+            if (truncate)
+            {
+                if (g > truncateThreshold)
+                    g = truncateThreshold;
+                else if (g < -truncateThreshold)
+                    g = -truncateThreshold;
+            }
+            g *= p.clipFactor;
+            if (s.l2Weight > 0)
+                g += s.l2Weight * w[i];
+
+            // the update step
+            switch (s.rule)
+            {
+            case Rule::Momentum: // Matrix::NormalGrad()
+            {
+                ElemType& v = p.smoothed[i];
+                v = (1 - m) * lr * g + m * v;
+                w[i] -= v;
+                break;
+            }
+            case Rule::NesterovMomentum:
+            {
+                ElemType& v = p.smoothed[i];
+                v = (1 - m) * lr * g + m * v;
+                w[i] -= m * v;
+                w[i] -= (1 - m) * lr * g;
+                break;
+            }
+            case Rule::AdaGrad: // CPUMatrix::Adagrad()
+            {
+                ElemType& a = p.smoothed[i];
+                a += g * g;
+                const ElemType factor = 1 / sqrt(a + (ElemType) 1e-16f);
+                g *= factor;
+                sumOfFactors += factor;
+                break;
+            }
+            case Rule::FSAdaGrad: // CPUMatrix::FSAdagrad()
+            {
+                ElemType& smoothAda = p.smoothed[i];
+                ElemType& smoothMom = p.smoothed[n + i];
+                const ElemType adaSqr = p.adaWeight * smoothAda + (1 - p.adaWeight) * g * g;
+                smoothAda = adaSqr;
+                if (adaSqr != 0)
+                {
+                    ElemType ada = sqrt(adaSqr);
+                    ElemType aw = p.adaMul * (1 / ada);
+                    if (aw > 10)
+                        aw = 10;
+                    g *= aw;
+                }
+                if (m > 0)
+                {
+                    g = m * smoothMom + (1 - m) * g;
+                    smoothMom = g;
+                }
+                w[i] -= lr * g;
+                break;
+            }
+            case Rule::RmsProp: // CPUMatrix::RmsProp()
+            {
+                ElemType& avar = p.smoothed[i];
+                ElemType& sign = p.smoothed[n + i];
+                ElemType& step = p.smoothed[2 * n + i];
+                avar = s.rmsGamma * avar + (1 - s.rmsGamma) * (g * g);
+                const int gradSign = (ElemType(0) < g) - (g < ElemType(0));
+                if (sign * gradSign > 0)
+                    step = (std::min)(step * s.rmsInc, s.rmsMax);
+                else
+                    step = (std::max)(step * s.rmsDec, s.rmsMin);
+                const ElemType factor = step / sqrt(avar + (ElemType) 1e-6f);
+                g *= factor;
+                sign = (ElemType) gradSign;
+                sumOfFactors += factor;
+                break;
+            }
+            }
+
+            // AdaGrad and RmsProp: apply the step now, or keep the gradient for the next pass
+            if (s.rule == Rule::AdaGrad || s.rule == Rule::RmsProp)
+            {
+                if (pass == Pass::AdaptiveGradient)
+                {
+                    gradient[i] = g;
+                    continue;
+                }
+                w[i] -= lr * g;
+            }
+        }
+        if (pass == Pass::ApplyAdaptiveStep)
+            w[i] -= (ElemType) p.stepScale * g;
+
+        // L1 regularization with proximal gradient descent (Matrix::InplaceSoftThreshold())
+        if (s.l1Threshold > 0)
+        {
+            if (w[i] > s.l1Threshold)
+                w[i] -= s.l1Threshold;
+            else if (w[i] < -s.l1Threshold)
+                w[i] += s.l1Threshold;
+            else
+                w[i] = 0;
+        }
+    }
+    return sumOfFactors;
+}
+} } }
@@ -21,6 +21,14 @@ public:
     // Returns a boolean indicating if any samples were processed
     virtual bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, int epochNumber) = 0;
 
+    // whether the gradients of many parameters may be passed as one flat column vector (see FlatParameterStorage)
+    // This is not the case if the aggregation depends on the matrix shape (e.g. column-wise quantization) or
+    // replaces the gradient storage.
+    virtual bool SupportsFlatGradients() const
+    {
+        return false;
+    }
+
     size_t NumProc()
     {
         return m_mpi->NumNodesInUse();
@@ -0,0 +1,224 @@
+// MinibatchCachingReader.h -- reader that keeps the minibatches of a small epoch in RAM, to replay them when the same epoch is started again
+
+#pragma once
+
+#include "Basics.h"
+#include "DataReader.h"
+#include "Matrix.h"
+#include "Sequences.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// ===========================================================================
+// MinibatchCachingReader -- wraps a reader and replays a recorded epoch instead of reading it again
+//
+// The learning-rate and minibatch-size searches train the same model on the same small subset of the data
+// once per candidate value. The first (Distributed)StartMinibatchLoop() with a given set of arguments reads from
+// the wrapped reader and records the minibatches and their layouts in CPU RAM; each later call with the same
+// arguments replays them. Readers are deterministic for a given epoch, so this gives the same minibatches.
+// Recording is abandoned (and the wrapped reader used throughout) if the epoch exceeds 'maxBytes', or if a
+// reader-specific call is made that cannot be replayed (e.g. lattices for sequence training).
+// ===========================================================================
+
+template <class ElemType>
+class MinibatchCachingReader : public IDataReader<ElemType>
+{
+    struct Minibatch
+    {
+        std::map<std::wstring, std::shared_ptr<Matrix<ElemType>>> matrices;
+        MBLayoutPtr pMBLayout;
+    };
+
+    IDataReader<ElemType>* m_reader;
+    size_t m_maxBytes;
+
+    std::vector<size_t> m_epochKey; // arguments of the (Distributed)StartMinibatchLoop() call of the recorded epoch
+    std::vector<Minibatch> m_minibatches;
+    size_t m_bytes;
+    bool m_isComplete;  // the epoch has been recorded up to its end
+    bool m_isRecording; // the current epoch is being read from the wrapped reader and recorded
+    bool m_isReplaying; // the current epoch is being replayed
+    size_t m_nextMinibatch;
+
+    void StartEpoch(const std::vector<size_t>& epochKey)
+    {
+        if (m_isComplete && epochKey == m_epochKey)
+        {
+            m_isRecording = false;
+            m_isReplaying = true;
+            m_nextMinibatch = 0;
+            return;
+        }
+        m_epochKey = epochKey;
+        m_minibatches.clear();
+        m_bytes = 0;
+        m_isComplete = false;
+        m_isRecording = true;
+        m_isReplaying = false;
+    }
+
+    // copy a recorded minibatch matrix into an input matrix, which stays on its device
+    // (SetValue(const Matrix&) would move either matrix to the other's device, depending on their preferred devices)
+    static void CopyRecordedMatrix(const Matrix<ElemType>& recorded, Matrix<ElemType>& input)
+    {
+        const DEVICEID_TYPE deviceId = input.GetDeviceId();
+        if (recorded.GetMatrixType() == DENSE)
+        {
+            input.SwitchToMatrixType(DENSE, matrixFormatDense, false);
+            input.SetValue(recorded.GetNumRows(), recorded.GetNumCols(), deviceId, recorded.BufferPointer());
+        }
+        else
+            input.SetValue(Matrix<ElemType>(recorded, deviceId)); // (sparse: no raw-buffer copy, go through a temporary on the input's device)
+    }
+
+    // give up recording this epoch, e.g. because it cannot be replayed
+    void AbandonRecording()
+    {
+        if (m_isReplaying)
+            LogicError("MinibatchCachingReader: The epoch being replayed uses reader functions that cannot be replayed.");
+        m_minibatches.clear();
+        m_bytes = 0;
+        m_isRecording = false;
+    }
+
+public:
+    MinibatchCachingReader(IDataReader<ElemType>* reader, size_t maxBytes)
+        : m_reader(reader), m_maxBytes(maxBytes), m_bytes(0), m_isComplete(false), m_isRecording(false), m_isReplaying(false), m_nextMinibatch(0)
+    {
+    }
+
+    bool IsReplaying() const
+    {
+        return m_isReplaying;
+    }
+
+    virtual void Init(const ConfigParameters&) override
+    {
+        LogicError("MinibatchCachingReader: Init() must be called on the wrapped reader.");
+    }
+    virtual void Init(const ScriptableObjects::IConfigRecord&) override
+    {
+        LogicError("MinibatchCachingReader: Init() must be called on the wrapped reader.");
+    }
+    virtual void Destroy() override
+    {
+    }
+
+    virtual void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize) override
+    {
+        StartEpoch(std::vector<size_t>{mbSize, epoch, 0, 1, requestedEpochSamples});
+        if (!m_isReplaying)
+            m_reader->StartMinibatchLoop(mbSize, epoch, requestedEpochSamples);
+    }
+    virtual bool SupportsDistributedMBRead() const override
+    {
+        return m_reader->SupportsDistributedMBRead();
+    }
+    virtual void StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples = requestDataSize) override
+    {
+        StartEpoch(std::vector<size_t>{mbSize, epoch, subsetNum, numSubsets, requestedEpochSamples});
+        if (!m_isReplaying)
+            m_reader->StartDistributedMinibatchLoop(mbSize, epoch, subsetNum, numSubsets, requestedEpochSamples);
+    }
+
+    virtual bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices) override
+    {
+        if (m_isReplaying)
+        {
+            if (m_nextMinibatch >= m_minibatches.size())
+                return false;
+            const Minibatch& minibatch = m_minibatches[m_nextMinibatch++];
+            for (auto& iter : matrices)
+            {
+                auto cached = minibatch.matrices.find(iter.first);
+                if (cached == minibatch.matrices.end())
+                    LogicError("MinibatchCachingReader: Input '%ls' was not requested when the epoch was recorded.", iter.first.c_str());
+                CopyRecordedMatrix(*cached->second, *iter.second);
+            }
+            return true;
+        }
+
+        bool wasDataRead = m_reader->GetMinibatch(matrices);
+        if (!m_isRecording)
+            return wasDataRead;
+        if (!wasDataRead)
+        {
+            m_isComplete = true;
+            m_isRecording = false;
+            return false;
+        }
+
+        Minibatch minibatch;
+        for (const auto& iter : matrices)
+        {
+            minibatch.matrices[iter.first] = std::make_shared<Matrix<ElemType>>(*iter.second, CPUDEVICE); // (deep copy)
+            m_bytes += iter.second->BufferSize();
+        }
+        minibatch.pMBLayout = make_shared<MBLayout>();
+        m_reader->CopyMBLayoutTo(minibatch.pMBLayout);
+        m_minibatches.push_back(std::move(minibatch));
+        if (m_bytes > m_maxBytes)
+        {
+            fprintf(stderr, "MinibatchCachingReader: Epoch exceeds %.1f MB, reading it from the reader each time.\n", m_maxBytes / 1048576.0);
+            AbandonRecording();
+        }
+        return true;
+    }
+
+    virtual void CopyMBLayoutTo(MBLayoutPtr pMBLayout) override
+    {
+        if (m_isReplaying)
+            pMBLayout->CopyFrom(m_minibatches[m_nextMinibatch - 1].pMBLayout);
+        else
+            m_reader->CopyMBLayoutTo(pMBLayout);
+    }
+
+    virtual size_t GetNumParallelSequences() override
+    {
+        return m_reader->GetNumParallelSequences();
+    }
+    virtual int GetSentenceEndIdFromOutputLabel() override
+    {
+        return m_reader->GetSentenceEndIdFromOutputLabel();
+    }
+    virtual bool RequireSentenceSeg() const override
+    {
+        return m_reader->RequireSentenceSeg();
+    }
+    virtual bool DataEnd(EndDataType endDataType) override
+    {
+        if (m_isReplaying)
+            return false; // (no reader state to advance; SGD does not use the result)
+        return m_reader->DataEnd(endDataType);
+    }
+
+    // reader-specific functions that cannot be replayed (GetMinibatchCopy() is called for all readers, but only returns data for some)
+    virtual bool GetMinibatch4SE(std::vector<shared_ptr<const msra::dbn::latticepair>>& latticeinput, vector<size_t>& uids, vector<size_t>& boundaries, vector<size_t>& extrauttmap) override
+    {
+        AbandonRecording();
+        return m_reader->GetMinibatch4SE(latticeinput, uids, boundaries, extrauttmap);
+    }
+    virtual bool GetHmmData(msra::asr::simplesenonehmm* hmm) override
+    {
+        return m_reader->GetHmmData(hmm);
+    }
+    virtual bool GetMinibatchCopy(std::vector<std::vector<std::pair<wstring, size_t>>>& uttInfo, std::map<std::wstring, Matrix<ElemType>*>& matrices, MBLayoutPtr pMBLayout) override
+    {
+        if (m_isReplaying)
+            return false; // (it returned false while the epoch was recorded)
+        bool wasCopied = m_reader->GetMinibatchCopy(uttInfo, matrices, pMBLayout);
+        if (wasCopied)
+            AbandonRecording();
+        return wasCopied;
+    }
+    virtual bool SetNetOutput(const std::vector<std::vector<std::pair<wstring, size_t>>>& uttInfo, const Matrix<ElemType>& outputs, const MBLayoutPtr pMBLayout) override
+    {
+        AbandonRecording();
+        return m_reader->SetNetOutput(uttInfo, outputs, pMBLayout);
+    }
+};
+} } }
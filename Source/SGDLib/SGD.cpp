@@ -9,13 +9,16 @@
 #include "SpecialPurposeNodes.h"        // for SequenceWithSoftmaxNode
 #include "DataReaderHelpers.h"
 #include "MatrixQuantizerImpl.h"
+#include "ScratchArena.h"
 #ifdef QUANTIZED_GRADIENT_AGGREGATION
 #include "AllReduceDistGradAggregator.h"
 #endif
 #include "SimpleDistGradAggregator.h"
 #include "ProgressTracing.h"
+#include "MinibatchCachingReader.h"
 
 #include <map>
+#include <deque>
 #include <set>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -258,6 +261,12 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         prevLearnRates[i] = -1.0;
     }
 
+    // (collective: all ranks get here with the same configuration)
+    if (g_mpi != nullptr)
+        g_mpi->SetAllReduceAlgorithm(m_allReduceAlgorithm, m_allReduceChunkBytes);
+    if (m_parallelizationMethod == ParallelizationMethod::ModelAveragingSGD && m_asyncModelAveraging)
+        m_asyncModelAverager.Init(g_mpi, m_modelAveragingBlend, m_blockMomentum, m_elasticAlpha);
+
     if (m_parallelizationMethod == ParallelizationMethod::DataParallelSGD)
     {
         InitDistGradAgg(evaluationNodes.size(), m_traceLevel);
@@ -546,6 +555,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                 {
                     auto bestModelPath = GetModelNameForEpoch(i - m_learnRateAdjustInterval);
                     fprintf(stderr, "Loading previous model with best training-criterion value: %ls.\n", bestModelPath.c_str());
+                    WaitForPendingCheckpoints();
                     net->RereadPersistableParameters<ElemType>(bestModelPath);
                     LoadCheckPointInfo(i - m_learnRateAdjustInterval,
                                        /*out*/ totalSamplesSeen,
@@ -624,8 +634,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         // persist model and check-point info
         if ((g_mpi == nullptr) || g_mpi->IsMainNode())
         {
-            net->Save(GetModelNameForEpoch(i));
-            SaveCheckPointInfo(i, totalSamplesSeen, learnRatePerSample, smoothedGradients, prevCriterion, chosenMinibatchSize);
+            vector<wstring> obsoleteCheckPointFiles;
             if (!m_keepCheckPointFiles)
             {
                 // delete previous checkpoint file to save space
@@ -633,18 +642,30 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                 {
                     if (epochsSinceLastLearnRateAdjust != 1)
                     {
-                        _wunlink(GetCheckPointFileNameForEpoch(i - 1).c_str());
+                        obsoleteCheckPointFiles.push_back(GetCheckPointFileNameForEpoch(i - 1));
                     }
                     if (epochsSinceLastLearnRateAdjust == m_learnRateAdjustInterval)
                     {
-                        _wunlink(GetCheckPointFileNameForEpoch(i - m_learnRateAdjustInterval).c_str());
+                        obsoleteCheckPointFiles.push_back(GetCheckPointFileNameForEpoch(i - m_learnRateAdjustInterval));
                     }
                 }
                 else
                 {
-                    _wunlink(GetCheckPointFileNameForEpoch(i - 1).c_str());
+                    obsoleteCheckPointFiles.push_back(GetCheckPointFileNameForEpoch(i - 1));
                 }
             }
+
+            if (m_asyncCheckpoint)
+            {
+                SaveCheckPointAsync(net, i, totalSamplesSeen, learnRatePerSample, smoothedGradients, prevCriterion, chosenMinibatchSize, obsoleteCheckPointFiles);
+            }
+            else
+            {
+                net->Save(GetModelNameForEpoch(i));
+                SaveCheckPointInfo(i, totalSamplesSeen, learnRatePerSample, smoothedGradients, prevCriterion, chosenMinibatchSize);
+                for (const auto& fileName : obsoleteCheckPointFiles)
+                    _wunlink(fileName.c_str());
+            }
         }
 
         if (learnRatePerSample < 1e-12)
@@ -655,6 +676,16 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     }
     // --- END OF MAIN EPOCH LOOP
 
+    WaitForPendingCheckpoints();
+
+    // parameters get their own memory again, since the buffers and the smoothed gradients go away
+    m_flatParameters.Release();
+
+    // temporary matrices of the nodes are no longer needed
+    if (m_traceLevel > 0)
+        ScratchArena<ElemType>::PrintStatisticsOfAllThreads();
+    ScratchArena<ElemType>::ReleaseMemoryOfAllThreads();
+
     // Synchronize all ranks before proceeding to ensure that
     // rank 0 has finished writing the model file
     if (g_mpi != nullptr)
@@ -727,9 +758,9 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     localEpochEvalErrors.SetValue(0);
 
     bool useGradientAggregation = ((m_parallelizationMethod == ParallelizationMethod::DataParallelSGD) &&
-                                   (epochNumber >= m_parallelizationStartEpochNum));
+                                   (epochNumber >= m_parallelizationStartEpochNum) && !m_trainingSearchCandidateLocally);
     bool useModelAveraging = ((m_parallelizationMethod == ParallelizationMethod::ModelAveragingSGD) &&
-                              (epochNumber >= m_parallelizationStartEpochNum));
+                              (epochNumber >= m_parallelizationStartEpochNum) && !m_trainingSearchCandidateLocally);
     bool useParallelTrain = useGradientAggregation || useModelAveraging;
 
     // MA-related variables
@@ -846,6 +877,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         if (!wasDataRead)
             actualMBSize = 0; // (undefined if !wasDataRead)
 
+        ScratchArena<ElemType>::ForCurrentThread().BeginMinibatch();
+
         nSamplesSinceLastModelSync += actualMBSize;
 
         // node data was changed
@@ -929,6 +962,10 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         size_t aggregateNumSamples = actualMBSize;
         size_t aggregateNumSamplesWithLabel = numSamplesWithLabel;
 
+        // turn parameters that have become standalone matrices (e.g. by the first update) into views again
+        if (m_flatParameterStorage)
+            UpdateFlatParameterStorage(net, learnableNodes, smoothedGradients);
+
         if (!useGradientAggregation)
         {
             // accumulate criterion values (objective, eval)
@@ -948,7 +985,9 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         else
         {
             // distributed gradient aggregation
-            if (learnParamsGradients.size() == 0)
+            if (m_flatParameterStorage && m_distGradAgg->SupportsFlatGradients())
+                learnParamsGradients = m_flatParameters.GradientMatrices(); // one all-reduce for all parameters in the buffer
+            else if (learnParamsGradients.size() == 0)
             {
                 learnParamsGradients.reserve(learnableNodes.size());
                 for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++)
@@ -992,26 +1031,44 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         // update model parameters
         if ((aggregateNumSamples > 0) && (learnRatePerSample > m_minLearnRate * 0.01))
         {
-            auto smoothedGradientIter = smoothedGradients.begin();
-            for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+            const double momentumPerSample = GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, net->GetMBLayoutPtr()->GetNumParallelSequences());
+            if (m_flatParameterStorage && CanUpdateFlatParametersAtOnce())
             {
-                ComputationNodeBasePtr node = *nodeIter;
-                if (node->IsParameterUpdateRequired())
+                // all parameters are in the buffers: update them with a single call
+                UpdateWeightsS(this, m_flatParameters.Values(), m_flatParameters.Gradients(), m_flatParameters.SmoothedGradients(),
+                               learnRatePerSample, momentumPerSample, aggregateNumSamples,
+                               m_L2RegWeight, m_L1RegWeight,
+                               m_needAveMultiplier, m_useNesterovMomentum);
+                for (const auto& node : m_flatParameters.Nodes())
+                    node->BumpEvalTimeStamp();
+            }
+            else
+            {
+                auto smoothedGradientIter = smoothedGradients.begin();
+                for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
                 {
-                    Matrix<ElemType>& smoothedGradient = *smoothedGradientIter;
+                    ComputationNodeBasePtr node = *nodeIter;
+                    if (node->IsParameterUpdateRequired())
+                    {
+                        Matrix<ElemType>& smoothedGradient = *smoothedGradientIter;
 #ifdef _DEBUG
-                    if (smoothedGradient.HasNan("TrainOneEpoch/UpdateWeights(): "))
-                        LogicError("%ls %ls operation has NaNs in smoothedGradient.", node->NodeName().c_str(), node->OperationName().c_str());
+                        if (smoothedGradient.HasNan("TrainOneEpoch/UpdateWeights(): "))
+                            LogicError("%ls %ls operation has NaNs in smoothedGradient.", node->NodeName().c_str(), node->OperationName().c_str());
 #endif
-                    UpdateWeights(node, smoothedGradient, learnRatePerSample,
-                                  GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, net->GetMBLayoutPtr()->GetNumParallelSequences()), aggregateNumSamples,
-                                  m_L2RegWeight, m_L1RegWeight,
-                                  m_needAveMultiplier, m_useNesterovMomentum);
+                        if (m_fusedParameterUpdate && AddToFusedUpdate(node, smoothedGradient, aggregateNumSamples))
+                            continue; // (updated below together with the others)
+                        UpdateWeights(node, smoothedGradient, learnRatePerSample,
+                                      momentumPerSample, aggregateNumSamples,
+                                      m_L2RegWeight, m_L1RegWeight,
+                                      m_needAveMultiplier, m_useNesterovMomentum);
 #ifdef _DEBUG
-                    if (dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().HasNan("TrainOneEpoch/UpdateWeights(): "))
-                        LogicError("%ls %ls operation has NaNs in functionValues after parameter update.", node->NodeName().c_str(), node->OperationName().c_str());
+                        if (dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().HasNan("TrainOneEpoch/UpdateWeights(): "))
+                            LogicError("%ls %ls operation has NaNs in functionValues after parameter update.", node->NodeName().c_str(), node->OperationName().c_str());
 #endif
+                    }
                 }
+                if (!m_fusedUpdate.IsEmpty())
+                    UpdateWeightsFused(learnRatePerSample, momentumPerSample, aggregateNumSamples);
             }
         }
 
@@ -1019,7 +1076,13 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         if (useModelAveraging)
         {
             // Determine if any samples were processed across any of the ranks
-            if (useDistributedMBReading)
+            // With asynchronous averaging, each rank stops on its own; AsyncModelAveragingFinish() waits for the others.
+            if (useDistributedMBReading && m_asyncModelAveraging)
+            {
+                if (!wasDataRead)
+                    noMoreSamplesToProcess = true;
+            }
+            else if (useDistributedMBReading)
             {
                 std::array<int, 1> numNodesWithDataToProcess;
                 numNodesWithDataToProcess[0] = wasDataRead ? 1 : 0;
@@ -1034,8 +1097,17 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                 size_t processedSamples = 0;
                 float secondsSinceLastSyncFinished = 0;
                 float secondsSpentOnSync = 0;
-                if (ModelAveragingProcessing(nSamplesSinceLastModelSync, learnableNodes, processedSamples,
-                                             secondsSinceLastSyncFinished, secondsSpentOnSync))
+                if (m_asyncModelAveraging)
+                {
+                    if (AsyncModelAveragingProcessing(nSamplesSinceLastModelSync, learnableNodes, processedSamples))
+                    {
+                        nSynced++;
+                        if (m_syncStatsTrace > 0 && nSynced % m_syncStatsTrace == 0)
+                            fprintf(stderr, "\t\t-----(async model averaging stats) %d-th round blended in, %d samples over all ranks\n", (int) nSynced, (int) processedSamples);
+                    }
+                }
+                else if (ModelAveragingProcessing(nSamplesSinceLastModelSync, learnableNodes, processedSamples,
+                                                  secondsSinceLastSyncFinished, secondsSpentOnSync))
                 {
                     // if a sync happens, do some extra work
                     nSamplesSinceLastModelSync = 0;
@@ -1175,7 +1247,14 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
     // --- END MAIN MINIBATCH LOOP
 
-    if (useModelAveraging && (g_mpi->NumNodesInUse() > 1))
+    if (useModelAveraging && (g_mpi->NumNodesInUse() > 1) && m_asyncModelAveraging)
+    {
+        size_t residualSamples = AsyncModelAveragingFinish(nSamplesSinceLastModelSync, learnableNodes);
+        totalSamplesSeen += residualSamples;
+        totalEpochSamples += residualSamples;
+        nSamplesSinceLastModelSync = 0;
+    }
+    else if (useModelAveraging && (g_mpi->NumNodesInUse() > 1))
     {
         // may not be synced after epoch finished, so do the sync here
         int residualSampels = (int) nSamplesSinceLastModelSync;
@@ -1283,16 +1362,22 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
         fprintf(stderr, "\tNodeName: %ls\n", (node->NodeName()).c_str());
     }
 
-    // compute
-    // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , requestDataSize);
-    // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , m_epochSize); // only based on one epoch
-    // [1/12/2015 erw] to support large dataset, we usually partition whole dataset into several epoch's,
-    // so we need to use all the data to do precomputing
-    if (m_useAllDataForPreComputedNode) // using all the data
-        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0);
-    else // using only one epoch
-        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0, m_epochSize);
-    net->StartEvaluateMinibatchLoop(nodes);
+    // Mean and InvStdDev nodes can hand out their statistics as sums over the samples. With those, parallel workers
+    // each process a disjoint part of the data and add up their sums, and the sums can be cached in a file.
+    std::vector<shared_ptr<MeanInvStdDevNodeBase<ElemType>>> statisticsNodes;
+    for (const auto& node : nodes)
+    {
+        auto statisticsNode = dynamic_pointer_cast<MeanInvStdDevNodeBase<ElemType>>(node);
+        if (statisticsNode)
+            statisticsNodes.push_back(statisticsNode);
+    }
+    const bool haveSums = statisticsNodes.size() == nodes.size();
+    const bool useParallelPreCompute = haveSums && (g_mpi != nullptr) && (g_mpi->NumNodesInUse() > 1) &&
+                                       (m_parallelizationMethod != ParallelizationMethod::None);
+    const bool useDistributedMBReading = useParallelPreCompute && m_enableDistributedMBReading && trainSetDataReader->SupportsDistributedMBRead();
+    const bool useCache = haveSums && !m_preComputeCacheFile.empty();
+    if (!m_preComputeCacheFile.empty() && !haveSums)
+        fprintf(stderr, "Precomputing: Not all PreCompute nodes support caching, ignoring the preComputeCache file.\n");
 
     // initialize
     for (auto nodeIter = nodes.begin(); nodeIter != nodes.end(); nodeIter++)
@@ -1301,27 +1386,80 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
         node->MarkComputed(false /*begin accumulating*/);
     }
 
-    const size_t numIterationsBeforePrintingProgress = 100;
-    size_t numItersSinceLastPrintOfProgress = 0;
-    size_t actualMBSizeDummy;
-    while (DataReaderHelpers::GetMinibatchIntoNetwork(*trainSetDataReader, net, nullptr, false, false, *inputMatrices, actualMBSizeDummy))
+    std::vector<std::vector<double>> sums;
+    bool loadedFromCache = useCache && LoadPreComputeCache(statisticsNodes, sums);
+    if (useParallelPreCompute && useCache) // (collective) only use the cache if all workers could load it
     {
-        // TODO: move these into GetMinibatchIntoNetwork()  --but those are passed around; necessary? Can't we get them from 'net'?
-        ComputationNetwork::BumpEvalTimeStamp(featureNodes);
-        ComputationNetwork::BumpEvalTimeStamp(labelNodes);
+        double numLoaded = loadedFromCache ? 1 : 0;
+        g_mpi->AllReduce(&numLoaded, 1);
+        loadedFromCache = numLoaded == g_mpi->NumNodesInUse();
+    }
 
-        net->ForwardProp(nodes);
+    if (!loadedFromCache)
+    {
+        // compute
+        // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , requestDataSize);
+        // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , m_epochSize); // only based on one epoch
+        // [1/12/2015 erw] to support large dataset, we usually partition whole dataset into several epoch's,
+        // so we need to use all the data to do precomputing
+        size_t epochSize = m_useAllDataForPreComputedNode ? requestDataSize /*using all the data*/ : m_epochSize /*using only one epoch*/;
+        if (useDistributedMBReading) // each worker reads its own part of the data
+            trainSetDataReader->StartDistributedMinibatchLoop(m_mbSize[0], 0, g_mpi->CurrentNodeRank(), g_mpi->NumNodesInUse(), epochSize);
+        else
+            trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0, epochSize);
+        net->StartEvaluateMinibatchLoop(nodes);
 
-        if (ProgressTracing::IsEnabled())
+        if (useParallelPreCompute)
+            fprintf(stderr, "Precomputing: Worker %d of %d processes its part of the data (%ls).\n", (int) g_mpi->CurrentNodeRank(), (int) g_mpi->NumNodesInUse(),
+                    useDistributedMBReading ? L"distributed reading" : L"decimated minibatches");
+
+        const size_t numIterationsBeforePrintingProgress = 100;
+        size_t numItersSinceLastPrintOfProgress = 0;
+        size_t actualMBSize;
+        while (DataReaderHelpers::GetMinibatchIntoNetwork(*trainSetDataReader, net, nullptr, useDistributedMBReading, useParallelPreCompute, *inputMatrices, actualMBSize))
         {
-            numItersSinceLastPrintOfProgress++;
-            if (numItersSinceLastPrintOfProgress >= numIterationsBeforePrintingProgress)
+            if (actualMBSize == 0) // (a worker may get nothing from decimation or from its part of the data)
+                continue;
+
+            // TODO: move these into GetMinibatchIntoNetwork()  --but those are passed around; necessary? Can't we get them from 'net'?
+            ComputationNetwork::BumpEvalTimeStamp(featureNodes);
+            ComputationNetwork::BumpEvalTimeStamp(labelNodes);
+
+            net->ForwardProp(nodes);
+
+            if (ProgressTracing::IsEnabled())
             {
-                // TODO: For now just print 0.0 instead of calculating actual progress
-                printf("PROGRESS: %.2f%%\n", 0.0f);
-                numItersSinceLastPrintOfProgress = 0;
+                numItersSinceLastPrintOfProgress++;
+                if (numItersSinceLastPrintOfProgress >= numIterationsBeforePrintingProgress)
+                {
+                    // TODO: For now just print 0.0 instead of calculating actual progress
+                    printf("PROGRESS: %.2f%%\n", 0.0f);
+                    numItersSinceLastPrintOfProgress = 0;
+                }
             }
         }
+
+        if (useParallelPreCompute || useCache)
+        {
+            sums.clear();
+            for (const auto& node : statisticsNodes)
+                sums.push_back(node->GetAccumulatedSums());
+        }
+        if (useParallelPreCompute) // (collective) add up the sums of all workers
+        {
+            for (auto& nodeSums : sums)
+                g_mpi->AllReduce(nodeSums.data(), nodeSums.size());
+        }
+        if (useCache && ((g_mpi == nullptr) || g_mpi->IsMainNode()))
+            SavePreComputeCache(statisticsNodes, sums);
+    }
+    else
+        fprintf(stderr, "Precomputing: Statistics loaded from %ls.\n", m_preComputeCacheFile.c_str());
+
+    if (loadedFromCache || useParallelPreCompute)
+    {
+        for (size_t i = 0; i < statisticsNodes.size(); i++)
+            statisticsNodes[i]->SetAccumulatedSums(sums[i]);
     }
 
     // finalize
@@ -1335,6 +1473,75 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
     return true;
 }
 
+// the cache key: the data source as set by SetPreComputeCacheKey(), plus how much of it PreCompute() reads
+template <class ElemType>
+wstring SGD<ElemType>::GetPreComputeCacheKey() const
+{
+    return m_preComputeCacheKey + msra::strfun::wstrprintf(L"\nUseAllDataForPreComputedNode=%d epochSize=%llu",
+                                                           (int) m_useAllDataForPreComputedNode, (unsigned long long) m_epochSize);
+}
+
+// load the sums of 'nodes' from the cache file, if it exists and was written for the same data and nodes
+// The nodes must be accumulating, so that they know the dimensions of their sums.
+template <class ElemType>
+bool SGD<ElemType>::LoadPreComputeCache(const std::vector<shared_ptr<MeanInvStdDevNodeBase<ElemType>>>& nodes, /*out*/ std::vector<std::vector<double>>& sums) const
+{
+    if (m_preComputeCacheKey.empty())
+    {
+        fprintf(stderr, "Precomputing: No reader configuration known to identify the data, ignoring the preComputeCache file.\n");
+        return false;
+    }
+    if (!fexists(m_preComputeCacheFile.c_str()))
+        return false;
+
+    File fstream(m_preComputeCacheFile, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BPreCompute");
+    wstring key;
+    size_t numNodes;
+    fstream >> key >> numNodes;
+    if (key != GetPreComputeCacheKey() || numNodes != nodes.size())
+    {
+        fprintf(stderr, "Precomputing: %ls was written for different data or nodes, recomputing.\n", m_preComputeCacheFile.c_str());
+        return false;
+    }
+    std::vector<std::vector<double>> loadedSums(numNodes);
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        wstring nodeName;
+        fstream >> nodeName >> loadedSums[i];
+        if (nodeName != nodes[i]->NodeName() || loadedSums[i].size() != nodes[i]->GetAccumulatedSums().size())
+        {
+            fprintf(stderr, "Precomputing: %ls does not match node %ls, recomputing.\n", m_preComputeCacheFile.c_str(), nodes[i]->NodeName().c_str());
+            return false;
+        }
+    }
+    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EPreCompute");
+
+    sums = std::move(loadedSums);
+    return true;
+}
+
+template <class ElemType>
+void SGD<ElemType>::SavePreComputeCache(const std::vector<shared_ptr<MeanInvStdDevNodeBase<ElemType>>>& nodes, const std::vector<std::vector<double>>& sums) const
+{
+    if (m_preComputeCacheKey.empty())
+        return;
+
+    // write into a temporary file and rename it, so that a job that dies while writing leaves no partial cache behind
+    wstring tempFileName = m_preComputeCacheFile + L".tmp";
+    {
+        File fstream(tempFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BPreCompute");
+        fstream << GetPreComputeCacheKey() << nodes.size();
+        for (size_t i = 0; i < nodes.size(); i++)
+            fstream << nodes[i]->NodeName() << sums[i];
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EPreCompute");
+        fstream.Sync();
+    }
+    renameOrDie(tempFileName, m_preComputeCacheFile);
+    fprintf(stderr, "Precomputing: Statistics saved to %ls.\n", m_preComputeCacheFile.c_str());
+}
+
 // return a reasonable initial learning rate based on the initial mbsize
 template <class ElemType>
 double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
@@ -1378,6 +1585,7 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
     }
 
     int baseModelEpoch = epochNumber - 1;
+    WaitForPendingCheckpoints();
     net->RereadPersistableParameters<ElemType>(GetModelNameForEpoch(baseModelEpoch));
 
     double learnRate = learnRatePerSample;
@@ -1389,15 +1597,28 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
                        /*out*/ prevCriterion,
                        /*out*/ dummyMinibatchSize);
 
+    // the search trains on the same subset for each candidate; keep it in RAM if it is small enough
+    MinibatchCachingReader<ElemType> cachingReader(trainSetDataReader, m_searchDataCacheMaxMB * 1048576);
+    IDataReader<ElemType>* searchReader = m_searchDataCacheMaxMB > 0 ? &cachingReader : trainSetDataReader;
+    const size_t numCandidatesPerRound = GetNumSearchCandidatesPerRound();
+
     // if model is not changed this is what we will get
-    TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
-                                    numFramesToUseInSearch, trainSetDataReader, 0, m_mbSize[epochNumber],
-                                    featureNodes, labelNodes,
-                                    criterionNodes, evaluationNodes,
-                                    inputMatrices, learnableNodes,
-                                    smoothedGradients, /*out*/ baseCriterion,
-                                    /*out*/ epochEvalErrors, /*out*/ totalSamplesSeen,
-                                    "BaseAdaptiveLearnRateSearch:");
+    // A parallel search trains the first candidates of the loop below alongside.
+    std::deque<std::pair<double, double>> trainedCandidates; // (learning rate, criterion) of candidates of the loop below, trained ahead
+    {
+        std::vector<SearchCandidate> candidates(1, SearchCandidate{0, (size_t) m_mbSize[epochNumber], "BaseAdaptiveLearnRateSearch:"});
+        for (double candidateLearnRate = learnRatePerSample * 0.618; candidates.size() < numCandidatesPerRound; candidateLearnRate *= 0.618)
+            candidates.push_back(SearchCandidate{candidateLearnRate, (size_t) m_mbSize[epochNumber], "AdaptiveLearnRateSearch:"});
+        auto criteria = TrainMiniEpochsForCandidates(net, refNet, refNode, epochNumber,
+                                                     numFramesToUseInSearch, searchReader, candidates,
+                                                     featureNodes, labelNodes,
+                                                     criterionNodes, evaluationNodes,
+                                                     inputMatrices, learnableNodes,
+                                                     smoothedGradients);
+        baseCriterion = criteria[0];
+        for (size_t i = 1; i < candidates.size(); i++)
+            trainedCandidates.push_back(make_pair(candidates[i].learnRatePerSample, criteria[i]));
+    }
 
     if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::SearchBeforeEpoch)
     {
@@ -1415,14 +1636,23 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
     do
     {
         learnRatePerSample *= 0.618;
-        TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
-                                        numFramesToUseInSearch, trainSetDataReader,
-                                        learnRatePerSample, m_mbSize[epochNumber], featureNodes,
-                                        labelNodes, criterionNodes,
-                                        evaluationNodes, inputMatrices,
-                                        learnableNodes, smoothedGradients,
-                                        /*out*/ epochCriterion, /*out*/ epochEvalErrors,
-                                        /*out*/ totalSamplesSeen, "AdaptiveLearnRateSearch:");
+        if (trainedCandidates.empty()) // train the next round of candidates
+        {
+            std::vector<SearchCandidate> candidates;
+            for (double candidateLearnRate = learnRatePerSample; candidates.size() < numCandidatesPerRound; candidateLearnRate *= 0.618)
+                candidates.push_back(SearchCandidate{candidateLearnRate, (size_t) m_mbSize[epochNumber], "AdaptiveLearnRateSearch:"});
+            auto criteria = TrainMiniEpochsForCandidates(net, refNet, refNode, epochNumber,
+                                                         numFramesToUseInSearch, searchReader, candidates,
+                                                         featureNodes, labelNodes,
+                                                         criterionNodes, evaluationNodes,
+                                                         inputMatrices, learnableNodes,
+                                                         smoothedGradients);
+            for (size_t i = 0; i < candidates.size(); i++)
+                trainedCandidates.push_back(make_pair(candidates[i].learnRatePerSample, criteria[i]));
+        }
+        learnRatePerSample = trainedCandidates.front().first;
+        epochCriterion = trainedCandidates.front().second;
+        trainedCandidates.pop_front();
 
     } while (std::isnan(epochCriterion) || (epochCriterion > baseCriterion && learnRatePerSample > minLearnRate));
 
@@ -1431,63 +1661,88 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
     // grid search for the first m_numBestSearchEpoch  epochs
     if (epochNumber < m_numBestSearchEpoch)
     {
-        double leftLearnRatePerSample = 0.01 / m_mbSize[epochNumber];
-        double rightLearnRatePerSample = learnRatePerSample;
-        double leftCriterion, rightCriterion = epochCriterion;
-
-        TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
-                                        numFramesToUseInSearch, trainSetDataReader,
-                                        leftLearnRatePerSample, m_mbSize[epochNumber],
-                                        featureNodes, labelNodes,
-                                        criterionNodes, evaluationNodes,
-                                        inputMatrices, learnableNodes,
-                                        smoothedGradients, /*out*/ leftCriterion,
-                                        /*out*/ epochEvalErrors, /*out*/ totalSamplesSeen,
-                                        "DetailBaseAdaptiveLearnRateSearch:");
-
-        while (rightLearnRatePerSample > leftLearnRatePerSample * 1.2)
+        // Each step moves the end of [left, right] with the larger criterion towards the other end.
+        // A parallel search trains the candidates of the next few steps for both outcomes of each comparison
+        // (1 + 2 + 4 + ... candidates), and then follows the actual outcomes as far as it can.
+        struct Interval
         {
-            if (rightCriterion > leftCriterion)
+            double left, right;
+            size_t leftCriterion, rightCriterion; // indices into 'criteria'
+            int child[2];                         // the interval after moving the left [0] or right [1] end, if speculated
+        };
+        std::vector<double> criteria(1, epochCriterion);
+        std::vector<Interval> intervals(1, Interval{0.01 / m_mbSize[epochNumber], learnRatePerSample, 1, 0, {-1, -1}});
+        std::vector<SearchCandidate> candidates(1, SearchCandidate{intervals[0].left, (size_t) m_mbSize[epochNumber], "DetailBaseAdaptiveLearnRateSearch:"});
+        criteria.push_back(0); // (left criterion, to be trained)
+        std::vector<bool> isKnown(2, false);
+        isKnown[0] = true;
+
+        for (;;)
+        {
+            // speculate on the next steps from intervals[0], breadth-first
+            for (size_t i = 0; i < intervals.size() && candidates.size() < numCandidatesPerRound; i++)
+            {
+                const Interval interval = intervals[i]; // (copy, since 'intervals' grows below)
+                if (!(interval.right > interval.left * 1.2))
+                    continue;
+                for (int moveRight = 1; moveRight >= 0 && candidates.size() < numCandidatesPerRound; moveRight--)
+                {
+                    if (isKnown[interval.leftCriterion] && isKnown[interval.rightCriterion] &&
+                        (criteria[interval.rightCriterion] > criteria[interval.leftCriterion]) != (moveRight == 1))
+                        continue; // (this outcome is already decided against)
+                    Interval next = interval;
+                    next.child[0] = next.child[1] = -1;
+                    if (moveRight)
+                    {
+                        next.right *= 0.618;
+                        next.rightCriterion = criteria.size();
+                    }
+                    else
+                    {
+                        next.left /= 0.618;
+                        next.leftCriterion = criteria.size();
+                    }
+                    criteria.push_back(0);
+                    isKnown.push_back(false);
+                    candidates.push_back(SearchCandidate{moveRight ? next.right : next.left, (size_t) m_mbSize[epochNumber],
+                                                         moveRight ? "DetailRightAdaptiveLearnRateSearch:" : "DetailLeftAdaptiveLearnRateSearch:"});
+                    intervals[i].child[moveRight] = (int) intervals.size();
+                    intervals.push_back(next);
+                }
+            }
+            if (candidates.empty())
+                break;
+
+            auto trainedCriteria = TrainMiniEpochsForCandidates(net, refNet, refNode, epochNumber,
+                                                                numFramesToUseInSearch, searchReader, candidates,
+                                                                featureNodes, labelNodes,
+                                                                criterionNodes, evaluationNodes,
+                                                                inputMatrices, learnableNodes,
+                                                                smoothedGradients);
+            for (size_t i = 0; i < candidates.size(); i++)
             {
-                rightLearnRatePerSample *= 0.618;
-
-                TrainOneMiniEpochAndReloadModel(net, refNet, refNode,
-                                                epochNumber, numFramesToUseInSearch,
-                                                trainSetDataReader,
-                                                rightLearnRatePerSample, m_mbSize[epochNumber],
-                                                featureNodes, labelNodes,
-                                                criterionNodes,
-                                                evaluationNodes,
-                                                inputMatrices,
-                                                learnableNodes,
-                                                smoothedGradients,
-                                                /*out*/ rightCriterion,
-                                                /*out*/ epochEvalErrors,
-                                                /*out*/ totalSamplesSeen,
-                                                "DetailRightAdaptiveLearnRateSearch:");
+                criteria[criteria.size() - candidates.size() + i] = trainedCriteria[i];
+                isKnown[isKnown.size() - candidates.size() + i] = true;
             }
-            else
+            candidates.clear();
+
+            // follow the actual outcomes
+            Interval interval = intervals[0];
+            while (interval.right > interval.left * 1.2)
             {
-                leftLearnRatePerSample /= 0.618;
-
-                TrainOneMiniEpochAndReloadModel(net, refNet, refNode,
-                                                epochNumber, numFramesToUseInSearch,
-                                                trainSetDataReader,
-                                                leftLearnRatePerSample, m_mbSize[epochNumber],
-                                                featureNodes, labelNodes,
-                                                criterionNodes,
-                                                evaluationNodes,
-                                                inputMatrices,
-                                                learnableNodes,
-                                                smoothedGradients,
-                                                /*out*/ leftCriterion,
-                                                /*out*/ epochEvalErrors,
-                                                /*out*/ totalSamplesSeen,
-                                                "DetailLeftAdaptiveLearnRateSearch:");
+                int next = interval.child[criteria[interval.rightCriterion] > criteria[interval.leftCriterion] ? 1 : 0];
+                if (next < 0)
+                    break;
+                interval = intervals[next];
             }
+            interval.child[0] = interval.child[1] = -1;
+            intervals.assign(1, interval);
         }
 
-        bestLearnRatePerSample = (leftCriterion < rightCriterion) ? leftLearnRatePerSample : rightLearnRatePerSample;
+        const Interval& interval = intervals[0];
+        double leftCriterion = criteria[interval.leftCriterion];
+        double rightCriterion = criteria[interval.rightCriterion];
+        bestLearnRatePerSample = (leftCriterion < rightCriterion) ? interval.left : interval.right;
     }
 
     fprintf(stderr, "Best Learn Rate Per Sample for Epoch[%d] = %.10g  baseCriterion=%.10g\n",
@@ -1640,6 +1895,8 @@ size_t SGD<ElemType>::SearchForBestMinibatchSize(ComputationNetworkPtr net,
 
     size_t lastTriedTrialMinibatchSize = 0;
     double lastTriedTrialEpochCriterion = 0;
+    const size_t numCandidatesPerRound = GetNumSearchCandidatesPerRound();
+    std::deque<double> trainedCriteria; // criteria of the next trial minibatch sizes, if trained ahead (parallel search)
     for (float trialMinibatchSizeFloat = (float) minMinibatchSize;
          trialMinibatchSizeFloat <= maxMinibatchSize;
          trialMinibatchSizeFloat *= minibatchSizeTuningFactor)
@@ -1650,21 +1907,29 @@ size_t SGD<ElemType>::SearchForBestMinibatchSize(ComputationNetworkPtr net,
         fprintf(stderr, "\nAdaptiveMinibatchSearch: Evaluating trial minibatchSize=%zd out of range %zd..%zd ...\n\n",
                 trialMinibatchSize, RoundToMultipleOf64(minMinibatchSize), RoundToMultipleOf64(maxMinibatchSize));
 
-        size_t totalSamplesSeen;
-        std::vector<double> epochEvalErrors(evaluationNodes.size(), std::numeric_limits<double>::infinity());
-        double epochCriterion = std::numeric_limits<double>::infinity();
-
         // Train on a few minibatches and so we can observe the epochCriterion as we try increasing
         // minibatches with iteration of this loop.
-        TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
-                                        numFramesToUseInSearch, trainSetDataReader,
-                                        learnRatePerSample, trialMinibatchSize, featureNodes,
-                                        labelNodes, criterionNodes,
-                                        evaluationNodes, inputMatrices,
-                                        learnableNodes, smoothedGradients,
-                                        /*out*/ epochCriterion, /*out*/ epochEvalErrors,
-                                        /*out*/ totalSamplesSeen,
-                                        isFirstIteration ? "BaseAdaptiveMinibatchSearch:" : "AdaptiveMinibatchSearch:");
+        // A parallel search trains the next few trial minibatch sizes at once.
+        if (trainedCriteria.empty())
+        {
+            std::vector<SearchCandidate> candidates;
+            for (float candidateMinibatchSizeFloat = trialMinibatchSizeFloat;
+                 candidateMinibatchSizeFloat <= maxMinibatchSize && candidates.size() < numCandidatesPerRound;
+                 candidateMinibatchSizeFloat *= minibatchSizeTuningFactor)
+            {
+                candidates.push_back(SearchCandidate{learnRatePerSample, RoundToMultipleOf64(candidateMinibatchSizeFloat),
+                                                     isFirstIteration && candidates.empty() ? "BaseAdaptiveMinibatchSearch:" : "AdaptiveMinibatchSearch:"});
+            }
+            auto criteria = TrainMiniEpochsForCandidates(net, refNet, refNode, epochNumber,
+                                                         numFramesToUseInSearch, trainSetDataReader, candidates,
+                                                         featureNodes, labelNodes,
+                                                         criterionNodes, evaluationNodes,
+                                                         inputMatrices, learnableNodes,
+                                                         smoothedGradients);
+            trainedCriteria.assign(criteria.begin(), criteria.end());
+        }
+        double epochCriterion = trainedCriteria.front();
+        trainedCriteria.pop_front();
 
         if (isFirstIteration)
         {
@@ -1747,6 +2012,7 @@ void SGD<ElemType>::TrainOneMiniEpochAndReloadModel(ComputationNetworkPtr net,
     }
 
     int baseModelEpoch = epochNumber - 1;
+    WaitForPendingCheckpoints();
     net->RereadPersistableParameters<ElemType>(GetModelNameForEpoch(baseModelEpoch));
 
     double dummyLearnRate;
@@ -1760,6 +2026,63 @@ void SGD<ElemType>::TrainOneMiniEpochAndReloadModel(ComputationNetworkPtr net,
                        /*out*/ dummyMinibatchSize);
 }
 
+// number of candidates that the searches train at once: one per rank in a parallel search, otherwise one
+template <class ElemType>
+size_t SGD<ElemType>::GetNumSearchCandidatesPerRound() const
+{
+    if (m_parallelSearch && (g_mpi != nullptr) && (m_parallelizationMethod != ParallelizationMethod::None))
+        return g_mpi->NumNodesInUse();
+    return 1;
+}
+
+// run TrainOneMiniEpochAndReloadModel() for each candidate and return their criteria
+// In a parallel search, candidate i is trained by rank i % NumNodesInUse() alone, on the whole search subset, and the
+// criteria are then exchanged, so that all ranks return the same criteria and make the same choices.
+template <class ElemType>
+std::vector<double> SGD<ElemType>::TrainMiniEpochsForCandidates(ComputationNetworkPtr net,
+                                                                ComputationNetworkPtr refNet,
+                                                                const ComputationNodeBasePtr& refNode, const int epochNumber,
+                                                                const size_t epochSize, IDataReader<ElemType>* trainSetDataReader,
+                                                                const std::vector<SearchCandidate>& candidates,
+                                                                const std::vector<ComputationNodeBasePtr>& featureNodes,
+                                                                const std::vector<ComputationNodeBasePtr>& labelNodes,
+                                                                const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                                                const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                                                std::map<std::wstring, Matrix<ElemType>*>* inputMatrices,
+                                                                const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                                                std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    const bool isParallel = GetNumSearchCandidatesPerRound() > 1;
+    std::vector<double> criteria(candidates.size(), 0);
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        if (isParallel && (i % g_mpi->NumNodesInUse() != g_mpi->CurrentNodeRank()))
+            continue;
+
+        size_t totalSamplesSeen;
+        std::vector<double> epochEvalErrors(evaluationNodes.size(), std::numeric_limits<double>::infinity());
+        m_trainingSearchCandidateLocally = isParallel;
+        TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
+                                        epochSize, trainSetDataReader,
+                                        candidates[i].learnRatePerSample, candidates[i].minibatchSize,
+                                        featureNodes, labelNodes,
+                                        criterionNodes, evaluationNodes,
+                                        inputMatrices, learnableNodes,
+                                        smoothedGradients, /*out*/ criteria[i],
+                                        /*out*/ epochEvalErrors, /*out*/ totalSamplesSeen,
+                                        candidates[i].prefixMsg);
+        m_trainingSearchCandidateLocally = false;
+    }
+    if (isParallel) // (collective) each criterion is nonzero on one rank only
+    {
+        g_mpi->AllReduce(criteria.data(), criteria.size());
+        for (size_t i = 0; i < candidates.size(); i++)
+            fprintf(stderr, "%s learnRatePerSample = %.10g, minibatchSize = %d: TrainLossPerSample = %.8g (rank %d)\n", candidates[i].prefixMsg.c_str(),
+                    candidates[i].learnRatePerSample, (int) candidates[i].minibatchSize, criteria[i], (int) (i % g_mpi->NumNodesInUse()));
+    }
+    return criteria;
+}
+
 // Attemps to compute the error signal for the whole utterance, which will
 // be fed to the neural network as features. Currently it is a workaround
 // for the two-forward-pass sequence and ctc training, which allows
@@ -1931,14 +2254,11 @@ size_t SGD<ElemType>::ModelAveragingSync(int nSamplesSinceLastSync, const std::l
     //          (node1) GPU ->  CPU  ->  MPI_AllReduce
     //          (node2)         GPU  ->  CPU            -> MPI_AllReduce
     //          (node3)                  GPU            -> CPU              -> MPI_AllReduce
+    //       With flatParameterStorage, all parameters in the buffer are averaged at once.
     // ========================================
-    for (auto iter = learnableNodes.begin(); iter != learnableNodes.end(); iter++)
+    for (auto* value : ModelAveragingValues(learnableNodes))
     {
-        ComputationNodeBasePtr pNode = *iter;
-        if (!pNode->IsParameterUpdateRequired())
-            continue;
-
-        Matrix<ElemType>& mat = dynamic_pointer_cast<ComputationNode<ElemType>>(pNode)->Value();
+        Matrix<ElemType>& mat = *value;
         // 1. normalize the weight matrix
         Matrix<ElemType>::Scale(factor, mat);
         // 2. send weight matrix over MPI nodes;
@@ -1955,6 +2275,69 @@ size_t SGD<ElemType>::ModelAveragingSync(int nSamplesSinceLastSync, const std::l
     return nTotalSamples;
 }
 
+// the parameters that model averaging averages
+template <class ElemType>
+std::vector<Matrix<ElemType>*> SGD<ElemType>::ModelAveragingValues(const std::list<ComputationNodeBasePtr>& learnableNodes)
+{
+    std::vector<Matrix<ElemType>*> values;
+    if (m_flatParameterStorage && !m_flatParameters.IsEmpty())
+        return m_flatParameters.ValueMatrices();
+    for (auto iter = learnableNodes.begin(); iter != learnableNodes.end(); iter++)
+    {
+        if ((*iter)->IsParameterUpdateRequired())
+            values.push_back(&dynamic_pointer_cast<ComputationNode<ElemType>>(*iter)->Value());
+    }
+    return values;
+}
+
+// asynchronous model averaging, called after each minibatch: blend in a round that has finished, and start
+// the next round once this rank has processed m_nFramesBetweenMASync samples since its previous one
+// Unlike ModelAveragingProcessing(), this does not communicate with the other ranks on the main thread.
+// Returns whether a round was blended in, and its number of samples over all ranks in 'nProcessedFrames'.
+template <class ElemType>
+bool SGD<ElemType>::AsyncModelAveragingProcessing(size_t& nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes, size_t& nProcessedFrames)
+{
+    nProcessedFrames = 0;
+    bool blended = false;
+    if (m_asyncModelAverager.IsRoundFinished())
+    {
+        bool allFinal;
+        m_asyncModelAverager.Finish(ModelAveragingValues(learnableNodes), nProcessedFrames, allFinal);
+        blended = true;
+    }
+    if (!m_asyncModelAverager.IsPending() && nSamplesSinceLastSync >= m_nFramesBetweenMASync)
+    {
+        m_asyncModelAverager.Start(ModelAveragingValues(learnableNodes), nSamplesSinceLastSync, /*isFinal=*/false);
+        nSamplesSinceLastSync = 0;
+    }
+    return blended;
+}
+
+// end of epoch with asynchronous model averaging: finish the pending round, then run final rounds until
+// all ranks have reached the end of the epoch, so that all ranks leave with the same number of rounds and
+// the same model (up to blending)
+// Returns the number of samples of these rounds over all ranks.
+template <class ElemType>
+size_t SGD<ElemType>::AsyncModelAveragingFinish(size_t nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes)
+{
+    size_t totalSamples = 0;
+    size_t roundSamples = 0;
+    bool allFinal = false;
+    if (m_asyncModelAverager.IsPending())
+    {
+        m_asyncModelAverager.Finish(ModelAveragingValues(learnableNodes), roundSamples, allFinal);
+        totalSamples += roundSamples;
+    }
+    do
+    {
+        m_asyncModelAverager.Start(ModelAveragingValues(learnableNodes), nSamplesSinceLastSync, /*isFinal=*/true);
+        nSamplesSinceLastSync = 0;
+        m_asyncModelAverager.Finish(ModelAveragingValues(learnableNodes), roundSamples, allFinal);
+        totalSamples += roundSamples;
+    } while (!allFinal);
+    return totalSamples;
+}
+
 // public:
 // UpdateWeightsS - static version of UpdateWeights()
 // not static since it wants to access protected methods on the SGD object
@@ -1989,14 +2372,16 @@ template <class ElemType>
 
     GradientsUpdateType adpType = sgd->GradUpdateType();
     double noiseStd = sgd->GradientUpdateNoiseStd();
-    Matrix<ElemType> sgdUpdateNoise((DEVICEID_TYPE) functionValues.GetDeviceId());
+    ScratchMatrix<ElemType> sgdUpdateNoise;
     if (noiseStd > 0)
     {
+        sgdUpdateNoise = ScratchArena<ElemType>::ForCurrentThread().Take((DEVICEID_TYPE) functionValues.GetDeviceId(), L"SGD::UpdateWeights", gradientValues.GetMatrixType(), gradientValues.GetFormat());
+
         // get the gradient structure since gradient is sparse
-        sgdUpdateNoise.SetValue(gradientValues);
+        sgdUpdateNoise->SetValue(gradientValues);
 
         // reset its value to random
-        sgdUpdateNoise.SetGaussianRandomValue(0, (ElemType) noiseStd);
+        sgdUpdateNoise->SetGaussianRandomValue(0, (ElemType) noiseStd);
     }
 
     // L2 regularizer
@@ -2034,7 +2419,7 @@ template <class ElemType>
 
     if (noiseStd > 0)
     {
-        Matrix<ElemType>::ScaleAndAdd(1.0, sgdUpdateNoise, functionValues);
+        Matrix<ElemType>::ScaleAndAdd(1.0, *sgdUpdateNoise, functionValues);
     }
 
     // L1 regularizer with proximal gradient descent method
@@ -2075,6 +2460,92 @@ void SGD<ElemType>::UpdateWeights(const ComputationNodeBasePtr& node,
     node->BumpEvalTimeStamp();
 }
 
+// the update rule of the fused update, from gradUpdateType
+template <class ElemType>
+typename FusedParameterUpdate<ElemType>::Rule SGD<ElemType>::GetFusedUpdateRule() const
+{
+    typedef typename FusedParameterUpdate<ElemType>::Rule Rule;
+    switch (GradUpdateType())
+    {
+    case GradientsUpdateType::AdaGrad:   return Rule::AdaGrad;
+    case GradientsUpdateType::FSAdaGrad: return Rule::FSAdaGrad;
+    case GradientsUpdateType::RmsProp:   return Rule::RmsProp;
+    default:                             return m_useNesterovMomentum ? Rule::NesterovMomentum : Rule::Momentum;
+    }
+}
+
+// add a parameter to the fused update of this minibatch, if it can be updated that way
+// Parameters that are not on the CPU, and all parameters when noise is injected, take the regular path.
+template <class ElemType>
+bool SGD<ElemType>::AddToFusedUpdate(const ComputationNodeBasePtr& node, Matrix<ElemType>& smoothedGradient, const size_t actualMBSize)
+{
+    if (GradientUpdateNoiseStd() > 0)
+        return false;
+
+    auto paramNode = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+    const auto rule = GetFusedUpdateRule();
+    if (!FusedParameterUpdate<ElemType>::CanUpdate(rule, paramNode->Value(), paramNode->Gradient(), smoothedGradient))
+        return false;
+
+    // FSAdaGrad weights depend on the number of preceding updates, so they must be drawn in the regular order
+    ElemType adaWeight = 0, adaMul = 0;
+    if (rule == FusedParameterUpdate<ElemType>::Rule::FSAdaGrad)
+        Matrix<ElemType>::FSAdagradNextWeights(actualMBSize, adaWeight, adaMul);
+
+    m_fusedUpdate.Add(paramNode->Value(), paramNode->Gradient(), smoothedGradient, adaWeight, adaMul);
+    node->BumpEvalTimeStamp();
+    return true;
+}
+
+// update all parameters added by AddToFusedUpdate(); same as UpdateWeights() for each of them
+template <class ElemType>
+void SGD<ElemType>::UpdateWeightsFused(const double learnRatePerSample, const double momentumPerSample, const size_t actualMBSize)
+{
+    assert(actualMBSize > 0);
+
+    typename FusedParameterUpdate<ElemType>::Settings settings;
+    settings.rule = GetFusedUpdateRule();
+    settings.learnRatePerSample = (ElemType) learnRatePerSample;
+    settings.momentum = (ElemType) MomentumPerMB(momentumPerSample, actualMBSize);
+    settings.maxGradientPerMB = m_clippingThresholdPerSample * actualMBSize;
+    settings.clipWithTruncation = m_gradientClippingWithTruncation;
+    settings.l2Weight = m_L2RegWeight > 0 ? (ElemType)(m_L2RegWeight * actualMBSize) : 0;
+    settings.l1Threshold = m_L1RegWeight > 0 ? (ElemType)(learnRatePerSample * m_L1RegWeight * actualMBSize) : 0;
+    settings.needAveMultiplier = m_needAveMultiplier;
+    settings.rmsGamma = (ElemType) m_rpi.gamma;
+    settings.rmsInc = (ElemType) m_rpi.inc;
+    settings.rmsMax = (ElemType) m_rpi.max;
+    settings.rmsDec = (ElemType) m_rpi.dec;
+    settings.rmsMin = (ElemType) m_rpi.min;
+    m_fusedUpdate.Update(settings);
+}
+
+// make the parameters of the network views into contiguous buffers, or again if they have become standalone matrices
+template <class ElemType>
+void SGD<ElemType>::UpdateFlatParameterStorage(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    // columns of a smoothed gradient in units of the parameter's columns, once the update rule has allocated it
+    size_t smoothedColumnsFactor = 1;
+    if (GradUpdateType() == GradientsUpdateType::FSAdaGrad)
+        smoothedColumnsFactor = 2;
+    else if (GradUpdateType() == GradientsUpdateType::RmsProp)
+        smoothedColumnsFactor = 3;
+
+    m_flatParameters.Update(learnableNodes, smoothedGradients, smoothedColumnsFactor, net->GetDeviceId(), m_traceLevel);
+}
+
+// whether UpdateWeightsS() on the buffers gives the same result as on each parameter
+// This requires an element-wise update rule: no per-parameter norm clipping, no per-parameter averages (AdaGrad,
+// RmsProp), no per-parameter state (FSAdaGrad), and no noise (to keep the random sequence of the regular update).
+template <class ElemType>
+bool SGD<ElemType>::CanUpdateFlatParametersAtOnce() const
+{
+    return m_flatParameters.CanUpdateAllAtOnce() &&
+           GradUpdateType() == GradientsUpdateType::None &&
+           GradientUpdateNoiseStd() == 0 &&
+           (m_clippingThresholdPerSample == std::numeric_limits<double>::infinity() || m_gradientClippingWithTruncation);
+}
+
 template <class ElemType>
 void SGD<ElemType>::ClipGradient(Matrix<ElemType>& gradient, const size_t actualMBSize) const
 {
@@ -2137,13 +2608,67 @@ void SGD<ElemType>::SaveCheckPointInfo(const size_t epoch, const size_t totalSam
             fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ECKP");
 
             // Ensuring that data is written
-            fstream.Flush();
+            fstream.Sync();
         }
 
         renameOrDie(tempFileName, checkPointFileName);
     }
 }
 
+// The model is serialized here, and the smoothed gradients are copied to the CPU. Training then continues with the next epoch
+// while a background thread completes the model file and writes the checkpoint. That thread does not touch the network or the GPU.
+// Model and checkpoint are written in that order, like in the synchronous case, since restarting relies on the timestamps
+// of the model files. The files of previous checkpoints are only deleted once the new checkpoint is complete.
+template <class ElemType>
+void SGD<ElemType>::SaveCheckPointAsync(ComputationNetworkPtr net, const size_t epoch, const size_t totalSamplesSeen,
+                                        const double learnRatePerSample,
+                                        const std::list<Matrix<ElemType>>& smoothedGradients,
+                                        const double prevCriterion,
+                                        const size_t minibatchSize,
+                                        const std::vector<wstring>& obsoleteCheckPointFiles)
+{
+    if (!m_checkpointWriter)
+        m_checkpointWriter.reset(new AsyncCheckpointWriter(m_maxPendingCheckpoints));
+
+    Timer timer;
+    timer.Start();
+
+    wstring modelFileName = GetModelNameForEpoch(int(epoch));
+    auto modelSnapshot = net->SaveSnapshot(modelFileName);
+    auto gradientSnapshot = make_shared<std::list<Matrix<ElemType>>>();
+    for (const auto& smoothedGradient : smoothedGradients)
+    {
+        gradientSnapshot->emplace_back(smoothedGradient.GetNumRows(), smoothedGradient.GetNumCols(), CPUDEVICE);
+        ElemType* buffer = gradientSnapshot->back().BufferPointer();
+        size_t bufferSize = gradientSnapshot->back().GetNumElements();
+        smoothedGradient.CopyToArray(buffer, bufferSize);
+    }
+
+    timer.Stop();
+    if (m_traceLevel > 0)
+        fprintf(stderr, "Checkpoint for epoch %d serialized in %.3f seconds, now written in the background.\n", (int) epoch + 1, timer.ElapsedSeconds());
+
+    m_checkpointWriter->Submit([this, modelFileName, modelSnapshot, epoch, totalSamplesSeen, learnRatePerSample, gradientSnapshot, prevCriterion, minibatchSize, obsoleteCheckPointFiles]()
+                               {
+                                   ComputationNetwork::CommitSnapshot(modelSnapshot, modelFileName);
+                                   SaveCheckPointInfo(epoch, totalSamplesSeen, learnRatePerSample, *gradientSnapshot, prevCriterion, minibatchSize);
+                                   for (const auto& fileName : obsoleteCheckPointFiles)
+                                       _wunlink(fileName.c_str());
+                               });
+}
+
+// A rank may only read back a model or checkpoint file once rank 0 has completed writing it.
+template <class ElemType>
+void SGD<ElemType>::WaitForPendingCheckpoints()
+{
+    if (!m_asyncCheckpoint)
+        return;
+    if (m_checkpointWriter)
+        m_checkpointWriter->WaitForAll();
+    if (g_mpi != nullptr)
+        g_mpi->WaitAll();
+}
+
 template <class ElemType>
 bool SGD<ElemType>::LoadCheckPointInfo(const size_t epochNumber,
                                        /*out*/ size_t& totalSamplesSeen,
@@ -2385,6 +2910,28 @@ static ParallelizationMethod ParseParallelizationMethod(const wstring& s)
         InvalidArgument("ParseParallelizationMethod: Invalid Parallelization Method. Valid values are (none | dataParallelSGD | modelAveragingSGD)");
 }
 
+static MPIAllReduceAlgorithm ParseAllReduceAlgorithm(const wstring& s)
+{
+    if (!_wcsicmp(s.c_str(), L"") || !_wcsicmp(s.c_str(), L"native"))
+        return MPIAllReduceAlgorithm::Native;
+    else if (!_wcsicmp(s.c_str(), L"ring"))
+        return MPIAllReduceAlgorithm::Ring;
+    else if (!_wcsicmp(s.c_str(), L"hierarchical"))
+        return MPIAllReduceAlgorithm::Hierarchical;
+    else
+        InvalidArgument("ParseAllReduceAlgorithm: Invalid all-reduce algorithm. Valid values are (native | ring | hierarchical)");
+}
+
+static ModelAveragingBlend ParseModelAveragingBlend(const wstring& s)
+{
+    if (!_wcsicmp(s.c_str(), L"blockMomentum"))
+        return ModelAveragingBlend::BlockMomentum;
+    else if (!_wcsicmp(s.c_str(), L"elastic"))
+        return ModelAveragingBlend::Elastic;
+    else
+        InvalidArgument("ParseModelAveragingBlend: Invalid model averaging blend. Valid values are (blockMomentum | elastic)");
+}
+
 static LearningRateSearchAlgorithm ParseLearningRateSearchType(const wstring& s)
 {
     // TODO: why allow so many variants?
@@ -2424,6 +2971,10 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_minibatchSizeTuningMax = configAALR(L"minibatchSizeTuningMax", (size_t) 1048576);
     m_minibatchSearchCriterionErrorMargin = configAALR(L"minibatchSearchCriterionErrorMargin", (size_t) 1);
 
+    // with parallel training, spread the candidates of the searches over the ranks instead of training each candidate with all ranks
+    m_parallelSearch = configAALR(L"parallelSearch", false);
+    m_searchDataCacheMaxMB = configAALR(L"searchDataCacheMaxMB", (size_t) 0);
+
     // the number of minibatches used to search
     // the learning rate. Its typically set to 10-20% of
     // the total minibatches in an epoch.
@@ -2499,6 +3050,8 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_needAveMultiplier = configSGD(L"normWithAveMultiplier", true);
     m_L2RegWeight = configSGD(L"L2RegWeight", 0.0);
     m_L1RegWeight = configSGD(L"L1RegWeight", 0.0);
+    m_fusedParameterUpdate = configSGD(L"fusedParameterUpdate", false);
+    m_flatParameterStorage = configSGD(L"flatParameterStorage", false);
 
     // for backward support. future setup should use gradUpdateType=AdaGrad, instead of
     // useAdagrad=true
@@ -2627,6 +3180,12 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_enableDistributedMBReading = false;
     m_parallelizationStartEpochNum = 0;
     m_nFramesBetweenMASync = 40000; // default 40k frames
+    m_asyncModelAveraging = false;
+    m_modelAveragingBlend = ModelAveragingBlend::BlockMomentum;
+    m_blockMomentum = 0;
+    m_elasticAlpha = 1;
+    m_allReduceAlgorithm = MPIAllReduceAlgorithm::Native;
+    m_allReduceChunkBytes = 1 << 20;
 
     if ((g_mpi != nullptr) && configSGD.Exists(L"ParallelTrain"))
     {
@@ -2635,6 +3194,10 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
         m_parallelizationStartEpochNum = configParallelTrain(L"parallelizationStartEpoch", (int) 1) - 1; // Epoch numbers internally are 0 based
         m_enableDistributedMBReading = configParallelTrain(L"distributedMBReading", false);
         m_syncStatsTrace = configParallelTrain(L"syncPerfStats", (int) 0);
+        m_allReduceAlgorithm = ParseAllReduceAlgorithm(configParallelTrain(L"allReduceAlgorithm", L"native"));
+        m_allReduceChunkBytes = configParallelTrain(L"allReduceChunkBytes", (size_t) 1 << 20);
+        if (m_allReduceChunkBytes == 0)
+            InvalidArgument("allReduceChunkBytes must be > 0.");
 
         if (configParallelTrain.Exists(L"DataParallelSGD"))
         {
@@ -2643,6 +3206,8 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
             m_numGradientBits = configDataParallelSGD(L"gradientBits", defaultGradientBits);
             m_zeroThresholdFor1Bit = configDataParallelSGD(L"useZeroThresholdFor1BitQuantization", true);
             m_bufferedAsyncGradientAggregation = configDataParallelSGD(L"useBufferedAsyncGradientAggregation", false);
+            if (m_bufferedAsyncGradientAggregation && m_flatParameterStorage)
+                InvalidArgument("flatParameterStorage cannot be used with useBufferedAsyncGradientAggregation, which swaps the storage of the gradient matrices.");
             if ((m_numGradientBits < 1) || (m_numGradientBits > (8 * sizeofElemType)))
             {
                 InvalidArgument("gradientBits must be in the range [1, 32] when using precision=float and in range [1, 64] when using precision=double!");
@@ -2653,6 +3218,14 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
         {
             const ConfigRecordType& configMASGD(configParallelTrain(L"ModelAveragingSGD", ConfigRecordType::Record()));
             m_nFramesBetweenMASync = configMASGD(L"syncFrequencyInFrames", (size_t) 40000);
+            m_asyncModelAveraging = configMASGD(L"asyncAveraging", false);
+            m_modelAveragingBlend = ParseModelAveragingBlend(configMASGD(L"blend", L"blockMomentum"));
+            m_blockMomentum = configMASGD(L"blockMomentum", 1.0 - 1.0 / g_mpi->NumNodesInUse()); // (default as suggested for block-wise model update filtering)
+            m_elasticAlpha = configMASGD(L"elasticAlpha", 0.5);
+            if (m_blockMomentum < 0 || m_blockMomentum >= 1)
+                InvalidArgument("blockMomentum must be in [0, 1).");
+            if (m_elasticAlpha <= 0 || m_elasticAlpha > 1)
+                InvalidArgument("elasticAlpha must be in (0, 1].");
         }
     }
 }
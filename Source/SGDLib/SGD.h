@@ -17,6 +17,11 @@
 #include <chrono>
 #include <random>
 #include "Profiler.h"
+#include "AsyncCheckpointWriter.h"
+#include "FusedParameterUpdate.h"
+#include "FlatParameterStorage.h"
+#include "MPIWrapper.h"
+#include "AsyncModelAverager.h"
 
 using namespace std; // ugh! TODO: get rid of this from .h files!!!
 
@@ -197,6 +202,10 @@ protected:
     size_t m_minibatchSizeTuningFrequency;
     size_t m_minibatchSizeTuningMax;
 
+    // learning-rate and minibatch-size searches
+    bool m_parallelSearch;         // parallel training: each rank trains its own candidates on the whole search subset
+    size_t m_searchDataCacheMaxMB; // keep the search subset of the learning-rate search in RAM up to this size (0: read it for each candidate)
+
     floatargvector m_dropoutRates;
     size_t m_maxTempMemSizeInSamplesForCNN;
 
@@ -237,11 +246,22 @@ protected:
 
     // Parallel training related with MA
     size_t m_nFramesBetweenMASync;
+    bool m_asyncModelAveraging; // average in the background while local SGD continues (AsyncModelAverager)
+    ModelAveragingBlend m_modelAveragingBlend;
+    double m_blockMomentum;
+    double m_elasticAlpha;
+
+    // algorithm of MPIWrapper::AllReduce(), used for gradient aggregation and model averaging
+    MPIAllReduceAlgorithm m_allReduceAlgorithm;
+    size_t m_allReduceChunkBytes;
 
     bool m_needAveMultiplier;
     double m_L2RegWeight;
     double m_L1RegWeight;
 
+    bool m_fusedParameterUpdate; // update all CPU parameters in one fused pass
+    bool m_flatParameterStorage; // keep parameters, gradients and smoothed gradients in contiguous buffers
+
     // sequence training
     double m_hSmoothingWeight;
     double m_frameDropThresh;
@@ -256,6 +276,9 @@ protected:
 template <class ElemType>
 class IDistGradAggregator;
 
+template <class ElemType>
+class MeanInvStdDevNodeBase;
+
 // -----------------------------------------------------------------------
 // class SGD
 // -----------------------------------------------------------------------
@@ -277,11 +300,15 @@ public:
           // TODO: The next few do not belong into SGD any more than the network or reader we operate on. Either move network and reader in here, or move these out.
           m_modelPath((const wstring&) configSGD(L"modelPath")),
           m_keepCheckPointFiles(configSGD(L"keepCheckPointFiles", false)),
+          m_asyncCheckpoint(configSGD(L"asyncCheckpoint", false)),
+          m_maxPendingCheckpoints(configSGD(L"maxPendingCheckpoints", (size_t) 1)),
+          m_preComputeCacheFile((const wstring&) configSGD(L"preComputeCache", L"")),
           // m_validateAfterModelReloading(configSGD(L"validateAfterModelReloading", true)),
           m_trainCriterionNodeName((const wstring&) configSGD(L"trainCriterionNodeName", L"")),
           m_evalCriterionNodeName((const wstring&) configSGD(L"evalCriterionNodeName", L"")),
           m_prevChosenMinibatchSize(0),
           m_lastFinishedEpochTrainLoss(0.0),
+          m_trainingSearchCandidateLocally(false),
           m_distGradAgg(nullptr),
           m_gradHeader(nullptr)
     {
@@ -304,6 +331,13 @@ public:
                IDataReader<ElemType>* validationSetDataReader,
                const DEVICEID_TYPE deviceID, const bool makeMode = true);
 
+    // identifies the data that PreCompute() reads, typically the reader configuration;
+    // the 'preComputeCache' file is only used if it was written with the same key
+    void SetPreComputeCacheKey(const wstring& key)
+    {
+        m_preComputeCacheKey = key;
+    }
+
 protected:
 
     std::vector<ComputationNodeBasePtr>& GetTrainCriterionNodes(ComputationNetworkPtr net);
@@ -323,6 +357,9 @@ protected:
                     std::vector<ComputationNodeBasePtr>& featureNodes,
                     std::vector<ComputationNodeBasePtr>& labelNodes,
                     std::map<std::wstring, Matrix<ElemType>*>* inputMatrices);
+    wstring GetPreComputeCacheKey() const;
+    bool LoadPreComputeCache(const std::vector<shared_ptr<MeanInvStdDevNodeBase<ElemType>>>& nodes, /*out*/ std::vector<std::vector<double>>& sums) const;
+    void SavePreComputeCache(const std::vector<shared_ptr<MeanInvStdDevNodeBase<ElemType>>>& nodes, const std::vector<std::vector<double>>& sums) const;
 
     // return a reasonable initial learning rate based on the initial mbsize
     double SearchForBestLearnRate(ComputationNetworkPtr net,
@@ -358,6 +395,27 @@ protected:
                                          /*out*/ size_t& totalSamplesSeen,
                                          std::string prefixMsg = "");
 
+    // a candidate of the learning-rate and minibatch-size searches
+    struct SearchCandidate
+    {
+        double learnRatePerSample;
+        size_t minibatchSize;
+        std::string prefixMsg;
+    };
+    size_t GetNumSearchCandidatesPerRound() const;
+    std::vector<double> TrainMiniEpochsForCandidates(ComputationNetworkPtr net,
+                                                     ComputationNetworkPtr refNet,
+                                                     const ComputationNodeBasePtr& refNode, const int epochNumber,
+                                                     const size_t epochSize, IDataReader<ElemType>* trainSetDataReader,
+                                                     const std::vector<SearchCandidate>& candidates,
+                                                     const std::vector<ComputationNodeBasePtr>& featureNodes,
+                                                     const std::vector<ComputationNodeBasePtr>& labelNodes,
+                                                     const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                                     const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                                     std::map<std::wstring, Matrix<ElemType>*>* inputMatrices,
+                                                     const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                                     std::list<Matrix<ElemType>>& smoothedGradients);
+
     size_t AdaptiveMinibatchSizing(ComputationNetworkPtr net,
                                    ComputationNetworkPtr refNet,
                                    const ComputationNodeBasePtr& refNode,
@@ -429,6 +487,10 @@ protected:
                                   float& SecondsSinceLastSyncFinished, float& SecondsSpentOnSync);
 
     size_t ModelAveragingSync(int nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes);
+    std::vector<Matrix<ElemType>*> ModelAveragingValues(const std::list<ComputationNodeBasePtr>& learnableNodes);
+
+    bool AsyncModelAveragingProcessing(size_t& nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes, size_t& nProcessedFrames);
+    size_t AsyncModelAveragingFinish(size_t nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes);
 
 public:
     // UpdateWeightsS - static version of UpdateWeights()
@@ -456,12 +518,31 @@ protected:
 
     void ClipGradient(Matrix<ElemType>& gradient, const size_t actualMBSize) const;
 
+    // fused update of all parameters on the CPU (m_fusedParameterUpdate)
+    typename FusedParameterUpdate<ElemType>::Rule GetFusedUpdateRule() const;
+    bool AddToFusedUpdate(const ComputationNodeBasePtr& node, Matrix<ElemType>& smoothedGradient, const size_t actualMBSize);
+    void UpdateWeightsFused(const double learnRatePerSample, const double momentumPerSample, const size_t actualMBSize);
+
+    // contiguous parameter storage (m_flatParameterStorage)
+    void UpdateFlatParameterStorage(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients);
+    bool CanUpdateFlatParametersAtOnce() const;
+
     void SaveCheckPointInfo(const size_t epoch, const size_t totalSamplesSeen,
                             const double learnRatePerSample,
                             const std::list<Matrix<ElemType>>& smoothedGradients,
                             const double prevCriterion,
                             const size_t minibatchSize);
 
+    // write model and checkpoint from a snapshot on a background thread, then delete the given files
+    void SaveCheckPointAsync(ComputationNetworkPtr net, const size_t epoch, const size_t totalSamplesSeen,
+                             const double learnRatePerSample,
+                             const std::list<Matrix<ElemType>>& smoothedGradients,
+                             const double prevCriterion,
+                             const size_t minibatchSize,
+                             const std::vector<wstring>& obsoleteCheckPointFiles);
+    // must be called by all ranks before reading back a model or checkpoint file
+    void WaitForPendingCheckpoints();
+
     bool LoadCheckPointInfo(const size_t epochNumber,
                             /*out*/ size_t& totalSamplesSeen,
                             /*out*/ double& learnRatePerSample,
@@ -495,6 +576,14 @@ public:
 protected:
     wstring m_modelPath;
     bool m_keepCheckPointFiles;
+    bool m_asyncCheckpoint;         // write checkpoints in the background while training continues
+    size_t m_maxPendingCheckpoints; // training blocks when this many checkpoints are still being written
+    std::unique_ptr<AsyncCheckpointWriter> m_checkpointWriter;
+    wstring m_preComputeCacheFile; // statistics of the PreCompute nodes are saved here, and loaded from here if the key matches
+    wstring m_preComputeCacheKey;
+    FusedParameterUpdate<ElemType> m_fusedUpdate; // parameters of this minibatch for UpdateWeightsFused()
+    FlatParameterStorage<ElemType> m_flatParameters;
+    AsyncModelAverager<ElemType> m_asyncModelAverager;
     // bool m_validateAfterModelReloading; // TODO: remove this. Why would one not validate a model?
 
     wstring m_trainCriterionNodeName;
@@ -502,6 +591,7 @@ protected:
 
     size_t m_prevChosenMinibatchSize;
     double m_lastFinishedEpochTrainLoss;
+    bool m_trainingSearchCandidateLocally; // TrainOneEpoch() runs without parallelization (rank-parallel search)
 
     IDistGradAggregator<ElemType>* m_distGradAgg;
     struct DistGradHeader* m_gradHeader;
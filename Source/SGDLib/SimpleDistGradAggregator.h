@@ -121,6 +121,12 @@ public:
         }
     }
 
+    // each gradient is all-reduced as a whole; async aggregation swaps the gradient matrices' storage
+    bool SupportsFlatGradients() const override
+    {
+        return !m_useAsyncAggregation;
+    }
+
 private:
     std::shared_ptr<ElemType> AllocateIntermediateBuffer(int deviceID, size_t numElements)
     {
@@ -239,6 +245,24 @@ private:
             }
         }
 
+        if (m_mpi->GetAllReduceAlgorithm() != MPIAllReduceAlgorithm::Native)
+            AllReduceGradientsAndHeader(gradients, headerCPU, deviceId);
+        else
+            AggregateGradientsAndHeaderOnMainNode(gradients, headerCPU, deviceId);
+
+        if (showSyncPerfStats)
+        {
+            aggregationTimer.Stop();
+            double epochTime = aggregationTimer.ElapsedSeconds();
+            fprintf(stderr, "Actual gradient aggregation time: %.6g\n", epochTime);
+        }
+    }
+
+    // MPI_Iallreduce of the gradients; the headers are summed on the main node and sent back
+    void AggregateGradientsAndHeaderOnMainNode(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, int deviceId)
+    {
+        size_t numGradMatrices = gradients.size();
+
         // Initiate transfer of the gradient matrices to the CPU if needed
         if (deviceId >= 0)
         {
@@ -356,12 +380,51 @@ private:
         {
             MPI_Waitall(sendAggHeaderRequests.size(), sendAggHeaderRequests.data(), MPI_STATUSES_IGNORE) || MpiFail("MPI_Waitall");
         }
+    }
 
-        if (showSyncPerfStats)
+    // all-reduce of the gradients and of the header with the algorithm selected in MPIWrapper::SetAllReduceAlgorithm()
+    // The gradients are reduced one after the other; the ring algorithms pipeline each of them in chunks.
+    // The header is all-reduced as well, as an array of doubles, instead of being sent to and back from the main node.
+    void AllReduceGradientsAndHeader(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, int deviceId)
+    {
+        size_t numGradMatrices = gradients.size();
+        if (deviceId >= 0)
         {
-            aggregationTimer.Stop();
-            double epochTime = aggregationTimer.ElapsedSeconds();
-            fprintf(stderr, "Actual gradient aggregation time: %.6g\n", epochTime);
+            for (size_t i = 0; i < numGradMatrices; ++i)
+                m_gpuDataTransferers[i]->CopyGPUToCPUAsync(gradients[i]->BufferPointer(), gradients[i]->GetNumElements(), m_intermediateCPUBuffers[i].get());
+        }
+
+        for (size_t i = 0; i < numGradMatrices; ++i)
+        {
+            ElemType* reductionBuffer = gradients[i]->BufferPointer();
+            if (deviceId >= 0)
+            {
+                m_gpuDataTransferers[i]->WaitForCopyGPUToCPUAsync();
+                reductionBuffer = m_intermediateCPUBuffers[i].get();
+            }
+            m_mpi->AllReduce(reductionBuffer, gradients[i]->GetNumElements());
+            if (deviceId >= 0)
+                m_gpuDataTransferers[i]->CopyCPUToGPUAsync(m_intermediateCPUBuffers[i].get(), gradients[i]->GetNumElements(), gradients[i]->BufferPointer());
+        }
+
+        // sample counts are exact in a double up to 2^53
+        std::vector<double> header(3 + headerCPU->numEvalNode);
+        header[0] = (double) headerCPU->numSamples;
+        header[1] = (double) headerCPU->numSamplesWithLabel;
+        header[2] = headerCPU->criterion;
+        for (int j = 0; j < headerCPU->numEvalNode; j++)
+            header[3 + j] = headerCPU->evalErrors[j];
+        m_mpi->AllReduce(header.data(), header.size());
+        headerCPU->numSamples = (size_t) header[0];
+        headerCPU->numSamplesWithLabel = (size_t) header[1];
+        headerCPU->criterion = header[2];
+        for (int j = 0; j < headerCPU->numEvalNode; j++)
+            headerCPU->evalErrors[j] = header[3 + j];
+
+        if (deviceId >= 0)
+        {
+            for (size_t i = 0; i < numGradMatrices; ++i)
+                m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
         }
     }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <unordered_map>
+#include <exception>
 #include "simplesenonehmm.h"
 #include "latticearchive.h"
 #include "latticesource.h"
@@ -95,6 +96,13 @@ public:
                        std::vector<size_t>& extrauttmap,
                        bool doreferencealign)
     {
+        if (m_deviceid == CPUDEVICE)
+        {
+            CalGammaForMBOnCPU(functionValues, lattices, loglikelihood, labels, gammafromlattice, uids, boundaries,
+                               samplesInRecurrentStep, pMBLayout, extrauttmap, doreferencealign);
+            return;
+        }
+
         // check total frame number to be added ?
         // int deviceid = loglikelihood.GetDeviceId();
         size_t boundaryframenum;
@@ -136,13 +144,8 @@ public:
             if (samplesInRecurrentStep == 1) // no sequence parallelism
             {
                 tempmatrix = loglikelihood.ColumnSlice(ts, numframes);
-                // if (m_deviceid == CPUDEVICE)
-                {
-                    CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
-                }
-
-                if (m_deviceid != CPUDEVICE)
-                    parallellattice.setloglls(tempmatrix);
+                CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
+                parallellattice.setloglls(tempmatrix);
             }
             else // multiple parallel sequences
             {
@@ -172,15 +175,8 @@ public:
                 Microsoft::MSR::CNTK::Matrix<ElemType> loglikelihoodForCurrentParallelUtterance = loglikelihood.ColumnSlice(mapi + (validframes[mapi] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
                 tempmatrix.CopyColumnsStrided(loglikelihoodForCurrentParallelUtterance, numframes, samplesInRecurrentStep, 1);
 
-                // if (doreferencealign || m_deviceid == CPUDEVICE)
-                {
-                    CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
-                }
-
-                if (m_deviceid != CPUDEVICE)
-                {
-                    parallellattice.setloglls(tempmatrix);
-                }
+                CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
+                parallellattice.setloglls(tempmatrix);
             }
 
             array_ref<size_t> uidsstripe(&uids[ts], numframes);
@@ -214,12 +210,7 @@ public:
             }
 
             // copy gamma to tempmatrix
-            if (m_deviceid == CPUDEVICE)
-            {
-                CopyFromSSEMatrixToCNTKMatrix(dengammas, numrows, numframes, tempmatrix, gammafromlattice.GetDeviceId());
-            }
-            else
-                parallellattice.getgamma(tempmatrix);
+            parallellattice.getgamma(tempmatrix);
 
             // set gamma for multi channel
             if (samplesInRecurrentStep > 1)
@@ -248,71 +239,187 @@ public:
     }
 
 private:
-    // Helper methods for copying between ssematrix objects and CNTK matrices
-    void CopyFromCNTKMatrixToSSEMatrix(const Microsoft::MSR::CNTK::Matrix<ElemType>& src, size_t numCols, msra::math::ssematrixbase& dest)
+    // CPU version of calgammaformb(): the utterances of the minibatch are processed in parallel.
+    // Each utterance copies its log-likelihood columns straight from the CNTK matrix into its own stripe of 'pred',
+    // and its gammas from its own stripe of 'dengammas' straight into 'gammafromlattice'. All other scratch memory
+    // is allocated by forwardbackward() itself, so utterances share no mutable state.
+    void CalGammaForMBOnCPU(Microsoft::MSR::CNTK::Matrix<ElemType>& functionValues,
+                            std::vector<shared_ptr<const msra::dbn::latticepair>>& lattices,
+                            const Microsoft::MSR::CNTK::Matrix<ElemType>& loglikelihood,
+                            Microsoft::MSR::CNTK::Matrix<ElemType>& labels,
+                            Microsoft::MSR::CNTK::Matrix<ElemType>& gammafromlattice,
+                            std::vector<size_t>& uids, std::vector<size_t>& boundaries,
+                            size_t samplesInRecurrentStep,
+                            std::shared_ptr<Microsoft::MSR::CNTK::MBLayout> pMBLayout,
+                            std::vector<size_t>& extrauttmap,
+                            bool doreferencealign)
     {
         if (!std::is_same<ElemType, float>::value)
         {
             LogicError("Cannot copy between a SSE matrix and a non-float type CNTK Matrix object!");
         }
+        if (loglikelihood.GetDeviceId() != CPUDEVICE || gammafromlattice.GetDeviceId() != CPUDEVICE ||
+            loglikelihood.GetMatrixType() != Microsoft::MSR::CNTK::MatrixType::DENSE || gammafromlattice.GetMatrixType() != Microsoft::MSR::CNTK::MatrixType::DENSE)
+        {
+            LogicError("gammacalculation: CPU mode requires dense CPU matrices for log-likelihoods and gammas.");
+        }
 
-        size_t numRows = src.GetNumRows();
-        const Microsoft::MSR::CNTK::Matrix<ElemType> srcSlice = src.ColumnSlice(0, numCols);
-        if ((m_intermediateCUDACopyBuffer == nullptr) || (m_intermediateCUDACopyBufferSize < srcSlice.GetNumElements()))
+        size_t numrows = loglikelihood.GetNumRows();
+        size_t numcols = loglikelihood.GetNumCols();
+        if (numcols > pred.cols())
         {
-            m_intermediateCUDACopyBuffer = AllocateIntermediateBuffer(srcSlice.GetDeviceId(), srcSlice.GetNumElements());
-            m_intermediateCUDACopyBufferSize = srcSlice.GetNumElements();
+            pred.resize(numrows, numcols);
+            dengammas.resize(numrows, numcols);
         }
 
-        ElemType* pBuf = m_intermediateCUDACopyBuffer.get();
-        srcSlice.CopyToArray(pBuf, m_intermediateCUDACopyBufferSize);
-        if (pBuf != m_intermediateCUDACopyBuffer.get())
+        if (doreferencealign)
+            labels.SetValue((ElemType)(0.0f));
+
+        const size_t S = samplesInRecurrentStep; // frame t of an utterance is at column firstcol + t * S of the CNTK matrices
+        size_t T = numcols / S;                  // number of time steps in minibatch
+        if (S > 1)
         {
-            LogicError("Unexpected re-allocation of destination CPU buffer in Matrix::CopyToArray!");
+            assert(extrauttmap.size() == lattices.size());
+            assert(T == pMBLayout->GetNumTimeSteps());
         }
 
-        if ((dest.getcolstride() == dest.rows()) && (numRows == dest.rows()))
+        // locate all utterances first
+        const size_t numutts = lattices.size();
+        std::vector<size_t> uttbegin(numutts); // [i] first column of utterance [i] in pred, dengammas, uids, and boundaries
+        std::vector<size_t> firstcol(numutts); // [i] column of first frame of utterance [i] in the CNTK matrices
+        std::vector<size_t> validframes(S, 0); // [s] cursor pointing to next utterance begin within a single parallel sequence [s]
+        size_t ts = 0;
+        for (size_t i = 0; i < numutts; i++)
         {
-            memcpy(&dest(0, 0), (float*) pBuf, sizeof(ElemType) * numRows * numCols);
+            const size_t numframes = lattices[i]->getnumframes();
+            uttbegin[i] = ts;
+            if (S == 1) // no sequence parallelism
+                firstcol[i] = ts;
+            else
+            {
+                const size_t mapi = extrauttmap[i]; // parallel-sequence index
+
+                // scan MBLayout for end of utterance
+                size_t mapframenum = SIZE_MAX;
+                for (size_t t = validframes[mapi]; t < T; t++)
+                {
+                    if (pMBLayout->IsEnd(mapi, t))
+                    {
+                        mapframenum = t - validframes[mapi] + 1;
+                        break;
+                    }
+                }
+                if (numframes != mapframenum)
+                    LogicError("gammacalculation: IsEnd() not working, numframes (%d) vs. mapframenum (%d)", (int) numframes, (int) mapframenum);
+
+                firstcol[i] = mapi + validframes[mapi] * S;
+                validframes[mapi] += numframes;
+            }
+            ts += numframes;
         }
-        else
+
+        const float* loglls = (const float*) loglikelihood.BufferPointer();
+        float* gammas = (float*) gammafromlattice.BufferPointer();
+        std::vector<double> denavlogps(numutts);
+        std::vector<double> objectives(numutts);
+        std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic)
+        for (long long ii = 0; ii < (long long) numutts; ii++)
         {
-            // We need to copy columnwise
-            for (size_t i = 0; i < numCols; ++i)
+            try
             {
-                memcpy(&dest(0, i), (float*) (pBuf + (i * numRows)), sizeof(ElemType) * numRows);
+                const size_t i = (size_t) ii;
+                const size_t numframes = lattices[i]->getnumframes();
+
+                msra::dbn::matrixstripe predstripe(pred, uttbegin[i], numframes);           // logLLs for this utterance
+                msra::dbn::matrixstripe dengammasstripe(dengammas, uttbegin[i], numframes); // denominator gammas
+                for (size_t t = 0; t < numframes; t++)
+                    memcpy(&predstripe(0, t), loglls + (firstcol[i] + t * S) * numrows, sizeof(float) * numrows);
+
+                array_ref<size_t> uidsstripe(&uids[uttbegin[i]], numframes);
+                array_ref<size_t> boundariesstripe(&boundaries[uttbegin[i]], doreferencealign ? numframes : 0);
+
+                double numavlogp = 0;
+                foreach_column (t, dengammasstripe)
+                {
+                    const size_t s = uidsstripe[t];
+                    numavlogp += predstripe(s, t) / amf;
+                }
+                numavlogp /= numframes;
+
+                msra::dbn::matrix errorsignalbuf; // (empty, not used)
+                double denavlogp = lattices[i]->second.forwardbackward(parallellattice,
+                                                                       (const msra::math::ssematrixbase&) predstripe, (const msra::asr::simplesenonehmm&) m_hset,
+                                                                       (msra::math::ssematrixbase&) dengammasstripe, (msra::math::ssematrixbase&) errorsignalbuf,
+                                                                       lmf, wp, amf, boostmmifactor, seqsMBRmode, uidsstripe, boundariesstripe);
+
+                for (size_t t = 0; t < numframes; t++)
+                    memcpy(gammas + (firstcol[i] + t * S) * numrows, &dengammasstripe(0, t), sizeof(float) * numrows);
+
+                denavlogps[i] = denavlogp;
+                objectives[i] = (numavlogp - denavlogp) * numframes;
+            }
+            catch (...) // (exceptions must not leave the parallel region)
+            {
+#pragma omp critical
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+
+        // in utterance order, so that the result does not depend on the thread scheduling
+        ElemType objectValue = 0.0;
+        for (size_t i = 0; i < numutts; i++)
+        {
+            if (doreferencealign)
+            {
+                const size_t numframes = lattices[i]->getnumframes();
+                for (size_t nframe = 0; nframe < numframes; nframe++)
+                    labels(uids[uttbegin[i] + nframe], firstcol[i] + nframe * S) = 1.0;
             }
+            fprintf(stderr, "dengamma value %f\n", denavlogps[i]);
+            objectValue += (ElemType) objectives[i];
         }
+        functionValues.SetValue(objectValue);
     }
 
-    void CopyFromSSEMatrixToCNTKMatrix(const msra::math::ssematrixbase& src, size_t numRows, size_t numCols, Microsoft::MSR::CNTK::Matrix<ElemType>& dest, int deviceId)
+    // Helper methods for copying between ssematrix objects and CNTK matrices
+    void CopyFromCNTKMatrixToSSEMatrix(const Microsoft::MSR::CNTK::Matrix<ElemType>& src, size_t numCols, msra::math::ssematrixbase& dest)
     {
         if (!std::is_same<ElemType, float>::value)
         {
             LogicError("Cannot copy between a SSE matrix and a non-float type CNTK Matrix object!");
         }
 
-        size_t numElements = numRows * numCols;
-        if ((m_intermediateCUDACopyBuffer == nullptr) || (m_intermediateCUDACopyBufferSize < numElements))
+        size_t numRows = src.GetNumRows();
+        const Microsoft::MSR::CNTK::Matrix<ElemType> srcSlice = src.ColumnSlice(0, numCols);
+        if ((m_intermediateCUDACopyBuffer == nullptr) || (m_intermediateCUDACopyBufferSize < srcSlice.GetNumElements()))
         {
-            m_intermediateCUDACopyBuffer = AllocateIntermediateBuffer(deviceId, numElements);
-            m_intermediateCUDACopyBufferSize = numElements;
+            m_intermediateCUDACopyBuffer = AllocateIntermediateBuffer(srcSlice.GetDeviceId(), srcSlice.GetNumElements());
+            m_intermediateCUDACopyBufferSize = srcSlice.GetNumElements();
+        }
+
+        ElemType* pBuf = m_intermediateCUDACopyBuffer.get();
+        srcSlice.CopyToArray(pBuf, m_intermediateCUDACopyBufferSize);
+        if (pBuf != m_intermediateCUDACopyBuffer.get())
+        {
+            LogicError("Unexpected re-allocation of destination CPU buffer in Matrix::CopyToArray!");
         }
 
-        if ((src.getcolstride() == src.rows()) && (numRows == src.rows()))
+        if ((dest.getcolstride() == dest.rows()) && (numRows == dest.rows()))
         {
-            memcpy((float*) m_intermediateCUDACopyBuffer.get(), &src(0, 0), sizeof(float) * numRows * numCols);
+            memcpy(&dest(0, 0), (float*) pBuf, sizeof(ElemType) * numRows * numCols);
         }
         else
         {
             // We need to copy columnwise
             for (size_t i = 0; i < numCols; ++i)
             {
-                memcpy((float*) (m_intermediateCUDACopyBuffer.get() + (i * numRows)), &src(0, i), sizeof(float) * numRows);
+                memcpy(&dest(0, i), (float*) (pBuf + (i * numRows)), sizeof(ElemType) * numRows);
             }
         }
-
-        dest.SetValue(numRows, numCols, deviceId, m_intermediateCUDACopyBuffer.get(), 0);
     }
 
     // TODO: This function is duplicate of the one in HTLMLFReader.
@@ -3,16 +3,145 @@
 
 #include "stdafx.h"
 #include "Eval.h"
+#include "EvalBatchingServer.h"
 #include "DataReader.h"
 #include "Config.h"
+#include <random>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 using namespace Microsoft::MSR::CNTK;
 
+// benchmark the EvalBatchingServer
+// For each batching policy (maxLatencyMs) and offered load (requestRates, in requests per second), a load generator
+// submits requests of random input frames with Poisson arrivals for durationSeconds, and the latencies from
+// Submit() until the outputs are available are recorded. Prints one line per point of the latency/throughput curves.
+template <typename ElemType>
+void DoBenchmark(const ConfigParameters& config)
+{
+    std::wstring modelPath = config("modelPath");
+    std::wstring outputName = config("outputNodeName");
+    size_t framesPerRequest = config("framesPerRequest", "1");
+    double durationSeconds = config("durationSeconds", "5");
+    ConfigArray requestRatesArray = config("requestRates", "100:200:400:800:1600");
+    floatargvector requestRates = requestRatesArray;
+    ConfigArray maxLatenciesArray = config("maxLatencyMs", "0:2:5:10");
+    floatargvector maxLatencies = maxLatenciesArray;
+    EvalBatchingPolicy policy;
+    policy.maxRequests = config("maxRequests", "64");
+    policy.maxFrames = config("maxFrames", "10240");
+
+    Eval<ElemType> eval(config);
+    eval.LoadModel(modelPath);
+    std::map<std::wstring, size_t> inputDimensions;
+    eval.GetNodeDimensions(inputDimensions, nodeInput);
+
+    // a few random inputs to draw the requests from
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(-1, 1);
+    std::vector<typename EvalBatchingServer<ElemType>::Values> inputPool(16);
+    for (auto& inputs : inputPool)
+    {
+        for (const auto& iter : inputDimensions)
+        {
+            std::vector<ElemType>& frames = inputs[iter.first];
+            frames.resize(iter.second * framesPerRequest);
+            for (auto& value : frames)
+                value = (ElemType) uniform(rng);
+        }
+    }
+
+    fprintf(stderr, "\nmaxLatencyMs offeredRate achievedRate requestsPerMinibatch p50Ms p99Ms\n");
+    for (auto maxLatency : maxLatencies)
+    {
+        policy.maxLatencyMs = maxLatency;
+        for (auto requestRate : requestRates)
+        {
+            typedef std::chrono::steady_clock Clock;
+            typedef std::pair<Clock::time_point, std::future<typename EvalBatchingServer<ElemType>::Values>> Pending;
+            EvalBatchingServer<ElemType> server(&eval, std::vector<std::wstring>{outputName}, policy);
+
+            // the collector waits for the responses in the order of submission, which is the order of completion
+            std::deque<Pending> pending;
+            std::mutex pendingMutex;
+            std::condition_variable pendingAdded;
+            bool generatorDone = false;
+            std::vector<double> latencies;
+            std::thread collector([&]
+                                  {
+                                      for (;;)
+                                      {
+                                          Pending next;
+                                          {
+                                              std::unique_lock<std::mutex> lock(pendingMutex);
+                                              pendingAdded.wait(lock, [&]
+                                                                {
+                                                                    return generatorDone || !pending.empty();
+                                                                });
+                                              if (pending.empty())
+                                                  return;
+                                              next = std::move(pending.front());
+                                              pending.pop_front();
+                                          }
+                                          next.second.get();
+                                          latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - next.first).count());
+                                      }
+                                  });
+
+            // open-loop load generator: requests arrive independently of the responses
+            std::exponential_distribution<double> interarrival(requestRate);
+            const auto start = Clock::now();
+            const auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(durationSeconds));
+            auto arrival = start;
+            for (size_t i = 0;; i++)
+            {
+                arrival += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interarrival(rng)));
+                if (arrival >= end)
+                    break;
+                std::this_thread::sleep_until(arrival);
+                auto inputs = inputPool[i % inputPool.size()];
+                auto submitTime = Clock::now();
+                auto result = server.Submit(std::move(inputs));
+                {
+                    std::lock_guard<std::mutex> lock(pendingMutex);
+                    pending.push_back(Pending(submitTime, std::move(result)));
+                }
+                pendingAdded.notify_one();
+            }
+            {
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                generatorDone = true;
+            }
+            pendingAdded.notify_one();
+            collector.join();
+            const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            server.Stop();
+
+            const EvalBatchingStatistics statistics = server.GetStatistics();
+            std::sort(latencies.begin(), latencies.end());
+            auto percentile = [&](double p)
+            {
+                return latencies.empty() ? 0.0 : latencies[(std::min)(latencies.size() - 1, (size_t)(p * latencies.size()))];
+            };
+            fprintf(stderr, "%12.1f %11.1f %12.1f %20.2f %5.2f %5.2f\n", maxLatency, requestRate, latencies.size() / elapsed,
+                    statistics.numMinibatches > 0 ? (double) statistics.numRequests / statistics.numMinibatches : 0.0, percentile(0.5), percentile(0.99));
+        }
+    }
+}
+
 // process the command
 template <typename ElemType>
 void DoCommand(const ConfigParameters& configRoot)
 {
     ConfigArray command = configRoot("command", "train");
     ConfigParameters config = configRoot(command[0]);
+    std::string action = config("action", "eval");
+    if (action == "benchmark")
+    {
+        DoBenchmark<ElemType>(config);
+        return;
+    }
     ConfigParameters readerConfig(config("reader"));
     readerConfig.Insert("traceLevel", config("traceLevel", "0"));
 
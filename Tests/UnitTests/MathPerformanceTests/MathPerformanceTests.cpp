@@ -216,6 +216,34 @@ void MultiplyAndWeightedAddTest(int n, int k, int m)
     std::cout << "Matrix in: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
 }
 
+// float GEMM vs. the int8 GEMM used for quantized weights at inference (see CPUMatrix::QuantizeForMultiply()), A(n x k) * B(k x m)
+template <class ElemType>
+void QuantizedMultiplyTest(int n, int k, int m, int count)
+{
+    cout << "A(" << n << "x" << k << ") and B(" << k << "," << m << "), " << count << " times" << endl;
+    CPUMatrix<ElemType> A(n, k);
+    randomInitializeCPUMatrix<ElemType>(A, -1, 1);
+    CPUMatrix<ElemType> B(k, m);
+    randomInitializeCPUMatrix<ElemType>(B, -1, 1);
+    CPUMatrix<ElemType> C(n, m);
+    CPUMatrix<ElemType> CQ(n, m);
+
+    auto t_start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+        CPUMatrix<ElemType>::MultiplyAndWeightedAdd(1, A, false, B, false, 0, C);
+    double floatSeconds = chrono::duration<double>(chrono::steady_clock::now() - t_start).count();
+
+    A.QuantizeForMultiply(false, 1); // (once, as at model load)
+    t_start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+        CPUMatrix<ElemType>::MultiplyAndWeightedAdd(1, A, false, B, false, 0, CQ);
+    double int8Seconds = chrono::duration<double>(chrono::steady_clock::now() - t_start).count();
+
+    cout << "float GEMM in: " << floatSeconds / count * 1000 << " ms" << endl;
+    cout << "int8 GEMM in: " << int8Seconds / count * 1000 << " ms" << endl;
+    cout << "largest difference: " << CQ.AssignDifferenceOf(CQ, C).MatrixNormInf() << endl;
+}
+
 template <class ElemType>
 void AddMultiplyAndInplaceSigmoidTest(int n, int k, int m)
 {
@@ -443,6 +471,11 @@ int wmain()
 
     TestOldRnnForwardPropSRP<float>();
 
+    cout << endl << "********************Matrix QuantizedMultiply TEST********************" << endl;
+    QuantizedMultiplyTest<float>(1024, 1024, 1, 100);
+    QuantizedMultiplyTest<float>(1024, 1024, 64, 20);
+    QuantizedMultiplyTest<float>(4096, 1024, 256, 5);
+
     // MandSTest<float>(100, 2);
 
     /*cout<<endl<<"********************Matrix SquareMultiplyAndWeightedAdd10TimesAvg TEST********************"<<endl;
@@ -898,6 +898,230 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixSeedingDouble, RandomSeedFixture)
     BOOST_CHECK(m1.IsEqualTo(m2));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixLSTMCell, RandomSeedFixture)
+{
+    const size_t cellDim = 3;
+    const size_t numCols = 4;
+    const unsigned long seed = 4711;
+
+    DMatrix preActivations = DMatrix::RandomUniform(4 * cellDim, numCols, -1, 1, seed);
+    DMatrix bias = DMatrix::RandomUniform(4 * cellDim, 1, -1, 1, seed + 1);
+    DMatrix prevState = DMatrix::RandomUniform(2 * cellDim, numCols, -1, 1, seed + 2);
+    DMatrix stateGradient = DMatrix::RandomUniform(2 * cellDim, numCols, -1, 1, seed + 3);
+
+    // forward: compare against the unfused computation
+    DMatrix gates(preActivations);
+    DMatrix state;
+    DMatrix::LSTMCellForward(gates, bias, prevState, state);
+    BOOST_CHECK_EQUAL(state.GetNumRows(), 2 * cellDim);
+    BOOST_CHECK_EQUAL(state.GetNumCols(), numCols);
+
+    auto sigmoid = [](double z) { return 1 / (1 + exp(-z)); };
+    for (size_t j = 0; j < numCols; j++)
+    {
+        for (size_t k = 0; k < cellDim; k++)
+        {
+            double i = sigmoid(preActivations(k, j) + bias(k, 0));
+            double f = sigmoid(preActivations(cellDim + k, j) + bias(cellDim + k, 0));
+            double o = sigmoid(preActivations(2 * cellDim + k, j) + bias(2 * cellDim + k, 0));
+            double g = tanh(preActivations(3 * cellDim + k, j) + bias(3 * cellDim + k, 0));
+            double c = f * prevState(cellDim + k, j) + i * g;
+            BOOST_CHECK_CLOSE(state(cellDim + k, j), c, 1e-8);
+            BOOST_CHECK_CLOSE(state(k, j), o * tanh(c), 1e-8);
+            BOOST_CHECK_CLOSE(gates(k, j), i, 1e-8);
+            BOOST_CHECK_CLOSE(gates(3 * cellDim + k, j), g, 1e-8);
+        }
+    }
+
+    // backward: compare against finite differences of sum(stateGradient .* state)
+    DMatrix gatesGradient;
+    DMatrix prevCellGradient;
+    DMatrix::LSTMCellBackward(gates, prevState, state, stateGradient, gatesGradient, prevCellGradient);
+    BOOST_CHECK_EQUAL(gatesGradient.GetNumRows(), 4 * cellDim);
+    BOOST_CHECK_EQUAL(prevCellGradient.GetNumRows(), cellDim);
+
+    auto objective = [&](const DMatrix& pre, const DMatrix& prev)
+    {
+        DMatrix g(pre);
+        DMatrix s;
+        DMatrix::LSTMCellForward(g, bias, prev, s);
+        return DMatrix::InnerProductOfMatrices(s, stateGradient);
+    };
+    const double epsilon = 1e-6;
+    for (size_t j = 0; j < numCols; j++)
+    {
+        for (size_t k = 0; k < 4 * cellDim; k++)
+        {
+            DMatrix plus(preActivations), minus(preActivations);
+            plus(k, j) += epsilon;
+            minus(k, j) -= epsilon;
+            double numeric = (objective(plus, prevState) - objective(minus, prevState)) / (2 * epsilon);
+            BOOST_CHECK_SMALL(gatesGradient(k, j) - numeric, 1e-6);
+        }
+        for (size_t k = 0; k < cellDim; k++)
+        {
+            DMatrix plus(prevState), minus(prevState);
+            plus(cellDim + k, j) += epsilon;
+            minus(cellDim + k, j) -= epsilon;
+            double numeric = (objective(preActivations, plus) - objective(preActivations, minus)) / (2 * epsilon);
+            BOOST_CHECK_SMALL(prevCellGradient(k, j) - numeric, 1e-6);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixPackedMultiply, RandomSeedFixture)
+{
+    const unsigned long seed = 4711;
+    SMatrix a = SMatrix::RandomUniform(5, 7, -1, 1, seed);
+    SMatrix b = SMatrix::RandomUniform(7, 3, -1, 1, seed + 1);
+    SMatrix bT = SMatrix::RandomUniform(5, 3, -1, 1, seed + 2);
+
+    SMatrix expected, expectedT;
+    SMatrix::MultiplyAndWeightedAdd(1, a, false, b, false, 0, expected);
+    SMatrix::MultiplyAndWeightedAdd(1, a, true, bT, false, 0, expectedT);
+
+    // packing is optional (depends on the BLAS library), but results must not change either way
+    bool isPacked = a.PackForMultiply(false);
+    BOOST_CHECK_EQUAL(a.HasPackedCopy(), isPacked);
+    SMatrix c;
+    SMatrix::MultiplyAndWeightedAdd(1, a, false, b, false, 0, c);
+    BOOST_CHECK(c.IsEqualTo(expected, 1e-5f));
+    SMatrix::MultiplyAndWeightedAdd(1, a, false, b, false, 1, c); // accumulate into c
+    expected.AssignSumOf(expected, expected);
+    BOOST_CHECK(c.IsEqualTo(expected, 1e-5f));
+
+    // packed for the other transposition: must not be used for the non-transposed product and vice versa
+    a.PackForMultiply(true);
+    SMatrix::MultiplyAndWeightedAdd(1, a, true, bT, false, 0, c);
+    BOOST_CHECK(c.IsEqualTo(expectedT, 1e-5f));
+
+    // overwriting the matrix drops the packed copy
+    a.SetValue(2);
+    BOOST_CHECK(!a.HasPackedCopy());
+    SMatrix::MultiplyAndWeightedAdd(1, a, true, bT, false, 0, c);
+    BOOST_CHECK_CLOSE(c(0, 0), 2 * (bT(0, 0) + bT(1, 0) + bT(2, 0) + bT(3, 0) + bT(4, 0)), 1e-3f);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixQuantizedMultiply, RandomSeedFixture)
+{
+    const unsigned long seed = 4711;
+    SMatrix a = SMatrix::RandomUniform(16, 64, -1, 1, seed);
+    SMatrix b = SMatrix::RandomUniform(64, 8, -1, 1, seed + 1);
+    SMatrix bT = SMatrix::RandomUniform(8, 64, -1, 1, seed + 2);
+
+    SMatrix expected, expectedT;
+    SMatrix::MultiplyAndWeightedAdd(1, a, false, b, false, 0, expected);
+    SMatrix::MultiplyAndWeightedAdd(1, a, false, bT, true, 0, expectedT);
+
+    // int8 products are approximate; with k = 64 and values in [-1, 1] the error stays well below 0.1
+    a.QuantizeForMultiply(false, 1);
+    BOOST_CHECK(a.HasQuantizedCopy());
+    SMatrix c, cT;
+    SMatrix::MultiplyAndWeightedAdd(1, a, false, b, false, 0, c);
+    BOOST_CHECK(c.IsEqualTo(expected, 0.1f));
+    BOOST_CHECK(!c.IsEqualTo(expected, 1e-6f)); // make sure the quantized path was taken
+    SMatrix::MultiplyAndWeightedAdd(1, a, false, bT, true, 0, cT);
+    BOOST_CHECK(cT.IsEqualTo(expectedT, 0.1f));
+
+    // range 0: the right operand is scaled per column; alpha and beta apply as usual
+    a.QuantizeForMultiply(false, 0);
+    SMatrix::MultiplyAndWeightedAdd(1, a, false, b, false, 0, c);
+    SMatrix::MultiplyAndWeightedAdd(2, a, false, b, false, 1, c);
+    expected.AssignProductOf(3, expected);
+    BOOST_CHECK(c.IsEqualTo(expected, 0.3f));
+
+    // quantized for the other transposition is not used; overwriting the matrix drops the copy
+    expected.AssignProductOf(1.0f / 3, expected);
+    a.QuantizeForMultiply(true, 1);
+    SMatrix::MultiplyAndWeightedAdd(1, a, false, b, false, 0, c);
+    BOOST_CHECK(c.IsEqualTo(expected, 1e-5f));
+    a.SetValue(0);
+    BOOST_CHECK(!a.HasQuantizedCopy());
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixRCRFForwardBackward, RandomSeedFixture)
+{
+    // two parallel sequences of 3 labels: [0, 4) in slot 0 and [1, 3) in slot 1; the other columns of slot 1 are gaps
+    const size_t numLabels = 3;
+    const size_t numParallelSequences = 2;
+    const size_t numTimeSteps = 4;
+    const unsigned long seed = 4711;
+    const std::vector<ParallelSequenceSpan> sequences = {{0, 0, 4}, {1, 1, 3}};
+    const int goldLabels[2][4] = {{2, 0, 0, 1}, {-1, 1, 2, -1}};
+
+    DMatrix posScores = DMatrix::RandomUniform(numLabels, numParallelSequences * numTimeSteps, -2, 2, seed);
+    DMatrix pairScores = DMatrix::RandomUniform(numLabels, numLabels, -1, 1, seed + 1);
+    DMatrix lbls(numLabels, numParallelSequences * numTimeSteps);
+    lbls.SetValue(0);
+    for (size_t s = 0; s < numParallelSequences; s++)
+        for (size_t t = 0; t < numTimeSteps; t++)
+            if (goldLabels[s][t] >= 0)
+                lbls(goldLabels[s][t], t * numParallelSequences + s) = 1;
+
+    DMatrix alpha, postprob;
+    double negLogLikelihood = DMatrix::RCRFForwardBackward(lbls, posScores, pairScores, numParallelSequences, sequences, alpha, postprob);
+
+    // compare against enumerating all label paths; the gold label of the first frame is the start state
+    double expected = 0;
+    DMatrix expectedPostprob(lbls);
+    for (const auto& sequence : sequences)
+    {
+        const size_t length = sequence.tEnd - sequence.tBegin;
+        auto column = [&](size_t t) { return (sequence.tBegin + t) * numParallelSequences + sequence.s; };
+        auto gold = [&](size_t t) { return goldLabels[sequence.s][sequence.tBegin + t]; };
+        double logZ = -1e30;
+        std::vector<double> pathScores;
+        std::vector<std::vector<int>> paths;
+        std::vector<int> path(length, 0);
+        for (;;)
+        {
+            double score = pairScores(path[0], gold(0));
+            for (size_t t = 0; t < length; t++)
+                score += posScores(path[t], column(t)) + (t > 0 ? pairScores(path[t], path[t - 1]) : 0);
+            logZ = (std::max)(logZ, score) + log(1 + exp(-fabs(logZ - score)));
+            pathScores.push_back(score);
+            paths.push_back(path);
+            size_t t = 0;
+            while (t < length && ++path[t] == (int) numLabels)
+                path[t++] = 0;
+            if (t == length)
+                break;
+        }
+        double goldScore = pairScores(gold(0), gold(0));
+        for (size_t t = 0; t < length; t++)
+            goldScore += posScores(gold(t), column(t)) + (t > 0 ? pairScores(gold(t), gold(t - 1)) : 0);
+        expected += logZ - goldScore;
+
+        for (size_t t = 0; t < length; t++)
+        {
+            for (size_t k = 0; k < numLabels; k++)
+                expectedPostprob(k, column(t)) = 0;
+            for (size_t n = 0; n < paths.size(); n++)
+                expectedPostprob(paths[n][t], column(t)) += exp(pathScores[n] - logZ);
+        }
+    }
+    BOOST_CHECK_CLOSE(negLogLikelihood, expected, 1e-8);
+    BOOST_CHECK(postprob.IsEqualTo(expectedPostprob, 1e-10));
+
+    // transition gradient: compare against finite differences
+    DMatrix gradient(numLabels, numLabels);
+    gradient.SetValue(0);
+    DMatrix::RCRFTransGrdAccumulate(lbls, alpha, postprob, pairScores, numParallelSequences, sequences, 2, gradient);
+    const double epsilon = 1e-6;
+    for (size_t i = 0; i < numLabels; i++)
+    {
+        for (size_t j = 0; j < numLabels; j++)
+        {
+            DMatrix plus(pairScores), minus(pairScores), a, p;
+            plus(j, i) += epsilon;
+            minus(j, i) -= epsilon;
+            double numeric = (DMatrix::RCRFForwardBackward(lbls, posScores, plus, numParallelSequences, sequences, a, p) -
+                              DMatrix::RCRFForwardBackward(lbls, posScores, minus, numParallelSequences, sequences, a, p)) / (2 * epsilon);
+            BOOST_CHECK_SMALL(gradient(j, i) - 2 * numeric, 1e-6);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
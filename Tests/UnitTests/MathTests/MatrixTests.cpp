@@ -6,6 +6,7 @@
 #include "../../../Source/Math/Matrix.h"
 #include "../../../Source/Math/CPUMatrix.h"
 #include "../../../Source/Math/Helpers.h"
+#include "../../../Source/Math/ScratchArena.h"
 
 #define IDX2C(i, j, ld) (((j) * (ld)) + (i)) // 0 based indexing
 
@@ -1101,6 +1102,36 @@ BOOST_FIXTURE_TEST_CASE(MatrixAssignNumOfDiff, RandomSeedFixture)
         BOOST_CHECK_EQUAL(expectedDiff, actual.Get00Element());
     }
 }
+
+BOOST_FIXTURE_TEST_CASE(MatrixScratchArena, RandomSeedFixture)
+{
+    auto& arena = ScratchArena<float>::ForCurrentThread();
+    float* buffer;
+    {
+        auto temp = arena.Take(CPUDEVICE, L"Test");
+        temp->Resize(10, 20);
+        buffer = temp->BufferPointer();
+    }
+    {
+        // a temporary that fits reuses the memory of the one given back
+        auto temp = arena.Take(CPUDEVICE, L"Test");
+        temp->Resize(5, 20);
+        BOOST_CHECK_EQUAL(buffer, temp->BufferPointer());
+
+        // one taken at the same time does not
+        auto temp2 = arena.Take(CPUDEVICE, L"Test");
+        temp2->Resize(5, 20);
+        BOOST_CHECK(buffer != temp2->BufferPointer());
+    }
+    arena.BeginMinibatch();
+    {
+        // temporaries must not be held across minibatches
+        auto temp = arena.Take(CPUDEVICE, L"Test");
+        BOOST_CHECK_THROW(arena.BeginMinibatch(), std::logic_error);
+    }
+    ScratchArena<float>::ReleaseMemoryOfAllThreads();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
@@ -0,0 +1,81 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// two independent branches that both read the features, a recurrent one and a feed-forward one:
+//   h1(t) = tanh(W1 * x(t) + R1 * h1(t-1));  h2 = sigmoid(W2 * x + b2)
+//   out = Wo1 * h1 + Wo2 * h2;  ce = SquareError(out, labels)
+static ComputationNetworkPtr CreateTwoBranchTestNetwork(size_t inputDim, size_t hiddenDim, size_t outputDim)
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<float> builder(*net);
+
+    auto features = builder.CreateInputNode(L"features", inputDim);
+    auto labels = builder.CreateInputNode(L"labels", outputDim);
+    auto prevH1 = builder.PastValue(nullptr, 0.0f, hiddenDim, 1, L"h1_prev");
+    auto h1 = builder.Tanh(builder.Plus(builder.Times(builder.CreateLearnableParameter(L"W1", hiddenDim, inputDim), features, L"W1_x"),
+                                        builder.Times(builder.CreateLearnableParameter(L"R1", hiddenDim, hiddenDim), prevH1, L"R1_h"), L"z1"),
+                           L"h1");
+    prevH1->AttachInputs(h1);
+    auto h2 = builder.Sigmoid(builder.Plus(builder.Times(builder.CreateLearnableParameter(L"W2", hiddenDim, inputDim), features, L"W2_x"),
+                                           builder.CreateLearnableParameter(L"b2", hiddenDim, 1), L"z2"),
+                              L"h2");
+    auto out = builder.Plus(builder.Times(builder.CreateLearnableParameter(L"Wo1", outputDim, hiddenDim), h1, L"Wo1_h1"),
+                            builder.Times(builder.CreateLearnableParameter(L"Wo2", outputDim, hiddenDim), h2, L"Wo2_h2"), L"out");
+    net->FeatureNodes().push_back(features);
+    net->LabelNodes().push_back(labels);
+    net->OutputNodes().push_back(out);
+    net->FinalCriterionNodes().push_back(builder.SquareError(labels, out, L"ce"));
+
+    net->CompileNetwork();
+    return net;
+}
+
+BOOST_AUTO_TEST_SUITE(ConcurrentNodeExecutionSuite)
+
+// The branches run at the same time and both read the features, whose gaps they would otherwise mask in place.
+// Results agree with serial execution up to rounding.
+BOOST_AUTO_TEST_CASE(ConcurrentExecutionMatchesSerialExecution)
+{
+    static const wchar_t* const parameterNames[] = {L"W1", L"R1", L"W2", L"b2", L"Wo1", L"Wo2"};
+    // minibatches with gaps at different positions
+    const std::vector<std::vector<size_t>> minibatches{{6, 3, 4}, {2, 5}, {4, 4, 1, 3}};
+
+    // outputs, criterion and gradients of each minibatch
+    auto run = [&minibatches](ComputationNetwork& net)
+    {
+        std::vector<std::vector<float>> results;
+        InitTestParameters(net, 1);
+        PrepareTestNetwork(net, true);
+        for (size_t i = 0; i < minibatches.size(); i++)
+        {
+            SetTestMinibatch(net, CreateTestLayout(minibatches[i]), 2 + (unsigned long) i);
+            ForwardTestNetwork(net);
+            net.Backprop(net.FinalCriterionNodes()[0]);
+            results.push_back(GetValidFrames(net.GetNodeFromName(L"out")));
+            results.push_back(GetValidFrames(net.GetNodeFromName(L"ce")));
+            for (const auto& name : parameterNames)
+                results.push_back(GetGradient(net.GetNodeFromName(name)));
+        }
+        return results;
+    };
+
+    // A network decides on concurrent execution when it allocates its matrices and runs its first minibatch.
+    auto serialResults = run(*CreateTwoBranchTestNetwork(3, 4, 2));
+    ComputationNetwork::SetConcurrentNodeExecution(2, 1);
+    auto concurrentResults = run(*CreateTwoBranchTestNetwork(3, 4, 2));
+    ComputationNetwork::SetConcurrentNodeExecution(0, 0);
+
+    BOOST_REQUIRE_EQUAL(serialResults.size(), concurrentResults.size());
+    for (size_t i = 0; i < serialResults.size(); i++)
+        CheckEqualValues(serialResults[i], concurrentResults[i]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
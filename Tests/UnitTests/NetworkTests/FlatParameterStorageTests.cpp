@@ -0,0 +1,84 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "FlatParameterStorage.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(FlatParameterStorageSuite)
+
+static const float TestLearningRate = 0.1f;
+
+// plain SGD, either on each parameter, or on the buffers of 'flatStorage' as SGD does with flatParameterStorage
+static void TrainTestNetwork(ComputationNetwork& net, FlatParameterStorage<float>* flatStorage, size_t numMinibatches)
+{
+    const auto& learnableNodes = net.LearnableParameterNodes(net.FinalCriterionNodes()[0]);
+    std::list<Matrix<float>> smoothedGradients;
+    for (const auto& node : learnableNodes)
+    {
+        const auto& value = node->As<ComputationNode<float>>()->Value();
+        smoothedGradients.emplace_back(value.GetNumRows(), value.GetNumCols(), CPUDEVICE);
+        smoothedGradients.back().SetValue(0);
+    }
+
+    for (size_t i = 0; i < numMinibatches; i++)
+    {
+        SetTestMinibatch(net, CreateTestLayout({5, 3, 4}), 10 + (unsigned long) i);
+        ForwardTestNetwork(net);
+        net.Backprop(net.FinalCriterionNodes()[0]);
+
+        if (flatStorage)
+        {
+            flatStorage->Update(learnableNodes, smoothedGradients, 1, CPUDEVICE, 0);
+            BOOST_REQUIRE_EQUAL(flatStorage->Nodes().size(), learnableNodes.size());
+            Matrix<float>::ScaleAndAdd(-TestLearningRate, flatStorage->Gradients(), flatStorage->Values());
+        }
+        else
+        {
+            for (const auto& node : learnableNodes)
+            {
+                auto parameter = node->As<ComputationNode<float>>();
+                Matrix<float>::ScaleAndAdd(-TestLearningRate, parameter->Gradient(), parameter->Value());
+            }
+        }
+        for (const auto& node : learnableNodes)
+            node->BumpEvalTimeStamp();
+    }
+}
+
+// The gradients in the buffer must not be shared through the matrix pool with the values of other nodes,
+// which would write their outputs into the buffer in the next forward pass.
+BOOST_AUTO_TEST_CASE(TrainingWithFlatStorageEqualsTrainingPerParameter)
+{
+    auto reference = CreateRecurrentTestNetwork(3, 4, 2);
+    auto flat = CreateRecurrentTestNetwork(3, 4, 2);
+    for (const auto& net : {reference, flat})
+    {
+        InitTestParameters(*net, 1);
+        PrepareTestNetwork(*net, true);
+    }
+
+    FlatParameterStorage<float> flatStorage;
+    TrainTestNetwork(*reference, nullptr, 4);
+    TrainTestNetwork(*flat, &flatStorage, 4);
+
+    for (const auto& node : flatStorage.Nodes())
+    {
+        const auto* gradient = &node->As<ComputationNode<float>>()->Gradient();
+        for (const auto& other : flat->GetAllNodes())
+            BOOST_CHECK(&other->As<ComputationNode<float>>()->Value() != gradient);
+    }
+
+    for (const auto& name : {L"Wx", L"R", L"b", L"Wo"})
+        CheckEqualValues(GetValidFrames(reference->GetNodeFromName(name)), GetValidFrames(flat->GetNodeFromName(name)));
+    CheckEqualValues(GetValidFrames(reference->GetNodeFromName(L"out")), GetValidFrames(flat->GetNodeFromName(L"out")));
+
+    flatStorage.Release();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
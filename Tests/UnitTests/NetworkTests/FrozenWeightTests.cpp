@@ -0,0 +1,88 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(FrozenWeightSuite)
+
+// Frozen weights are packed for the GEMM by StartEvaluateMinibatchLoop() if the BLAS library supports it.
+// An in-place write must not leave the product with a stale packed copy.
+BOOST_AUTO_TEST_CASE(InPlaceWeightUpdateInvalidatesPackedCopy)
+{
+    auto reference = CreateFeedForwardTestNetwork(3, 4, 2);
+    auto frozen = CreateFeedForwardTestNetwork(3, 4, 2);
+    frozen->GetNodeFromName(L"W")->SetParameterUpdateRequired(false);
+
+    std::vector<ComputationNetworkPtr> nets{reference, frozen};
+    for (auto& net : nets)
+    {
+        InitTestParameters(*net, 1);
+        PrepareTestNetwork(*net, false);
+        SetTestMinibatch(*net, CreateTestLayout({4, 2}), 2);
+        ForwardTestNetwork(*net);
+    }
+    CheckEqualValues(GetValidFrames(reference->GetNodeFromName(L"out")), GetValidFrames(frozen->GetNodeFromName(L"out")));
+
+    // scale W in place, and evaluate the next minibatch without calling StartEvaluateMinibatchLoop() again
+    for (auto& net : nets)
+    {
+        Matrix<float>::Scale(2.0f, net->GetNodeFromName(L"W")->As<ComputationNode<float>>()->Value());
+        SetTestMinibatch(*net, CreateTestLayout({3, 5}), 3);
+        ForwardTestNetwork(*net);
+    }
+    CheckEqualValues(GetValidFrames(reference->GetNodeFromName(L"out")), GetValidFrames(frozen->GetNodeFromName(L"out")));
+}
+
+// A model loaded for evaluation (see CNTKEval::LoadModel()) is saved with its parameters marked as trained. PrepareForInference()
+// must freeze them, so that the weight products multiply with int8 copies if quantization ranges are given, and otherwise with packed
+// copies if the BLAS library supports them.
+BOOST_AUTO_TEST_CASE(ModelLoadedForInferenceUsesCopiesOfWeights)
+{
+    const std::wstring modelPath = L"FrozenWeightTests.dnn";
+    const std::wstring rangesPath = L"FrozenWeightTests.ranges";
+    auto trained = CreateFeedForwardTestNetwork(3, 4, 2);
+    InitTestParameters(*trained, 1);
+    trained->Save(modelPath);
+    trained->SaveQuantizationRanges(rangesPath); // not calibrated, so the input ranges are taken from the data
+
+    PrepareTestNetwork(*trained, false);
+    SetTestMinibatch(*trained, CreateTestLayout({4, 2}), 2);
+    ForwardTestNetwork(*trained);
+    BOOST_CHECK(trained->GetNodeFromName(L"W")->IsParameterUpdateRequired());
+    BOOST_CHECK(!trained->GetNodeFromName(L"W")->As<ComputationNode<float>>()->Value().HasPackedCopy());
+
+    Matrix<float> probe(2, 2, CPUDEVICE);
+    probe.SetValue(1.0f);
+    const bool canPack = probe.PackForMultiply(false);
+
+    for (const auto& quantizationRangesPath : {std::wstring(), rangesPath})
+    {
+        const bool quantized = !quantizationRangesPath.empty();
+        auto net = ComputationNetwork::CreateFromFile<float>(CPUDEVICE, modelPath);
+        net->PrepareForInference(quantizationRangesPath);
+        PrepareTestNetwork(*net, false);
+        SetTestMinibatch(*net, CreateTestLayout({4, 2}), 2);
+        ForwardTestNetwork(*net);
+
+        for (const auto& name : {L"W", L"b", L"Wo"})
+            BOOST_CHECK(!net->GetNodeFromName(name)->IsParameterUpdateRequired());
+        for (const auto& name : {L"W", L"Wo"}) // the left operands of the Times nodes "W_x" and "out"
+        {
+            const auto& weights = net->GetNodeFromName(name)->As<ComputationNode<float>>()->Value();
+            BOOST_CHECK_EQUAL(weights.HasQuantizedCopy(), quantized);
+            BOOST_CHECK_EQUAL(weights.HasPackedCopy(), !quantized && canPack);
+        }
+        CheckEqualValues(GetValidFrames(trained->GetNodeFromName(L"out")), GetValidFrames(net->GetNodeFromName(L"out")), quantized ? 5e-2f : 1e-5f);
+    }
+
+    _wunlink(modelPath.c_str());
+    _wunlink(rangesPath.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
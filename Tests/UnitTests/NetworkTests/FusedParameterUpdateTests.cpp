@@ -0,0 +1,199 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "SGD.h"
+#include "InputAndParamNodes.h"
+#include <cmath>
+#include <random>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t TestMBSize = 256;
+static const double TestLearnRatePerSample = 0.05;
+static const size_t TestNumMinibatches = 4;
+
+// SGD with access to both update paths of TrainOneEpoch()
+class FusedUpdateTestSGD : public SGD<float>
+{
+public:
+    FusedUpdateTestSGD(const ConfigParameters& config)
+        : SGD<float>(config)
+    {
+    }
+
+    using SGD<float>::AddToFusedUpdate;
+    using SGD<float>::UpdateWeightsFused;
+
+    // the regular update of one parameter, which calls UpdateWeightsS()
+    void UpdateParameter(const ComputationNodeBasePtr& node, Matrix<float>& smoothedGradient, double momentumPerSample)
+    {
+        UpdateWeights(node, smoothedGradient, TestLearnRatePerSample, momentumPerSample, TestMBSize,
+                      m_L2RegWeight, m_L1RegWeight, m_needAveMultiplier, m_useNesterovMomentum);
+    }
+};
+
+// parameters of different sizes; the first one spans several blocks of the fused update
+static std::vector<ComputationNodeBasePtr> CreateTestParameters()
+{
+    const std::vector<std::pair<size_t, size_t>> dims{{300, 120}, {7, 3}, {64, 1}, {1, 1}};
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(-0.1f, 0.1f);
+    std::vector<ComputationNodeBasePtr> parameters;
+    for (size_t k = 0; k < dims.size(); k++)
+    {
+        auto node = make_shared<LearnableParameter<float>>(CPUDEVICE, L"p" + std::to_wstring(k), dims[k].first, dims[k].second);
+        std::vector<float> values(dims[k].first * dims[k].second);
+        for (auto& value : values)
+            value = uniform(rng);
+        node->Value().SetValue(dims[k].first, dims[k].second, CPUDEVICE, values.data());
+        node->CreateGradientMatrixIfNull();
+        parameters.push_back(node);
+    }
+    return parameters;
+}
+
+static void SetTestGradients(const std::vector<ComputationNodeBasePtr>& parameters, unsigned long seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    for (const auto& node : parameters)
+    {
+        auto& gradient = node->As<ComputationNode<float>>()->Gradient();
+        std::vector<float> values(gradient.GetNumElements());
+        for (auto& value : values)
+            value = uniform(rng);
+        gradient.SetValue(gradient.GetNumRows(), gradient.GetNumCols(), CPUDEVICE, values.data());
+    }
+}
+
+static std::list<Matrix<float>> CreateSmoothedGradients(const std::vector<ComputationNodeBasePtr>& parameters)
+{
+    std::list<Matrix<float>> smoothedGradients;
+    for (const auto& node : parameters)
+    {
+        const auto& value = node->As<ComputationNode<float>>()->Value();
+        smoothedGradients.emplace_back(value.GetNumRows(), value.GetNumCols(), CPUDEVICE);
+        smoothedGradients.back().SetValue(0);
+    }
+    return smoothedGradients;
+}
+
+static std::vector<float> GetValues(const Matrix<float>& matrix)
+{
+    std::vector<float> values(matrix.GetNumElements());
+    matrix.CopySection(matrix.GetNumRows(), matrix.GetNumCols(), values.data(), matrix.GetNumRows());
+    return values;
+}
+
+// FSAdagradNextWeights() keeps a running average over all FSAdaGrad updates of the process, so that the fused and
+// the regular run would draw different weights; let the average settle at its fixed point for the test's minibatch size
+static void SettleFSAdaGradWeights()
+{
+    float adaWeight, adaMul, lastAdaMul = -1;
+    for (size_t i = 0; i < 1000000; i++)
+    {
+        Matrix<float>::FSAdagradNextWeights(TestMBSize, adaWeight, adaMul);
+        if (adaMul == lastAdaMul)
+            break;
+        lastAdaMul = adaMul;
+    }
+}
+
+// Train the same parameters with the same gradients for a few minibatches, once with UpdateWeightsS() for each
+// parameter and once with the fused update, as TrainOneEpoch() does with fusedParameterUpdate. 'sgdConfig' is in the
+// syntax of the SGD section. The weights and the smoothed gradients must agree after each minibatch.
+static void CheckFusedUpdateEqualsRegularUpdate(const std::string& sgdConfig)
+{
+    BOOST_TEST_MESSAGE(sgdConfig);
+    ConfigParameters config;
+    config.Parse("modelPath=FusedParameterUpdateTests.dnn\nmaxEpochs=1\nlearningRatesPerSample=0.05\n"
+                 "L2RegWeight=0.0001\nL1RegWeight=0.0001\n" + sgdConfig);
+    FusedUpdateTestSGD sgd(config);
+    const double momentumPerSample = pow(0.9, 1.0 / TestMBSize);
+
+    auto regular = CreateTestParameters();
+    auto fused = CreateTestParameters();
+    auto regularSmoothedGradients = CreateSmoothedGradients(regular);
+    auto fusedSmoothedGradients = CreateSmoothedGradients(fused);
+    SettleFSAdaGradWeights();
+
+    for (size_t i = 0; i < TestNumMinibatches; i++)
+    {
+        SetTestGradients(regular, 10 + (unsigned long) i);
+        SetTestGradients(fused, 10 + (unsigned long) i);
+
+        auto smoothedGradientIter = regularSmoothedGradients.begin();
+        for (const auto& node : regular)
+            sgd.UpdateParameter(node, *smoothedGradientIter++, momentumPerSample);
+
+        // FSAdaGrad and RmsProp initialize their smoothed gradients in the first regular update
+        bool anyFused = false;
+        smoothedGradientIter = fusedSmoothedGradients.begin();
+        for (const auto& node : fused)
+        {
+            Matrix<float>& smoothedGradient = *smoothedGradientIter++;
+            if (sgd.AddToFusedUpdate(node, smoothedGradient, TestMBSize))
+                anyFused = true;
+            else
+            {
+                BOOST_CHECK_EQUAL(i, 0);
+                sgd.UpdateParameter(node, smoothedGradient, momentumPerSample);
+            }
+        }
+        if (anyFused)
+            sgd.UpdateWeightsFused(TestLearnRatePerSample, momentumPerSample, TestMBSize);
+        BOOST_CHECK(anyFused || i == 0);
+
+        auto regularSmoothedGradientIter = regularSmoothedGradients.begin();
+        auto fusedSmoothedGradientIter = fusedSmoothedGradients.begin();
+        for (size_t k = 0; k < regular.size(); k++)
+        {
+            CheckEqualValues(GetValues(regular[k]->As<ComputationNode<float>>()->Value()), GetValues(fused[k]->As<ComputationNode<float>>()->Value()));
+            CheckEqualValues(GetValues(*regularSmoothedGradientIter++), GetValues(*fusedSmoothedGradientIter++));
+        }
+    }
+}
+
+// without clipping, with clipping of the gradient norm (which clips only the larger parameters), and with truncation
+static void CheckAllClippingModes(const std::string& sgdConfig)
+{
+    CheckFusedUpdateEqualsRegularUpdate(sgdConfig);
+    CheckFusedUpdateEqualsRegularUpdate(sgdConfig + "\nclippingThresholdPerSample=0.015625\ngradientClippingWithTruncation=false");
+    CheckFusedUpdateEqualsRegularUpdate(sgdConfig + "\nclippingThresholdPerSample=0.001953125\ngradientClippingWithTruncation=true");
+}
+
+BOOST_AUTO_TEST_SUITE(FusedParameterUpdateSuite)
+
+BOOST_AUTO_TEST_CASE(FusedMomentumEqualsRegularUpdate)
+{
+    CheckAllClippingModes("gradUpdateType=None");
+}
+
+BOOST_AUTO_TEST_CASE(FusedNesterovMomentumEqualsRegularUpdate)
+{
+    CheckAllClippingModes("gradUpdateType=None\nuseNAG=true");
+}
+
+BOOST_AUTO_TEST_CASE(FusedAdaGradEqualsRegularUpdate)
+{
+    CheckAllClippingModes("gradUpdateType=AdaGrad\nnormWithAveMultiplier=true");
+    CheckAllClippingModes("gradUpdateType=AdaGrad\nnormWithAveMultiplier=false");
+}
+
+BOOST_AUTO_TEST_CASE(FusedFSAdaGradEqualsRegularUpdate)
+{
+    CheckAllClippingModes("gradUpdateType=FSAdaGrad");
+}
+
+BOOST_AUTO_TEST_CASE(FusedRmsPropEqualsRegularUpdate)
+{
+    CheckAllClippingModes("gradUpdateType=RmsProp\nnormWithAveMultiplier=true");
+    CheckAllClippingModes("gradUpdateType=RmsProp\nnormWithAveMultiplier=false");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,70 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "InputAndParamNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// out = Wo * sigmoid((A * W) * features + b), where (A * W) does not depend on the minibatch and is folded into a constant
+static ComputationNetworkPtr CreateFoldableTestNetwork(size_t inputDim, size_t hiddenDim, size_t outputDim)
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<float> builder(*net);
+
+    auto features = builder.CreateInputNode(L"features", inputDim);
+    auto labels = builder.CreateInputNode(L"labels", outputDim);
+    auto AW = builder.Times(builder.CreateLearnableParameter(L"A", hiddenDim, hiddenDim), builder.CreateLearnableParameter(L"W", hiddenDim, inputDim), L"AW");
+    auto z = builder.Plus(builder.Times(AW, features, L"AW_x"), builder.CreateLearnableParameter(L"b", hiddenDim, 1), L"z");
+    auto out = builder.Times(builder.CreateLearnableParameter(L"Wo", outputDim, hiddenDim), builder.Sigmoid(z, L"h"), L"out");
+    net->FeatureNodes().push_back(features);
+    net->LabelNodes().push_back(labels);
+    net->OutputNodes().push_back(out);
+    net->FinalCriterionNodes().push_back(builder.SquareError(labels, out, L"ce"));
+
+    net->CompileNetwork();
+    return net;
+}
+
+BOOST_AUTO_TEST_SUITE(GraphOptimizationSuite)
+
+BOOST_AUTO_TEST_CASE(FoldedConstantsEqualSubgraphOutputs)
+{
+    auto reference = CreateFoldableTestNetwork(3, 4, 2);
+    auto optimized = CreateFoldableTestNetwork(3, 4, 2);
+    InitTestParameters(*reference, 1);
+    InitTestParameters(*optimized, 1);
+
+    // folding evaluates the subgraph, so the parameters must have their values before the network is compiled again
+    optimized->EnableGraphOptimization(true);
+    optimized->CompileNetwork();
+
+    BOOST_CHECK(!optimized->NodeNameExists(L"A"));
+    BOOST_CHECK(!optimized->NodeNameExists(L"W"));
+    auto folded = optimized->GetNodeFromName(L"AW");
+    BOOST_REQUIRE(folded->OperationName() == OperationNameOf(LearnableParameter));
+    BOOST_CHECK(!folded->IsParameterUpdateRequired());
+
+    Matrix<float> expected(CPUDEVICE);
+    Matrix<float>::Multiply(reference->GetNodeFromName(L"A")->As<ComputationNode<float>>()->Value(), false,
+                            reference->GetNodeFromName(L"W")->As<ComputationNode<float>>()->Value(), false, expected);
+    std::vector<float> expectedValues(expected.GetNumElements());
+    expected.CopySection(expected.GetNumRows(), expected.GetNumCols(), expectedValues.data(), expected.GetNumRows());
+    CheckEqualValues(GetValidFrames(folded), expectedValues);
+
+    std::vector<ComputationNetworkPtr> nets{reference, optimized};
+    for (auto& net : nets)
+    {
+        PrepareTestNetwork(*net, false);
+        SetTestMinibatch(*net, CreateTestLayout({5, 3}), 2);
+        ForwardTestNetwork(*net);
+    }
+    CheckEqualValues(GetValidFrames(reference->GetNodeFromName(L"out")), GetValidFrames(optimized->GetNodeFromName(L"out")));
+    CheckEqualValues(GetValidFrames(reference->GetNodeFromName(L"ce")), GetValidFrames(optimized->GetNodeFromName(L"ce")));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
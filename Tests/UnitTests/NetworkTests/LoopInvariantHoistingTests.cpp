@@ -0,0 +1,50 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(LoopInvariantHoistingSuite)
+
+BOOST_AUTO_TEST_CASE(HoistingIsOffByDefault)
+{
+    auto net = CreateRecurrentTestNetwork(3, 4, 2);
+    BOOST_CHECK(net->NodeNameExists(L"R_h_b"));
+    BOOST_CHECK(net->GetNodeFromName(L"R_h_b")->IsPartOfLoop());
+}
+
+BOOST_AUTO_TEST_CASE(HoistedLoopComputesSameOutputsAndGradients)
+{
+    auto reference = CreateRecurrentTestNetwork(3, 4, 2);
+    auto hoisted = CreateRecurrentTestNetwork(3, 4, 2);
+    hoisted->EnableLoopInvariantHoisting(true);
+    hoisted->CompileNetwork();
+
+    // (R h + b) was turned into (Wx x + b), which is no longer part of the loop and got a new name
+    BOOST_CHECK(!hoisted->NodeNameExists(L"R_h_b"));
+    BOOST_REQUIRE(hoisted->NodeNameExists(L"R_h_b.hoisted"));
+    BOOST_CHECK(!hoisted->GetNodeFromName(L"R_h_b.hoisted")->IsPartOfLoop());
+    BOOST_CHECK(hoisted->GetNodeFromName(L"z")->IsPartOfLoop());
+
+    std::vector<ComputationNetworkPtr> nets{reference, hoisted};
+    for (auto& net : nets)
+    {
+        InitTestParameters(*net, 1);
+        PrepareTestNetwork(*net, true);
+        SetTestMinibatch(*net, CreateTestLayout({7, 4, 5}), 2);
+        ForwardTestNetwork(*net);
+        net->Backprop(net->FinalCriterionNodes()[0]);
+    }
+
+    CheckEqualValues(GetValidFrames(reference->GetNodeFromName(L"out")), GetValidFrames(hoisted->GetNodeFromName(L"out")));
+    CheckEqualValues(GetValidFrames(reference->GetNodeFromName(L"ce")), GetValidFrames(hoisted->GetNodeFromName(L"ce")));
+    for (const auto& name : {L"Wx", L"R", L"b", L"Wo"})
+        CheckEqualValues(GetGradient(reference->GetNodeFromName(name)), GetGradient(hoisted->GetNodeFromName(name)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
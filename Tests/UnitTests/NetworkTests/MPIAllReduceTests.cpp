@@ -0,0 +1,84 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// These tests compare the all-reduce algorithms of MPIWrapper with MPI_Allreduce(). In a single process they only check
+// that nothing is changed; run them with several ranks, e.g.
+//   mpiexec -n 4 NetworkTests --run_test=MPIAllReduceSuite
+//
+#include "stdafx.h"
+#include "MPIWrapper.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// MPIWrapper is a singleton that finalizes MPI when it goes away, so all tests share one
+static MPIWrapper& GetTestMPIWrapper()
+{
+    static MPIWrapper mpi;
+    return mpi;
+}
+
+// values that differ between ranks; small integers, so that the sums do not depend on the order of the additions
+static std::vector<float> RankValues(size_t n, size_t rank)
+{
+    std::vector<float> values(n);
+    for (size_t i = 0; i < n; i++)
+        values[i] = (float) ((i * 7 + rank * 13) % 101) - 50;
+    return values;
+}
+
+// all-reduce buffers of various sizes with 'algorithm' and compare with MPI_Allreduce()
+static void CheckAllReduceAlgorithm(MPIAllReduceAlgorithm algorithm)
+{
+    auto& mpi = GetTestMPIWrapper();
+    const size_t chunkBytes = 16; // 4 floats, so that all but the smallest buffers take the ring, in several chunks
+    mpi.SetAllReduceAlgorithm(algorithm, chunkBytes);
+    BOOST_REQUIRE(mpi.GetAllReduceAlgorithm() == algorithm);
+
+    // smaller than a chunk, fewer elements than ranks, not divisible by the number of ranks, many chunks per segment
+    for (size_t n : {1, 3, 4, 5, 17, 64, 1000, 4099})
+    {
+        auto values = RankValues(n, mpi.CurrentNodeRank());
+        auto expected = values;
+        MPI_Allreduce(MPI_IN_PLACE, expected.data(), (int) n, MPI_FLOAT, MPI_SUM, mpi.Communicator()) || MpiFail("MPI_Allreduce");
+
+        mpi.AllReduce(values.data(), n);
+        BOOST_CHECK_MESSAGE(values == expected, "all-reduce of " << n << " elements differs from MPI_Allreduce");
+    }
+    mpi.SetAllReduceAlgorithm(MPIAllReduceAlgorithm::Native, chunkBytes);
+}
+
+BOOST_AUTO_TEST_SUITE(MPIAllReduceSuite)
+
+BOOST_AUTO_TEST_CASE(RingAllReduceEqualsMPIAllreduce)
+{
+    CheckAllReduceAlgorithm(MPIAllReduceAlgorithm::Ring);
+}
+
+BOOST_AUTO_TEST_CASE(HierarchicalAllReduceEqualsMPIAllreduce)
+{
+    CheckAllReduceAlgorithm(MPIAllReduceAlgorithm::Hierarchical);
+}
+
+// the hierarchical algorithm runs the ring among the first ranks of each host, which needs several hosts; split the ranks instead
+BOOST_AUTO_TEST_CASE(RingAllReduceOnSubCommunicatorEqualsMPIAllreduce)
+{
+    auto& mpi = GetTestMPIWrapper();
+    MPI_Comm comm;
+    MPI_Comm_split(mpi.Communicator(), (int) (mpi.CurrentNodeRank() % 2), (int) mpi.CurrentNodeRank(), &comm) || MpiFail("MPI_Comm_split");
+    for (size_t n : {1, 5, 4099})
+    {
+        auto values = RankValues(n, mpi.CurrentNodeRank());
+        auto expected = values;
+        MPI_Allreduce(MPI_IN_PLACE, expected.data(), (int) n, MPI_FLOAT, MPI_SUM, comm) || MpiFail("MPI_Allreduce");
+
+        mpi.RingAllReduce(values.data(), n, comm);
+        BOOST_CHECK_MESSAGE(values == expected, "ring all-reduce of " << n << " elements differs from MPI_Allreduce");
+    }
+    MPI_Comm_free(&comm);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
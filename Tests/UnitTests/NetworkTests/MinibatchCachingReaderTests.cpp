@@ -0,0 +1,170 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "MinibatchCachingReader.h"
+#include <random>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// a deterministic reader of 'numMinibatches' minibatches per epoch, with a dense input "features" and a sparse input "labels"
+// whose values depend on the epoch; it counts the minibatches it was asked for
+class TestReader : public IDataReader<float>
+{
+    size_t m_epoch;
+    size_t m_numMinibatches;
+    size_t m_nextMinibatch;
+    MBLayoutPtr m_pMBLayout;
+
+public:
+    size_t m_numMinibatchesRead;
+
+    TestReader(size_t numMinibatches)
+        : m_epoch(0), m_numMinibatches(numMinibatches), m_nextMinibatch(0), m_numMinibatchesRead(0)
+    {
+    }
+
+    virtual void Init(const ConfigParameters&) override
+    {
+    }
+    virtual void Init(const ScriptableObjects::IConfigRecord&) override
+    {
+    }
+    virtual void Destroy() override
+    {
+    }
+    virtual void StartMinibatchLoop(size_t, size_t epoch, size_t) override
+    {
+        m_epoch = epoch;
+        m_nextMinibatch = 0;
+    }
+    virtual bool GetMinibatch(std::map<std::wstring, Matrix<float>*>& matrices) override
+    {
+        if (m_nextMinibatch >= m_numMinibatches)
+            return false;
+        const size_t i = m_nextMinibatch++;
+        m_numMinibatchesRead++;
+
+        // sequences of different lengths, so that the layouts differ between minibatches and have gaps
+        m_pMBLayout = CreateTestLayout({2 + i, 4, 1 + 2 * i});
+        const size_t numCols = m_pMBLayout->GetNumCols();
+        std::mt19937 rng((unsigned long) (100 * m_epoch + i));
+        std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+        std::vector<float> features(3 * numCols);
+        for (auto& value : features)
+            value = uniform(rng);
+        matrices[L"features"]->SetValue(3, numCols, matrices[L"features"]->GetDeviceId(), features.data());
+
+        std::vector<float> labels(2 * numCols, 0.0f); // one-hot
+        for (size_t j = 0; j < numCols; j++)
+            labels[2 * j + (rng() % 2)] = 1.0f;
+        Matrix<float> denseLabels(2, numCols, labels.data(), matrixFlagNormal, CPUDEVICE);
+        denseLabels.SwitchToMatrixType(SPARSE, matrixFormatSparseCSC, true);
+        matrices[L"labels"]->SetValue(denseLabels);
+        return true;
+    }
+    virtual void CopyMBLayoutTo(MBLayoutPtr pMBLayout) override
+    {
+        pMBLayout->CopyFrom(m_pMBLayout);
+    }
+    virtual size_t GetNumParallelSequences() override
+    {
+        return m_pMBLayout->GetNumParallelSequences();
+    }
+};
+
+struct TestMinibatch
+{
+    std::vector<float> features;
+    std::vector<float> labels;
+    MBLayoutPtr pMBLayout;
+};
+
+static std::vector<float> GetDenseValues(const Matrix<float>& matrix)
+{
+    Matrix<float> dense(matrix, CPUDEVICE);
+    dense.SwitchToMatrixType(DENSE, matrixFormatDense, true);
+    std::vector<float> values(dense.GetNumElements());
+    if (!values.empty())
+        dense.CopySection(dense.GetNumRows(), dense.GetNumCols(), values.data(), dense.GetNumRows());
+    return values;
+}
+
+// read one epoch through 'reader' into matrices that live on 'deviceId'
+static std::vector<TestMinibatch> ReadTestEpoch(IDataReader<float>& reader, size_t epoch, DEVICEID_TYPE deviceId)
+{
+    Matrix<float> features(deviceId);
+    Matrix<float> labels(2, 1, deviceId, SPARSE, matrixFormatSparseCSC);
+    std::map<std::wstring, Matrix<float>*> matrices{{L"features", &features}, {L"labels", &labels}};
+
+    std::vector<TestMinibatch> minibatches;
+    reader.StartMinibatchLoop(16, epoch, requestDataSize);
+    while (reader.GetMinibatch(matrices))
+    {
+        BOOST_CHECK_EQUAL(features.GetDeviceId(), deviceId);
+        BOOST_CHECK_EQUAL(labels.GetDeviceId(), deviceId);
+        BOOST_CHECK(features.GetMatrixType() == DENSE);
+        BOOST_CHECK(labels.GetMatrixType() == SPARSE);
+
+        TestMinibatch minibatch;
+        minibatch.features = GetDenseValues(features);
+        minibatch.labels = GetDenseValues(labels);
+        minibatch.pMBLayout = make_shared<MBLayout>();
+        reader.CopyMBLayoutTo(minibatch.pMBLayout);
+        minibatches.push_back(std::move(minibatch));
+    }
+    return minibatches;
+}
+
+static void CheckEqualEpochs(const std::vector<TestMinibatch>& a, const std::vector<TestMinibatch>& b)
+{
+    BOOST_REQUIRE_EQUAL(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        BOOST_CHECK(a[i].features == b[i].features);
+        BOOST_CHECK(a[i].labels == b[i].labels);
+        BOOST_CHECK(*a[i].pMBLayout == *b[i].pMBLayout);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(MinibatchCachingReaderSuite)
+
+// A replayed epoch must give the same minibatches and layouts as the wrapped reader, in matrices that keep their device and type.
+BOOST_AUTO_TEST_CASE(ReplayedEpochEqualsReadEpoch)
+{
+    TestReader reference(4);
+    TestReader wrapped(4);
+    MinibatchCachingReader<float> cachingReader(&wrapped, 1048576);
+
+    auto expected = ReadTestEpoch(reference, 0, CPUDEVICE);
+    CheckEqualEpochs(expected, ReadTestEpoch(cachingReader, 0, CPUDEVICE)); // recorded
+    BOOST_CHECK(!cachingReader.IsReplaying());
+    CheckEqualEpochs(expected, ReadTestEpoch(cachingReader, 0, CPUDEVICE)); // replayed
+    BOOST_CHECK(cachingReader.IsReplaying());
+    BOOST_CHECK_EQUAL(wrapped.m_numMinibatchesRead, 4u);
+
+    // another epoch is read and recorded again
+    CheckEqualEpochs(ReadTestEpoch(reference, 1, CPUDEVICE), ReadTestEpoch(cachingReader, 1, CPUDEVICE));
+    BOOST_CHECK(!cachingReader.IsReplaying());
+    BOOST_CHECK_EQUAL(wrapped.m_numMinibatchesRead, 8u);
+}
+
+BOOST_AUTO_TEST_CASE(EpochLargerThanCacheIsNotReplayed)
+{
+    TestReader reference(4);
+    TestReader wrapped(4);
+    MinibatchCachingReader<float> cachingReader(&wrapped, 64);
+
+    auto expected = ReadTestEpoch(reference, 0, CPUDEVICE);
+    CheckEqualEpochs(expected, ReadTestEpoch(cachingReader, 0, CPUDEVICE));
+    CheckEqualEpochs(expected, ReadTestEpoch(cachingReader, 0, CPUDEVICE));
+    BOOST_CHECK(!cachingReader.IsReplaying());
+    BOOST_CHECK_EQUAL(wrapped.m_numMinibatchesRead, 8u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
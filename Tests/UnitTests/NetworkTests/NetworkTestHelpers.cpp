@@ -0,0 +1,182 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "MPIWrapper.h"
+#include "InputAndParamNodes.h"
+#include <random>
+#include <algorithm>
+
+// globals that are defined by the CNTK executable
+Microsoft::MSR::CNTK::MPIWrapper* g_mpi = nullptr;
+bool g_shareNodeValueMatrices = false;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+typedef shared_ptr<ComputationNode<float>> NodePtr;
+
+static std::vector<float> RandomValues(size_t n, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> uniform(-0.5f, 0.5f);
+    std::vector<float> values(n);
+    for (auto& value : values)
+        value = uniform(rng);
+    return values;
+}
+
+// add the output and the criterion on top of 'h'
+static void AddTestOutputs(ComputationNetwork& net, ComputationNetworkBuilder<float>& builder, const NodePtr& h, size_t hiddenDim, size_t outputDim)
+{
+    auto labels = builder.CreateInputNode(L"labels", outputDim);
+    auto out = builder.Times(builder.CreateLearnableParameter(L"Wo", outputDim, hiddenDim), h, L"out");
+    auto ce = builder.SquareError(labels, out, L"ce");
+    net.LabelNodes().push_back(labels);
+    net.OutputNodes().push_back(out);
+    net.FinalCriterionNodes().push_back(ce);
+}
+
+ComputationNetworkPtr CreateRecurrentTestNetwork(size_t inputDim, size_t hiddenDim, size_t outputDim, bool useLSTMCell)
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<float> builder(*net);
+
+    auto features = builder.CreateInputNode(L"features", inputDim);
+    net->FeatureNodes().push_back(features);
+    NodePtr h;
+    if (useLSTMCell)
+    {
+        auto prevState = builder.PastValue(nullptr, 0.0f, 2 * hiddenDim, 1, L"state_prev");
+        auto state = builder.LSTMCell(builder.CreateLearnableParameter(L"W", 4 * hiddenDim, inputDim + hiddenDim),
+                                      builder.CreateLearnableParameter(L"b", 4 * hiddenDim, 1), features, prevState, L"state");
+        prevState->AttachInputs(state);
+        h = builder.RowSlice(state, 0, hiddenDim, L"h");
+    }
+    else
+    {
+        auto prevH = builder.PastValue(nullptr, 0.0f, hiddenDim, 1, L"h_prev");
+        auto Wx = builder.Times(builder.CreateLearnableParameter(L"Wx", hiddenDim, inputDim), features, L"Wx_x");
+        auto Rh = builder.Times(builder.CreateLearnableParameter(L"R", hiddenDim, hiddenDim), prevH, L"R_h");
+        auto Rhb = builder.Plus(Rh, builder.CreateLearnableParameter(L"b", hiddenDim, 1), L"R_h_b");
+        h = builder.Tanh(builder.Plus(Wx, Rhb, L"z"), L"h");
+        prevH->AttachInputs(h);
+    }
+    AddTestOutputs(*net, builder, h, hiddenDim, outputDim);
+
+    net->CompileNetwork();
+    return net;
+}
+
+ComputationNetworkPtr CreateFeedForwardTestNetwork(size_t inputDim, size_t hiddenDim, size_t outputDim)
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<float> builder(*net);
+
+    auto features = builder.CreateInputNode(L"features", inputDim);
+    net->FeatureNodes().push_back(features);
+    auto z = builder.Plus(builder.Times(builder.CreateLearnableParameter(L"W", hiddenDim, inputDim), features, L"W_x"),
+                          builder.CreateLearnableParameter(L"b", hiddenDim, 1), L"z");
+    AddTestOutputs(*net, builder, builder.Sigmoid(z, L"h"), hiddenDim, outputDim);
+
+    net->CompileNetwork();
+    return net;
+}
+
+void InitTestParameters(ComputationNetwork& net, unsigned long seed)
+{
+    std::mt19937 rng(seed);
+    for (const auto& node : net.GetNodesWithType(OperationNameOf(LearnableParameter)))
+    {
+        auto& value = node->As<ComputationNode<float>>()->Value();
+        auto values = RandomValues(value.GetNumElements(), rng);
+        value.SetValue(value.GetNumRows(), value.GetNumCols(), CPUDEVICE, values.data());
+    }
+}
+
+MBLayoutPtr CreateTestLayout(const std::vector<size_t>& sequenceLengths)
+{
+    const size_t numTimeSteps = *std::max_element(sequenceLengths.begin(), sequenceLengths.end());
+    auto layout = make_shared<MBLayout>();
+    layout->Init(sequenceLengths.size(), numTimeSteps);
+    for (size_t s = 0; s < sequenceLengths.size(); s++)
+    {
+        layout->AddSequence(NEW_SEQUENCE_ID, s, 0, sequenceLengths[s]);
+        if (sequenceLengths[s] < numTimeSteps)
+            layout->AddGap(s, sequenceLengths[s], numTimeSteps);
+    }
+    return layout;
+}
+
+void SetTestMinibatch(ComputationNetwork& net, const MBLayoutPtr& layout, unsigned long seed)
+{
+    std::mt19937 rng(seed);
+    net.GetMBLayoutPtr()->CopyFrom(layout);
+    std::vector<ComputationNodeBasePtr> inputs = net.FeatureNodes();
+    inputs.insert(inputs.end(), net.LabelNodes().begin(), net.LabelNodes().end());
+    for (const auto& node : inputs)
+    {
+        const size_t rows = node->GetSampleMatrixNumRows();
+        auto values = RandomValues(rows * layout->GetNumCols(), rng);
+        node->As<ComputationNode<float>>()->Value().SetValue(rows, layout->GetNumCols(), CPUDEVICE, values.data());
+        node->NotifyFunctionValuesMBSizeModified();
+    }
+    ComputationNetwork::BumpEvalTimeStamp(inputs);
+}
+
+void PrepareTestNetwork(ComputationNetwork& net, bool withGradient)
+{
+    net.AllocateAllMatrices(net.OutputNodes(), {}, withGradient ? net.FinalCriterionNodes()[0] : nullptr);
+    net.StartEvaluateMinibatchLoop(net.OutputNodes(), net.FinalCriterionNodes());
+}
+
+void ForwardTestNetwork(ComputationNetwork& net)
+{
+    net.ForwardProp(net.OutputNodes());
+    net.ForwardProp(net.FinalCriterionNodes());
+}
+
+std::vector<float> GetValidFrames(const ComputationNodeBasePtr& node)
+{
+    const auto& value = node->As<ComputationNode<float>>()->Value();
+    const size_t rows = value.GetNumRows();
+    std::vector<float> all(value.GetNumElements());
+    if (!all.empty())
+        value.CopySection(rows, value.GetNumCols(), all.data(), rows);
+
+    auto layout = node->GetMBLayout();
+    if (!layout)
+        return all;
+    std::vector<float> frames;
+    for (size_t t = 0; t < layout->GetNumTimeSteps(); t++)
+    {
+        for (size_t s = 0; s < layout->GetNumParallelSequences(); s++)
+        {
+            if (layout->IsGap(FrameRange(layout, t).Sequence(s)))
+                continue;
+            const size_t j = t * layout->GetNumParallelSequences() + s;
+            frames.insert(frames.end(), all.begin() + j * rows, all.begin() + (j + 1) * rows);
+        }
+    }
+    return frames;
+}
+
+std::vector<float> GetGradient(const ComputationNodeBasePtr& node)
+{
+    const auto& gradient = node->As<ComputationNode<float>>()->Gradient();
+    std::vector<float> values(gradient.GetNumElements());
+    if (!values.empty())
+        gradient.CopySection(gradient.GetNumRows(), gradient.GetNumCols(), values.data(), gradient.GetNumRows());
+    return values;
+}
+
+void CheckEqualValues(const std::vector<float>& a, const std::vector<float>& b, float tolerance)
+{
+    BOOST_REQUIRE_EQUAL(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        const float scale = std::max(1.0f, std::max(fabs(a[i]), fabs(b[i])));
+        BOOST_CHECK_MESSAGE(fabs(a[i] - b[i]) <= tolerance * scale, "element " << i << ": " << a[i] << " != " << b[i]);
+    }
+}
+
+} } } }
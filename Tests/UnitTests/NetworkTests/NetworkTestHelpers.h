@@ -0,0 +1,58 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// NetworkTestHelpers.h -- small networks built in code, test minibatches, and comparison of results
+//
+// All test networks run on the CPU in single precision.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNetwork.h"
+#include "ComputationNetworkBuilder.h"
+#include "Sequences.h"
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// a recurrent network the way the network builders write it:
+//   z(t) = Wx * x(t) + (R * h(t-1) + b)      ("Wx_x", "R_h", "R_h_b", "z")
+//   h(t) = tanh(z(t))                        ("h", delayed as "h_prev")
+// or, if 'useLSTMCell', a fused LSTM cell:
+//   state(t) = LSTMCell(W, b, x(t), state(t-1))   ("state", delayed as "state_prev")
+//   h(t) = RowSlice(0, hiddenDim, state(t))   ("h")
+// followed in both cases by
+//   out = Wo * h;  ce = SquareError(out, labels)
+// Inputs are "features" and "labels"; "out" is an output node and "ce" the training criterion.
+ComputationNetworkPtr CreateRecurrentTestNetwork(size_t inputDim, size_t hiddenDim, size_t outputDim, bool useLSTMCell = false);
+
+// a feed-forward network: out = Wo * sigmoid(W * features + b);  ce = SquareError(out, labels)
+ComputationNetworkPtr CreateFeedForwardTestNetwork(size_t inputDim, size_t hiddenDim, size_t outputDim);
+
+// set all LearnableParameters to deterministic random values in [-0.5, 0.5]
+void InitTestParameters(ComputationNetwork& net, unsigned long seed);
+
+// layout of 'sequenceLengths.size()' parallel sequences that start in the first frame; shorter sequences are padded with gaps
+MBLayoutPtr CreateTestLayout(const std::vector<size_t>& sequenceLengths);
+
+// copy 'layout' into the network, and fill all feature and label nodes with deterministic random values, gaps included
+void SetTestMinibatch(ComputationNetwork& net, const MBLayoutPtr& layout, unsigned long seed);
+
+// allocate the matrices for computing the output nodes, and the gradients of the training criterion if 'withGradient'
+void PrepareTestNetwork(ComputationNetwork& net, bool withGradient);
+
+// forward the output and criterion nodes for the current minibatch
+void ForwardTestNetwork(ComputationNetwork& net);
+
+// the values of 'node' column by column, without the gap frames of its layout
+std::vector<float> GetValidFrames(const ComputationNodeBasePtr& node);
+
+// the gradient of a LearnableParameter
+std::vector<float> GetGradient(const ComputationNodeBasePtr& node);
+
+// check that two results agree to within 'tolerance', relative to the larger magnitude
+void CheckEqualValues(const std::vector<float>& a, const std::vector<float>& b, float tolerance = 1e-5f);
+
+} } } }
@@ -0,0 +1,67 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const Matrix<float>& GetValue(ComputationNetwork& net, const std::wstring& nodeName)
+{
+    return net.GetNodeFromName(nodeName)->As<ComputationNode<float>>()->Value();
+}
+
+// Copies made by CopySharingParameters(), as CNTKEval makes one per concurrent Evaluate() call, must use the parameter matrices
+// of the original, together with the int8 copies of the weights made for inference, and evaluate independently of each other.
+static void CheckCopiesShareParameters(bool useLSTMCell)
+{
+    auto net = CreateRecurrentTestNetwork(3, 4, 2, useLSTMCell);
+    InitTestParameters(*net, 1);
+    net->PrepareForInference();
+    net->QuantizeForInference();
+    const auto parameterNames = useLSTMCell ? std::vector<std::wstring>{L"W", L"b", L"Wo"} : std::vector<std::wstring>{L"Wx", L"R", L"b", L"Wo"};
+    const auto quantizedNames = useLSTMCell ? std::vector<std::wstring>{L"Wo"} : std::vector<std::wstring>{L"Wx", L"R", L"Wo"};
+
+    auto context1 = net->CopySharingParameters<float>();
+    auto context2 = net->CopySharingParameters<float>();
+    for (const auto& evaluated : {net, context1, context2})
+        PrepareTestNetwork(*evaluated, false);
+    for (const auto& name : parameterNames)
+    {
+        BOOST_CHECK_EQUAL(&GetValue(*context1, name), &GetValue(*net, name));
+        BOOST_CHECK_EQUAL(&GetValue(*context2, name), &GetValue(*net, name));
+        BOOST_CHECK(!context1->GetNodeFromName(name)->IsParameterUpdateRequired());
+    }
+
+    // two different minibatches at the same time
+    SetTestMinibatch(*context1, CreateTestLayout({4, 2}), 2);
+    SetTestMinibatch(*context2, CreateTestLayout({3, 5, 1}), 3);
+    ForwardTestNetwork(*context1);
+    ForwardTestNetwork(*context2);
+    for (const auto& name : quantizedNames)
+        BOOST_CHECK(GetValue(*net, name).HasQuantizedCopy());
+
+    SetTestMinibatch(*net, CreateTestLayout({4, 2}), 2);
+    ForwardTestNetwork(*net);
+    CheckEqualValues(GetValidFrames(net->GetNodeFromName(L"out")), GetValidFrames(context1->GetNodeFromName(L"out")));
+    SetTestMinibatch(*net, CreateTestLayout({3, 5, 1}), 3);
+    ForwardTestNetwork(*net);
+    CheckEqualValues(GetValidFrames(net->GetNodeFromName(L"out")), GetValidFrames(context2->GetNodeFromName(L"out")));
+}
+
+BOOST_AUTO_TEST_SUITE(ParameterSharingSuite)
+
+BOOST_AUTO_TEST_CASE(CopiesShareParameterStorage)
+{
+    CheckCopiesShareParameters(false);
+}
+
+BOOST_AUTO_TEST_CASE(LSTMCellCopiesShareParameterStorage)
+{
+    CheckCopiesShareParameters(true);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,155 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include <numeric>
+#include <random>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// frames of one sequence for each input node
+typedef std::map<std::wstring, std::vector<float>> TestSequence;
+
+static std::vector<ComputationNodeBasePtr> GetTestInputs(ComputationNetwork& net)
+{
+    std::vector<ComputationNodeBasePtr> inputs = net.FeatureNodes();
+    inputs.insert(inputs.end(), net.LabelNodes().begin(), net.LabelNodes().end());
+    return inputs;
+}
+
+static std::vector<TestSequence> CreateTestSequences(ComputationNetwork& net, const std::vector<size_t>& sequenceLengths, unsigned long seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(-0.5f, 0.5f);
+    std::vector<TestSequence> sequences;
+    for (size_t length : sequenceLengths)
+    {
+        TestSequence sequence;
+        for (const auto& node : GetTestInputs(net))
+        {
+            auto& frames = sequence[node->NodeName()];
+            frames.resize(node->GetSampleMatrixNumRows() * length);
+            for (auto& value : frames)
+                value = uniform(rng);
+        }
+        sequences.push_back(std::move(sequence));
+    }
+    return sequences;
+}
+
+// set the sequences as the parallel sequences of one minibatch, sequence s in parallel sequence s
+static void SetTestSequences(ComputationNetwork& net, const std::vector<TestSequence>& sequences, const std::vector<size_t>& sequenceLengths)
+{
+    auto layout = CreateTestLayout(sequenceLengths);
+    net.GetMBLayoutPtr()->CopyFrom(layout);
+    const auto inputs = GetTestInputs(net);
+    for (const auto& node : inputs)
+    {
+        const size_t rows = node->GetSampleMatrixNumRows();
+        std::vector<float> values(rows * layout->GetNumCols(), 0.0f);
+        for (size_t s = 0; s < sequences.size(); s++)
+        {
+            const auto& frames = sequences[s].at(node->NodeName());
+            for (size_t t = 0; t < sequenceLengths[s]; t++)
+                std::copy(frames.begin() + t * rows, frames.begin() + (t + 1) * rows, values.begin() + (t * sequences.size() + s) * rows);
+        }
+        node->As<ComputationNode<float>>()->Value().SetValue(rows, layout->GetNumCols(), CPUDEVICE, values.data());
+        node->NotifyFunctionValuesMBSizeModified();
+    }
+    ComputationNetwork::BumpEvalTimeStamp(inputs);
+}
+
+static void AddValues(std::vector<float>& sum, const std::vector<float>& values)
+{
+    if (sum.empty())
+        sum.assign(values.size(), 0.0f);
+    BOOST_REQUIRE_EQUAL(sum.size(), values.size());
+    for (size_t i = 0; i < values.size(); i++)
+        sum[i] += values[i];
+}
+
+// Evaluate sequences whose lengths leave trailing gaps (parallel sequences that a loop skips at the later time steps)
+// as one minibatch, and each sequence on its own, where nothing is skipped. The outputs must agree frame by frame,
+// the criterion and the gradients must be the sums over the sequences.
+static void CheckTrailingGapsAreSkippedExactly(bool useLSTMCell, const std::vector<size_t>& sequenceLengths)
+{
+    auto batched = CreateRecurrentTestNetwork(3, 4, 2, useLSTMCell);
+    auto single = CreateRecurrentTestNetwork(3, 4, 2, useLSTMCell);
+    for (const auto& net : {batched, single})
+    {
+        InitTestParameters(*net, 1);
+        PrepareTestNetwork(*net, true);
+    }
+    const auto parameterNames = useLSTMCell ? std::vector<std::wstring>{L"W", L"b", L"Wo"} : std::vector<std::wstring>{L"Wx", L"R", L"b", L"Wo"};
+    auto sequences = CreateTestSequences(*batched, sequenceLengths, 5);
+
+    SetTestSequences(*batched, sequences, sequenceLengths);
+    ForwardTestNetwork(*batched);
+    batched->Backprop(batched->FinalCriterionNodes()[0]);
+
+    // outputs of the batch, per sequence; GetValidFrames() returns the frames of time step t of all sequences before those of t + 1
+    std::vector<std::vector<float>> batchedOutputs(sequences.size());
+    {
+        const auto frames = GetValidFrames(batched->GetNodeFromName(L"out"));
+        const size_t rows = frames.size() / std::accumulate(sequenceLengths.begin(), sequenceLengths.end(), (size_t) 0);
+        size_t j = 0;
+        for (size_t t = 0; j < frames.size(); t++)
+        {
+            for (size_t s = 0; s < sequences.size(); s++)
+            {
+                if (t < sequenceLengths[s])
+                {
+                    batchedOutputs[s].insert(batchedOutputs[s].end(), frames.begin() + j, frames.begin() + j + rows);
+                    j += rows;
+                }
+            }
+        }
+    }
+
+    std::vector<float> criterion;
+    std::map<std::wstring, std::vector<float>> gradients;
+    for (size_t s = 0; s < sequences.size(); s++)
+    {
+        SetTestSequences(*single, {sequences[s]}, {sequenceLengths[s]});
+        ForwardTestNetwork(*single);
+        single->Backprop(single->FinalCriterionNodes()[0]);
+        CheckEqualValues(GetValidFrames(single->GetNodeFromName(L"out")), batchedOutputs[s]);
+        AddValues(criterion, GetValidFrames(single->GetNodeFromName(L"ce")));
+        for (const auto& name : parameterNames)
+            AddValues(gradients[name], GetGradient(single->GetNodeFromName(name)));
+    }
+
+    CheckEqualValues(GetValidFrames(batched->GetNodeFromName(L"ce")), criterion);
+    for (const auto& name : parameterNames)
+        CheckEqualValues(GetGradient(batched->GetNodeFromName(name)), gradients[name]);
+}
+
+BOOST_AUTO_TEST_SUITE(RecurrentLoopGapSuite)
+
+BOOST_AUTO_TEST_CASE(LayoutCountsActiveSequences)
+{
+    auto layout = CreateTestLayout({5, 2, 4, 1});
+    const size_t expected[] = {4, 3, 3, 3, 1};
+    for (size_t t = 0; t < layout->GetNumTimeSteps(); t++)
+        BOOST_CHECK_EQUAL(layout->GetNumActiveSequences(t), expected[t]);
+}
+
+// lengths that shrink with the parallel-sequence index, as HTKMLFReader arranges them, and mixed ones,
+// whose gaps are partly in front of active sequences (those are computed and masked as before)
+BOOST_AUTO_TEST_CASE(LoopWithTrailingGapsEqualsSequencesEvaluatedAlone)
+{
+    CheckTrailingGapsAreSkippedExactly(false, {7, 6, 4, 2});
+    CheckTrailingGapsAreSkippedExactly(false, {6, 2, 5, 3});
+}
+
+BOOST_AUTO_TEST_CASE(LSTMCellLoopWithTrailingGapsEqualsSequencesEvaluatedAlone)
+{
+    CheckTrailingGapsAreSkippedExactly(true, {7, 6, 4, 2});
+    CheckTrailingGapsAreSkippedExactly(true, {6, 2, 5, 3});
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,142 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "DataReaderHelpers.h"
+#include <tuple>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// GetMinibatchIntoCache() takes the reader only for its interface; the test puts the minibatch into the network itself
+class NullReader : public IDataReader<float>
+{
+public:
+    virtual void Init(const ConfigParameters&) override
+    {
+    }
+    virtual void Init(const ScriptableObjects::IConfigRecord&) override
+    {
+    }
+    virtual void Destroy() override
+    {
+    }
+    virtual void StartMinibatchLoop(size_t, size_t, size_t) override
+    {
+    }
+    virtual bool GetMinibatch(std::map<std::wstring, Matrix<float>*>&) override
+    {
+        return false;
+    }
+    virtual size_t GetNumParallelSequences() override
+    {
+        return 0;
+    }
+};
+
+// (parallel sequence, begin, end) of the sequences of a minibatch of 'numTimeSteps' time steps; all other frames are gaps
+// Sequences may begin before the minibatch and end after it, like the chunks of streams in truncated BPTT.
+static MBLayoutPtr CreateStreamLayout(size_t numParallelSequences, size_t numTimeSteps, const std::vector<std::tuple<size_t, ptrdiff_t, size_t>>& sequences)
+{
+    auto layout = make_shared<MBLayout>();
+    layout->Init(numParallelSequences, numTimeSteps);
+    std::vector<std::vector<bool>> isCovered(numParallelSequences, std::vector<bool>(numTimeSteps, false));
+    for (const auto& seq : sequences)
+    {
+        layout->AddSequence(NEW_SEQUENCE_ID, std::get<0>(seq), std::get<1>(seq), std::get<2>(seq));
+        for (size_t t = (size_t) std::max(std::get<1>(seq), (ptrdiff_t) 0); t < std::min(std::get<2>(seq), numTimeSteps); t++)
+            isCovered[std::get<0>(seq)][t] = true;
+    }
+    for (size_t s = 0; s < numParallelSequences; s++)
+        for (size_t t = 0; t < numTimeSteps; t++)
+            if (!isCovered[s][t])
+                layout->AddGap(s, t, t + 1);
+    return layout;
+}
+
+// the frames of parallel sequence 's' that are not gaps, in time order
+static std::vector<float> GetSequenceFrames(const ComputationNodeBasePtr& node, size_t s)
+{
+    const auto& value = node->As<ComputationNode<float>>()->Value();
+    auto layout = node->GetMBLayout();
+    const size_t rows = value.GetNumRows();
+    std::vector<float> all(value.GetNumElements());
+    value.CopySection(rows, value.GetNumCols(), all.data(), rows);
+    std::vector<float> frames;
+    for (size_t t = 0; t < layout->GetNumTimeSteps(); t++)
+    {
+        if (layout->IsGap(FrameRange(layout, t).Sequence(s)))
+            continue;
+        const size_t j = t * layout->GetNumParallelSequences() + s;
+        frames.insert(frames.end(), all.begin() + j * rows, all.begin() + (j + 1) * rows);
+    }
+    return frames;
+}
+
+BOOST_AUTO_TEST_SUITE(TruncatedBPTTStateSuite)
+
+// Streams that continue over minibatches must give the same outputs, criteria and gradients when each minibatch
+// is split into sub-minibatches, whose DelayedValueNode states SubminibatchDispatcher swaps out and in, as when
+// the network processes the whole minibatch.
+BOOST_AUTO_TEST_CASE(SubminibatchesCarryStateLikeWholeMinibatches)
+{
+    const size_t numParallelSequences = 4, numTimeSteps = 4, numSubminibatches = 2;
+    // parallel sequences 1 and 2 end in gaps in the first minibatch; stream 2 continues in the second (as the chunks
+    // of CNTKEval's streaming sessions do), so its state is the last frame before the gap
+    const std::vector<MBLayoutPtr> layouts{
+        CreateStreamLayout(numParallelSequences, numTimeSteps, {std::make_tuple(0, 0, 6), std::make_tuple(1, 0, 2), std::make_tuple(2, 0, 3), std::make_tuple(3, 0, 7)}),
+        CreateStreamLayout(numParallelSequences, numTimeSteps, {std::make_tuple(0, -4, 2), std::make_tuple(0, 2, 5), std::make_tuple(1, 0, 4), std::make_tuple(2, -1, 2), std::make_tuple(3, -4, 3)}),
+        CreateStreamLayout(numParallelSequences, numTimeSteps, {std::make_tuple(0, -2, 1), std::make_tuple(0, 1, 4), std::make_tuple(1, 0, 3), std::make_tuple(2, 0, 4), std::make_tuple(3, 0, 2)})};
+
+    auto reference = CreateRecurrentTestNetwork(3, 4, 2);
+    auto dispatched = CreateRecurrentTestNetwork(3, 4, 2);
+    for (const auto& net : {reference, dispatched})
+    {
+        InitTestParameters(*net, 1);
+        PrepareTestNetwork(*net, true);
+    }
+    const auto criterion = dispatched->FinalCriterionNodes()[0];
+    const auto& learnableNodes = dispatched->LearnableParameterNodes(criterion);
+
+    DataReaderHelpers::SubminibatchDispatcher<float> dispatcher;
+    dispatcher.Init(dispatched, learnableNodes, dispatched->FinalCriterionNodes(), {});
+    std::map<std::wstring, Matrix<float>*> inputMatrices;
+    for (const auto& name : {L"features", L"labels"})
+        inputMatrices[name] = &dispatched->GetNodeFromName(name)->As<ComputationNode<float>>()->Value();
+    NullReader reader;
+
+    for (size_t i = 0; i < layouts.size(); i++)
+    {
+        SetTestMinibatch(*reference, layouts[i], 10 + (unsigned long) i);
+        ForwardTestNetwork(*reference);
+        reference->Backprop(reference->FinalCriterionNodes()[0]);
+
+        SetTestMinibatch(*dispatched, layouts[i], 10 + (unsigned long) i);
+        BOOST_REQUIRE_EQUAL(dispatcher.GetMinibatchIntoCache(reader, *dispatched, inputMatrices, numSubminibatches), numSubminibatches);
+        for (size_t ismb = 0; ismb < numSubminibatches; ismb++)
+        {
+            dispatcher.GetSubMinibatchToNet(ismb);
+            ComputationNetwork::BumpEvalTimeStamp(dispatched->FeatureNodes());
+            ComputationNetwork::BumpEvalTimeStamp(dispatched->LabelNodes());
+            ForwardTestNetwork(*dispatched);
+            dispatched->Backprop(criterion);
+
+            // sub-minibatch 'ismb' holds the parallel sequences from 'ismb * numParallelSequences / numSubminibatches' on
+            const size_t numSequences = numParallelSequences / numSubminibatches;
+            for (size_t s = 0; s < numSequences; s++)
+                CheckEqualValues(GetSequenceFrames(reference->GetNodeFromName(L"out"), ismb * numSequences + s), GetSequenceFrames(dispatched->GetNodeFromName(L"out"), s));
+
+            dispatcher.DoneWithCurrentSubMinibatch(ismb);
+        }
+        dispatcher.DoneWithCurrentMinibatch();
+
+        CheckEqualValues(GetValidFrames(reference->GetNodeFromName(L"ce")), GetValidFrames(criterion));
+        for (const auto& node : learnableNodes)
+            CheckEqualValues(GetGradient(reference->GetNodeFromName(node->NodeName())), GetGradient(node));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }